@@ -90,8 +90,34 @@ Java_net_sourceforge_opencamera_OMTSender_nativeInit(
     return JNI_TRUE;
 }
 
+// External C function from libomt (multi-plane 4:2:0 send)
+extern int omt_send_yuv420(omt_send_t* instance, OMTMediaFrame* frame,
+                           void* dataU, int strideU, void* dataV, int strideV, int pixelStrideUV);
+
+/**
+ * Fill in the video properties shared by all frame send paths.
+ */
+static void prepareVideoFrame(OMTMediaFrame& frame, int width, int height, int yStride) {
+    auto now = std::chrono::steady_clock::now();
+    auto duration = now.time_since_epoch();
+    int64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / 100;
+
+    frame.Type = OMTFrameType_Video;
+    frame.Codec = OMTCodec_NV12;
+    frame.Width = width;
+    frame.Height = height;
+    frame.Stride = yStride;
+    frame.Flags = OMTVideoFlags_None;
+    frame.FrameRateN = g_frameRateN;
+    frame.FrameRateD = g_frameRateD;
+    frame.AspectRatio = (float)width / (float)height;
+    frame.ColorSpace = (height >= 720) ? OMTColorSpace_BT709 : OMTColorSpace_BT601;
+    frame.Timestamp = timestamp;
+}
+
 /**
  * Send a video frame to connected receivers.
+ * The buffer holds an NV12 Y plane followed by the interleaved UV plane, each with its own stride.
  */
 JNIEXPORT jboolean JNICALL
 Java_net_sourceforge_opencamera_OMTSender_nativeSendFrame(
@@ -111,39 +137,67 @@ Java_net_sourceforge_opencamera_OMTSender_nativeSendFrame(
     }
     
     // Get the native buffer address
-    void* data = env->GetDirectBufferAddress(buffer);
+    uint8_t* data = static_cast<uint8_t*>(env->GetDirectBufferAddress(buffer));
     if (data == nullptr) {
         LOGE("Failed to get direct buffer address");
         return JNI_FALSE;
     }
     
-    // Calculate data length for NV12 format
-    int dataLength = (height * yStride) + ((height / 2) * uvStride);
-    
     // Prepare the media frame
     OMTMediaFrame frame = {};
+    prepareVideoFrame(frame, width, height, yStride);
+    frame.Data = data;
+    frame.DataLength = height * yStride;
 
-    auto now = std::chrono::steady_clock::now();
-    auto duration = now.time_since_epoch();
-    int64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / 100;
-
-    frame.Type = OMTFrameType_Video;
-    frame.Codec = OMTCodec_NV12;
-    frame.Width = width;
-    frame.Height = height;
-    frame.Stride = yStride;
-    frame.Flags = OMTVideoFlags_None;
-    frame.FrameRateN = g_frameRateN;
-    frame.FrameRateD = g_frameRateD;
-    frame.AspectRatio = (float)width / (float)height;
-    frame.ColorSpace = (height >= 720) ? OMTColorSpace_BT709 : OMTColorSpace_BT601;
-    frame.Timestamp = timestamp;
+    // The UV plane has its own stride, which a single buffer OMTMediaFrame cannot express
+    uint8_t* uv = data + ((size_t)height * yStride);
+    int result = omt_send_yuv420(g_sender, &frame, uv, uvStride, uv + 1, uvStride, 2);
+    
+    if (result != 0) {
+        LOGD("Frame sent (result: %d)", result);
+    }
+    
+    return JNI_TRUE;
+}
 
-    frame.Data = data;
-    frame.DataLength = dataLength;
+/**
+ * Send a YUV_420_888 frame straight from the camera's plane buffers, without gathering them into one buffer first.
+ * Handles NV12, NV21 and I420 layouts; which one is determined by uvPixelStride and the plane addresses.
+ */
+JNIEXPORT jboolean JNICALL
+Java_net_sourceforge_opencamera_OMTSender_nativeSendFramePlanes(
+        JNIEnv* env,
+        jobject /* this */,
+        jobject yBuffer,
+        jobject uBuffer,
+        jobject vBuffer,
+        jint width,
+        jint height,
+        jint yStride,
+        jint uvStride,
+        jint uvPixelStride) {
+    
+    std::lock_guard<std::mutex> lock(g_senderMutex);
+    
+    if (g_sender == nullptr) {
+        LOGE("Cannot send frame: sender not initialized");
+        return JNI_FALSE;
+    }
+    
+    void* y = env->GetDirectBufferAddress(yBuffer);
+    void* u = env->GetDirectBufferAddress(uBuffer);
+    void* v = env->GetDirectBufferAddress(vBuffer);
+    if (y == nullptr || u == nullptr || v == nullptr) {
+        LOGE("Failed to get direct buffer address of plane");
+        return JNI_FALSE;
+    }
     
-    // Send the frame
-    int result = omt_send(g_sender, &frame);
+    OMTMediaFrame frame = {};
+    prepareVideoFrame(frame, width, height, yStride);
+    frame.Data = y;
+    frame.DataLength = height * yStride;
+    
+    int result = omt_send_yuv420(g_sender, &frame, u, uvStride, v, uvStride, uvPixelStride);
     
     if (result != 0) {
         LOGD("Frame sent (result: %d)", result);
@@ -242,6 +296,24 @@ Java_net_sourceforge_opencamera_OMTSender_nativeSetQuality(
     omt_send_set_quality(g_sender, (OMTQuality)quality);
 }
 
+extern void omt_send_set_low_latency(omt_send_t* instance, int slicesPerChunk);
+
+/**
+ * Set the number of 16 line slices sent as soon as they are encoded, 0 for whole frames.
+ */
+JNIEXPORT void JNICALL
+Java_net_sourceforge_opencamera_OMTSender_nativeSetLowLatencySlices(
+        JNIEnv* env,
+        jobject /* this */,
+        jint slices) {
+    
+    std::lock_guard<std::mutex> lock(g_senderMutex);
+    if (g_sender == nullptr) return;
+    
+    LOGI("JNI: Setting OMT low-latency slices to %d", slices);
+    omt_send_set_low_latency(g_sender, slices);
+}
+
 /**
  * Set sender information (product, manufacturer).
  */
@@ -128,6 +128,37 @@ public class OMTSender {
         return nativeSendFrame(buffer, width, height, yStride, uvStride);
     }
 
+    /**
+     * Send a video frame straight from the planes of an ImageFormat.YUV_420_888 Image.
+     * 
+     * The plane buffers are read in place, so no copy into a contiguous buffer is needed.
+     * Semi-planar (NV12/NV21, uvPixelStride 2) and planar (I420, uvPixelStride 1) layouts are supported.
+     * 
+     * @param yBuffer       Direct ByteBuffer of the Y plane
+     * @param uBuffer       Direct ByteBuffer of the U plane
+     * @param vBuffer       Direct ByteBuffer of the V plane
+     * @param width         Frame width
+     * @param height        Frame height
+     * @param yStride       Row stride of the Y plane
+     * @param uvStride      Row stride of the U and V planes
+     * @param uvPixelStride Pixel stride of the U and V planes
+     * @return true if frame was sent successfully
+     */
+    public boolean sendFramePlanes(ByteBuffer yBuffer, ByteBuffer uBuffer, ByteBuffer vBuffer,
+                                   int width, int height, int yStride, int uvStride, int uvPixelStride) {
+        if (!isInitialized) {
+            Log.e(TAG, "Cannot send frame: OMTSender not initialized");
+            return false;
+        }
+
+        if (!yBuffer.isDirect() || !uBuffer.isDirect() || !vBuffer.isDirect()) {
+            Log.e(TAG, "Plane buffers must be direct ByteBuffers");
+            return false;
+        }
+
+        return nativeSendFramePlanes(yBuffer, uBuffer, vBuffer, width, height, yStride, uvStride, uvPixelStride);
+    }
+
     /**
      * Get the number of currently connected receivers.
      */
@@ -173,6 +204,18 @@ public class OMTSender {
         }
     }
 
+    /**
+     * Send each group of this many 16 line slices as soon as it is encoded, instead of whole frames.
+     * Only receivers that ask for low-latency chunks get them, the others still receive whole frames.
+     * 
+     * @param slices Slices of 16 lines per chunk, or 0 for whole frames
+     */
+    public void setLowLatencySlices(int slices) {
+        if (isInitialized) {
+            nativeSetLowLatencySlices(slices);
+        }
+    }
+
     // =============================================================
     // Statistics API (for monitoring and UI feedback)
     // =============================================================
@@ -227,6 +270,9 @@ public class OMTSender {
 
     private native boolean nativeSendFrame(ByteBuffer buffer, int width, int height, int yStride, int uvStride);
 
+    private native boolean nativeSendFramePlanes(ByteBuffer yBuffer, ByteBuffer uBuffer, ByteBuffer vBuffer,
+                                                 int width, int height, int yStride, int uvStride, int uvPixelStride);
+
     private native int nativeGetConnectionCount();
 
     private native String nativeGetAddress();
@@ -246,6 +292,8 @@ public class OMTSender {
 
     private native void nativeSetQuality(int quality);
 
+    private native void nativeSetLowLatencySlices(int slices);
+
     private native int nativeGetProfile();
 
     /**
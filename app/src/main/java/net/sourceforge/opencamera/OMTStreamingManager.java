@@ -13,8 +13,6 @@ import android.net.wifi.WifiManager;
 import android.os.PowerManager;
 import android.view.Surface;
 
-import java.nio.ByteBuffer;
-
 /**
  * OMT Streaming Manager - Manages the OMT network streaming lifecycle.
  * 
@@ -70,7 +68,6 @@ public class OMTStreamingManager {
     private HandlerThread backgroundThread;
     private Handler backgroundHandler;
 
-    private ByteBuffer frameBuffer;
     private boolean isAnnouncing = false; // mDNS is active, device is discoverable
     private boolean isStreaming = false; // Camera frames are being sent
 
@@ -338,7 +335,7 @@ public class OMTStreamingManager {
 
     /**
      * Send a frame to the OMT sender.
-     * Converts YUV_420_888 format to the NV12 format expected by OMT.
+     * The YUV_420_888 planes are handed to native code as they are; NV12, NV21 and I420 layouts are all encoded in place.
      */
     private int sentFrameCount = 0;
 
@@ -347,43 +344,23 @@ public class OMTStreamingManager {
             return;
         }
 
-        // Get Y and U planes (U plane for NV12 interleaved UV)
-        Image.Plane yPlane = image.getPlanes()[0];
-        Image.Plane uPlane = image.getPlanes()[1];
+        Image.Plane[] planes = image.getPlanes();
+        Image.Plane yPlane = planes[0];
+        Image.Plane uPlane = planes[1];
+        Image.Plane vPlane = planes[2];
 
         int yStride = yPlane.getRowStride();
         int uvStride = uPlane.getRowStride();
-        int ySize = yStride * image.getHeight();
-        int uvSize = uvStride * (image.getHeight() / 2);
-        int totalSize = ySize + uvSize;
+        int uvPixelStride = uPlane.getPixelStride();
 
         sentFrameCount++;
         if (DEBUG_LOGS && sentFrameCount % 30 == 1) {
             Log.d(TAG, "sendFrame #" + sentFrameCount + ": " + image.getWidth() + "x" + image.getHeight() +
-                    ", yStride=" + yStride + ", uvStride=" + uvStride + ", totalSize=" + totalSize);
-        }
-
-        // Allocate or resize frame buffer if needed
-        if (frameBuffer == null || frameBuffer.capacity() < totalSize) {
-            frameBuffer = ByteBuffer.allocateDirect(totalSize);
-            Log.d(TAG, "Allocated frame buffer: " + totalSize + " bytes");
+                    ", yStride=" + yStride + ", uvStride=" + uvStride + ", uvPixelStride=" + uvPixelStride);
         }
 
-        // Copy Y and UV planes into the frame buffer
-        frameBuffer.clear();
-
-        ByteBuffer yBuffer = yPlane.getBuffer();
-        yBuffer.rewind();
-        frameBuffer.put(yBuffer);
-
-        ByteBuffer uBuffer = uPlane.getBuffer();
-        uBuffer.rewind();
-        frameBuffer.put(uBuffer);
-
-        frameBuffer.flip();
-
-        // Send to OMT
-        omtSender.sendFrame(frameBuffer, image.getWidth(), image.getHeight(), yStride, uvStride);
+        omtSender.sendFramePlanes(yPlane.getBuffer(), uPlane.getBuffer(), vPlane.getBuffer(),
+                image.getWidth(), image.getHeight(), yStride, uvStride, uvPixelStride);
     }
 
     private void startBackgroundThread() {
@@ -477,8 +454,6 @@ public class OMTStreamingManager {
             imageReader.close();
             imageReader = null;
         }
-        // Clear frame buffer
-        frameBuffer = null;
     }
 
     /**
@@ -39,6 +39,7 @@ AsyncBuffer* AsyncPool::acquire() {
         if (!buf->inUse) {
             buf->inUse = true;
             buf->length = 0;
+            buf->complete = true;
             return buf;
         }
     }
@@ -22,6 +22,7 @@ public:
     std::vector<uint8_t> data;
     size_t length = 0;
     bool inUse = false;
+    bool complete = true;  // False while a low-latency frame is still being appended
     
     explicit AsyncBuffer(size_t bufferSize) : data(bufferSize) {}
     
@@ -5,6 +5,7 @@
 
 #include "OMTChannel.h"
 #include <cstring>
+#include <algorithm>
 #include <unistd.h>
 #include <fcntl.h>
 #include <netinet/tcp.h>
@@ -172,8 +173,21 @@ bool Channel::sendMetadataSync(const char* xml) {
 int Channel::sendAsync(const void* headerData, size_t headerLen,
                        const void* extHeaderData, size_t extHeaderLen,
                        const void* payloadData, size_t payloadLen) {
+    struct iovec payload;
+    payload.iov_base = const_cast<void*>(payloadData);
+    payload.iov_len = payloadLen;
+    return sendAsync(headerData, headerLen, extHeaderData, extHeaderLen, &payload, 1);
+}
+
+int Channel::sendAsync(const void* headerData, size_t headerLen,
+                       const void* extHeaderData, size_t extHeaderLen,
+                       const struct iovec* payload, int payloadCount) {
     if (!connected_) return 0;
     
+    size_t payloadLen = 0;
+    for (int i = 0; i < payloadCount; i++) {
+        payloadLen += payload[i].iov_len;
+    }
     size_t totalLen = headerLen + extHeaderLen + payloadLen;
     
     if (totalLen > static_cast<size_t>(Constants::VIDEO_MAX_SIZE)) {
@@ -200,7 +214,10 @@ int Channel::sendAsync(const void* headerData, size_t headerLen,
     offset += headerLen;
     memcpy(buf->data.data() + offset, extHeaderData, extHeaderLen);
     offset += extHeaderLen;
-    memcpy(buf->data.data() + offset, payloadData, payloadLen);
+    for (int i = 0; i < payloadCount; i++) {
+        memcpy(buf->data.data() + offset, payload[i].iov_base, payload[i].iov_len);
+        offset += payload[i].iov_len;
+    }
     buf->length = totalLen;
     
     {
@@ -212,6 +229,69 @@ int Channel::sendAsync(const void* headerData, size_t headerLen,
     return static_cast<int>(totalLen);
 }
 
+bool Channel::beginFrameAsync(size_t maxLength) {
+    frameBuffer_ = nullptr;
+    if (!connected_) return false;
+    
+    AsyncBuffer* buf = sendPool_->acquire();
+    if (!buf) {
+        framesDropped_++;
+        return false;
+    }
+    
+    // Sized once up front, the sender thread reads from it while chunks are appended
+    buf->resize(std::min(maxLength, static_cast<size_t>(Constants::VIDEO_MAX_SIZE)));
+    buf->complete = false;
+    frameBuffer_ = buf;
+    
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        pendingQueue_.push(buf);
+    }
+    queueCV_.notify_one();
+    return true;
+}
+
+int Channel::appendFrameAsync(const void* headerData, size_t headerLen,
+                              const void* extHeaderData, size_t extHeaderLen,
+                              const struct iovec* payload, int payloadCount, bool last) {
+    AsyncBuffer* buf = frameBuffer_;
+    if (!buf || !connected_) return 0;
+    
+    size_t chunkLen = headerLen + extHeaderLen;
+    for (int i = 0; i < payloadCount; i++) {
+        chunkLen += payload[i].iov_len;
+    }
+    
+    // Only the bytes up to buf->length have been published, so the rest can be written without the lock
+    size_t offset = buf->length;
+    bool fits = offset + chunkLen <= buf->data.size();
+    if (fits) {
+        memcpy(buf->data.data() + offset, headerData, headerLen);
+        offset += headerLen;
+        memcpy(buf->data.data() + offset, extHeaderData, extHeaderLen);
+        offset += extHeaderLen;
+        for (int i = 0; i < payloadCount; i++) {
+            memcpy(buf->data.data() + offset, payload[i].iov_base, payload[i].iov_len);
+            offset += payload[i].iov_len;
+        }
+    } else {
+        // Every chunk is a frame of its own, so the ones already queued still decode
+        framesDropped_++;
+        LOGE("appendFrameAsync: frame too large");
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        buf->length = offset;
+        buf->complete = last || !fits;
+    }
+    queueCV_.notify_one();
+    
+    if (last || !fits) frameBuffer_ = nullptr;
+    return fits ? static_cast<int>(chunkLen) : 0;
+}
+
 void Channel::senderLoop() {
     LOGI("senderLoop: started");
     
@@ -233,11 +313,32 @@ void Channel::senderLoop() {
         
         if (!buf) continue;
         
-        bool success = sendAllBlocking(buf->data.data(), buf->length);
+        // Low-latency frames are sent as their chunks are appended, everything else in one go
+        size_t sent = 0;
+        bool success = true;
+        while (true) {
+            size_t length;
+            bool complete;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex_);
+                queueCV_.wait(lock, [&] {
+                    return buf->length > sent || buf->complete || !running_ || !connected_;
+                });
+                length = buf->length;
+                complete = buf->complete;
+            }
+            if (length == sent) {
+                success = complete;
+                break;
+            }
+            success = sendAllBlocking(buf->data.data() + sent, length - sent);
+            sent = length;
+            if (!success) break;
+        }
         
         if (success) {
             framesSent_++;
-            bytesSent_ += buf->length;
+            bytesSent_ += sent;
         }
         
         sendPool_->release(buf);
@@ -417,6 +518,39 @@ void Channel::processMetadata(const std::string& xml) {
         return;
     }
     
+    // Skip-slice frames
+    if (xml == MetadataConstants::CHANNEL_SKIP_SLICES_ON) {
+        skipSlices_ = true;
+        LOGI("Client accepts skip-slice frames");
+        return;
+    }
+    if (xml == MetadataConstants::CHANNEL_SKIP_SLICES_OFF) {
+        skipSlices_ = false;
+        return;
+    }
+    
+    // 4:2:0 frames
+    if (xml == MetadataConstants::CHANNEL_CHROMA420_ON) {
+        chroma420_ = true;
+        LOGI("Client accepts 4:2:0 frames");
+        return;
+    }
+    if (xml == MetadataConstants::CHANNEL_CHROMA420_OFF) {
+        chroma420_ = false;
+        return;
+    }
+    
+    // Low-latency frames
+    if (xml == MetadataConstants::CHANNEL_CHUNKS_ON) {
+        chunks_ = true;
+        LOGI("Client accepts chunked frames");
+        return;
+    }
+    if (xml == MetadataConstants::CHANNEL_CHUNKS_OFF) {
+        chunks_ = false;
+        return;
+    }
+    
     // Quality suggestion
     if (xml.find(MetadataConstants::SUGGESTED_QUALITY_PREFIX) == 0) {
         Quality oldQuality = suggestedQuality_.load();
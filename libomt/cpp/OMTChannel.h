@@ -19,6 +19,7 @@
 #include <memory>
 #include <functional>
 #include <arpa/inet.h>
+#include <sys/uio.h>
 
 #include "OMTConstants.h"
 #include "OMTProtocol.h"
@@ -90,11 +91,38 @@ public:
     // Preview mode
     bool isPreviewMode() const { return previewMode_.load(); }
     
+    // Skip-slice frames (VMX_GetEncodedSkipSegments) are only sent once the receiver asks for them
+    bool isSkipSlicesEnabled() const { return skipSlices_.load(); }
+    
+    // 4:2:0 frames are only sent to 4:2:0 sources once every receiver asks for them
+    bool isChroma420Enabled() const { return chroma420_.load(); }
+    
+    // Low-latency chunks (VMX_SetChunkedOutput) are only sent once the receiver asks for them, the others get whole frames
+    bool isChunksEnabled() const { return chunks_.load(); }
+    
+    // Sequence number of the last video frame queued to this channel, -1 after a drop.
+    // Only used by the sender's dispatch thread.
+    int64_t getVideoReference() const { return videoReference_; }
+    void setVideoReference(int64_t sequence) { videoReference_ = sequence; }
+    
     // Send methods
     int sendAsync(const void* headerData, size_t headerLen,
                   const void* extHeaderData, size_t extHeaderLen,
                   const void* payloadData, size_t payloadLen);
     
+    // Gathers a payload made of several segments (e.g. VMX_GetEncodedSegments) into the send buffer
+    int sendAsync(const void* headerData, size_t headerLen,
+                  const void* extHeaderData, size_t extHeaderLen,
+                  const struct iovec* payload, int payloadCount);
+    
+    // Low-latency frames: the send buffer is queued by beginFrameAsync and transmitted while the encoder appends
+    // chunks to it, each with its own headers. Returns false if the frame is dropped, in which case appends are
+    // ignored until the next beginFrameAsync.
+    bool beginFrameAsync(size_t maxLength);
+    int appendFrameAsync(const void* headerData, size_t headerLen,
+                         const void* extHeaderData, size_t extHeaderLen,
+                         const struct iovec* payload, int payloadCount, bool last);
+    
     bool sendMetadataSync(const char* xml);
     
     // Statistics
@@ -118,6 +146,7 @@ private:
     std::condition_variable queueCV_;
     std::thread senderThread_;
     std::thread receiverThread_;
+    AsyncBuffer* frameBuffer_ = nullptr;  // Low-latency frame being appended, owned by the caller of beginFrameAsync
     
     // Subscriptions and state
     std::atomic<Subscription> subscriptions_{Subscription::None};
@@ -125,6 +154,10 @@ private:
     std::atomic<bool> tallyPreview_{false};
     std::atomic<bool> tallyProgram_{false};
     std::atomic<bool> previewMode_{false};
+    std::atomic<bool> skipSlices_{false};
+    std::atomic<bool> chroma420_{false};
+    std::atomic<bool> chunks_{false};
+    int64_t videoReference_ = -1;
     
     // Statistics
     std::atomic<int64_t> framesSent_{0};
@@ -24,6 +24,7 @@ namespace Constants {
     constexpr int VIDEO_FRAME_POOL_COUNT = 4;
     constexpr int VIDEO_MIN_SIZE = 65536;
     constexpr int VIDEO_MAX_SIZE = 10485760;         // 10MB max frame
+    constexpr int VIDEO_RATE_BUFFER_MS = 250;        // Leaky bucket the encoder bitrate is averaged over
     
     constexpr int AUDIO_FRAME_POOL_COUNT = 10;
     constexpr int AUDIO_MIN_SIZE = 65536;
@@ -53,6 +54,18 @@ namespace MetadataConstants {
     constexpr const char* CHANNEL_PREVIEW_VIDEO_ON = "<OMTSettings Preview=\"true\" />";
     constexpr const char* CHANNEL_PREVIEW_VIDEO_OFF = "<OMTSettings Preview=\"false\" />";
     
+    // Skip-slice frames: the receiver keeps its last decoded picture and accepts VMX frames that leave out repeated slices
+    constexpr const char* CHANNEL_SKIP_SLICES_ON = "<OMTSettings SkipSlices=\"true\" />";
+    constexpr const char* CHANNEL_SKIP_SLICES_OFF = "<OMTSettings SkipSlices=\"false\" />";
+    
+    // 4:2:0 frames: the receiver decodes VMX frames with half height chroma (VMX_SetChroma420)
+    constexpr const char* CHANNEL_CHROMA420_ON = "<OMTSettings Chroma420=\"true\" />";
+    constexpr const char* CHANNEL_CHROMA420_OFF = "<OMTSettings Chroma420=\"false\" />";
+    
+    // Low-latency frames: the receiver decodes VMX frames sent as chunks of slices (VMX_SetChunkedOutput)
+    constexpr const char* CHANNEL_CHUNKS_ON = "<OMTSettings Chunks=\"true\" />";
+    constexpr const char* CHANNEL_CHUNKS_OFF = "<OMTSettings Chunks=\"false\" />";
+    
     // Tally commands
     constexpr const char* TALLY_PREVIEW = "<OMTTally Preview=\"true\" Program==\"false\" />";
     constexpr const char* TALLY_PROGRAM = "<OMTTally Preview=\"false\" Program==\"true\" />";
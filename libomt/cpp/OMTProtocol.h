@@ -65,7 +65,9 @@ namespace Codec {
     constexpr int32_t UYVY = 0x59565955;  // "UYVY"
     constexpr int32_t YUY2 = 0x32595559;  // "YUY2"
     constexpr int32_t NV12 = 0x3231564E;  // "NV12"
+    constexpr int32_t YV12 = 0x32315659;  // "YV12"
     constexpr int32_t BGRA = 0x41524742;  // "BGRA"
+    constexpr int32_t P010 = 0x30313050;  // "P010"
     constexpr int32_t PCM_F32 = 0x32334650; // "FP32" (floating point audio)
 }
 
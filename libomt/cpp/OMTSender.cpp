@@ -71,6 +71,9 @@ bool Sender::start() {
     
     LOGI("Sender: listening on port %d", config_.port);
     
+    dispatchStop_ = false;
+    dispatchChannels_ = -1;
+    dispatchThread_ = std::thread(&Sender::dispatchLoop, this);
     acceptThread_ = std::thread(&Sender::acceptLoop, this);
     return true;
 }
@@ -90,6 +93,16 @@ void Sender::stop() {
         acceptThread_.join();
     }
     
+    // Let the dispatcher hand over the last frame before the channels go
+    {
+        std::lock_guard<std::mutex> lock(dispatchMutex_);
+        dispatchStop_ = true;
+    }
+    dispatchCV_.notify_all();
+    if (dispatchThread_.joinable()) {
+        dispatchThread_.join();
+    }
+    
     // Disconnect all channels
     {
         std::lock_guard<std::mutex> lock(channelsMutex_);
@@ -211,13 +224,22 @@ void Sender::setQuality(Quality quality) {
     if (quality != Quality::Default) {
         int newProfile = selectProfile(quality);
         if (newProfile != currentProfile_) {
-            currentProfile_ = newProfile;
-            destroyEncoder();
+            switchProfile(newProfile);
             LOGI("Profile changed to %d on manual request", newProfile);
         }
     }
 }
 
+void Sender::setLowLatencySlices(int slices) {
+    if (slices < 0) slices = 0;
+    LOGI("Updating low-latency slices to %d", slices);
+    
+    std::lock_guard<std::mutex> lock(encoderMutex_);
+    if (slices == config_.lowLatencySlices) return;
+    config_.lowLatencySlices = slices;
+    destroyEncoder();  // Recreated with the new framing by the next send
+}
+
 int Sender::calculateOptimalBuffer(int width, int height, int profile) {
     int rawSize = width * height * 3 / 2;
     
@@ -237,11 +259,15 @@ int Sender::calculateOptimalBuffer(int width, int height, int profile) {
     return bufferSize;
 }
 
-void Sender::createEncoder(int width, int height, int frameRate, int colorSpace) {
+void Sender::createEncoder(int width, int height, int frameRateN, int frameRateD, int colorSpace) {
     std::lock_guard<std::mutex> lock(encoderMutex_);
     
     if (vmxInstance_ && currentWidth_ == width && currentHeight_ == height) {
-        return;  // Already have correct encoder. Recreated via destroyEncoder() if profile changed.
+        // Already have correct encoder. Profile changes are applied in place by switchProfile().
+        if (currentFrameRateN_ != frameRateN || currentFrameRateD_ != frameRateD) {
+            setRateControl(frameRateN, frameRateD);
+        }
+        return;
     }
     
     destroyEncoder();
@@ -253,14 +279,46 @@ void Sender::createEncoder(int width, int height, int frameRate, int colorSpace)
     currentWidth_ = width;
     currentHeight_ = height;
     
-    int maxSize = width * height * 4;
-    if (maxSize < 1024 * 1024) maxSize = 1024 * 1024;
-    encodeBuffer_.resize(maxSize);
+    if (vmxInstance_) {
+        encodeSegments_.resize(VMX_GetEncodedSegmentCount(vmxInstance_));
+        payloadSegments_.resize(encodeSegments_.size());
+        skipSegments_.resize(encodeSegments_.size());
+        skipPayloadSegments_.resize(encodeSegments_.size());
+        skipLength_ = 0;
+        setRateControl(frameRateN, frameRateD);
+        if (config_.reuseStaticSlices) VMX_SetSliceCache(vmxInstance_, 1);
+        if (config_.lowLatencySlices > 0) {
+            VMX_SetChunkedOutput(vmxInstance_, config_.lowLatencySlices, &Sender::onEncodedChunk, this);
+            int slices = (height + 15) / 16;
+            int chunks = (slices + config_.lowLatencySlices - 1) / config_.lowLatencySlices;
+            chunkMaxLength_ = static_cast<size_t>(VMX_GetMaxEncodedLength(vmxInstance_, 1)) +
+                              static_cast<size_t>(chunks) * (FrameHeader::SIZE + VideoExtHeader::SIZE);
+        }
+    }
     
     LOGI("Encoder created: %dx%d, profile=%d", width, height, static_cast<int>(currentProfile_));
 }
 
+void Sender::setRateControl(int frameRateN, int frameRateD) {
+    // The profile bitrate is per second, so the per frame target has to follow the real frame rate
+    VMX_SetRateControl(vmxInstance_, 0, frameRateN, frameRateD, config_.rateBufferMs);
+    currentFrameRateN_ = frameRateN;
+    currentFrameRateD_ = frameRateD;
+    LOGI("Encoder rate control: %d/%d fps, %d ms buffer", frameRateN, frameRateD, config_.rateBufferMs);
+}
+
+void Sender::switchProfile(int profile) {
+    currentProfile_ = profile;
+    // Keep the encoder, its buffers and slice cache; only the bitrate targets change, so the next frame carries on at the new profile
+    if (vmxInstance_ && VMX_SetProfile(vmxInstance_, static_cast<VMX_PROFILE>(profile)) == VMX_ERR_OK) {
+        setRateControl(currentFrameRateN_, currentFrameRateD_);
+    } else {
+        destroyEncoder();
+    }
+}
+
 void Sender::destroyEncoder() {
+    waitDispatched();  // The dispatcher may still be reading the last frame from the encoder
     if (vmxInstance_) {
         VMX_Destroy(vmxInstance_);
         vmxInstance_ = nullptr;
@@ -277,25 +335,78 @@ int Sender::encodeFrame(const MediaFrame& frame) {
     int interlaced = (frame.flags & VideoFlags::Interlaced) ? 1 : 0;
     VMX_ERR err = VMX_ERR_UNKNOWN;
     
+    chunkFrame_ = frame;
+    chunkFrame_.data = nullptr;  // Only the description is needed by sendChunk
+    chunkFrame_.dataU = nullptr;
+    chunkFrame_.dataV = nullptr;
+    chunkBytes_ = 0;
+    chunkChannels_.clear();
+    
+    // 4:2:0 sources only code their chroma rows once when every receiver can decode that
+    bool source420 = frame.dataU || frame.codec == Codec::NV12 || frame.codec == Codec::YV12 || frame.codec == Codec::P010;
+    chroma420_ = source420 && acceptsChroma420();
+    VMX_SetChroma420(vmxInstance_, chroma420_ ? 1 : 0);
+    
     BYTE* data = static_cast<BYTE*>(frame.data);
     
+    if (frame.dataU) {
+        // Multi-plane 4:2:0 source, encoded straight from the caller's planes
+        BYTE* u = static_cast<BYTE*>(frame.dataU);
+        BYTE* v = static_cast<BYTE*>(frame.dataV);
+        if (frame.codec == Codec::P010) {
+            err = VMX_EncodeAsync(vmxInstance_, VMX_IMAGE_P010, data, frame.stride, u, frame.strideU, nullptr, 0, interlaced);
+        } else if (frame.pixelStrideUV == 1) {
+            err = VMX_EncodeAsync(vmxInstance_, VMX_IMAGE_YV12, data, frame.stride, u, frame.strideU, v, frame.strideV, interlaced);
+        } else if (frame.pixelStrideUV == 2 && u == v + 1) {
+            err = VMX_EncodeAsync(vmxInstance_, VMX_IMAGE_NV21, data, frame.stride, v, frame.strideV, nullptr, 0, interlaced);
+        } else if (frame.pixelStrideUV == 2 && v == u + 1) {
+            err = VMX_EncodeAsync(vmxInstance_, VMX_IMAGE_NV12, data, frame.stride, u, frame.strideU, nullptr, 0, interlaced);
+        } else {
+            err = VMX_ERR_INVALID_PARAMETERS;
+        }
+        if (err != VMX_ERR_OK) {
+            LOGE("VMX encode failed: %d", err);
+            return 0;
+        }
+        return getEncodedSegments();
+    }
+    
     // Encode based on input codec
     switch (frame.codec) {
         case Codec::UYVY:
-            err = VMX_EncodeUYVY(vmxInstance_, data, frame.stride, interlaced);
+            err = VMX_EncodeAsync(vmxInstance_, VMX_IMAGE_UYVY, data, frame.stride, nullptr, 0, nullptr, 0, interlaced);
             break;
         case Codec::YUY2:
-            err = VMX_EncodeYUY2(vmxInstance_, data, frame.stride, interlaced);
+            err = VMX_EncodeAsync(vmxInstance_, VMX_IMAGE_YUY2, data, frame.stride, nullptr, 0, nullptr, 0, interlaced);
             break;
-        case 0x3231564E:  // NV12
+        case Codec::NV12:
             {
+                // Single buffer: UV plane directly follows the Y plane and shares its stride
                 BYTE* y = data;
                 BYTE* uv = data + (frame.stride * frame.height);
-                err = VMX_EncodeNV12(vmxInstance_, y, frame.stride, uv, frame.stride, interlaced);
+                err = VMX_EncodeAsync(vmxInstance_, VMX_IMAGE_NV12, y, frame.stride, uv, frame.stride, nullptr, 0, interlaced);
+            }
+            break;
+        case Codec::YV12:
+            {
+                // Single buffer: half height V then U planes, each with half the Y stride
+                int strideUV = frame.stride / 2;
+                BYTE* y = data;
+                BYTE* v = data + (frame.stride * frame.height);
+                BYTE* u = v + (strideUV * (frame.height / 2));
+                err = VMX_EncodeAsync(vmxInstance_, VMX_IMAGE_YV12, y, frame.stride, u, strideUV, v, strideUV, interlaced);
             }
             break;
         case Codec::BGRA:
-            err = VMX_EncodeBGRA(vmxInstance_, data, frame.stride, interlaced);
+            err = VMX_EncodeAsync(vmxInstance_, VMX_IMAGE_BGRA, data, frame.stride, nullptr, 0, nullptr, 0, interlaced);
+            break;
+        case Codec::P010:
+            {
+                // Single buffer: 16 bit UV plane directly follows the Y plane and shares its stride
+                BYTE* y = data;
+                BYTE* uv = data + (frame.stride * frame.height);
+                err = VMX_EncodeAsync(vmxInstance_, VMX_IMAGE_P010, y, frame.stride, uv, frame.stride, nullptr, 0, interlaced);
+            }
             break;
         default:
             LOGE("Unknown codec: 0x%08X", frame.codec);
@@ -307,10 +418,94 @@ int Sender::encodeFrame(const MediaFrame& frame) {
         return 0;
     }
     
-    int encodedLen = VMX_SaveTo(vmxInstance_, encodeBuffer_.data(), encodeBuffer_.size());
+    return getEncodedSegments();
+}
+
+void Sender::onEncodedChunk(void* context, const VMX_SEGMENT* segments, int segmentCount, int length, int last) {
+    static_cast<Sender*>(context)->sendChunk(segments, segmentCount, length, last != 0);
+}
+
+void Sender::sendChunk(const VMX_SEGMENT* segments, int segmentCount, int length, bool last) {
+    // Called from the encoder threads one chunk at a time, while encodeFrame waits for the frame
+    bool first = chunkBytes_ == 0;
+    chunkBytes_ += length;
+    
+    FrameHeader header{};
+    VideoExtHeader extHeader{};
+    makeVideoHeaders(chunkFrame_, length, header, extHeader);
+    
+    chunkSegments_.resize(segmentCount);
+    for (int i = 0; i < segmentCount; i++) {
+        chunkSegments_[i].iov_base = const_cast<BYTE*>(segments[i].Data);
+        chunkSegments_[i].iov_len = segments[i].Length;
+    }
+    
+    std::lock_guard<std::mutex> lock(channelsMutex_);
+    for (const auto& ch : channels_) {
+        if (!ch->isConnected() || !ch->isVideoSubscribed()) continue;
+        // Channels left out of the first chunk have no frame to append the rest to. Receivers that did not ask
+        // for chunks get the whole frame from the dispatcher instead.
+        if (first && !ch->isChunksEnabled()) continue;
+        if (first && chroma420_ && !ch->isChroma420Enabled()) continue;
+        if (first && !ch->beginFrameAsync(chunkMaxLength_)) continue;
+        if (first) chunkChannels_.push_back(ch.get());
+        ch->appendFrameAsync(&header, sizeof(header),
+                             &extHeader, sizeof(extHeader),
+                             chunkSegments_.data(), segmentCount, last);
+    }
+}
+
+bool Sender::acceptsChroma420() const {
+    // A receiver that joined since the encode still gets nothing it cannot decode, see sendToChannels
+    std::lock_guard<std::mutex> lock(channelsMutex_);
+    bool any = false;
+    for (const auto& ch : channels_) {
+        if (!ch->isConnected() || !ch->isVideoSubscribed()) continue;
+        if (!ch->isChroma420Enabled()) return false;
+        any = true;
+    }
+    return any;
+}
+
+int Sender::getEncodedSegments() {
+    // While the frame encodes, the dispatcher is still gathering the previous frame from the encoder's other
+    // stream set. This thread codes slices alongside the workers, then waits for the dispatcher as well
+    // before this frame's segment list replaces the previous one.
+    VMX_WaitEncoded(vmxInstance_);
+    waitDispatched();
+    
+    // The frame stays in the encoder's slice buffers; the only copy is the gather into each channel's send buffer
+    int encodedLen;
+    if (config_.lowLatencySlices > 0) {
+        // sendChunk has already handed the chunks to the receivers that asked for them, the others get the same slices as a whole frame
+        encodedLen = VMX_GetEncodedFrameSegments(vmxInstance_, encodeSegments_.data(), static_cast<int>(encodeSegments_.size()));
+    } else {
+        encodedLen = VMX_GetEncodedSegments(vmxInstance_, encodeSegments_.data(), static_cast<int>(encodeSegments_.size()));
+    }
+    for (size_t i = 0; i < encodeSegments_.size(); i++) {
+        payloadSegments_[i].iov_base = const_cast<BYTE*>(encodeSegments_[i].Data);
+        payloadSegments_[i].iov_len = encodeSegments_[i].Length;
+    }
+    skipLength_ = config_.lowLatencySlices > 0 ? 0 : getSkipSegments();
     return encodedLen;
 }
 
+int Sender::getSkipSegments() {
+    // Only worth building when the slice cache found repeats; channels that are not up to date get the full frame
+    if (!config_.reuseStaticSlices) return 0;
+    int repeated = VMX_GetRepeatedSliceCount(vmxInstance_);
+    if (repeated <= 0) return 0;
+    
+    int skipLen = VMX_GetEncodedSkipSegments(vmxInstance_, skipSegments_.data(), static_cast<int>(skipSegments_.size()));
+    int slices = static_cast<int>(encodeSegments_.size() - 1) / 2;
+    skipSegmentCount_ = 1 + (slices - repeated) * 2;
+    for (int i = 0; i < skipSegmentCount_; i++) {
+        skipPayloadSegments_[i].iov_base = const_cast<BYTE*>(skipSegments_[i].Data);
+        skipPayloadSegments_[i].iov_len = skipSegments_[i].Length;
+    }
+    return skipLen;
+}
+
 int Sender::send(const MediaFrame& frame) {
     // Cleanup disconnected first
     cleanupDisconnected();
@@ -319,13 +514,19 @@ int Sender::send(const MediaFrame& frame) {
     
     // Create/update encoder
     createEncoder(frame.width, frame.height, 
-                  frame.frameRateN / frame.frameRateD, 
+                  frame.frameRateN, frame.frameRateD, 
                   frame.colorSpace);
     
     // Encode frame
     int encodedLen = encodeFrame(frame);
     if (encodedLen <= 0) return 0;
     
+    // Hand the frame to the dispatcher before anything here can recreate the encoder. Channels that took it
+    // chunk by chunk are left out. Whole frames reach the channels in the background, so what is known here
+    // is whether any channel took the previous one, which encodeFrame waited for, or this one's chunks.
+    bool taken = !chunkChannels_.empty() || dispatchedChannels() != 0;
+    dispatchFrame(frame, encodedLen);
+    
     totalEncodedBytes_ += encodedLen;
     int count = frameCount_++;
     
@@ -337,15 +538,65 @@ int Sender::send(const MediaFrame& frame) {
         checkCongestion();
     }
     
-    // Build headers
-    FrameHeader header{};
+    return taken ? encodedLen : 0;
+}
+
+void Sender::dispatchFrame(const MediaFrame& frame, int encodedLen) {
+    {
+        std::lock_guard<std::mutex> lock(dispatchMutex_);
+        if (dispatchStop_) return;  // Stopped, nobody to send to
+        dispatchFrame_ = frame;
+        dispatchFrame_.data = nullptr;  // Only the description is needed, the payload is in payloadSegments_
+        dispatchFrame_.dataU = nullptr;
+        dispatchFrame_.dataV = nullptr;
+        dispatchLength_ = encodedLen;
+        dispatchChroma420_ = chroma420_;
+        dispatchChunked_ = chunkChannels_;
+        dispatchPending_ = true;
+    }
+    dispatchCV_.notify_all();
+}
+
+void Sender::waitDispatched() {
+    std::unique_lock<std::mutex> lock(dispatchMutex_);
+    dispatchCV_.wait(lock, [this] { return !dispatchPending_; });
+}
+
+int Sender::dispatchedChannels() {
+    std::lock_guard<std::mutex> lock(dispatchMutex_);
+    return dispatchChannels_;
+}
+
+void Sender::dispatchLoop() {
+    LOGI("dispatchLoop: started");
+    
+    std::unique_lock<std::mutex> lock(dispatchMutex_);
+    while (true) {
+        dispatchCV_.wait(lock, [this] { return dispatchPending_ || dispatchStop_; });
+        if (!dispatchPending_) break;
+        
+        MediaFrame frame = dispatchFrame_;
+        int encodedLen = dispatchLength_;
+        bool chroma420 = dispatchChroma420_;
+        lock.unlock();
+        int channels = sendToChannels(frame, encodedLen, chroma420, dispatchChunked_);
+        lock.lock();
+        
+        dispatchChannels_ = channels;
+        dispatchPending_ = false;
+        dispatchCV_.notify_all();
+    }
+    
+    LOGI("dispatchLoop: stopped");
+}
+
+void Sender::makeVideoHeaders(const MediaFrame& frame, int encodedLen, FrameHeader& header, VideoExtHeader& extHeader) {
     header.version = 1;
     header.frameType = static_cast<uint8_t>(FrameType::Video);
     header.timestamp = frame.timestamp;
     header.metadataLength = 0;
     header.dataLength = VideoExtHeader::SIZE + encodedLen;
     
-    VideoExtHeader extHeader{};
     extHeader.codec = Codec::VMX1;
     extHeader.width = frame.width;
     extHeader.height = frame.height;
@@ -353,28 +604,57 @@ int Sender::send(const MediaFrame& frame) {
     extHeader.frameRateD = frame.frameRateD;
     extHeader.aspectRatio = frame.aspectRatio;
     extHeader.flags = frame.flags;
+    if (frame.codec == Codec::P010) extHeader.flags |= VideoFlags::HighBitDepth;  // Receivers pick P216 output from this flag
     extHeader.colorSpace = frame.colorSpace;
+}
+
+int Sender::sendToChannels(const MediaFrame& frame, int encodedLen, bool chroma420, const std::vector<Channel*>& chunked) {
+    // Build headers
+    FrameHeader header{};
+    VideoExtHeader extHeader{};
+    makeVideoHeaders(frame, encodedLen, header, extHeader);
+    
+    FrameHeader skipHeader{};
+    VideoExtHeader skipExtHeader{};
+    if (skipLength_ > 0) makeVideoHeaders(frame, skipLength_, skipHeader, skipExtHeader);
+    int64_t sequence = ++videoSequence_;
     
     // Send to all subscribed clients
-    int totalSent = 0;
-    {
-        std::lock_guard<std::mutex> lock(channelsMutex_);
-        for (const auto& ch : channels_) {
-            if (!ch->isConnected()) continue;
-            
-            // Only send if client has subscribed to video (per OMT protocol)
-            if (!ch->isVideoSubscribed()) continue;
-            
-            int sent = ch->sendAsync(&header, sizeof(header),
-                                     &extHeader, sizeof(extHeader),
-                                     encodeBuffer_.data(), encodedLen);
-            if (sent > 0) {
-                totalSent += sent;
-            }
+    int channels = 0;
+    std::lock_guard<std::mutex> lock(channelsMutex_);
+    for (const auto& ch : channels_) {
+        if (!ch->isConnected()) continue;
+        
+        // Only send if client has subscribed to video (per OMT protocol)
+        if (!ch->isVideoSubscribed()) continue;
+        
+        // Already sent chunk by chunk, which skip frames cannot follow
+        if (std::find(chunked.begin(), chunked.end(), ch.get()) != chunked.end()) {
+            ch->setVideoReference(-1);
+            continue;
         }
+        
+        // The frame is dropped for a receiver that cannot decode 4:2:0, and the next one it gets must be whole
+        if (chroma420 && !ch->isChroma420Enabled()) {
+            ch->setVideoReference(-1);
+            continue;
+        }
+        
+        // A skip frame is only valid on top of the previous frame, so the channel must have queued that one
+        int sent;
+        if (skipLength_ > 0 && ch->isSkipSlicesEnabled() && ch->getVideoReference() == sequence - 1) {
+            sent = ch->sendAsync(&skipHeader, sizeof(skipHeader),
+                                 &skipExtHeader, sizeof(skipExtHeader),
+                                 skipPayloadSegments_.data(), skipSegmentCount_);
+        } else {
+            sent = ch->sendAsync(&header, sizeof(header),
+                                 &extHeader, sizeof(extHeader),
+                                 payloadSegments_.data(), static_cast<int>(payloadSegments_.size()));
+        }
+        ch->setVideoReference(sent > 0 ? sequence : -1);
+        if (sent > 0) channels++;
     }
-    
-    return totalSent > 0 ? encodedLen : 0;
+    return channels;
 }
 
 void Sender::sendMetadata(const std::string& xml) {
@@ -447,9 +727,7 @@ void Sender::onQualityChanged(Channel* channel) {
             std::lock_guard<std::mutex> lock(encoderMutex_);
             int newProfile = selectProfile(best);
             if (newProfile != currentProfile_) {
-                currentProfile_ = newProfile;
-                // Encoder will be recreated on next send
-                destroyEncoder();
+                switchProfile(newProfile);
                 LOGI("Profile changed to %d based on receiver suggestion", 
                      static_cast<int>(newProfile));
             }
@@ -485,8 +763,7 @@ void Sender::checkCongestion() {
             else if (current == VMX_PROFILE_OMT_SQ) lower = VMX_PROFILE_OMT_LQ;
             
             if (lower != current) {
-                currentProfile_ = lower;
-                destroyEncoder();
+                switchProfile(lower);
                 LOGI("Congestion Control: Downgraded profile to %d", currentProfile_);
             }
         }
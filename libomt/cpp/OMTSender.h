@@ -14,6 +14,7 @@
 
 #include <vector>
 #include <mutex>
+#include <condition_variable>
 #include <thread>
 #include <atomic>
 #include <memory>
@@ -23,8 +24,9 @@
 #include "OMTConstants.h"
 #include "OMTChannel.h"
 
-// Forward declare VMX instance only (struct is fine)
+// Forward declare VMX types only (structs are fine)
 struct VMX_INSTANCE;
+struct VMX_SEGMENT;
 
 namespace omt {
 
@@ -55,6 +57,15 @@ struct MediaFrame {
     int flags;
     int colorSpace;
     int64_t timestamp;
+
+    // Separate chroma planes for YUV 4:2:0 sources (e.g. Android YUV_420_888).
+    // When dataU is set, data/stride describe the Y plane only and the planes are encoded in place.
+    // For P010 frames dataU/strideU is the interleaved 16 bit UV plane and the other fields are ignored.
+    void* dataU = nullptr;
+    void* dataV = nullptr;
+    int strideU = 0;
+    int strideV = 0;
+    int pixelStrideUV = 0;  // 1 = I420, 2 = NV12/NV21 (interleave order is given by the dataU/dataV addresses)
 };
 
 /**
@@ -65,6 +76,11 @@ struct SenderConfig {
     Quality quality = Quality::Default;
     int port = Constants::NETWORK_PORT_START;
     int sendBufferSize = Constants::NETWORK_SEND_BUFFER;  // Official: 65536 (64KB)
+    int rateBufferMs = Constants::VIDEO_RATE_BUFFER_MS;   // Encoder bitrate averaging window, 0 = per frame targets only
+    int lowLatencySlices = 0;  // Send each group of this many 16 line slices as soon as it is encoded, 0 = whole frames.
+                               // Only to receivers that send CHANNEL_CHUNKS_ON, the others get whole frames
+    bool reuseStaticSlices = false;  // Skip encoding slices identical to the previous frame (screen and other static sources),
+                                     // and leave them out entirely for receivers that send CHANNEL_SKIP_SLICES_ON
     std::string senderInfoXml = "<OMTInfo ProductName=\"OMT Android Sender\" Manufacturer=\"Open Media Transport\" Version=\"1.0\" />";
 };
 
@@ -97,8 +113,11 @@ public:
     void stop();
     
     /**
-     * Send a video frame to all subscribed clients
-     * @return encoded frame size in bytes, or 0 on failure
+     * Send a video frame to all subscribed clients.
+     * Returns once the frame is encoded; it is copied to the clients' send buffers in the background
+     * while the next frame encodes, so frame.data may be reused as soon as this returns.
+     * @return encoded frame size in bytes, or 0 on failure or when no client took the frame. Whole frames are handed
+     *         to the clients after this returns, so for them this reports on the previous frame.
      */
     int send(const MediaFrame& frame);
     
@@ -147,6 +166,13 @@ public:
      * Update the quality configuration and reset encoder.
      */
     void setQuality(Quality quality);
+    
+    /**
+     * Send each group of this many 16 line slices as soon as it is encoded, or whole frames with 0.
+     * Only receivers that send CHANNEL_CHUNKS_ON get the chunks, the others still get whole frames.
+     * Takes effect from the next frame.
+     */
+    void setLowLatencySlices(int slices);
 
 private:
     // Configuration
@@ -166,9 +192,37 @@ private:
     int currentWidth_ = 0;
     int currentHeight_ = 0;
     int currentProfile_ = 0;  // VMX_PROFILE stored as int
-    std::vector<uint8_t> encodeBuffer_;
+    int currentFrameRateN_ = 0;
+    int currentFrameRateD_ = 0;
+    std::vector<VMX_SEGMENT> encodeSegments_;    // Encoded frame in place, valid until the encode after next
+    std::vector<struct iovec> payloadSegments_;  // encodeSegments_ as passed to Channel::sendAsync
+    std::vector<VMX_SEGMENT> skipSegments_;      // Same frame without the slices repeated from the previous one
+    std::vector<struct iovec> skipPayloadSegments_;
+    int skipSegmentCount_ = 0;
+    int skipLength_ = 0;                         // 0 when no slice repeats, or the cache is off
+    bool chroma420_ = false;                     // The frame being encoded codes its chroma as 4:2:0 (VMX_SetChroma420)
+    int64_t videoSequence_ = 0;                  // Frames handed to the channels, owned by the dispatch thread
     std::mutex encoderMutex_;
     
+    // Low-latency mode: chunks go straight to the channels from the encoder threads
+    MediaFrame chunkFrame_{};                    // Description of the frame being encoded
+    std::vector<struct iovec> chunkSegments_;
+    size_t chunkMaxLength_ = 0;                  // Upper bound of a whole frame of chunks including their headers
+    int chunkBytes_ = 0;                         // Encoded bytes of the frame handed out so far
+    std::vector<Channel*> chunkChannels_;        // Channels that took the first chunk of the frame
+    
+    // Dispatch thread: hands frame N to the channels while frame N+1 encodes
+    std::thread dispatchThread_;
+    std::mutex dispatchMutex_;
+    std::condition_variable dispatchCV_;
+    bool dispatchPending_ = false;  // payloadSegments_ and dispatchChunked_ are in use until the dispatcher clears this
+    bool dispatchStop_ = true;      // Set while no dispatch thread is running
+    MediaFrame dispatchFrame_{};
+    int dispatchLength_ = 0;
+    bool dispatchChroma420_ = false;
+    std::vector<Channel*> dispatchChunked_;  // chunkChannels_ of the frame, which the dispatcher leaves out
+    int dispatchChannels_ = -1;     // Channels that took the last dispatched frame, -1 before the first
+    
     // Statistics
     std::atomic<int64_t> totalEncodedBytes_{0};
     std::atomic<int> frameCount_{0};
@@ -186,9 +240,24 @@ private:
     void cleanupDisconnected();
     
     // Encoder management
-    void createEncoder(int width, int height, int frameRate, int colorSpace);
+    void createEncoder(int width, int height, int frameRateN, int frameRateD, int colorSpace);
     void destroyEncoder();
+    void switchProfile(int profile);  // Call with encoderMutex_ held
+    void setRateControl(int frameRateN, int frameRateD);
+    static void onEncodedChunk(void* context, const VMX_SEGMENT* segments, int segmentCount, int length, int last);
+    void sendChunk(const VMX_SEGMENT* segments, int segmentCount, int length, bool last);
     int encodeFrame(const MediaFrame& frame);
+    int getEncodedSegments();
+    
+    // Frame dispatch
+    void dispatchLoop();
+    void dispatchFrame(const MediaFrame& frame, int encodedLen);
+    void waitDispatched();
+    int dispatchedChannels();
+    int sendToChannels(const MediaFrame& frame, int encodedLen, bool chroma420, const std::vector<Channel*>& chunked);
+    static void makeVideoHeaders(const MediaFrame& frame, int encodedLen, FrameHeader& header, VideoExtHeader& extHeader);
+    int getSkipSegments();
+    bool acceptsChroma420() const;
     
     // Buffer size calculation
     static int calculateOptimalBuffer(int width, int height, int profile);
@@ -180,6 +180,37 @@ int omt_send(omt_send_t* instance, OMTMediaFrame* frame) {
     return sender->send(mf);
 }
 
+// Custom helper: send a YUV 4:2:0 video frame whose chroma lives in separate planes (e.g. Android YUV_420_888).
+// frame->Data/Stride describe the Y plane. The planes are encoded in place without being gathered into one buffer.
+int omt_send_yuv420(omt_send_t* instance, OMTMediaFrame* frame,
+                    void* dataU, int strideU, void* dataV, int strideV, int pixelStrideUV) {
+    if (!instance || !frame || !dataU || !dataV) return 0;
+    if (frame->Type != OMTFrameType_Video) return 0;
+    
+    auto* sender = reinterpret_cast<omt::Sender*>(instance);
+    
+    omt::MediaFrame mf{};
+    mf.data = frame->Data;
+    mf.dataLength = frame->DataLength;
+    mf.width = frame->Width;
+    mf.height = frame->Height;
+    mf.stride = frame->Stride;
+    mf.codec = frame->Codec;
+    mf.frameRateN = frame->FrameRateN;
+    mf.frameRateD = frame->FrameRateD;
+    mf.aspectRatio = frame->AspectRatio;
+    mf.flags = frame->Flags;
+    mf.colorSpace = frame->ColorSpace;
+    mf.timestamp = frame->Timestamp;
+    mf.dataU = dataU;
+    mf.dataV = dataV;
+    mf.strideU = strideU;
+    mf.strideV = strideV;
+    mf.pixelStrideUV = pixelStrideUV;
+    
+    return sender->send(mf);
+}
+
 int omt_send_connections(omt_send_t* instance) {
     if (!instance) return 0;
     auto* sender = reinterpret_cast<omt::Sender*>(instance);
@@ -299,6 +330,14 @@ void omt_send_set_quality(omt_send_t* instance, OMTQuality quality) {
     sender->setQuality(q);
 }
 
+// Custom helper: send each group of slicesPerChunk 16 line slices as soon as it is encoded, 0 for whole frames.
+// Receivers get the chunks only once they send <OMTSettings Chunks="true" />.
+void omt_send_set_low_latency(omt_send_t* instance, int slicesPerChunk) {
+    if (!instance) return;
+    auto* sender = reinterpret_cast<omt::Sender*>(instance);
+    sender->setLowLatencySlices(slicesPerChunk);
+}
+
 int64_t omt_send_get_recent_drops_and_reset(omt_send_t* instance) {
     // Not implemented in new modular design - would need to track in Sender
     // For now, return 0 (no recent drops tracked)
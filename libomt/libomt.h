@@ -66,6 +66,8 @@ typedef enum OMTFrameType
 * 
 * PA16 = Same as P216 folowed by an additional 16bit alpha plane.
 *
+* P010 = Planar 4:2:0 YUV format. 16bit Y plane followed by interleaved half height 16bit UV plane. Sending only.
+*
 * FPA1 = Floating-point Planar Audio 32bit
 */
 typedef enum OMTCodec
@@ -79,7 +81,8 @@ typedef enum OMTCodec
     OMTCodec_YV12 = 0x32315659,
     OMTCodec_UYVA = 0x41565955,
     OMTCodec_P216 = 0x36313250,
-    OMTCodec_PA16 = 0x36314150
+    OMTCodec_PA16 = 0x36314150,
+    OMTCodec_P010 = 0x30313050
 
 } OMTCodec;
 
@@ -126,7 +129,7 @@ typedef enum OMTColorSpace
 * 
 * Preview: Frame is a special 1/8th preview frame
 * 
-* HighBitDepth: Sender automatically adds this flag for frames encoded using P216 or PA16 pixel formats.
+* HighBitDepth: Sender automatically adds this flag for frames encoded using P216, PA16 or P010 pixel formats.
 * 
 * Set this manually for VMX1 compressed data where the the frame was originally encoded using P216 or PA16.
 * This determines which pixel format is selected on the decode side.
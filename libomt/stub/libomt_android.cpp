@@ -948,6 +948,13 @@ int omt_send(omt_send_t* instance, OMTMediaFrame* frame) {
         case OMTCodec_BGRA: 
             err = VMX_EncodeBGRA(ctx->vmxInstance, (BYTE*)frame->Data, frame->Stride, interlaced); 
             break;
+        case OMTCodec_P010: 
+            {
+                BYTE* y = (BYTE*)frame->Data;
+                BYTE* uv = y + (frame->Stride * frame->Height);
+                err = VMX_EncodeP010(ctx->vmxInstance, y, frame->Stride, uv, frame->Stride, interlaced);
+            }
+            break;
         default: 
             LOGE("Unknown codec: %d", frame->Codec);
             return 0;
@@ -996,6 +1003,7 @@ int omt_send(omt_send_t* instance, OMTMediaFrame* frame) {
     extHeader.FrameRateD = frame->FrameRateD;
     extHeader.AspectRatio = frame->AspectRatio;
     extHeader.Flags = frame->Flags;
+    if (frame->Codec == OMTCodec_P010) extHeader.Flags |= OMTVideoFlags_HighBitDepth;
     extHeader.ColorSpace = frame->ColorSpace;
     
     // Send to all clients using async pool
@@ -0,0 +1,1197 @@
+/*
+* MIT License
+*
+* Copyright (c) 2025 Open Media Transport Contributors
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+*/
+
+/// vmx_bench: frame level encode/decode throughput of libvmx.
+///
+/// Every combination of profile, resolution and image format is run through the public API exactly as an
+/// application would (Encode* + SaveTo, LoadFromInPlace + Decode*), once with the 128bit path forced and once with
+/// the 256bit path selected by VMX_Create, so the two can be compared on the same row.
+///
+/// The rate direction instead encodes a UYVY sequence of scenes of very different detail with each rate control mode,
+/// and reports how far frames overshoot the encoder's frameMax target, above all on the first frame after each cut.
+///
+/// The latency direction encodes UYVY frames whole and in low-latency chunks (VMX_SetChunkedOutput), and reports how
+/// long after the encode call the first and the last bytes of the frame are ready to send.
+///
+/// The static direction encodes UYVY frames where only a band of 32 lines moves, with and without the slice cache
+/// (VMX_SetSliceCache), as a stand-in for a locked-off camera or a screen source.
+///
+/// The pipeline direction decodes a stream through VMX_CreatePipeline with 1 to 8 frames in flight.
+///
+/// The memory direction reports what an encoder holds after a UYVY frame (VMX_GetMemoryUsage), full size and lean
+/// (VMX_SetLeanMemory). --lean runs every other direction on lean instances.
+///
+/// The quality direction measures a decoded UYVY frame against its source, with the legacy VMX_CalculatePSNR and with
+/// each mode of VMX_CalculateQuality, including the sampled mode meant for live monitoring.
+///
+/// The determinism direction encodes every format at widths that are not a multiple of 32, progressive and interlaced,
+/// on several threads and again on one, and fails (exit code 1) if any run differs from the single threaded stream.
+///
+/// --chroma420 codes every frame with half height chroma (VMX_SetChroma420), to compare with the default 4:2:2.
+///
+/// --memory-policy applies VMX_MEMORY_POLICY flags (VMX_SetMemoryPolicy) to every instance, e.g. 3 for NUMA placement on huge pages.
+///
+/// Usage: vmx_bench [--frames n] [--warmup n] [--fps n] [--threads n] [--scene n] [--chunk n] [--lean] [--chroma420]
+///                  [--memory-policy n] [--csv]
+///                  [--profile LQ,SQ,HQ,OMT_LQ,OMT_SQ,OMT_HQ] [--res 480p,...,4320p]
+///                  [--format UYVY,...] [--dir encode,decode,rate,latency,static,pipeline,memory,quality,determinism]
+
+#include "vmxcodec.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct BenchProfile
+{
+	const char* Name;
+	VMX_PROFILE Profile;
+};
+
+struct BenchResolution
+{
+	const char* Name;
+	VMX_SIZE Size;
+};
+
+static const BenchProfile BENCH_PROFILES[] = {
+	{ "LQ", VMX_PROFILE_LQ },
+	{ "SQ", VMX_PROFILE_SQ },
+	{ "HQ", VMX_PROFILE_HQ },
+	{ "OMT_LQ", VMX_PROFILE_OMT_LQ },
+	{ "OMT_SQ", VMX_PROFILE_OMT_SQ },
+	{ "OMT_HQ", VMX_PROFILE_OMT_HQ },
+};
+
+static const BenchResolution BENCH_RESOLUTIONS[] = {
+	{ "480p", { 720, 480 } },
+	{ "576p", { 720, 576 } },
+	{ "720p", { 1280, 720 } },
+	{ "1080p", { 1920, 1080 } },
+	{ "1440p", { 2560, 1440 } },
+	{ "2160p", { 3840, 2160 } },
+	{ "4320p", { 7680, 4320 } },
+};
+
+/// Source/destination image, laid out the way the matching VMX_Encode*/VMX_Decode* call expects.
+struct BenchImage
+{
+	BYTE* Data = NULL;
+	int Stride = 0;
+	int Rows = 0; //Rows of Stride bytes at Data, including any planes stored after the first
+	BYTE* Data2 = NULL; //UV plane for NV12/P010, U plane for YV12
+	int Stride2 = 0;
+	BYTE* Data3 = NULL; //V plane for YV12
+	int Stride3 = 0;
+	int Rows2 = 0; //Rows of Data2 and Data3
+	VMX_RECT Region = {}; //Area of the frame for VMX_DecodeRegion
+	int Interlaced = 0; //Passed to the Encode* call
+	std::vector<BYTE*> Allocations;
+
+	BYTE* Alloc(size_t len)
+	{
+		//Conversion routines are allowed to write up to 64 bytes past the end of each row.
+		len = ((len + 63) & ~(size_t)63) + 4096;
+		BYTE* p = (BYTE*)aligned_alloc(64, len);
+		memset(p, 0, len);
+		Allocations.push_back(p);
+		return p;
+	}
+	~BenchImage()
+	{
+		for (BYTE* p : Allocations) free(p);
+	}
+};
+
+typedef std::function<void(VMX_SIZE sz, BenchImage& img)> BenchAllocFunc;
+typedef std::function<VMX_ERR(VMX_INSTANCE* instance, BenchImage& img)> BenchCodecFunc;
+
+struct BenchFormat
+{
+	const char* Name;
+	BenchAllocFunc Alloc;
+	BenchCodecFunc Encode; //NULL if this format is decode only
+	BenchCodecFunc Decode; //NULL if this format is encode only
+};
+
+static int BenchAlign(int v, int a)
+{
+	return (v + a - 1) & ~(a - 1);
+}
+
+static void BenchPacked(VMX_SIZE sz, BenchImage& img, int bytesPerPixel, int planes)
+{
+	img.Stride = BenchAlign(sz.width * bytesPerPixel, 64);
+	img.Rows = sz.height * planes;
+	img.Data = img.Alloc((size_t)img.Stride * img.Rows);
+}
+
+static void BenchPreview(VMX_SIZE sz, BenchImage& img, int bytesPerPixel, int planes)
+{
+	//Preview is 1/8th of the frame, see VMX_DecodePreviewBGRA
+	VMX_SIZE p = { BenchAlign(sz.width >> 3, 2), sz.height >> 3 };
+	BenchPacked(p, img, bytesPerPixel, planes);
+}
+
+static void BenchScaled(VMX_SIZE sz, BenchImage& img, int scale, int bytesPerPixel, int planes)
+{
+	//See VMX_DecodeScaled
+	VMX_SIZE p = { BenchAlign(sz.width / scale, 2), sz.height / scale };
+	BenchPacked(p, img, bytesPerPixel, planes);
+}
+
+static void BenchRegion(VMX_SIZE sz, BenchImage& img, int bytesPerPixel)
+{
+	//Centre quarter of the frame, as a monitor showing a 2x crop would
+	img.Region = { BenchAlign(sz.width / 4, 2), sz.height / 4, BenchAlign(sz.width / 2, 2), sz.height / 2 };
+	VMX_SIZE r = { img.Region.width, img.Region.height };
+	BenchPacked(r, img, bytesPerPixel, 1);
+}
+
+static void BenchNV12(VMX_SIZE sz, BenchImage& img, int bytesPerSample)
+{
+	img.Stride = BenchAlign(sz.width * bytesPerSample, 64);
+	img.Rows = sz.height;
+	img.Data = img.Alloc((size_t)img.Stride * img.Rows);
+	img.Stride2 = img.Stride;
+	img.Rows2 = (sz.height + 1) / 2;
+	img.Data2 = img.Alloc((size_t)img.Stride2 * img.Rows2);
+}
+
+static void BenchYV12(VMX_SIZE sz, BenchImage& img)
+{
+	img.Stride = BenchAlign(sz.width, 64);
+	img.Rows = sz.height;
+	img.Data = img.Alloc((size_t)img.Stride * img.Rows);
+	img.Stride2 = BenchAlign(sz.width / 2, 64);
+	img.Rows2 = (sz.height + 1) / 2;
+	img.Data2 = img.Alloc((size_t)img.Stride2 * img.Rows2);
+	img.Stride3 = img.Stride2;
+	img.Data3 = img.Alloc((size_t)img.Stride3 * img.Rows2);
+}
+
+static std::vector<BenchFormat> BenchFormats()
+{
+	using namespace std::placeholders;
+	std::vector<BenchFormat> f;
+	f.push_back({ "UYVY", std::bind(BenchPacked, _1, _2, 2, 1),
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_EncodeUYVY(i, m.Data, m.Stride, m.Interlaced); },
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodeUYVY(i, m.Data, m.Stride); } });
+	f.push_back({ "UYVA", std::bind(BenchPacked, _1, _2, 2, 2),
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_EncodeUYVA(i, m.Data, m.Stride, m.Interlaced); },
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodeUYVA(i, m.Data, m.Stride); } });
+	f.push_back({ "YUY2", std::bind(BenchPacked, _1, _2, 2, 1),
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_EncodeYUY2(i, m.Data, m.Stride, m.Interlaced); },
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodeYUY2(i, m.Data, m.Stride); } });
+	f.push_back({ "NV12", std::bind(BenchNV12, _1, _2, 1),
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_EncodeNV12(i, m.Data, m.Stride, m.Data2, m.Stride2, m.Interlaced); },
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodeNV12(i, m.Data, m.Stride, m.Data2, m.Stride2); } });
+	f.push_back({ "YV12", BenchYV12,
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_EncodeYV12(i, m.Data, m.Stride, m.Data2, m.Stride2, m.Data3, m.Stride3, m.Interlaced); },
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodeI420(i, m.Data, m.Stride, m.Data2, m.Stride2, m.Data3, m.Stride3); } });
+	f.push_back({ "Planar", std::bind(BenchPacked, _1, _2, 1, 1),
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_EncodePlanar(i, m.Interlaced); },
+		NULL });
+	f.push_back({ "P216", std::bind(BenchPacked, _1, _2, 2, 2),
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_EncodeP216(i, m.Data, m.Stride, m.Interlaced); },
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodeP216(i, m.Data, m.Stride); } });
+	f.push_back({ "P010", std::bind(BenchNV12, _1, _2, 2),
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_EncodeP010(i, m.Data, m.Stride, m.Data2, m.Stride2, m.Interlaced); },
+		NULL });
+	f.push_back({ "PA16", std::bind(BenchPacked, _1, _2, 2, 3),
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_EncodePA16(i, m.Data, m.Stride, m.Interlaced); },
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodePA16(i, m.Data, m.Stride); } });
+	f.push_back({ "BGRA", std::bind(BenchPacked, _1, _2, 4, 1),
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_EncodeBGRA(i, m.Data, m.Stride, m.Interlaced); },
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodeBGRA(i, m.Data, m.Stride); } });
+	f.push_back({ "BGRX", std::bind(BenchPacked, _1, _2, 4, 1),
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_EncodeBGRX(i, m.Data, m.Stride, m.Interlaced); },
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodeBGRX(i, m.Data, m.Stride); } });
+	f.push_back({ "PreviewUYVY", std::bind(BenchPreview, _1, _2, 2, 1), NULL,
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodePreviewUYVY(i, m.Data, m.Stride); } });
+	f.push_back({ "PreviewUYVA", std::bind(BenchPreview, _1, _2, 2, 2), NULL,
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodePreviewUYVA(i, m.Data, m.Stride); } });
+	f.push_back({ "PreviewYUY2", std::bind(BenchPreview, _1, _2, 2, 1), NULL,
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodePreviewYUY2(i, m.Data, m.Stride); } });
+	f.push_back({ "PreviewBGRA", std::bind(BenchPreview, _1, _2, 4, 1), NULL,
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodePreviewBGRA(i, m.Data, m.Stride); } });
+	f.push_back({ "PreviewBGRX", std::bind(BenchPreview, _1, _2, 4, 1), NULL,
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodePreviewBGRX(i, m.Data, m.Stride); } });
+	f.push_back({ "HalfUYVY", std::bind(BenchScaled, _1, _2, 2, 2, 1), NULL,
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodeScaled(i, 2, VMX_IMAGE_UYVY, m.Data, m.Stride); } });
+	f.push_back({ "HalfBGRA", std::bind(BenchScaled, _1, _2, 2, 4, 1), NULL,
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodeScaled(i, 2, VMX_IMAGE_BGRA, m.Data, m.Stride); } });
+	f.push_back({ "QuarterUYVY", std::bind(BenchScaled, _1, _2, 4, 2, 1), NULL,
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodeScaled(i, 4, VMX_IMAGE_UYVY, m.Data, m.Stride); } });
+	f.push_back({ "QuarterBGRA", std::bind(BenchScaled, _1, _2, 4, 4, 1), NULL,
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodeScaled(i, 4, VMX_IMAGE_BGRA, m.Data, m.Stride); } });
+	f.push_back({ "CropUYVY", std::bind(BenchRegion, _1, _2, 2), NULL,
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodeRegion(i, m.Region, VMX_IMAGE_UYVY, m.Data, m.Stride); } });
+	f.push_back({ "CropBGRA", std::bind(BenchRegion, _1, _2, 4), NULL,
+		[](VMX_INSTANCE* i, BenchImage& m) { return VMX_DecodeRegion(i, m.Region, VMX_IMAGE_BGRA, m.Data, m.Stride); } });
+	return f;
+}
+
+/// Deterministic test pattern: smooth gradients, hard edges and low amplitude noise so that both the DC and AC
+/// coders see realistic work. Written byte-wise into every plane of the image so that each format gets
+/// plausible (if not colorimetrically exact) content.
+static void BenchFill(BYTE* p, int stride, int rows, int seed)
+{
+	unsigned int r = 0x9E3779B9u ^ (unsigned int)seed;
+	for (int y = 0; y < rows; y++)
+	{
+		BYTE* row = p + (size_t)y * stride;
+		for (int x = 0; x < stride; x++)
+		{
+			r = r * 1664525u + 1013904223u;
+			int v = ((x >> 1) + y) & 0xFF;
+			if (((x >> 6) ^ (y >> 5)) & 1) v = 255 - v;
+			v += (int)((r >> 24) & 0xF) - 8;
+			row[x] = (BYTE)std::min(235, std::max(16, v));
+		}
+	}
+}
+
+static void BenchFillImage(BenchImage& img)
+{
+	BenchFill(img.Data, img.Stride, img.Rows, 1);
+	if (img.Data2) BenchFill(img.Data2, img.Stride2, img.Rows2, 2);
+	if (img.Data3) BenchFill(img.Data3, img.Stride3, img.Rows2, 3);
+}
+
+struct BenchResult
+{
+	bool Valid = false;
+	double Fps = 0;
+	double P50 = 0;
+	double P95 = 0;
+	double P99 = 0;
+	double AvgBytes = 0;
+};
+
+struct BenchOptions
+{
+	int Frames = 20;
+	int Warmup = 3;
+	int Fps = 60;
+	int Threads = 0;
+	int SceneFrames = 12;
+	int ChunkSlices = 8;
+	bool Lean = false;
+	bool Chroma420 = false;
+	int MemoryPolicy = VMX_MEMORY_POLICY_DEFAULT;
+	bool Csv = false;
+	std::vector<std::string> Profiles;
+	std::vector<std::string> Resolutions;
+	std::vector<std::string> Formats;
+	std::vector<std::string> Directions;
+};
+
+static double BenchPercentile(std::vector<double>& sorted, double p)
+{
+	if (sorted.empty()) return 0;
+	size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+	return sorted[std::min(i, sorted.size() - 1)];
+}
+
+static BenchResult BenchSummarize(std::vector<double>& times, double totalBytes)
+{
+	BenchResult r;
+	double total = 0;
+	for (double t : times) total += t;
+	std::sort(times.begin(), times.end());
+	r.Valid = true;
+	r.Fps = total > 0 ? times.size() / (total / 1000.0) : 0;
+	r.P50 = BenchPercentile(times, 0.50);
+	r.P95 = BenchPercentile(times, 0.95);
+	r.P99 = BenchPercentile(times, 0.99);
+	r.AvgBytes = totalBytes / times.size();
+	return r;
+}
+
+static VMX_INSTANCE* BenchCreate(const BenchOptions& opt, VMX_SIZE sz, VMX_PROFILE profile, bool avx2)
+{
+	VMX_INSTANCE* instance = VMX_Create(sz, profile, VMX_COLORSPACE_UNDEFINED);
+	if (!instance) return NULL;
+	if (avx2 && !instance->avx2)
+	{
+		//CPU or frame width cannot use the 256bit path
+		VMX_Destroy(instance);
+		return NULL;
+	}
+	if (!avx2) instance->avx2 = 0;
+	if (opt.Threads > 0) VMX_SetThreads(instance, opt.Threads);
+	if (opt.MemoryPolicy) VMX_SetMemoryPolicy(instance, opt.MemoryPolicy);
+	if (opt.Lean) VMX_SetLeanMemory(instance, 1);
+	if (opt.Chroma420) VMX_SetChroma420(instance, 1);
+	return instance;
+}
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double BenchElapsedMs(BenchClock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(BenchClock::now() - start).count();
+}
+
+static BenchResult BenchEncode(const BenchOptions& opt, VMX_SIZE sz, VMX_PROFILE profile, const BenchFormat& fmt, bool avx2)
+{
+	BenchResult result;
+	VMX_INSTANCE* instance = BenchCreate(opt, sz, profile, avx2);
+	if (!instance) return result;
+
+	BenchImage src;
+	fmt.Alloc(sz, src);
+	BenchFillImage(src);
+
+	int maxLen = sz.width * sz.height * 4;
+	std::vector<BYTE> encoded(maxLen);
+	std::vector<double> times;
+	double totalBytes = 0;
+	for (int i = 0; i < opt.Warmup + opt.Frames; i++)
+	{
+		BenchClock::time_point start = BenchClock::now();
+		if (fmt.Encode(instance, src) != VMX_ERR_OK) break;
+		int len = VMX_SaveTo(instance, encoded.data(), maxLen);
+		double ms = BenchElapsedMs(start);
+		if (len <= 0) break;
+		if (i >= opt.Warmup)
+		{
+			times.push_back(ms);
+			totalBytes += len;
+		}
+	}
+	VMX_Destroy(instance);
+	if ((int)times.size() != opt.Frames) return result;
+	return BenchSummarize(times, totalBytes);
+}
+
+static BenchResult BenchDecode(const BenchOptions& opt, VMX_SIZE sz, VMX_PROFILE profile, const BenchFormat& fmt, bool avx2)
+{
+	BenchResult result;
+	VMX_INSTANCE* encoder = BenchCreate(opt, sz, profile, avx2);
+	if (!encoder) return result;
+
+	//Encode a 16bit frame with alpha so that every decoder has a full 4:2:2:4 source to work with.
+	BenchImage src;
+	BenchPacked(sz, src, 2, 3);
+	BenchFillImage(src);
+	int maxLen = sz.width * sz.height * 4;
+	std::vector<BYTE> encoded(maxLen + VMX_LOAD_PADDING);
+	int len = 0;
+	for (int i = 0; i <= opt.Warmup; i++)
+	{
+		//Let the rate control settle before capturing the frame
+		VMX_EncodePA16(encoder, src.Data, src.Stride, 0);
+		len = VMX_SaveTo(encoder, encoded.data(), maxLen);
+	}
+	VMX_Destroy(encoder);
+	if (len <= 0) return result;
+
+	VMX_INSTANCE* instance = BenchCreate(opt, sz, profile, avx2);
+	if (!instance) return result;
+	BenchImage dst;
+	fmt.Alloc(sz, dst);
+
+	std::vector<double> times;
+	for (int i = 0; i < opt.Warmup + opt.Frames; i++)
+	{
+		BenchClock::time_point start = BenchClock::now();
+		if (VMX_LoadFromInPlace(instance, encoded.data(), len) != VMX_ERR_OK) break;
+		if (fmt.Decode(instance, dst) != VMX_ERR_OK) break;
+		double ms = BenchElapsedMs(start);
+		if (i >= opt.Warmup) times.push_back(ms);
+	}
+	VMX_Destroy(instance);
+	if ((int)times.size() != opt.Frames) return result;
+	return BenchSummarize(times, (double)len * opt.Frames);
+}
+
+/// Scene of the rate control sequence. Detail 0 is a smooth gradient, each step up adds sharper edges and stronger noise,
+/// so consecutive scenes differ in encoded size by several times. Extra columns on the right let each frame pan a little.
+static void BenchFillScene(BYTE* p, int stride, int rows, int detail)
+{
+	static const int NOISE[] = { 2, 12, 48, 160 };
+	static const int EDGE[] = { 0, 64, 16, 4 };
+	unsigned int r = 0x2545F491u ^ (unsigned int)detail;
+	for (int y = 0; y < rows; y++)
+	{
+		BYTE* row = p + (size_t)y * stride;
+		for (int x = 0; x < stride; x++)
+		{
+			r = r * 1664525u + 1013904223u;
+			int v = 64 + (((x >> 2) + y) & 0x7F);
+			if (EDGE[detail] && (((x / EDGE[detail]) ^ (y / EDGE[detail])) & 1)) v = 255 - v;
+			v += (int)((r >> 16) % NOISE[detail]) - (NOISE[detail] / 2);
+			row[x] = (BYTE)std::min(235, std::max(16, v));
+		}
+	}
+}
+
+struct BenchRateResult
+{
+	bool Valid = false;
+	double Fps = 0;
+	double Mbps = 0;
+	double InWindow = 0; //Percentage of frames between frameMin and frameMax
+	double Over = 0; //Percentage of frames above frameMax
+	double CutOver = 0; //Mean overshoot above frameMax of the first frame of each scene, in percent
+	double MaxOver = 0; //Largest overshoot of any frame, in percent
+	double Settle = 0; //Mean frames after a cut until one lands inside the window, 0 if the cut itself does
+};
+
+static const int BENCH_RATE_SCENES[] = { 0, 3, 1, 3, 2, 0, 2, 1 };
+
+static BenchRateResult BenchRate(const BenchOptions& opt, VMX_SIZE sz, VMX_PROFILE profile, VMX_RATE_CONTROL mode)
+{
+	BenchRateResult result;
+	VMX_INSTANCE* instance = BenchCreate(opt, sz, profile, true);
+	if (!instance) instance = BenchCreate(opt, sz, profile, false);
+	if (!instance) return result;
+	VMX_SetRateControlMode(instance, mode);
+	int frameMin, frameMax, minQuality, dcShift;
+	VMX_GetEncodingParameters(instance, &frameMin, &frameMax, &minQuality, &dcShift);
+
+	const int pan = 64;
+	int stride = (sz.width * 2) + (pan * 4);
+	std::vector<BenchImage> scenes(4);
+	for (int d = 0; d < 4; d++)
+	{
+		scenes[d].Data = scenes[d].Alloc((size_t)stride * sz.height);
+		scenes[d].Stride = stride;
+		scenes[d].Rows = sz.height;
+		BenchFillScene(scenes[d].Data, stride, sz.height, d);
+	}
+
+	int maxLen = sz.width * sz.height * 4;
+	std::vector<BYTE> encoded(maxLen);
+	int sceneCount = (int)(sizeof(BENCH_RATE_SCENES) / sizeof(BENCH_RATE_SCENES[0]));
+	double totalMs = 0;
+	double totalBytes = 0;
+	int frames = 0;
+	int inWindow = 0;
+	int over = 0;
+	double cutOver = 0;
+	double settle = 0;
+	bool settled = false;
+	for (int i = -opt.Warmup; i < sceneCount * opt.SceneFrames; i++)
+	{
+		//Warmup frames repeat the last scene so the sequence opens with a cut
+		int scene = i < 0 ? sceneCount - 1 : i / opt.SceneFrames;
+		int frame = i < 0 ? 0 : i % opt.SceneFrames;
+		const BenchImage& img = scenes[BENCH_RATE_SCENES[scene]];
+		BYTE* src = img.Data + ((frame * 4) % (pan * 4));
+
+		BenchClock::time_point start = BenchClock::now();
+		if (VMX_EncodeUYVY(instance, src, img.Stride, 0) != VMX_ERR_OK) break;
+		int len = VMX_SaveTo(instance, encoded.data(), maxLen);
+		double ms = BenchElapsedMs(start);
+		if (len <= 0) break;
+		if (i < 0) continue;
+
+		totalMs += ms;
+		totalBytes += len;
+		frames++;
+		double overshoot = len > frameMax ? (len - frameMax) * 100.0 / frameMax : 0;
+		result.MaxOver = std::max(result.MaxOver, overshoot);
+		if (len > frameMax) over++;
+		bool inside = len >= frameMin && len <= frameMax;
+		if (inside) inWindow++;
+		if (frame == 0)
+		{
+			cutOver += overshoot;
+			settled = false;
+		}
+		if (!settled && inside)
+		{
+			settle += frame;
+			settled = true;
+		}
+		if (!settled && frame == opt.SceneFrames - 1) settle += opt.SceneFrames;
+	}
+	VMX_Destroy(instance);
+	if (frames != sceneCount * opt.SceneFrames) return result;
+	result.Valid = true;
+	result.Fps = frames / (totalMs / 1000.0);
+	result.Mbps = totalBytes * 8.0 * opt.Fps / frames / 1000000.0;
+	result.InWindow = inWindow * 100.0 / frames;
+	result.Over = over * 100.0 / frames;
+	result.CutOver = cutOver / sceneCount;
+	result.Settle = settle / sceneCount;
+	return result;
+}
+
+static void BenchPrintRateHeader(const BenchOptions& opt)
+{
+	if (opt.Csv)
+	{
+		printf("profile,resolution,mode,mbps,fps,in_window,over,cut_over,max_over,settle\n");
+	}
+	else {
+		printf("%-7s %-6s %-10s %8s %8s | %7s %7s %8s %8s %7s\n",
+			"profile", "res", "mode", "Mbps", "fps", "in%", "over%", "cut+%", "max+%", "settle");
+	}
+}
+
+static void BenchPrintRateRow(const BenchOptions& opt, const char* profile, const char* res, const char* mode, const BenchRateResult& r)
+{
+	if (!r.Valid)
+	{
+		if (!opt.Csv) printf("%-7s %-6s %-10s %8s\n", profile, res, mode, "n/a");
+		return;
+	}
+	if (opt.Csv)
+	{
+		printf("%s,%s,%s,%.2f,%.2f,%.1f,%.1f,%.1f,%.1f,%.2f\n", profile, res, mode, r.Mbps, r.Fps, r.InWindow, r.Over, r.CutOver, r.MaxOver, r.Settle);
+	}
+	else {
+		printf("%-7s %-6s %-10s %8.1f %8.1f | %7.1f %7.1f %8.1f %8.1f %7.2f\n", profile, res, mode, r.Mbps, r.Fps, r.InWindow, r.Over, r.CutOver, r.MaxOver, r.Settle);
+	}
+	fflush(stdout);
+}
+
+struct BenchLatency
+{
+	BenchClock::time_point Start;
+	double FirstMs = -1;
+	int Chunks = 0;
+};
+
+//Only the arrival of each chunk is timed, its contents are not looked at
+static void BenchLatencyChunk(void* context, const VMX_SEGMENT*, int, int, int)
+{
+	BenchLatency* l = (BenchLatency*)context;
+	if (l->FirstMs < 0) l->FirstMs = BenchElapsedMs(l->Start);
+	l->Chunks++;
+}
+
+struct BenchLatencyResult
+{
+	bool Valid = false;
+	int Chunks = 0;
+	double FirstP50 = 0; //Milliseconds from the encode call until the first bytes are ready
+	double FirstP95 = 0;
+	double LastP50 = 0; //Milliseconds until the whole frame is ready
+	double LastP95 = 0;
+};
+
+/// chunkSlices 0 measures the whole frame path, where nothing is ready before VMX_SaveTo returns.
+static BenchLatencyResult BenchChunkLatency(const BenchOptions& opt, VMX_SIZE sz, VMX_PROFILE profile, int chunkSlices)
+{
+	BenchLatencyResult result;
+	VMX_INSTANCE* instance = BenchCreate(opt, sz, profile, true);
+	if (!instance) instance = BenchCreate(opt, sz, profile, false);
+	if (!instance) return result;
+	BenchLatency latency;
+	if (chunkSlices > 0) VMX_SetChunkedOutput(instance, chunkSlices, BenchLatencyChunk, &latency);
+
+	BenchImage src;
+	BenchPacked(sz, src, 2, 1);
+	BenchFillImage(src);
+	int maxLen = VMX_GetMaxEncodedLength(instance, 0);
+	std::vector<BYTE> encoded(maxLen);
+	std::vector<double> first;
+	std::vector<double> last;
+	for (int i = 0; i < opt.Warmup + opt.Frames; i++)
+	{
+		latency.FirstMs = -1;
+		latency.Chunks = 0;
+		latency.Start = BenchClock::now();
+		if (VMX_EncodeUYVY(instance, src.Data, src.Stride, 0) != VMX_ERR_OK) break;
+		if (chunkSlices <= 0 && VMX_SaveTo(instance, encoded.data(), maxLen) <= 0) break;
+		double ms = BenchElapsedMs(latency.Start);
+		if (i < opt.Warmup) continue;
+		first.push_back(chunkSlices > 0 ? latency.FirstMs : ms);
+		last.push_back(ms);
+	}
+	VMX_Destroy(instance);
+	if ((int)last.size() != opt.Frames) return result;
+	std::sort(first.begin(), first.end());
+	std::sort(last.begin(), last.end());
+	result.Valid = true;
+	result.Chunks = chunkSlices > 0 ? latency.Chunks : 1;
+	result.FirstP50 = BenchPercentile(first, 0.50);
+	result.FirstP95 = BenchPercentile(first, 0.95);
+	result.LastP50 = BenchPercentile(last, 0.50);
+	result.LastP95 = BenchPercentile(last, 0.95);
+	return result;
+}
+
+static void BenchPrintLatencyHeader(const BenchOptions& opt)
+{
+	if (opt.Csv)
+	{
+		printf("profile,resolution,mode,chunks,first_p50,first_p95,last_p50,last_p95\n");
+	}
+	else {
+		printf("%-7s %-6s %-10s %6s | %9s %9s | %9s %9s\n",
+			"profile", "res", "mode", "chunks", "first p50", "first p95", "last p50", "last p95");
+	}
+}
+
+static void BenchPrintLatencyRow(const BenchOptions& opt, const char* profile, const char* res, const char* mode, const BenchLatencyResult& r)
+{
+	if (!r.Valid)
+	{
+		if (!opt.Csv) printf("%-7s %-6s %-10s %6s\n", profile, res, mode, "n/a");
+		return;
+	}
+	if (opt.Csv)
+	{
+		printf("%s,%s,%s,%d,%.3f,%.3f,%.3f,%.3f\n", profile, res, mode, r.Chunks, r.FirstP50, r.FirstP95, r.LastP50, r.LastP95);
+	}
+	else {
+		printf("%-7s %-6s %-10s %6d | %9.3f %9.3f | %9.3f %9.3f\n", profile, res, mode, r.Chunks, r.FirstP50, r.FirstP95, r.LastP50, r.LastP95);
+	}
+	fflush(stdout);
+}
+
+static const int BENCH_STATIC_BAND = 32;
+
+/// Every frame rewrites a band of BENCH_STATIC_BAND lines a little further down the picture, so most slices repeat
+/// the previous frame and two or three change. With skip set, the bytes counted are those of the skip-slice frame
+/// (VMX_GetEncodedSkipSegments) whenever a slice repeats.
+static BenchResult BenchStatic(const BenchOptions& opt, VMX_SIZE sz, VMX_PROFILE profile, bool cache, bool skip)
+{
+	BenchResult result;
+	VMX_INSTANCE* instance = BenchCreate(opt, sz, profile, true);
+	if (!instance) instance = BenchCreate(opt, sz, profile, false);
+	if (!instance) return result;
+	VMX_SetSliceCache(instance, cache ? 1 : 0);
+
+	BenchImage src;
+	BenchPacked(sz, src, 2, 1);
+	BenchFillImage(src);
+	int maxLen = VMX_GetMaxEncodedLength(instance, 0);
+	std::vector<BYTE> encoded(maxLen);
+	std::vector<VMX_SEGMENT> segments(VMX_GetEncodedSegmentCount(instance));
+	std::vector<double> times;
+	double totalBytes = 0;
+	for (int i = 0; i < opt.Warmup + opt.Frames; i++)
+	{
+		int band = (i * 12) % std::max(1, sz.height - BENCH_STATIC_BAND);
+		BenchFill(src.Data + (size_t)band * src.Stride, src.Stride, BENCH_STATIC_BAND, i);
+		BenchClock::time_point start = BenchClock::now();
+		if (VMX_EncodeUYVY(instance, src.Data, src.Stride, 0) != VMX_ERR_OK) break;
+		int len = VMX_SaveTo(instance, encoded.data(), maxLen);
+		if (skip && VMX_GetRepeatedSliceCount(instance) > 0)
+		{
+			len = VMX_GetEncodedSkipSegments(instance, segments.data(), (int)segments.size());
+		}
+		double ms = BenchElapsedMs(start);
+		if (len <= 0) break;
+		if (i >= opt.Warmup)
+		{
+			times.push_back(ms);
+			totalBytes += len;
+		}
+	}
+	VMX_Destroy(instance);
+	if ((int)times.size() != opt.Frames) return result;
+	return BenchSummarize(times, totalBytes);
+}
+
+static void BenchPrintStaticHeader(const BenchOptions& opt)
+{
+	if (opt.Csv)
+	{
+		printf("profile,resolution,mode,mbps,fps,p50,p95,p99\n");
+	}
+	else {
+		printf("%-7s %-6s %-10s %8s | %8s %7s %7s %7s\n", "profile", "res", "mode", "Mbps", "fps", "p50", "p95", "p99");
+	}
+}
+
+static void BenchPrintStaticRow(const BenchOptions& opt, const char* profile, const char* res, const char* mode, const BenchResult& r)
+{
+	if (!r.Valid)
+	{
+		if (!opt.Csv) printf("%-7s %-6s %-10s %8s\n", profile, res, mode, "n/a");
+		return;
+	}
+	double mbps = r.AvgBytes * 8.0 * opt.Fps / 1000000.0;
+	if (opt.Csv)
+	{
+		printf("%s,%s,%s,%.2f,%.2f,%.3f,%.3f,%.3f\n", profile, res, mode, mbps, r.Fps, r.P50, r.P95, r.P99);
+	}
+	else {
+		printf("%-7s %-6s %-10s %8.1f | %8.1f %7.2f %7.2f %7.2f\n", profile, res, mode, mbps, r.Fps, r.P50, r.P95, r.P99);
+	}
+	fflush(stdout);
+}
+
+/// Decodes the same UYVY frame back to back through a VMX_PIPELINE of the given depth, into one destination per frame in flight.
+/// Fps is frames returned over the wall clock time, and the latencies are from VMX_SubmitPipelineFrame until the frame is returned.
+static BenchResult BenchPipeline(const BenchOptions& opt, VMX_SIZE sz, VMX_PROFILE profile, int depth)
+{
+	BenchResult result;
+	VMX_INSTANCE* encoder = BenchCreate(opt, sz, profile, true);
+	if (!encoder) encoder = BenchCreate(opt, sz, profile, false);
+	if (!encoder) return result;
+	BenchImage src;
+	BenchPacked(sz, src, 2, 1);
+	BenchFillImage(src);
+	int maxLen = VMX_GetMaxEncodedLength(encoder, 0);
+	std::vector<BYTE> encoded(maxLen);
+	VMX_EncodeUYVY(encoder, src.Data, src.Stride, 0);
+	int len = VMX_SaveTo(encoder, encoded.data(), maxLen);
+	VMX_Destroy(encoder);
+	if (len <= 0) return result;
+
+	VMX_PIPELINE* pipeline = VMX_CreatePipeline(sz, profile, VMX_COLORSPACE_UNDEFINED, depth, NULL);
+	if (!pipeline) return result;
+	std::vector<BenchImage> dst(depth);
+	for (BenchImage& d : dst) BenchPacked(sz, d, 2, 1);
+	std::vector<BenchClock::time_point> submitted(depth);
+
+	std::vector<double> times;
+	int total = opt.Warmup + opt.Frames;
+	int sent = 0;
+	int returned = 0;
+	bool timing = false;
+	BenchClock::time_point start;
+	while (returned < total)
+	{
+		if (!timing && returned == opt.Warmup)
+		{
+			start = BenchClock::now();
+			timing = true;
+		}
+		int slot = sent % depth;
+		if (sent < total && VMX_SubmitPipelineFrame(pipeline, encoded.data(), len, VMX_IMAGE_UYVY, dst[slot].Data, dst[slot].Stride, NULL, 0, NULL, 0, (void*)(intptr_t)slot) == VMX_ERR_OK)
+		{
+			submitted[slot] = BenchClock::now();
+			sent++;
+			continue;
+		}
+		void* userData = NULL;
+		if (!VMX_GetPipelineFrame(pipeline, 1, &userData)) break;
+		if (returned >= opt.Warmup) times.push_back(BenchElapsedMs(submitted[(intptr_t)userData]));
+		returned++;
+	}
+	double elapsed = BenchElapsedMs(start);
+	VMX_DestroyPipeline(pipeline);
+	if ((int)times.size() != opt.Frames) return result;
+	result = BenchSummarize(times, (double)len * opt.Frames);
+	result.Fps = elapsed > 0 ? opt.Frames / (elapsed / 1000.0) : 0;
+	return result;
+}
+
+/// Encodes one UYVY frame and reports the memory the encoder holds afterwards.
+static bool BenchMemory(const BenchOptions& opt, VMX_SIZE sz, VMX_PROFILE profile, bool lean, VMX_MEMORY_USAGE* usage)
+{
+	VMX_INSTANCE* instance = BenchCreate(opt, sz, profile, true);
+	if (!instance) instance = BenchCreate(opt, sz, profile, false);
+	if (!instance) return false;
+	VMX_SetLeanMemory(instance, lean ? 1 : 0);
+	BenchImage src;
+	BenchPacked(sz, src, 2, 1);
+	BenchFillImage(src);
+	bool ok = VMX_EncodeUYVY(instance, src.Data, src.Stride, 0) == VMX_ERR_OK && VMX_GetMemoryUsage(instance, usage) == VMX_ERR_OK;
+	VMX_Destroy(instance);
+	return ok;
+}
+
+static void BenchPrintMemoryHeader(const BenchOptions& opt)
+{
+	if (opt.Csv)
+	{
+		printf("profile,resolution,mode,planes,tiles,streams,other,total\n");
+	}
+	else {
+		printf("%-7s %-6s %-6s %9s %9s %9s %9s %9s  (MB)\n", "profile", "res", "mode", "planes", "tiles", "streams", "other", "total");
+	}
+}
+
+static void BenchPrintMemoryRow(const BenchOptions& opt, const char* profile, const char* res, const char* mode, bool valid, const VMX_MEMORY_USAGE& u)
+{
+	const double mb = 1.0 / (1024.0 * 1024.0);
+	if (!valid)
+	{
+		if (opt.Csv) printf("%s,%s,%s,,,,,\n", profile, res, mode);
+		else printf("%-7s %-6s %-6s %9s\n", profile, res, mode, "n/a");
+	}
+	else if (opt.Csv)
+	{
+		printf("%s,%s,%s,%lld,%lld,%lld,%lld,%lld\n", profile, res, mode, (long long)u.Planes, (long long)u.Tiles, (long long)u.Streams, (long long)u.Other, (long long)u.Total);
+	}
+	else {
+		printf("%-7s %-6s %-6s %9.2f %9.2f %9.2f %9.2f %9.2f\n", profile, res, mode, u.Planes * mb, u.Tiles * mb, u.Streams * mb, u.Other * mb, u.Total * mb);
+	}
+	fflush(stdout);
+}
+
+struct BenchQualityMode
+{
+	const char* Name;
+	int Flags; //0 for the legacy VMX_CalculatePSNR
+	int Sampling;
+};
+
+static const BenchQualityMode BENCH_QUALITY_MODES[] = {
+	{ "legacy_psnr", 0, 1 },
+	{ "psnr", VMX_METRICS_PSNR, 1 },
+	{ "psnr_ssim", VMX_METRICS_PSNR | VMX_METRICS_SSIM, 1 },
+	{ "ms_ssim", VMX_METRICS_PSNR | VMX_METRICS_SSIM | VMX_METRICS_MSSSIM, 1 },
+	{ "sampled_8", VMX_METRICS_PSNR | VMX_METRICS_SSIM, 8 },
+};
+
+/// Encodes and decodes one UYVY frame, then times one measurement of the decoded frame against the source per frame.
+static BenchResult BenchQuality(const BenchOptions& opt, VMX_SIZE sz, VMX_PROFILE profile, const BenchQualityMode& mode, bool avx2)
+{
+	BenchResult result;
+	VMX_INSTANCE* instance = BenchCreate(opt, sz, profile, avx2);
+	if (!instance) return result;
+	BenchImage src;
+	BenchImage dst;
+	BenchPacked(sz, src, 2, 1);
+	BenchPacked(sz, dst, 2, 1);
+	BenchFillImage(src);
+	int maxLen = VMX_GetMaxEncodedLength(instance, 0);
+	std::vector<BYTE> encoded(maxLen);
+	VMX_EncodeUYVY(instance, src.Data, src.Stride, 0);
+	int len = VMX_SaveTo(instance, encoded.data(), maxLen);
+	if (len <= 0 || VMX_LoadFromInPlace(instance, encoded.data(), len) != VMX_ERR_OK || VMX_DecodeUYVY(instance, dst.Data, dst.Stride) != VMX_ERR_OK)
+	{
+		VMX_Destroy(instance);
+		return result;
+	}
+
+	VMX_IMAGE reference = { src.Data, src.Stride, NULL, 0, NULL, 0 };
+	VMX_IMAGE image = { dst.Data, dst.Stride, NULL, 0, NULL, 0 };
+	VMX_METRICS metrics;
+	std::vector<double> times;
+	for (int i = 0; i < opt.Warmup + opt.Frames; i++)
+	{
+		BenchClock::time_point start = BenchClock::now();
+		if (mode.Flags) VMX_CalculateQuality(instance, VMX_IMAGE_UYVY, &reference, &image, mode.Flags, mode.Sampling, &metrics);
+		else VMX_CalculatePSNR(src.Data, dst.Data, src.Stride, 2, sz);
+		if (i >= opt.Warmup) times.push_back(BenchElapsedMs(start));
+	}
+	VMX_Destroy(instance);
+	return BenchSummarize(times, (double)len * opt.Frames);
+}
+
+/// Frame sizes whose rows end part way through the vectors of the converters, so that slices coded on different threads
+/// meet inside a vector. The packed rows of 1000x576 are exactly as long as the padded rows the converters work on.
+static const VMX_SIZE BENCH_DETERMINISM_SIZES[] = { { 1928, 1080 }, { 1936, 1088 }, { 1000, 576 } };
+
+/// Encodes the same frame on one thread and then repeatedly on several, and reports whether every stream is identical.
+/// Returns 1 if every run matches, 0 if any differs and -1 if the format cannot be encoded at this size.
+static int BenchDeterminism(const BenchOptions& opt, VMX_SIZE sz, VMX_PROFILE profile, const BenchFormat& fmt, int interlaced)
+{
+	BenchImage src;
+	fmt.Alloc(sz, src);
+	BenchFillImage(src);
+	src.Interlaced = interlaced;
+	std::vector<BYTE> reference;
+	for (int i = 0; i <= opt.Frames; i++)
+	{
+		VMX_INSTANCE* instance = BenchCreate(opt, sz, profile, true);
+		if (!instance) instance = BenchCreate(opt, sz, profile, false);
+		if (!instance) return -1;
+		VMX_SetThreads(instance, i == 0 ? 1 : (opt.Threads > 1 ? opt.Threads : 4));
+		int maxLen = VMX_GetMaxEncodedLength(instance, 0);
+		std::vector<BYTE> encoded(maxLen);
+		int len = 0;
+		if (fmt.Encode(instance, src) == VMX_ERR_OK) len = VMX_SaveTo(instance, encoded.data(), maxLen);
+		VMX_Destroy(instance);
+		if (len <= 0) return -1;
+		encoded.resize(len);
+		if (i == 0) reference = encoded;
+		else if (encoded != reference) return 0;
+	}
+	return 1;
+}
+
+static void BenchPrintDeterminismRow(const BenchOptions& opt, const char* profile, VMX_SIZE sz, const char* format, const char* scan, int result)
+{
+	const char* text = result < 0 ? "n/a" : (result ? "PASS" : "FAIL");
+	if (opt.Csv) printf("%s,%dx%d,%s,%s,%s\n", profile, sz.width, sz.height, format, scan, text);
+	else printf("%-7s %-9s %-12s %-11s %s\n", profile, (std::to_string(sz.width) + "x" + std::to_string(sz.height)).c_str(), format, scan, text);
+	fflush(stdout);
+}
+
+static bool BenchSelected(const std::vector<std::string>& filter, const char* name)
+{
+	if (filter.empty()) return true;
+	return std::find(filter.begin(), filter.end(), name) != filter.end();
+}
+
+static std::vector<std::string> BenchSplit(const char* s)
+{
+	std::vector<std::string> out;
+	std::string cur;
+	for (; *s; s++)
+	{
+		if (*s == ',')
+		{
+			if (!cur.empty()) out.push_back(cur);
+			cur.clear();
+		}
+		else {
+			cur += *s;
+		}
+	}
+	if (!cur.empty()) out.push_back(cur);
+	return out;
+}
+
+static void BenchPrintHeader(const BenchOptions& opt)
+{
+	if (opt.Csv)
+	{
+		printf("profile,resolution,format,direction,mbps,fps_128,p50_128,p95_128,p99_128,fps_256,p50_256,p95_256,p99_256,speedup\n");
+	}
+	else {
+		printf("%-7s %-6s %-12s %-6s %8s | %8s %7s %7s %7s | %8s %7s %7s %7s | %6s\n",
+			"profile", "res", "format", "dir", "Mbps", "fps128", "p50", "p95", "p99", "fps256", "p50", "p95", "p99", "x");
+	}
+}
+
+static void BenchPrintRow(const BenchOptions& opt, const char* profile, const char* res, const char* format, const char* dir, const BenchResult& r128, const BenchResult& r256)
+{
+	const BenchResult& any = r256.Valid ? r256 : r128;
+	double mbps = any.AvgBytes * 8.0 * opt.Fps / 1000000.0;
+	double speedup = (r128.Valid && r256.Valid && r128.Fps > 0) ? r256.Fps / r128.Fps : 0;
+	if (opt.Csv)
+	{
+		printf("%s,%s,%s,%s,%.2f,", profile, res, format, dir, mbps);
+		if (r128.Valid) printf("%.2f,%.3f,%.3f,%.3f,", r128.Fps, r128.P50, r128.P95, r128.P99); else printf(",,,,");
+		if (r256.Valid) printf("%.2f,%.3f,%.3f,%.3f,", r256.Fps, r256.P50, r256.P95, r256.P99); else printf(",,,,");
+		if (speedup > 0) printf("%.2f\n", speedup); else printf("\n");
+	}
+	else {
+		printf("%-7s %-6s %-12s %-6s %8.1f | ", profile, res, format, dir, mbps);
+		if (r128.Valid) printf("%8.1f %7.2f %7.2f %7.2f | ", r128.Fps, r128.P50, r128.P95, r128.P99);
+		else printf("%8s %7s %7s %7s | ", "n/a", "", "", "");
+		if (r256.Valid) printf("%8.1f %7.2f %7.2f %7.2f | ", r256.Fps, r256.P50, r256.P95, r256.P99);
+		else printf("%8s %7s %7s %7s | ", "n/a", "", "", "");
+		if (speedup > 0) printf("%6.2f\n", speedup); else printf("%6s\n", "");
+	}
+	fflush(stdout);
+}
+
+static void BenchUsage()
+{
+	printf("Usage: vmx_bench [options]\n");
+	printf("  --frames n     Measured frames per case (default 20)\n");
+	printf("  --warmup n     Unmeasured frames per case (default 3)\n");
+	printf("  --fps n        Frame rate used to express the encoded size as Mbps (default 60)\n");
+	printf("  --threads n    Override the per-profile thread count\n");
+	printf("  --scene n      Frames per scene of the rate control sequence (default 12)\n");
+	printf("  --chunk n      Slices per chunk of the latency direction (default 8)\n");
+	printf("  --lean         Run on lean instances (VMX_SetLeanMemory)\n");
+	printf("  --chroma420    Code chroma as 4:2:0 (VMX_SetChroma420)\n");
+	printf("  --memory-policy n  VMX_MEMORY_POLICY flags: 1 NUMA, 2 transparent huge pages, 4 explicit huge pages\n");
+	printf("  --profile list Comma separated subset of LQ,SQ,HQ,OMT_LQ,OMT_SQ,OMT_HQ\n");
+	printf("  --res list     Comma separated subset of 480p,576p,720p,1080p,1440p,2160p,4320p\n");
+	printf("  --format list  Comma separated subset of image formats, e.g. UYVY,NV12,BGRA\n");
+	printf("  --dir list     Comma separated subset of encode,decode,rate,latency,static,pipeline,memory,quality,determinism (default encode,decode)\n");
+	printf("  --csv          Machine readable output\n");
+	printf("Latencies are per frame in milliseconds. n/a means the path is unavailable on this CPU or frame width.\n");
+}
+
+int main(int argc, char** argv)
+{
+	BenchOptions opt;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (a == "--frames" && hasValue) opt.Frames = std::max(1, atoi(argv[++i]));
+		else if (a == "--warmup" && hasValue) opt.Warmup = std::max(0, atoi(argv[++i]));
+		else if (a == "--fps" && hasValue) opt.Fps = std::max(1, atoi(argv[++i]));
+		else if (a == "--threads" && hasValue) opt.Threads = atoi(argv[++i]);
+		else if (a == "--scene" && hasValue) opt.SceneFrames = std::max(1, atoi(argv[++i]));
+		else if (a == "--chunk" && hasValue) opt.ChunkSlices = std::max(1, atoi(argv[++i]));
+		else if (a == "--profile" && hasValue) opt.Profiles = BenchSplit(argv[++i]);
+		else if (a == "--res" && hasValue) opt.Resolutions = BenchSplit(argv[++i]);
+		else if (a == "--format" && hasValue) opt.Formats = BenchSplit(argv[++i]);
+		else if (a == "--dir" && hasValue) opt.Directions = BenchSplit(argv[++i]);
+		else if (a == "--memory-policy" && hasValue) opt.MemoryPolicy = atoi(argv[++i]);
+		else if (a == "--lean") opt.Lean = true;
+		else if (a == "--chroma420") opt.Chroma420 = true;
+		else if (a == "--csv") opt.Csv = true;
+		else {
+			BenchUsage();
+			return a == "--help" || a == "-h" ? 0 : 1;
+		}
+	}
+
+	std::vector<BenchFormat> formats = BenchFormats();
+	if (!opt.Directions.empty() && BenchSelected(opt.Directions, "rate"))
+	{
+		BenchPrintRateHeader(opt);
+		for (const BenchProfile& p : BENCH_PROFILES)
+		{
+			if (!BenchSelected(opt.Profiles, p.Name)) continue;
+			for (const BenchResolution& r : BENCH_RESOLUTIONS)
+			{
+				if (!BenchSelected(opt.Resolutions, r.Name)) continue;
+				BenchPrintRateRow(opt, p.Name, r.Name, "reactive", BenchRate(opt, r.Size, p.Profile, VMX_RATE_CONTROL_REACTIVE));
+				BenchPrintRateRow(opt, p.Name, r.Name, "predictive", BenchRate(opt, r.Size, p.Profile, VMX_RATE_CONTROL_PREDICTIVE));
+			}
+		}
+		printf("\n");
+	}
+	if (!opt.Directions.empty() && BenchSelected(opt.Directions, "latency"))
+	{
+		BenchPrintLatencyHeader(opt);
+		for (const BenchProfile& p : BENCH_PROFILES)
+		{
+			if (!BenchSelected(opt.Profiles, p.Name)) continue;
+			for (const BenchResolution& r : BENCH_RESOLUTIONS)
+			{
+				if (!BenchSelected(opt.Resolutions, r.Name)) continue;
+				BenchPrintLatencyRow(opt, p.Name, r.Name, "frame", BenchChunkLatency(opt, r.Size, p.Profile, 0));
+				BenchPrintLatencyRow(opt, p.Name, r.Name, "chunked", BenchChunkLatency(opt, r.Size, p.Profile, opt.ChunkSlices));
+			}
+		}
+		printf("\n");
+	}
+	if (!opt.Directions.empty() && BenchSelected(opt.Directions, "static"))
+	{
+		BenchPrintStaticHeader(opt);
+		for (const BenchProfile& p : BENCH_PROFILES)
+		{
+			if (!BenchSelected(opt.Profiles, p.Name)) continue;
+			for (const BenchResolution& r : BENCH_RESOLUTIONS)
+			{
+				if (!BenchSelected(opt.Resolutions, r.Name)) continue;
+				BenchPrintStaticRow(opt, p.Name, r.Name, "full", BenchStatic(opt, r.Size, p.Profile, false, false));
+				BenchPrintStaticRow(opt, p.Name, r.Name, "cached", BenchStatic(opt, r.Size, p.Profile, true, false));
+				BenchPrintStaticRow(opt, p.Name, r.Name, "skip", BenchStatic(opt, r.Size, p.Profile, true, true));
+			}
+		}
+		printf("\n");
+	}
+	if (!opt.Directions.empty() && BenchSelected(opt.Directions, "pipeline"))
+	{
+		BenchPrintStaticHeader(opt);
+		for (const BenchProfile& p : BENCH_PROFILES)
+		{
+			if (!BenchSelected(opt.Profiles, p.Name)) continue;
+			for (const BenchResolution& r : BENCH_RESOLUTIONS)
+			{
+				if (!BenchSelected(opt.Resolutions, r.Name)) continue;
+				BenchPrintStaticRow(opt, p.Name, r.Name, "depth1", BenchPipeline(opt, r.Size, p.Profile, 1));
+				BenchPrintStaticRow(opt, p.Name, r.Name, "depth2", BenchPipeline(opt, r.Size, p.Profile, 2));
+				BenchPrintStaticRow(opt, p.Name, r.Name, "depth4", BenchPipeline(opt, r.Size, p.Profile, 4));
+				BenchPrintStaticRow(opt, p.Name, r.Name, "depth8", BenchPipeline(opt, r.Size, p.Profile, 8));
+			}
+		}
+		printf("\n");
+	}
+	if (!opt.Directions.empty() && BenchSelected(opt.Directions, "memory"))
+	{
+		BenchPrintMemoryHeader(opt);
+		for (const BenchProfile& p : BENCH_PROFILES)
+		{
+			if (!BenchSelected(opt.Profiles, p.Name)) continue;
+			for (const BenchResolution& r : BENCH_RESOLUTIONS)
+			{
+				if (!BenchSelected(opt.Resolutions, r.Name)) continue;
+				VMX_MEMORY_USAGE usage = {};
+				bool valid = BenchMemory(opt, r.Size, p.Profile, false, &usage);
+				BenchPrintMemoryRow(opt, p.Name, r.Name, "full", valid, usage);
+				valid = BenchMemory(opt, r.Size, p.Profile, true, &usage);
+				BenchPrintMemoryRow(opt, p.Name, r.Name, "lean", valid, usage);
+			}
+		}
+		printf("\n");
+	}
+	if (!opt.Directions.empty() && BenchSelected(opt.Directions, "quality"))
+	{
+		BenchPrintHeader(opt);
+		for (const BenchProfile& p : BENCH_PROFILES)
+		{
+			if (!BenchSelected(opt.Profiles, p.Name)) continue;
+			for (const BenchResolution& r : BENCH_RESOLUTIONS)
+			{
+				if (!BenchSelected(opt.Resolutions, r.Name)) continue;
+				for (const BenchQualityMode& m : BENCH_QUALITY_MODES)
+				{
+					BenchPrintRow(opt, p.Name, r.Name, m.Name, "quality", BenchQuality(opt, r.Size, p.Profile, m, false), BenchQuality(opt, r.Size, p.Profile, m, true));
+				}
+			}
+		}
+		printf("\n");
+	}
+	bool deterministic = true;
+	if (!opt.Directions.empty() && BenchSelected(opt.Directions, "determinism"))
+	{
+		if (opt.Csv) printf("profile,size,format,scan,result\n");
+		else printf("%-7s %-9s %-12s %-11s %s\n", "profile", "size", "format", "scan", "result");
+		for (const BenchProfile& p : BENCH_PROFILES)
+		{
+			if (!BenchSelected(opt.Profiles, p.Name)) continue;
+			for (const VMX_SIZE& sz : BENCH_DETERMINISM_SIZES)
+			{
+				for (const BenchFormat& f : formats)
+				{
+					if (!f.Encode || !BenchSelected(opt.Formats, f.Name)) continue;
+					for (int interlaced = 0; interlaced < 2; interlaced++)
+					{
+						int result = BenchDeterminism(opt, sz, p.Profile, f, interlaced);
+						if (result == 0) deterministic = false;
+						BenchPrintDeterminismRow(opt, p.Name, sz, f.Name, interlaced ? "interlaced" : "progressive", result);
+					}
+				}
+			}
+		}
+		printf("\n");
+	}
+	if (!opt.Directions.empty() && !BenchSelected(opt.Directions, "encode") && !BenchSelected(opt.Directions, "decode")) return deterministic ? 0 : 1;
+	BenchPrintHeader(opt);
+	for (const BenchProfile& p : BENCH_PROFILES)
+	{
+		if (!BenchSelected(opt.Profiles, p.Name)) continue;
+		for (const BenchResolution& r : BENCH_RESOLUTIONS)
+		{
+			if (!BenchSelected(opt.Resolutions, r.Name)) continue;
+			for (const BenchFormat& f : formats)
+			{
+				if (!BenchSelected(opt.Formats, f.Name)) continue;
+				if (f.Encode && BenchSelected(opt.Directions, "encode"))
+				{
+					BenchResult r128 = BenchEncode(opt, r.Size, p.Profile, f, false);
+					BenchResult r256 = BenchEncode(opt, r.Size, p.Profile, f, true);
+					BenchPrintRow(opt, p.Name, r.Name, f.Name, "encode", r128, r256);
+				}
+				if (f.Decode && BenchSelected(opt.Directions, "decode"))
+				{
+					BenchResult r128 = BenchDecode(opt, r.Size, p.Profile, f, false);
+					BenchResult r256 = BenchDecode(opt, r.Size, p.Profile, f, true);
+					BenchPrintRow(opt, p.Name, r.Name, f.Name, "decode", r128, r256);
+				}
+			}
+		}
+	}
+	return deterministic ? 0 : 1;
+}
@@ -25,67 +25,381 @@
 
 #pragma once
 #include <thread>
-#include <queue>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
-#include <functional>
+#include <cstdio>
+#include <cstring>
+#if defined(__linux__)
+#include <sched.h>
+#include <pthread.h>
+#endif
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#define THREAD_TASKS_PAUSE() _mm_pause()
+#elif defined(_MSC_VER)
+#define THREAD_TASKS_PAUSE() __yield()
+#elif defined(__aarch64__)
+#define THREAD_TASKS_PAUSE() __asm__ __volatile__("yield")
+#else
+#define THREAD_TASKS_PAUSE()
+#endif
 
-struct ThreadTask
+//Iterations a thread busy waits before parking on a condition variable.
+//Frames arrive back to back, so the next job or the last straggler is usually only microseconds away.
+const int THREAD_TASKS_SPIN = 4096;
+
+//Most NUMA nodes a job is split across. Larger machines have their nodes folded onto these.
+const int THREAD_TASKS_MAX_NODES = 8;
+
+//NUMA nodes of the machine and the CPUs of each, read once from sysfs.
+//Machines with a single node, and platforms other than Linux, report one node holding every CPU.
+struct ThreadTasksTopology
 {
-	std::thread thread;
-	std::queue<std::function<void()>> queue;
-	std::mutex mtx;
-	std::condition_variable cv;
-	std::condition_variable complete;
-	bool running = false;
+	int nodes;
+#if defined(__linux__)
+	int cpuNode[CPU_SETSIZE];
+	cpu_set_t nodeCpus[THREAD_TASKS_MAX_NODES];
 
-	void Join()
+	//Parses a sysfs cpu list such as "0-15,32-47"
+	void AddCpus(int node, const char* list)
 	{
-		std::unique_lock<std::mutex> lock(mtx);
-		if (queue.size() > 0)
+		while (*list)
 		{
-			complete.wait(lock);
+			int first = 0;
+			int last = 0;
+			int used = 0;
+			if (sscanf(list, "%d%n", &first, &used) != 1) break;
+			list += used;
+			last = first;
+			if (*list == '-')
+			{
+				if (sscanf(list + 1, "%d%n", &last, &used) != 1) break;
+				list += used + 1;
+			}
+			for (int c = first; c <= last && c < CPU_SETSIZE; c++)
+			{
+				if (c < 0) continue;
+				CPU_SET(c, &nodeCpus[node]);
+				cpuNode[c] = node;
+			}
+			if (*list != ',') break;
+			list++;
 		}
 	}
+#endif
 
-	void TaskLoop()
+	ThreadTasksTopology()
 	{
-		while (running)
-		{			
-			std::unique_lock<std::mutex> lock(mtx);
-			if (queue.size() == 0)
+		nodes = 1;
+#if defined(__linux__)
+		memset(cpuNode, 0, sizeof(cpuNode));
+		for (int n = 0; n < THREAD_TASKS_MAX_NODES; n++) CPU_ZERO(&nodeCpus[n]);
+		int found = 0;
+		//Node ids can have gaps, so they are numbered in the order found
+		for (int id = 0; id < 1024; id++)
+		{
+			char path[64];
+			snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", id);
+			FILE* f = fopen(path, "r");
+			if (!f) continue;
+			char list[4096];
+			if (fgets(list, sizeof(list), f) && list[0] >= '0' && list[0] <= '9')
 			{
-				complete.notify_all();
-				cv.wait(lock);
+				AddCpus(found % THREAD_TASKS_MAX_NODES, list);
+				found++;
 			}
-			if (!running) break;
-			std::function<void()> func = NULL;
-			if (queue.size() > 0)
+			fclose(f);
+		}
+		if (found > THREAD_TASKS_MAX_NODES) found = THREAD_TASKS_MAX_NODES;
+		if (found > 1) nodes = found;
+#endif
+	}
+
+	static const ThreadTasksTopology& Get()
+	{
+		static ThreadTasksTopology topology;
+		return topology;
+	}
+
+	//Node of the CPU the calling thread is running on
+	int CurrentNode() const
+	{
+		if (nodes == 1) return 0;
+#if defined(__linux__)
+		int cpu = sched_getcpu();
+		if (cpu >= 0 && cpu < CPU_SETSIZE) return cpuNode[cpu];
+#endif
+		return 0;
+	}
+
+	//Restricts a thread to the CPUs of a node
+	void Pin(std::thread& thread, int node) const
+	{
+#if defined(__linux__)
+		if (nodes > 1) pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &nodeCpus[node % nodes]);
+#else
+		(void)thread;
+		(void)node;
+#endif
+	}
+};
+
+//Processes items [start, start + count) of a job
+typedef void (*ThreadTaskFunc)(void* context, int start, int count);
+
+//Items [next, end) of a job not handed out yet. A job split across NUMA nodes has one range per node, on its own cache line
+//so the nodes do not contend for the counters.
+struct alignas(64) ThreadTaskRange
+{
+	std::atomic<int> next;
+	int end;
+};
+
+//A unit of slice parallel work, owned by the submitter so that submitting allocates nothing
+struct ThreadTaskJob
+{
+	ThreadTaskFunc func;
+	void* context;
+	int total;
+	int batch;
+	int maxThreads; //Cap on threads working on this job at once, including the submitting thread
+	int ranges; //NUMA nodes the items are split across, 1 for a job any thread takes in order
+	ThreadTaskRange range[THREAD_TASKS_MAX_NODES];
+	std::atomic<int> active; //Threads currently working on this job, only incremented under the pool mutex
+	std::atomic<int> done; //Items processed
+	int queued; //Job was handed to the pool's workers rather than run entirely by the submitter
+	ThreadTaskJob* nextJob; //Pool's list of jobs with work outstanding
+
+	bool HasItems()
+	{
+		for (int r = 0; r < ranges; r++)
+		{
+			if (range[r].next.load(std::memory_order_relaxed) < range[r].end) return true;
+		}
+		return false;
+	}
+};
+
+//Fork/join pool for slice parallel work, either private to one instance or shared by many.
+//Items are handed out in small batches from an atomic counter, so a slow slice or a preempted core only delays the batch it is working on.
+//The submitting thread works on its own job as well unless it is submitted in the background. With several jobs queued, workers move to the next job round robin
+//after every batch so each instance gets a fair share of the pool.
+//A job split across NUMA nodes gives each node a contiguous range of its items. Threads take from the range of the node they are running on first,
+//and only then help with the others, so slices are coded on the node that first touched their memory unless that node falls behind.
+struct ThreadTasks
+{
+	int numWorkers;
+	int pinned; //Workers are restricted to the CPUs of one node each, round robin
+	std::thread* threads;
+
+	std::mutex mtx;
+	std::condition_variable cv; //Workers park here while there is nothing to join
+	std::condition_variable complete; //Submitters park here waiting for stragglers
+	bool running;
+	std::atomic<int> references; //Instances using a shared pool plus the creator, the pool is destroyed when this reaches 0
+
+	ThreadTaskJob* jobs; //Protected by mtx
+	ThreadTaskJob* cursor; //Last job a worker joined, for round robin
+	std::atomic<int> jobCount;
+	std::atomic<unsigned int> generation; //Incremented whenever a job is submitted
+
+	//Returns the number of items processed
+	int RunBatches(ThreadTaskJob* job, bool yield)
+	{
+		int processed = 0;
+		int first = job->ranges > 1 ? ThreadTasksTopology::Get().CurrentNode() % job->ranges : 0;
+		for (int r = 0; r < job->ranges; r++)
+		{
+			ThreadTaskRange* range = &job->range[(first + r) % job->ranges];
+			while (true)
 			{
-				func = queue.front();
-				queue.pop();
+				int start = range->next.fetch_add(job->batch, std::memory_order_relaxed);
+				if (start >= range->end) break;
+				int count = range->end - start;
+				if (count > job->batch) count = job->batch;
+				job->func(job->context, start, count);
+				processed += count;
+				if (yield && jobCount.load(std::memory_order_relaxed) > 1) return processed;
 			}
-			if (func)
+		}
+		return processed;
+	}
+
+	void Leave(ThreadTaskJob* job, int processed)
+	{
+		job->done.fetch_add(processed, std::memory_order_release);
+		if (job->active.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			complete.notify_all();
+		}
+	}
+
+	//Must be called with mtx held
+	ThreadTaskJob* PickJob()
+	{
+		ThreadTaskJob* start = (cursor && cursor->nextJob) ? cursor->nextJob : jobs;
+		ThreadTaskJob* j = start;
+		while (j)
+		{
+			if (j->HasItems() && j->active.load(std::memory_order_relaxed) < j->maxThreads)
 			{
-				func();
+				j->active.fetch_add(1, std::memory_order_relaxed);
+				cursor = j;
+				return j;
 			}
-
+			j = j->nextJob ? j->nextJob : jobs;
+			if (j == start) break;
 		}
+		return NULL;
 	}
-	void Initialize()
+
+	void TaskLoop()
 	{
-		running = true;
-		queue = std::queue<std::function<void()>>();
-		thread = std::thread(&ThreadTask::TaskLoop, this);
+		std::unique_lock<std::mutex> lock(mtx);
+		while (running)
+		{
+			ThreadTaskJob* job = PickJob();
+			if (!job)
+			{
+				unsigned int g = generation.load(std::memory_order_acquire);
+				lock.unlock();
+				for (int i = 0; i < THREAD_TASKS_SPIN && generation.load(std::memory_order_acquire) == g; i++)
+				{
+					THREAD_TASKS_PAUSE();
+				}
+				lock.lock();
+				cv.wait(lock, [&] { return generation.load(std::memory_order_acquire) != g || !running; });
+				continue;
+			}
+			lock.unlock();
+			Leave(job, RunBatches(job, true));
+			lock.lock();
+		}
 	}
-	void Push(std::function<void()> task)
+
+	//Queues a job. With participate the submitting thread must follow with Finish to work on it,
+	//otherwise the job runs on the pool's workers only (or right here if the pool has none) and Finish just waits for it.
+	//nodes > 1 splits the items into that many contiguous ranges, the first for node 0 and so on, see ThreadTasksTopology.
+	void Submit(ThreadTaskJob* job, ThreadTaskFunc f, void* ctx, int count, int maxThreads, bool participate, int nodes = 1)
 	{
+		job->func = f;
+		job->context = ctx;
+		job->total = count;
+		if (maxThreads < 1) maxThreads = 1;
+		job->maxThreads = maxThreads;
+		//Around four batches per thread, enough to even out uneven slices without contending on the counter
+		job->batch = count / (maxThreads * 4);
+		if (job->batch < 1) job->batch = 1;
+		if (nodes < 1) nodes = 1;
+		if (nodes > THREAD_TASKS_MAX_NODES) nodes = THREAD_TASKS_MAX_NODES;
+		job->ranges = nodes;
+		for (int r = 0; r < nodes; r++)
+		{
+			job->range[r].next.store((int)(((int64_t)count * r) / nodes), std::memory_order_relaxed);
+			job->range[r].end = (int)(((int64_t)count * (r + 1)) / nodes);
+		}
+		job->done.store(0, std::memory_order_relaxed);
+		job->active.store(participate ? 1 : 0, std::memory_order_relaxed);
+		job->nextJob = NULL;
+		job->queued = 0;
+		if (numWorkers == 0 || (participate && maxThreads == 1))
+		{
+			if (!participate)
+			{
+				f(ctx, 0, count);
+				for (int r = 0; r < nodes; r++) job->range[r].next.store(job->range[r].end, std::memory_order_relaxed);
+				job->done.store(count, std::memory_order_relaxed);
+			}
+			return;
+		}
+		job->queued = 1;
 		{
 			std::lock_guard<std::mutex> lock(mtx);
-			queue.push(task);
+			job->nextJob = jobs;
+			jobs = job;
+			jobCount.fetch_add(1, std::memory_order_relaxed);
+			generation.fetch_add(1, std::memory_order_release);
 		}
 		cv.notify_all();
 	}
+
+	//Works on a job submitted without participate from a thread that is about to wait for it anyway, as one of its maxThreads.
+	//Returns at once if every item is already handed out, or the job has all the threads it may use.
+	void Join(ThreadTaskJob* job)
+	{
+		if (!job->queued) return;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			if (!job->HasItems() || job->active.load(std::memory_order_relaxed) >= job->maxThreads) return;
+			job->active.fetch_add(1, std::memory_order_relaxed);
+		}
+		Leave(job, RunBatches(job, false));
+	}
+
+	//Works on the job from the submitting thread if it participates, then waits for every other thread to finish with it
+	void Finish(ThreadTaskJob* job, bool participate)
+	{
+		if (participate)
+		{
+			int processed = RunBatches(job, false);
+			job->done.fetch_add(processed, std::memory_order_release);
+			job->active.fetch_sub(1, std::memory_order_acq_rel);
+		}
+		if (!job->queued) return;
+
+		for (int i = 0; i < THREAD_TASKS_SPIN && !IsComplete(job); i++)
+		{
+			THREAD_TASKS_PAUSE();
+		}
+		std::unique_lock<std::mutex> lock(mtx);
+		complete.wait(lock, [&] { return IsComplete(job); });
+		//Nothing can join once every range is handed out, so it is now safe to unlink the job
+		ThreadTaskJob** p = &jobs;
+		while (*p != job) p = &(*p)->nextJob;
+		*p = job->nextJob;
+		if (cursor == job) cursor = NULL;
+		jobCount.fetch_sub(1, std::memory_order_relaxed);
+		job->queued = 0;
+	}
+
+	bool IsComplete(ThreadTaskJob* job)
+	{
+		return job->active.load(std::memory_order_acquire) == 0 && job->done.load(std::memory_order_acquire) == job->total;
+	}
+
+	//Runs func over [0, count) on up to maxThreads threads including the caller, and returns once every item has been processed
+	void Run(ThreadTaskFunc f, void* ctx, int count, int maxThreads, int nodes = 1)
+	{
+		ThreadTaskJob job;
+		Submit(&job, f, ctx, count, maxThreads, true, nodes);
+		Finish(&job, true);
+	}
+
+	void Initialize(int workers, bool pin = false)
+	{
+		numWorkers = workers > 0 ? workers : 0;
+		running = true;
+		references = 1;
+		jobs = NULL;
+		cursor = NULL;
+		jobCount = 0;
+		generation = 0;
+		threads = new std::thread[numWorkers > 0 ? numWorkers : 1];
+		for (int i = 0; i < numWorkers; i++)
+		{
+			threads[i] = std::thread(&ThreadTasks::TaskLoop, this);
+		}
+		//Spread across the nodes so that every node has workers to take its own range of a split job
+		const ThreadTasksTopology& topology = ThreadTasksTopology::Get();
+		pinned = (pin && topology.nodes > 1) ? 1 : 0;
+		for (int i = 0; pinned && i < numWorkers; i++)
+		{
+			topology.Pin(threads[i], i);
+		}
+	}
+
 	void Destroy()
 	{
 		{
@@ -93,41 +407,30 @@ struct ThreadTask
 			running = false;
 		}
 		cv.notify_all();
-		thread.join();
+		for (int i = 0; i < numWorkers; i++)
+		{
+			threads[i].join();
+		}
+		delete[] threads;
 	}
 };
 
-struct ThreadTasks
-{
-	int numThreads;
-	ThreadTask** tasks;
-};
-
-static ThreadTasks* CreateTasks(int numThreads)
+//Private pool for a single instance. The calling thread is one of the numThreads, so only numThreads - 1 workers are started.
+//With pin the workers are bound to NUMA nodes round robin.
+inline ThreadTasks* CreateTasks(int numThreads, bool pin = false)
 {
 	ThreadTasks* th = new ThreadTasks();
-	th->numThreads = numThreads;
-	th->tasks = new ThreadTask*[numThreads];
-	for (int i = 0; i < numThreads; i++)
-	{
-		ThreadTask* task = new ThreadTask();
-		th->tasks[i] = task;
-		task->Initialize();
-	}
+	th->Initialize(numThreads - 1, pin);
 	return th;
 }
 
-static void DestroyTasks(ThreadTasks* tasks)
+//Shared pools are reference counted, so this only stops the workers once the last user has released it
+inline void DestroyTasks(ThreadTasks* tasks)
 {
 	if (tasks)
 	{
-		for (int i = 0; i < tasks->numThreads; i++)
-		{
-			tasks->tasks[i]->Destroy();
-			ThreadTask* task = tasks->tasks[i];
-			delete task;
-		}
+		if (tasks->references.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+		tasks->Destroy();
 		delete tasks;
 	}
 }
-
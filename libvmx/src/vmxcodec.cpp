@@ -28,6 +28,10 @@
 #include <chrono>
 #include <iostream>
 #include <fstream>
+#include <climits>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 
 #if defined(X64)
 #include "vmxcodec_x86.h"
@@ -41,6 +45,108 @@
 
 using namespace std;
 
+static constexpr int flss(unsigned short val)
+{
+	int bit = 16;
+	if (val == 0) return 0;
+	if ((val & 0xff00) == 0) {
+		bit -= 8;
+		val <<= 8;
+	}
+	if ((val & 0xF000) == 0) {
+		bit -= 4;
+		val <<= 4;
+	}
+	if ((val & 0xC000) == 0) {
+		bit -= 2;
+		val <<= 2;
+	}
+	if ((val & 0x8000) == 0) {
+		bit -= 1;
+		val <<= 1;
+	}
+	return bit;
+}
+static constexpr void createReciprocal(unsigned short divisor, unsigned short* dst)
+{
+	if (divisor == 1)
+	{
+		dst[0] = 0;
+		dst[1] = 1;
+		dst[2] = 1;
+	}
+	int b = flss(divisor) - 1;
+	int r = 2 * 8 + b;
+	uint32_t fq = (1 << r) / divisor;
+	uint32_t fr = (1 << r) % divisor;
+	uint16_t c = divisor / 2;
+	if (fr == 0)
+	{
+		fq >>= 1;
+		r -= 1;
+	}
+	else if (fr <= (divisor / 2U))
+	{
+		c += 1;
+	}
+	else {
+		fq += 1;
+	}
+	uint16_t s = (1 << (2 * 8 * 2 - r));
+	dst[0] = c;
+	dst[1] = fq;
+	dst[2] = s;
+}
+
+//Quantisation matrix of every quality preset and the reciprocals the encoder multiplies by, also with each row of 8 repeated for the 256bit path.
+//The same for every instance, so they are built by the compiler and shared.
+struct VMX_QUALITY_TABLES
+{
+	alignas(32) unsigned short Decode[VMX_QUALITY_COUNT][VMX_DECODE_MATRIX_COUNT];
+	alignas(32) unsigned short Encode[VMX_QUALITY_COUNT][VMX_ENCODE_MATRIX_COUNT];
+	alignas(32) unsigned short Decode256[VMX_QUALITY_COUNT][VMX_DECODE_MATRIX_COUNT * 2];
+	alignas(32) unsigned short Encode256[VMX_QUALITY_COUNT][VMX_ENCODE_MATRIX_COUNT * 2];
+};
+
+static constexpr VMX_QUALITY_TABLES VMX_CreateQualityTables()
+{
+	VMX_QUALITY_TABLES t = {};
+	for (int i = 0; i < VMX_QUALITY_COUNT; i++)
+	{
+		for (int y = 0; y < VMX_DECODE_MATRIX_COUNT; y++)
+		{
+			if (y == 0)
+			{
+				t.Decode[i][0] = VMX_DEFAULT_QUANTIZATION_MATRIX[0];
+			}
+			else {
+				t.Decode[i][y] = VMX_DEFAULT_QUANTIZATION_MATRIX[y] * VMX_QUALITY[i];
+			}
+			unsigned short rc[3] = { 0, 0, 0 };
+			createReciprocal(t.Decode[i][y], &rc[0]);
+			t.Encode[i][y] = rc[0];
+			t.Encode[i][y + 64] = rc[1];
+			t.Encode[i][y + 128] = rc[2];
+		}
+		for (int y = 0; y < VMX_DECODE_MATRIX_COUNT; y += 8)
+		{
+			for (int k = 0; k < 8; k++)
+			{
+				t.Decode256[i][(y * 2) + k] = t.Decode[i][y + k];
+				t.Decode256[i][(y * 2) + 8 + k] = t.Decode[i][y + k];
+				for (int m = 0; m < 3; m++)
+				{
+					t.Encode256[i][(y * 2) + (m * 128) + k] = t.Encode[i][y + (m * 64) + k];
+					t.Encode256[i][(y * 2) + (m * 128) + 8 + k] = t.Encode[i][y + (m * 64) + k];
+				}
+			}
+		}
+	}
+	return t;
+}
+
+static constexpr VMX_QUALITY_TABLES VMX_QUALITY_PRESETS = VMX_CreateQualityTables();
+
 static inline void VMX_SetQualityInternal(VMX_INSTANCE* instance, int q) 
 {
 	int index = 0;
@@ -53,10 +159,10 @@ static inline void VMX_SetQualityInternal(VMX_INSTANCE* instance, int q)
 		}
 	}
 	instance->Quality = q;
-	instance->DecodeMatrix = instance->DecodeQualityPresets[index];
-	instance->EncodeMatrix = instance->EncodeQualityPresets[index];
-	instance->DecodeMatrix256 = instance->DecodeQualityPresets256[index];
-	instance->EncodeMatrix256 = instance->EncodeQualityPresets256[index];
+	instance->DecodeMatrix = VMX_QUALITY_PRESETS.Decode[index];
+	instance->EncodeMatrix = VMX_QUALITY_PRESETS.Encode[index];
+	instance->DecodeMatrix256 = VMX_QUALITY_PRESETS.Decode256[index];
+	instance->EncodeMatrix256 = VMX_QUALITY_PRESETS.Encode256[index];
 }
 
 VMX_API void VMX_SetQuality(VMX_INSTANCE* instance, int q)
@@ -89,6 +195,17 @@ VMX_API void VMX_SetEncodingParameters(VMX_INSTANCE* instance, int frameMin, int
 	instance->TargetBytesPerFrameMax = frameMax;
 	instance->MinQuality = minQuality;
 	instance->DCShift = dcShift;
+	instance->RateBufferSize = 0;
+}
+
+VMX_API void VMX_SetRateControlMode(VMX_INSTANCE* instance, VMX_RATE_CONTROL mode)
+{
+	if (!instance) return;
+	VMX_WaitEncoded(instance);
+	instance->RateControl = mode;
+	instance->RateBytesPerBit = 0;
+	instance->RateDCBytes = 0;
+	instance->RateEstimate = 0;
 }
 
 void VMX_ResetData(VMX_SLICE_DATA* s)
@@ -96,8 +213,12 @@ void VMX_ResetData(VMX_SLICE_DATA* s)
 	s->StreamPos = s->Stream;
 	s->BitsLeft = VMX_BITSSIZE;
 	s->Temp = 0;
-	buffer_t* si = (buffer_t*)s->StreamPos;
-	s->TempRead = VMX_BUFFERSWAP(*si);
+	s->TempRead = 0;
+	if (s->Stream)
+	{
+		buffer_t* si = (buffer_t*)s->StreamPos;
+		s->TempRead = VMX_BUFFERSWAP(*si);
+	}
 }
 
 void VMX_ResetStream(VMX_INSTANCE* instance)
@@ -109,99 +230,406 @@ void VMX_ResetStream(VMX_INSTANCE* instance)
 	}
 }
 
-VMX_API void VMX_Destroy(VMX_INSTANCE* instance)
+//Formats that stage the alpha plane, BGRX filling it with 255 on the way out
+static inline bool VMX_UsesAlphaPlane(VMX_IMAGE_FORMAT format)
 {
-	if (instance)
+	return format == VMX_IMAGE_UYVA || format == VMX_IMAGE_BGRA || format == VMX_IMAGE_BGRX || format == VMX_IMAGE_PA16;
+}
+
+static inline bool VMX_Is16Bit(VMX_IMAGE_FORMAT format)
+{
+	return format == VMX_IMAGE_P216 || format == VMX_IMAGE_PA16 || format == VMX_IMAGE_P010;
+}
+
+static int VMX_GetLeanStreamLength(VMX_INSTANCE* instance, int ac, bool bits16, bool alpha);
+
+//Stream buffers are only needed for encoding or VMX_LoadFrom, so decode only instances using VMX_LoadFromInPlace never allocate them
+static void VMX_AllocateStream(VMX_SLICE_DATA* s, int set, int length)
+{
+	if (s->BufferLength[set] < length)
 	{
-		if (instance->Tasks)
+		if (s->Buffers[set]) _mm_free(s->Buffers[set] - VMX_STREAM_HEADROOM);
+		s->Buffers[set] = (BYTE*)_mm_malloc(length + VMX_STREAM_HEADROOM, VMX_ALIGNMENT) + VMX_STREAM_HEADROOM;
+		memset(s->Buffers[set], 0xFF, length);
+		s->BufferLength[set] = length;
+	}
+	s->Buffer = s->Buffers[set];
+	s->Stream = s->Buffer;
+}
+
+//Nodes the slices of an instance are split across, see VMX_SetMemoryPolicy
+static inline int VMX_GetNodes(VMX_INSTANCE* instance)
+{
+	return (instance->MemoryPolicy & VMX_MEMORY_POLICY_NUMA) ? ThreadTasksTopology::Get().nodes : 1;
+}
+
+struct VMX_STREAM_PLACEMENT
+{
+	VMX_INSTANCE* Instance;
+	int ACLength;
+	int DCLength;
+	int Grow; //Only slices whose buffers are too small are touched, and their cached streams are dropped
+};
+
+static void VMX_AllocateStreamsTask(void* context, int start, int count)
+{
+	VMX_STREAM_PLACEMENT* placement = (VMX_STREAM_PLACEMENT*)context;
+	VMX_INSTANCE* instance = placement->Instance;
+	int set = instance->StreamSet;
+	for (int i = start; i < (start + count); i++)
+	{
+		VMX_SLICE_SET* s = instance->Slices[i];
+		if (placement->Grow)
 		{
-			DestroyTasks(instance->Tasks);
-			instance->Tasks = NULL;
+			if (s->AC.BufferLength[set] >= placement->ACLength && s->DC.BufferLength[set] >= placement->DCLength) continue;
+			if (s->CacheSet == set) s->CacheSet = -1;
 		}
-		if (instance->Planes[0].Data) _mm_free(instance->Planes[0].Data);
-		if (instance->Planes[1].Data) _mm_free(instance->Planes[1].Data);
-		if (instance->Planes[2].Data) _mm_free(instance->Planes[2].Data);
-		if (instance->Planes[3].Data) _mm_free(instance->Planes[3].Data);
-		if (instance->Slices) {
-			for (int i = 0; i < instance->SliceCount; i++)
+		VMX_AllocateStream(&s->AC, set, placement->ACLength);
+		VMX_AllocateStream(&s->DC, set, placement->DCLength);
+		if (placement->Grow)
+		{
+			VMX_ResetData(&s->AC);
+			VMX_ResetData(&s->DC);
+		}
+	}
+}
+
+//Buffers are allocated on the calling thread, or on the pool split across nodes when any has to be allocated under VMX_MEMORY_POLICY_NUMA,
+//so that it is first touched on the node that codes its slice
+static void VMX_PlaceStreams(VMX_INSTANCE* instance, int acLength, int dcLength, int grow)
+{
+	VMX_STREAM_PLACEMENT placement = { instance, acLength, dcLength, grow };
+	int set = instance->StreamSet;
+	int nodes = VMX_GetNodes(instance);
+	for (int i = 0; nodes > 1 && i < instance->SliceCount; i++)
+	{
+		if (instance->Slices[i]->AC.BufferLength[set] < acLength || instance->Slices[i]->DC.BufferLength[set] < dcLength)
+		{
+			instance->Tasks->Run(VMX_AllocateStreamsTask, &placement, instance->SliceCount, instance->Threads, nodes);
+			return;
+		}
+	}
+	VMX_AllocateStreamsTask(&placement, 0, instance->SliceCount);
+}
+
+static void VMX_AllocateStreams(VMX_INSTANCE* instance)
+{
+	int acLength = instance->Slices[0]->AC.MaxStreamLength;
+	int dcLength = instance->Slices[0]->DC.MaxStreamLength;
+	if (instance->LeanMemory)
+	{
+		//Sized for an 8bit frame without alpha, VMX_GrowStreams and VMX_CopyStream grow them once the frame is known
+		acLength = VMX_GetLeanStreamLength(instance, 1, false, false);
+		dcLength = VMX_GetLeanStreamLength(instance, 0, false, false);
+	}
+	VMX_PlaceStreams(instance, acLength, dcLength, 0);
+}
+
+//Quality and format are only final once a frame starts, so the streams of lean instances are grown to fit it here.
+//Repeated slices copy cached streams of the same quality, which therefore fit as well.
+static void VMX_GrowStreams(VMX_INSTANCE* instance)
+{
+	bool bits16 = VMX_Is16Bit(instance->ImageFormat);
+	bool alpha = VMX_UsesAlphaPlane(instance->ImageFormat);
+	VMX_PlaceStreams(instance, VMX_GetLeanStreamLength(instance, 1, bits16, alpha), VMX_GetLeanStreamLength(instance, 0, bits16, alpha), 1);
+}
+
+//VMX_LoadFrom copies each stream into the instance, growing the buffer when a lean instance was sized for a lower quality
+static inline void VMX_CopyStream(VMX_INSTANCE* instance, VMX_SLICE_DATA* d, const BYTE* src, int len)
+{
+	int length = instance->LeanMemory ? len + VMX_STREAM_SLACK : len;
+	if (d->BufferLength[instance->StreamSet] < length) VMX_AllocateStream(d, instance->StreamSet, length);
+	memcpy(d->Stream, src, len);
+}
+
+static void VMX_FreeStreams(VMX_INSTANCE* instance)
+{
+	for (int i = 0; i < instance->SliceCount; i++)
+	{
+		VMX_SLICE_SET* s = instance->Slices[i];
+		VMX_SLICE_DATA* data[2] = { &s->DC, &s->AC };
+		for (int d = 0; d < 2; d++)
+		{
+			for (int k = 0; k < VMX_STREAM_SETS; k++)
 			{
-				if (instance->Slices[i])
-				{
-					if (instance->Slices[i]->AC.Stream) _mm_free(instance->Slices[i]->AC.Stream);
-					if (instance->Slices[i]->DC.Stream) _mm_free(instance->Slices[i]->DC.Stream);
-					delete instance->Slices[i];
-				}
+				if (data[d]->Buffers[k]) _mm_free(data[d]->Buffers[k] - VMX_STREAM_HEADROOM);
+				data[d]->Buffers[k] = NULL;
+				data[d]->BufferLength[k] = 0;
+			}
+			data[d]->Buffer = NULL;
+			data[d]->Stream = NULL;
+			data[d]->StreamLength = 0;
+		}
+		s->CacheSet = -1;
+	}
+	instance->SliceCacheKey = -1;
+}
+
+//Value every plane starts out with, which is what encoding reads below the last row of a partial slice
+static const BYTE VMX_PLANE_FILL[VMX_MAX_PLANES] = { 0, 128, 128, 255 };
+
+const size_t VMX_HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+//Planes are mapped directly when the memory policy asks for huge pages or NUMA placement, so that they start on a huge page boundary
+//and no page has been touched before the threads placing it get to it. mapped receives the bytes to unmap, or 0 for _mm_malloc.
+static BYTE* VMX_AllocatePlane(VMX_INSTANCE* instance, size_t len, size_t* mapped)
+{
+	*mapped = 0;
+#if defined(__linux__)
+	int policy = instance->MemoryPolicy;
+	if (policy)
+	{
+		size_t length = (len + VMX_HUGE_PAGE_SIZE - 1) & ~(VMX_HUGE_PAGE_SIZE - 1);
+#if defined(MAP_HUGETLB)
+		if (policy & VMX_MEMORY_POLICY_HUGEPAGES_EXPLICIT)
+		{
+			void* data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (data != MAP_FAILED)
+			{
+				*mapped = length;
+				return (BYTE*)data;
 			}
-			delete[] instance->Slices;
 		}
-		for (int p = 0; p < VMX_QUALITY_COUNT; p++)
+#endif
+		//Over map by a huge page and trim both ends to align the start
+		BYTE* raw = (BYTE*)mmap(NULL, length + VMX_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (raw != (BYTE*)MAP_FAILED)
 		{
-			_mm_free(instance->EncodeQualityPresets[p]);
-			_mm_free(instance->DecodeQualityPresets[p]);
-			_mm_free(instance->EncodeQualityPresets256[p]);
-			_mm_free(instance->DecodeQualityPresets256[p]);
+			BYTE* data = (BYTE*)(((uintptr_t)raw + VMX_HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(VMX_HUGE_PAGE_SIZE - 1));
+			if (data > raw) munmap(raw, data - raw);
+			if (raw + VMX_HUGE_PAGE_SIZE > data) munmap(data + length, (raw + VMX_HUGE_PAGE_SIZE) - data);
+#if defined(MADV_HUGEPAGE)
+			if (policy & (VMX_MEMORY_POLICY_HUGEPAGES | VMX_MEMORY_POLICY_HUGEPAGES_EXPLICIT)) madvise(data, length, MADV_HUGEPAGE);
+#endif
+			*mapped = length;
+			return data;
 		}
-		delete instance;
 	}
+#endif
+	return (BYTE*)_mm_malloc(len, VMX_ALIGNMENT);
 }
 
-static inline int flss(unsigned short val)
+static void VMX_FreePlane(BYTE* data, size_t mapped)
 {
-	int bit = 16;
-	if (val == 0) return 0;
-	if ((val & 0xff00) == 0) {
-		bit -= 8;
-		val <<= 8;
+#if defined(__linux__)
+	if (mapped)
+	{
+		munmap(data, mapped);
+		return;
 	}
-	if ((val & 0xF000) == 0) {
-		bit -= 4;
-		val <<= 4;
+#endif
+	_mm_free(data);
+}
+
+static inline void VMX_FillPlaneRange(BYTE* data, size_t from, size_t to, size_t len, BYTE value)
+{
+	if (to > len) to = len;
+	if (from < to) memset(data + from, value, to - from);
+}
+
+struct VMX_PLANE_PLACEMENT
+{
+	VMX_INSTANCE* Instance;
+	int Planes; //Mask of the planes to fill
+};
+
+//Fills the rows of slices [start, start + count) in each plane of the placement, on the node coding them. That is the rows
+//of the slice as 8bit samples, then the part of them as 16bit samples that lies past the 8bit frame, so that both layouts are mostly
+//local. The last slice takes any padding after the frame.
+static void VMX_TouchPlanesTask(void* context, int start, int count)
+{
+	VMX_PLANE_PLACEMENT* placement = (VMX_PLANE_PLACEMENT*)context;
+	VMX_INSTANCE* instance = placement->Instance;
+	for (int p = 0; p < VMX_MAX_PLANES; p++)
+	{
+		if (!(placement->Planes & (1 << p))) continue;
+		BYTE* data = instance->Planes[p].Data;
+		size_t len = instance->PlaneLength[p];
+		size_t rows = (size_t)instance->Planes[p].Stride * VMX_SLICE_HEIGHT;
+		size_t frame = rows * instance->SliceCount;
+		for (int i = start; i < (start + count); i++)
+		{
+			size_t from16 = rows * 2 * i;
+			VMX_FillPlaneRange(data, rows * i, rows * (i + 1), len, VMX_PLANE_FILL[p]);
+			VMX_FillPlaneRange(data, from16 > frame ? from16 : frame, rows * 2 * (i + 1), len, VMX_PLANE_FILL[p]);
+			if (i == instance->SliceCount - 1) VMX_FillPlaneRange(data, frame > rows * 2 * (i + 1) ? frame : rows * 2 * (i + 1), len, len, VMX_PLANE_FILL[p]);
+		}
 	}
-	if ((val & 0xC000) == 0) {
-		bit -= 2;
-		val <<= 2;
+}
+
+//Full size instances allocate every plane as large as luma at twice the height for 16bit samples, once in VMX_Create.
+//Lean instances allocate each plane on first use at its own size, with a row of padding for the planar converters that read past
+//the end of the last row, and only double it once a 16bit format comes along.
+//Under VMX_MEMORY_POLICY_NUMA the new planes are filled on the pool, each slice by a thread of the node that codes it.
+static void VMX_PreparePlanes(VMX_INSTANCE* instance, bool alpha, bool depth16)
+{
+	int planes = alpha ? VMX_MAX_PLANES : 3;
+	int nodes = VMX_GetNodes(instance);
+	VMX_PLANE_PLACEMENT placement = { instance, 0 };
+	for (int p = 0; p < planes; p++)
+	{
+		VMX_PLANE* plane = &instance->Planes[p];
+		int len = instance->Planes[0].Stride * instance->AlignedHeight * 2;
+		if (instance->LeanMemory)
+		{
+			len = plane->Stride * instance->AlignedHeight;
+			len = depth16 ? len * 2 : len + plane->Stride + VMX_ALIGNMENT;
+		}
+		if (instance->PlaneLength[p] >= len) continue;
+		if (plane->Data) VMX_FreePlane(plane->Data, instance->PlaneMapped[p]);
+		plane->Data = VMX_AllocatePlane(instance, len, &instance->PlaneMapped[p]);
+		if (nodes > 1) placement.Planes |= 1 << p;
+		else memset(plane->Data, VMX_PLANE_FILL[p], len);
+		plane->DataLowerPreview = plane->Data + ((plane->Stride) * (instance->AlignedHeight >> 4));
+		instance->PlaneLength[p] = len;
 	}
-	if ((val & 0x8000) == 0) {
-		bit -= 1;
-		val <<= 1;
+	if (placement.Planes) instance->Tasks->Run(VMX_TouchPlanesTask, &placement, instance->SliceCount, instance->Threads, nodes);
+}
+
+static void VMX_FreePlanes(VMX_INSTANCE* instance)
+{
+	for (int p = 0; p < VMX_MAX_PLANES; p++)
+	{
+		if (instance->Planes[p].Data) VMX_FreePlane(instance->Planes[p].Data, instance->PlaneMapped[p]);
+		instance->PlaneMapped[p] = 0;
+		instance->Planes[p].Data = NULL;
+		instance->Planes[p].DataLowerPreview = NULL;
+		instance->PlaneLength[p] = 0;
 	}
-	return bit;
 }
-static inline void createReciprocal(unsigned short divisor, unsigned short* dst)
+
+static void VMX_FreeTiles(VMX_INSTANCE* instance)
 {
-	if (divisor == 1)
+	if (instance->Tiles) _mm_free(instance->Tiles);
+	delete[] instance->TileBusy;
+	instance->Tiles = NULL;
+	instance->TileBusy = NULL;
+	instance->TileLength = 0;
+	instance->TileCount = 0;
+}
+
+//Bytes of a tile for one plane. The *ToPlanar converters write up to a vector past the end of a row, so a row of padding follows
+//the slice to take what the last row spills.
+static inline int VMX_GetTilePlaneLength(VMX_INSTANCE* instance, int p, int shift)
+{
+	int len = ((instance->Planes[p].Stride << shift) * (VMX_SLICE_HEIGHT + 1)) + VMX_ALIGNMENT;
+	VMX_ALIGN(len, VMX_ALIGNMENT);
+	return len;
+}
+
+//One tile per thread that can be encoding this instance at once, each holding one slice of every plane
+static void VMX_PrepareTiles(VMX_INSTANCE* instance)
+{
+	int shift = VMX_Is16Bit(instance->ImageFormat) ? 1 : 0;
+	int len = 0;
+	for (int p = 0; p < VMX_MAX_PLANES; p++) len += VMX_GetTilePlaneLength(instance, p, shift);
+	int count = instance->Threads > 0 ? instance->Threads : 1;
+	if (instance->Tiles && instance->TileLength == len && instance->TileCount >= count && instance->TileShift == shift) return;
+	VMX_FreeTiles(instance);
+	instance->Tiles = (BYTE*)_mm_malloc((size_t)len * count, VMX_ALIGNMENT);
+	instance->TileBusy = new std::atomic<int>[count];
+	for (int t = 0; t < count; t++)
 	{
-		dst[0] = 0;
-		dst[1] = 1;
-		dst[2] = 1;
+		BYTE* tile = instance->Tiles + ((size_t)t * len);
+		for (int p = 0; p < VMX_MAX_PLANES; p++)
+		{
+			int planeLen = VMX_GetTilePlaneLength(instance, p, shift);
+			memset(tile, VMX_PLANE_FILL[p], planeLen);
+			tile += planeLen;
+		}
+		instance->TileBusy[t].store(0, std::memory_order_relaxed);
 	}
-	int b = flss(divisor) - 1;
-	int r = 2 * 8 + b;
-	uint32_t fq = (1 << r) / divisor;
-	uint32_t fr = (1 << r) % divisor;
-	uint16_t c = divisor / 2;
-	if (fr == 0)
+	instance->TileLength = len;
+	instance->TileCount = count;
+	instance->TileShift = shift;
+}
+
+//Slices staged through tiles instead of the frame sized planes. Besides lean instances that is any frame where a vector written past
+//the end of a plane row could reach the next row, as the last row of a slice would then write into the first row of the next slice
+//while another thread is coding it.
+static inline bool VMX_UsesTiles(VMX_INSTANCE* instance)
+{
+	if (instance->ImageFormat == VMX_IMAGE_YUVPLANAR422) return false;
+	if (instance->LeanMemory) return true;
+	for (int p = 0; p < VMX_MAX_PLANES; p++)
 	{
-		fq >>= 1;
-		r -= 1;
+		if (instance->Planes[p].Stride % VMX_ALIGNMENT) return true;
 	}
-	else if (fr <= (divisor / 2U))
+	return false;
+}
+
+//Returns 0 if there is no frame to decode, which is possible when stream buffers have not been allocated
+int VMX_ResetDecodeStream(VMX_INSTANCE* instance, int ac)
+{
+	VMX_WaitEncoded(instance);
+	VMX_WaitDecoded(instance);
+	for (int i = 0; i < instance->SliceCount; i++)
 	{
-		c += 1;
+		if (!instance->Slices[i]->DC.Stream) return 0;
+		if (ac && !instance->Slices[i]->AC.Stream) return 0;
 	}
-	else {
-		fq += 1;
+	VMX_ResetStream(instance);
+	return 1;
+}
+
+//Points every slice back at its own buffer, in case the last frame was loaded in place
+void VMX_ResetEncodeStream(VMX_INSTANCE* instance)
+{
+	VMX_WaitEncoded(instance);
+	VMX_WaitDecoded(instance);
+	//Chunks handed to ChunkCallback were the output of the last frame. Rate control catches up with it here,
+	//so its quality stays the one in the chunk headers until the next frame starts
+	if (instance->ChunkCallback && instance->ChunkBytes)
+	{
+		VMX_AdjustBitrate(instance, instance->ChunkBytes);
+		instance->ChunkBytes = 0;
+	}
+	//Move on to the next set, so the previous frame stays intact while this one is encoded
+	instance->StreamSet = (instance->StreamSet + 1) % instance->StreamSets;
+	VMX_AllocateStreams(instance);
+	VMX_ResetStream(instance);
+}
+
+VMX_API void VMX_Destroy(VMX_INSTANCE* instance)
+{
+	if (instance)
+	{
+		VMX_WaitEncoded(instance);
+		VMX_WaitDecoded(instance);
+		if (instance->Tasks)
+		{
+			DestroyTasks(instance->Tasks);
+			instance->Tasks = NULL;
+		}
+		VMX_FreePlanes(instance);
+		VMX_FreeTiles(instance);
+		if (instance->Slices) {
+			for (int i = 0; i < instance->SliceCount; i++)
+			{
+				if (instance->Slices[i])
+				{
+					for (int k = 0; k < VMX_STREAM_SETS; k++)
+					{
+						if (instance->Slices[i]->AC.Buffers[k]) _mm_free(instance->Slices[i]->AC.Buffers[k] - VMX_STREAM_HEADROOM);
+						if (instance->Slices[i]->DC.Buffers[k]) _mm_free(instance->Slices[i]->DC.Buffers[k] - VMX_STREAM_HEADROOM);
+					}
+					delete instance->Slices[i];
+				}
+			}
+			delete[] instance->Slices;
+		}
+		delete[] instance->ChunkPending;
+		delete[] instance->ChunkSegments;
+		delete[] instance->ChunkHeaders;
+		delete instance;
 	}
-	uint16_t s = (1 << (2 * 8 * 2 - r));
-	dst[0] = c;
-	dst[1] = fq;
-	dst[2] = s;
 }
 
-static int VMX_CalculateBitrate(int targetMbps, bool min)
+static int VMX_CalculateBitrate(int targetMbps, int fpsN, int fpsD, bool min)
 {
 	float t = (float)targetMbps;
-	t /= (60 * 8);
+	t *= (float)fpsD / (float)fpsN;
+	t /= 8;
 	t *= 1048576;
 	if (min)
 	{
@@ -214,7 +642,96 @@ static int VMX_CalculateBitrate(int targetMbps, bool min)
 	return (int)t;
 }
 
-VMX_API VMX_INSTANCE* VMX_Create(VMX_SIZE dimensions, VMX_PROFILE profile, VMX_COLORSPACE colorSpace)
+VMX_API void VMX_SetRateControl(VMX_INSTANCE* instance, int targetMbps, int fpsN, int fpsD, int bufferMs)
+{
+	if (!instance) return;
+	if (targetMbps <= 0) targetMbps = instance->TargetMbps;
+	if (fpsN <= 0 || fpsD <= 0) { fpsN = 60; fpsD = 1; }
+	VMX_WaitEncoded(instance);
+
+	double bytesPerSecond = (double)targetMbps * 1048576 / 8;
+	double bytesPerFrame = bytesPerSecond * fpsD / fpsN;
+	instance->TargetBytesPerFrameMin = VMX_CalculateBitrate(targetMbps, fpsN, fpsD, true);
+	instance->TargetBytesPerFrameMax = VMX_CalculateBitrate(targetMbps, fpsN, fpsD, false);
+	instance->RateBytesPerFrame = (int)bytesPerFrame;
+	instance->RateBufferSize = 0;
+	if (bufferMs > 0)
+	{
+		//A bucket that cannot hold two frames would swing every frame between the extremes
+		double size = bytesPerSecond * bufferMs / 1000;
+		if (size < bytesPerFrame * 2) size = bytesPerFrame * 2;
+		if (size > INT_MAX / 2) size = INT_MAX / 2;
+		instance->RateBufferSize = (int)size;
+		instance->RateBufferLevel = instance->RateBufferSize / 2;
+	}
+}
+
+//Leaky bucket for VMX_SetRateControl: drain one frame's worth of the bitrate, add the frame just encoded, and centre the next frame's
+//target on what brings the bucket back to half full over the frames it holds.
+static void VMX_UpdateRateBuffer(VMX_INSTANCE* instance, int frameLength)
+{
+	int size = instance->RateBufferSize;
+	int drain = instance->RateBytesPerFrame;
+	int level = instance->RateBufferLevel + frameLength - drain;
+	if (level < 0) level = 0; //Bandwidth left idle cannot be saved up
+	if (level > size) level = size;
+	instance->RateBufferLevel = level;
+
+	float target = drain + ((float)((size / 2) - level) * drain / size);
+	int space = size - level + drain;
+	int frameMin = (int)(target * 0.95f);
+	int frameMax = (int)(target * 1.05f);
+	if (frameMax > space) frameMax = space;
+	if (frameMin > frameMax) frameMin = frameMax;
+	instance->TargetBytesPerFrameMin = frameMin;
+	instance->TargetBytesPerFrameMax = frameMax;
+}
+
+//Apply the row of VMX_BITRATE_TABLE for the profile at this height and return its thread count, or 0 when there is none.
+static int VMX_SetProfileInternal(VMX_INSTANCE* instance, VMX_PROFILE profile, int height)
+{
+	for (int i = 0; i < VMX_BR_TABLE_COUNT; i++)
+	{
+		if (VMX_BITRATE_TABLE[i][VMX_BR_PROFILE_INDEX] == profile)
+		{
+			if (height >= VMX_BITRATE_TABLE[i][VMX_BR_RESOLUTION_INDEX])
+			{
+				instance->MinQuality = VMX_BITRATE_TABLE[i][VMX_BR_MINQ_INDEX];
+				instance->DCShift = VMX_BITRATE_TABLE[i][VMX_BR_SHIFT_INDEX];
+				instance->TargetMbps = VMX_BITRATE_TABLE[i][VMX_BR_TARGET_INDEX];
+				instance->TargetBytesPerFrameMin = VMX_CalculateBitrate(instance->TargetMbps, 60, 1, true);
+				instance->TargetBytesPerFrameMax = VMX_CalculateBitrate(instance->TargetMbps, 60, 1, false);
+				return VMX_BITRATE_TABLE[i][VMX_BR_THREADS_INDEX];
+			}
+		}
+	}
+	return 0;
+}
+
+VMX_API VMX_ERR VMX_SetProfile(VMX_INSTANCE* instance, VMX_PROFILE profile)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (profile == VMX_PROFILE_DEFAULT) { profile = VMX_PROFILE_HQ; }
+	VMX_WaitEncoded(instance);
+
+	int minQuality = instance->MinQuality;
+	int dcShift = instance->DCShift;
+	int targetMbps = instance->TargetMbps;
+	if (!VMX_SetProfileInternal(instance, profile, instance->Planes[0].Size.height))
+	{
+		instance->MinQuality = minQuality;
+		instance->DCShift = dcShift;
+		instance->TargetMbps = targetMbps;
+		return VMX_ERR_INVALID_PARAMETERS;
+	}
+	instance->Profile = profile;
+	instance->RateBufferSize = 0;
+	if (instance->Quality < instance->MinQuality) VMX_SetQualityInternal(instance, instance->MinQuality);
+	return VMX_ERR_OK;
+}
+
+//Decoders start out lean with no buffers at all, and run on pool, the default pool or else only on the calling thread
+static VMX_INSTANCE* VMX_CreateInternal(VMX_SIZE dimensions, VMX_PROFILE profile, VMX_COLORSPACE colorSpace, bool decoder, VMX_POOL* pool)
 {
 	if (dimensions.width < VMX_MIN_WIDTH) return NULL;
 	if (dimensions.width > VMX_MAX_WIDTH) return NULL;
@@ -266,28 +783,44 @@ VMX_API VMX_INSTANCE* VMX_Create(VMX_SIZE dimensions, VMX_PROFILE profile, VMX_C
 	instance->Profile = profile;
 	instance->MinQuality = 80;
 	instance->DCShift = 0;
+	instance->Chroma420 = 0;
 	instance->Format = VMX_FORMAT_PROGRESSIVE;
 	instance->ColorSpace = colorSpace;
+	instance->RateControl = VMX_RATE_CONTROL_REACTIVE;
+	instance->RateBytesPerBit = 0;
+	instance->RateDCBytes = 0;
+	instance->RateEstimate = 0;
+	instance->TargetMbps = 0;
+	instance->RateBufferSize = 0;
+	instance->RateBufferLevel = 0;
+	instance->RateBytesPerFrame = 0;
+
+	//Set per frame by the encode and decode functions, but read earlier by the lean paths (VMX_GetLeanStreamLength) and VMX_GetFrameStats
+	instance->ImageData = NULL;
+	instance->ImageStride = 0;
+	instance->ImageDataU = NULL;
+	instance->ImageStrideU = 0;
+	instance->ImageDataV = NULL;
+	instance->ImageStrideV = 0;
+	instance->ImageDataA = NULL;
+	instance->ImageStrideA = 0;
+	instance->ImageFormat = VMX_IMAGE_UYVY;
+	instance->DecodeScale = 1;
+	instance->DecodeRegion = { 0, 0, dimensions.width, dimensions.height };
+	instance->RegionFirst[0] = instance->RegionFirst[1] = 0;
+	instance->RegionCount[0] = instance->RegionCount[1] = 0;
+	instance->StatsStart = 0;
+	instance->StatsDecode = 0;
 
+	int threads = VMX_SetProfileInternal(instance, profile, dimensions.height);
+	if (threads) instance->Threads = threads;
 
-	for (int i = 0; i < VMX_BR_TABLE_COUNT; i++)
+	unsigned int nthreads = std::thread::hardware_concurrency();
+	if (decoder)
 	{
-		if (VMX_BITRATE_TABLE[i][VMX_BR_PROFILE_INDEX] == profile)
-		{
-			if (dimensions.height >= VMX_BITRATE_TABLE[i][VMX_BR_RESOLUTION_INDEX])
-			{
-				instance->MinQuality = VMX_BITRATE_TABLE[i][VMX_BR_MINQ_INDEX];
-				instance->DCShift = VMX_BITRATE_TABLE[i][VMX_BR_SHIFT_INDEX];
-				instance->Threads = VMX_BITRATE_TABLE[i][VMX_BR_THREADS_INDEX];
-				instance->TargetBytesPerFrameMin = VMX_CalculateBitrate(VMX_BITRATE_TABLE[i][VMX_BR_TARGET_INDEX], true);
-				instance->TargetBytesPerFrameMax = VMX_CalculateBitrate(VMX_BITRATE_TABLE[i][VMX_BR_TARGET_INDEX], false);
-				break;
-			}
-		}
+		instance->Threads = 1;
 	}
-
-	unsigned int nthreads = std::thread::hardware_concurrency();
-	if (dimensions.height >= 4320)
+	else if (dimensions.height >= 4320)
 	{
 		if (nthreads >= 16)
 		{
@@ -304,57 +837,18 @@ VMX_API VMX_INSTANCE* VMX_Create(VMX_SIZE dimensions, VMX_PROFILE profile, VMX_C
 	}	
 
 	//instance->Threads = 1;
-	instance->Tasks = CreateTasks(instance->Threads);
-
-	//128bit SIMD
-	for (int i = 0; i < VMX_QUALITY_COUNT; i++)
-	{
-		instance->DecodeQualityPresets[i] = (unsigned short*)_mm_malloc(VMX_DECODE_MATRIX_COUNT * 2, 16);
-		instance->EncodeQualityPresets[i] = (unsigned short*)_mm_malloc(VMX_ENCODE_MATRIX_COUNT * 2, 16);
-		for (int y = 0; y < VMX_DECODE_MATRIX_COUNT; y++)
-		{
-			if (y == 0)
-			{
-				instance->DecodeQualityPresets[i][0] = VMX_DEFAULT_QUANTIZATION_MATRIX[0];
-			}
-			else {
-				instance->DecodeQualityPresets[i][y] = VMX_DEFAULT_QUANTIZATION_MATRIX[y] * VMX_QUALITY[i];
-			}
-			unsigned short rc[3];
-			createReciprocal(instance->DecodeQualityPresets[i][y], &rc[0]);
-			instance->EncodeQualityPresets[i][y] = rc[0];
-			instance->EncodeQualityPresets[i][y + 64] = rc[1];
-			instance->EncodeQualityPresets[i][y + 128] = rc[2];
-		}
-	}
-
-	//Duplicate matrices for 256bit
-	for (int i = 0; i < VMX_QUALITY_COUNT; i++)
-	{
-		instance->DecodeQualityPresets256[i] = (unsigned short*)_mm_malloc(VMX_DECODE_MATRIX_COUNT * 4, 32);
-		instance->EncodeQualityPresets256[i] = (unsigned short*)_mm_malloc(VMX_ENCODE_MATRIX_COUNT * 4, 32);
-		for (int y = 0; y < VMX_DECODE_MATRIX_COUNT; y += 8)
-		{
-			memcpy(&instance->DecodeQualityPresets256[i][y * 2], &instance->DecodeQualityPresets[i][y], 16);
-			memcpy(&instance->DecodeQualityPresets256[i][(y * 2) + 8], &instance->DecodeQualityPresets[i][y], 16);
-
-			memcpy(&instance->EncodeQualityPresets256[i][y * 2], &instance->EncodeQualityPresets[i][y], 16);
-			memcpy(&instance->EncodeQualityPresets256[i][(y * 2) + 8], &instance->EncodeQualityPresets[i][y], 16);
-
-			memcpy(&instance->EncodeQualityPresets256[i][(y * 2) + 128], &instance->EncodeQualityPresets[i][y + 64], 16);
-			memcpy(&instance->EncodeQualityPresets256[i][(y * 2) + 136], &instance->EncodeQualityPresets[i][y + 64], 16);
-
-			memcpy(&instance->EncodeQualityPresets256[i][(y * 2) + 256], &instance->EncodeQualityPresets[i][y + 128], 16);
-			memcpy(&instance->EncodeQualityPresets256[i][(y * 2) + 264], &instance->EncodeQualityPresets[i][y + 128], 16);
-
-		}
-
-	}
+	if (pool) pool->references++;
+	instance->Tasks = pool ? pool : VMX_AcquireDefaultPool();
+	instance->SharedTasks = instance->Tasks ? 1 : 0;
+	//A decoder without a pool never starts workers, as the calling thread is its only participant. On a pool it can use all of it.
+	if (!instance->Tasks) instance->Tasks = CreateTasks(instance->Threads);
+	else if (decoder) instance->Threads = instance->Tasks->numWorkers + 1;
 
 	instance->Planes[0].Index = 0;
 	instance->Planes[1].Index = 1;
 	instance->Planes[2].Index = 2;
 	instance->Planes[3].Index = 3;
+	for (int p = 0; p < VMX_MAX_PLANES; p++) instance->Planes[p].SliceHeight = VMX_SLICE_HEIGHT;
 
 	instance->Planes[0].Size = dimensions;
 	instance->Planes[1].Size.width = dimensions.width / 2;
@@ -390,23 +884,40 @@ VMX_API VMX_INSTANCE* VMX_Create(VMX_SIZE dimensions, VMX_PROFILE profile, VMX_C
 	instance->AlignedHeight = dimensions.height;
 	VMX_ALIGN(instance->AlignedHeight, 16);
 
-	int planeLen = instance->Planes[0].Stride * instance->AlignedHeight * 2;
-	instance->Planes[0].Data = (BYTE*)_mm_malloc(planeLen, VMX_ALIGNMENT);
-	instance->Planes[1].Data = (BYTE*)_mm_malloc(planeLen, VMX_ALIGNMENT);
-	instance->Planes[2].Data = (BYTE*)_mm_malloc(planeLen, VMX_ALIGNMENT);
-	instance->Planes[3].Data = (BYTE*)_mm_malloc(planeLen, VMX_ALIGNMENT);
-
-	memset(instance->Planes[0].Data, 0, planeLen);
-	memset(instance->Planes[1].Data, 128, planeLen);
-	memset(instance->Planes[2].Data, 128, planeLen);
-	memset(instance->Planes[3].Data, 255, planeLen);
-
-	instance->Planes[0].DataLowerPreview = instance->Planes[0].Data + ((instance->Planes[0].Stride) * (instance->AlignedHeight >> 4));
-	instance->Planes[1].DataLowerPreview = instance->Planes[1].Data + ((instance->Planes[1].Stride) * (instance->AlignedHeight >> 4));
-	instance->Planes[2].DataLowerPreview = instance->Planes[2].Data + ((instance->Planes[2].Stride) * (instance->AlignedHeight >> 4));
-	instance->Planes[3].DataLowerPreview = instance->Planes[3].Data + ((instance->Planes[3].Stride) * (instance->AlignedHeight >> 4));
+	instance->LeanMemory = decoder ? 1 : 0;
+	instance->Tiles = NULL;
+	instance->TileBusy = NULL;
+	instance->TileLength = 0;
+	instance->TileCount = 0;
+	instance->TileShift = 0;
+	for (int p = 0; p < VMX_MAX_PLANES; p++)
+	{
+		instance->Planes[p].Data = NULL;
+		instance->PlaneLength[p] = 0;
+		instance->PlaneMapped[p] = 0;
+		instance->Planes[p].DataLowerPreview = NULL;
+	}
+	instance->MemoryPolicy = VMX_MEMORY_POLICY_DEFAULT;
+	if (!decoder) VMX_PreparePlanes(instance, true, true);
 
 	instance->SliceCount = instance->AlignedHeight >> 4;
+	instance->StreamSet = 0;
+	instance->StreamSets = 1;
+	instance->EncodeAsync = 0;
+	instance->EncodePending = 0;
+	instance->DecodeAsync = 0;
+	instance->DecodePending = 0;
+	instance->ChunkSlices = 0;
+	instance->ChunkCount = 0;
+	instance->ChunkCallback = NULL;
+	instance->ChunkContext = NULL;
+	instance->ChunkPending = NULL;
+	instance->ChunkNext = 0;
+	instance->ChunkBytes = 0;
+	instance->ChunkSegments = NULL;
+	instance->ChunkHeaders = NULL;
+	instance->SliceCache = 0;
+	instance->SliceCacheKey = -1;
 	instance->Slices = new VMX_SLICE_SET * [instance->SliceCount];
 
 	int dcLen = instance->Planes[0].Stride * VMX_SLICE_HEIGHT * 2;
@@ -417,14 +928,23 @@ VMX_API VMX_INSTANCE* VMX_Create(VMX_SIZE dimensions, VMX_PROFILE profile, VMX_C
 	for (int i = 0; i < instance->SliceCount; i++)
 	{
 		instance->Slices[i] = new VMX_SLICE_SET;
-		instance->Slices[i]->DC.Stream = (BYTE*)_mm_malloc(dcLen, VMX_ALIGNMENT);
-		instance->Slices[i]->AC.Stream = (BYTE*)_mm_malloc(acLen, VMX_ALIGNMENT);
+		instance->Slices[i]->DC.Stream = NULL;
+		instance->Slices[i]->AC.Stream = NULL;
+		instance->Slices[i]->DC.Buffer = NULL;
+		instance->Slices[i]->AC.Buffer = NULL;
+		for (int k = 0; k < VMX_STREAM_SETS; k++)
+		{
+			instance->Slices[i]->DC.Buffers[k] = NULL;
+			instance->Slices[i]->AC.Buffers[k] = NULL;
+			instance->Slices[i]->DC.BufferLength[k] = 0;
+			instance->Slices[i]->AC.BufferLength[k] = 0;
+		}
 		instance->Slices[i]->AC.StreamLength = 0;
 		instance->Slices[i]->DC.StreamLength = 0;
+		instance->Slices[i]->CacheSet = -1;
+		instance->Slices[i]->Repeated = 0;
 		instance->Slices[i]->AC.MaxStreamLength = acLen;
 		instance->Slices[i]->DC.MaxStreamLength = dcLen;
-		memset(instance->Slices[i]->DC.Stream, 0xFF, dcLen);
-		memset(instance->Slices[i]->AC.Stream, 0xFF, acLen);
 
 		instance->Slices[i]->PixelSize = { dimensions.width, VMX_SLICE_HEIGHT };
 		if (i == instance->SliceCount - 1) {
@@ -469,6 +989,16 @@ VMX_API VMX_INSTANCE* VMX_Create(VMX_SIZE dimensions, VMX_PROFILE profile, VMX_C
 	return instance;
 }
 
+VMX_API VMX_INSTANCE* VMX_Create(VMX_SIZE dimensions, VMX_PROFILE profile, VMX_COLORSPACE colorSpace)
+{
+	return VMX_CreateInternal(dimensions, profile, colorSpace, false, NULL);
+}
+
+VMX_API VMX_INSTANCE* VMX_CreateDecoder(VMX_SIZE dimensions, VMX_COLORSPACE colorSpace, VMX_POOL* pool)
+{
+	return VMX_CreateInternal(dimensions, VMX_PROFILE_DEFAULT, colorSpace, true, pool);
+}
+
 #define CHECKBUFF(checkNumBytes) \
 { \
 	if ((b + checkNumBytes) > maxB) { return VMX_ERR_BUFFER_OVERFLOW; } \
@@ -490,11 +1020,103 @@ inline void VMX_ConfigureInterlaced(VMX_INSTANCE* instance, int interlaced) {
 	}
 }
 
-VMX_API VMX_ERR VMX_LoadFrom(VMX_INSTANCE* instance, BYTE* data, int dataLen)
+inline void VMX_ConfigureChroma(VMX_INSTANCE* instance, int chroma420) {
+	instance->Chroma420 = chroma420 ? 1 : 0;
+	instance->Planes[1].SliceHeight = chroma420 ? (VMX_SLICE_HEIGHT >> 1) : VMX_SLICE_HEIGHT;
+	instance->Planes[2].SliceHeight = instance->Planes[1].SliceHeight;
+}
+
+//Points a stream back at the instance's own buffer, so that it no longer refers to a frame loaded in place
+inline void VMX_DetachStream(VMX_SLICE_DATA* d)
+{
+	d->Stream = d->Buffer;
+	d->StreamLength = 0;
+}
+
+//Loads one or more chunks written by VMX_SetChunkedOutput. Slices not covered by the data keep their previous streams,
+//except in place, where every slice must be covered as the previous caller's frame may already be gone.
+static VMX_ERR VMX_LoadChunks(VMX_INSTANCE* instance, BYTE* data, int dataLen, int inPlace)
+{
+	BYTE* b = data;
+	BYTE* maxB = data + dataLen;
+	if (!inPlace) VMX_AllocateStreams(instance);
+	else
+	{
+		for (int i = 0; i < instance->SliceCount; i++)
+		{
+			VMX_DetachStream(&instance->Slices[i]->DC);
+			VMX_DetachStream(&instance->Slices[i]->AC);
+			instance->Slices[i]->Repeated = 0;
+		}
+	}
+	while (b < maxB)
+	{
+		CHECKBUFF(8);
+		if (b[0] != VMX_CODEC_FORMAT_CHUNK) return VMX_ERR_INVALID_CODEC_FORMAT;
+		b++;
+		int offset = 0;
+		int dcshift = 0;
+		if (b[0] == VMX_CODEC_FORMAT_EXTENDED)
+		{
+			CHECKBUFF(9);
+			offset = 2;
+			dcshift = b[1];
+			if (dcshift & VMX_SKIP_SLICES) return VMX_ERR_INVALID_CODEC_FORMAT;
+		}
+		int chroma420 = dcshift & VMX_CHROMA_420;
+		dcshift &= ~VMX_CHROMA_420;
+		if (b[offset] != VMX_CODEC_FORMAT_PROGRESSIVE && b[offset] != VMX_CODEC_FORMAT_INTERLACED) return VMX_ERR_INVALID_CODEC_FORMAT;
+		int format = b[offset] - 1;
+		int quality = b[offset + 1];
+		int sliceCount = b[offset + 2];
+		if (sliceCount == 14 && instance->SliceCount == 270) sliceCount = 270; //Special case for 8K 4320p
+		if (sliceCount != instance->SliceCount) return VMX_ERR_INVALID_SLICE_COUNT;
+		b += 3 + offset;
+		int first = *(uint16_t*)b;
+		int count = *(uint16_t*)(b + 2);
+		b += 4;
+		if (first + count > instance->SliceCount) return VMX_ERR_INVALID_SLICE_COUNT;
+		for (int pass = 0; pass < 2; pass++)
+		{
+			for (int i = first; i < first + count; i++)
+			{
+				VMX_SLICE_DATA* d = pass ? &instance->Slices[i]->AC : &instance->Slices[i]->DC;
+				CHECKBUFF(4);
+				uint32_t len = *(uint32_t*)b;
+				b += 4;
+				//Unsigned, so that a corrupt length can neither wrap the pointer nor pass as negative
+				if (len > (uint32_t)(maxB - b) || len > (uint32_t)d->MaxStreamLength) return VMX_ERR_BUFFER_OVERFLOW;
+				if (inPlace) d->Stream = b;
+				else VMX_CopyStream(instance, d, b, len);
+				b += len;
+				d->StreamLength = len;
+			}
+		}
+		for (int i = first; i < first + count; i++) instance->Slices[i]->Repeated = 0;
+		VMX_SetQualityInternal(instance, quality);
+		VMX_ConfigureInterlaced(instance, format);
+		VMX_ConfigureChroma(instance, chroma420);
+		instance->DCShift = dcshift;
+	}
+	if (inPlace)
+	{
+		//Slices still on their own buffer were not in the data
+		for (int i = 0; i < instance->SliceCount; i++)
+		{
+			if (instance->Slices[i]->DC.Stream == instance->Slices[i]->DC.Buffer) return VMX_ERR_INVALID_SLICE_COUNT;
+		}
+	}
+	return VMX_ERR_OK;
+}
+
+static VMX_ERR VMX_LoadFromInternal(VMX_INSTANCE* instance, BYTE* data, int dataLen, int inPlace)
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	if (!data) return VMX_ERR_INVALID_PARAMETERS;
 	if (!dataLen) return VMX_ERR_INVALID_PARAMETERS;
+	VMX_WaitEncoded(instance);
+	VMX_WaitDecoded(instance);
+	instance->SliceCacheKey = -1; //The stream buffers are about to hold someone else's frame
 
 	BYTE* b = data;
 	BYTE* maxB = data + dataLen;
@@ -502,15 +1124,21 @@ VMX_API VMX_ERR VMX_LoadFrom(VMX_INSTANCE* instance, BYTE* data, int dataLen)
 	int dcshift = 0;
 	int format = 0;
 	int sliceCount = 0;
+	int skip = 0;
+	int chroma420 = 0;
 
 	CHECKBUFF(5);
 
+	if (b[0] == VMX_CODEC_FORMAT_CHUNK) return VMX_LoadChunks(instance, data, dataLen, inPlace);
+
 	if (b[0] == VMX_CODEC_FORMAT_PROGRESSIVE || b[0] == VMX_CODEC_FORMAT_INTERLACED || b[0] == VMX_CODEC_FORMAT_EXTENDED)
 	{
 		if (b[0] == VMX_CODEC_FORMAT_EXTENDED)
 		{
 			offset = 2;
-			dcshift = b[1];
+			dcshift = b[1] & ~(VMX_SKIP_SLICES | VMX_CHROMA_420);
+			skip = b[1] & VMX_SKIP_SLICES;
+			chroma420 = b[1] & VMX_CHROMA_420;
 		}
 		format = b[offset] - 1;
 		sliceCount = b[offset + 2];
@@ -520,37 +1148,69 @@ VMX_API VMX_ERR VMX_LoadFrom(VMX_INSTANCE* instance, BYTE* data, int dataLen)
 			//Bypass min/max checking in setquality to ensure exact quality is used when decoding
 			VMX_SetQualityInternal(instance, b[offset + 1]);
 			b += (3 + offset);
+			if (!inPlace) VMX_AllocateStreams(instance);
+			for (int i = 0; i < instance->SliceCount; i++) instance->Slices[i]->Repeated = 0;
+			if (skip)
+			{
+				int bitmapLen = (instance->SliceCount + 7) >> 3;
+				CHECKBUFF(bitmapLen);
+				for (int i = 0; i < instance->SliceCount; i++)
+				{
+					VMX_SLICE_SET* s = instance->Slices[i];
+					if (!((b[i >> 3] >> (i & 7)) & 1)) continue;
+					//Nothing reads a repeated slice, but the stream must not point into a previous caller's frame
+					s->Repeated = 1;
+					if (inPlace)
+					{
+						s->DC.Stream = b;
+						s->AC.Stream = b;
+					}
+					s->DC.StreamLength = 0;
+					s->AC.StreamLength = 0;
+				}
+				b += bitmapLen;
+			}
 			uint32_t len = 0;
 			for (int i = 0; i < instance->SliceCount; i++)
 			{
-				VMX_SLICE_DATA d = instance->Slices[i]->DC;
+				VMX_SLICE_DATA* d = &instance->Slices[i]->DC;
+				if (instance->Slices[i]->Repeated) continue;
 				CHECKBUFF(4);
 				len = *(uint32_t*)b;
 				b += 4;
-				CHECKBUFF(len);
-				if (len > d.MaxStreamLength) return VMX_ERR_BUFFER_OVERFLOW;
-				memcpy(d.Stream, b, len);
+				//Unsigned, so that a corrupt length can neither wrap the pointer nor pass as negative
+				if (len > (uint32_t)(maxB - b) || len > (uint32_t)d->MaxStreamLength) return VMX_ERR_BUFFER_OVERFLOW;
+				if (inPlace) d->Stream = b;
+				else VMX_CopyStream(instance, d, b, len);
 				b += len;
-				instance->Slices[i]->DC.StreamLength = len;
+				d->StreamLength = len;
 			}
 			//We may be loading a preview only image which only has DC
+			if (b >= maxB && inPlace)
+			{
+				//Don't leave AC pointing into a previous caller's frame
+				for (int i = 0; i < instance->SliceCount; i++) VMX_DetachStream(&instance->Slices[i]->AC);
+			}
 			if (b < maxB)
 			{
 				for (int i = 0; i < instance->SliceCount; i++)
 				{
-					VMX_SLICE_DATA d = instance->Slices[i]->AC;
+					VMX_SLICE_DATA* d = &instance->Slices[i]->AC;
+					if (instance->Slices[i]->Repeated) continue;
 					CHECKBUFF(4);
 					len = *(uint32_t*)b;
 					b += 4;
-					CHECKBUFF(len);
-					if (len > d.MaxStreamLength) return VMX_ERR_BUFFER_OVERFLOW;
-					memcpy(d.Stream, b, len);
+					//Unsigned, so that a corrupt length can neither wrap the pointer nor pass as negative
+					if (len > (uint32_t)(maxB - b) || len > (uint32_t)d->MaxStreamLength) return VMX_ERR_BUFFER_OVERFLOW;
+					if (inPlace) d->Stream = b;
+					else VMX_CopyStream(instance, d, b, len);
 					b += len;
-					instance->Slices[i]->AC.StreamLength = len;
+					d->StreamLength = len;
 				}
 			}
 			//instance->Format = (VMX_FORMAT)format;
 			VMX_ConfigureInterlaced(instance, format);
+			VMX_ConfigureChroma(instance, chroma420);
 			instance->DCShift = dcshift;
 			return VMX_ERR_OK;
 		}
@@ -564,19 +1224,127 @@ VMX_API VMX_ERR VMX_LoadFrom(VMX_INSTANCE* instance, BYTE* data, int dataLen)
 	return VMX_ERR_OK;
 }
 
+VMX_API VMX_ERR VMX_LoadFrom(VMX_INSTANCE* instance, BYTE* data, int dataLen)
+{
+	return VMX_LoadFromInternal(instance, data, dataLen, 0);
+}
+
+VMX_API VMX_ERR VMX_LoadFromInPlace(VMX_INSTANCE* instance, BYTE* data, int dataLen)
+{
+	return VMX_LoadFromInternal(instance, data, dataLen, 1);
+}
+
+//Spreads the first rows of a slice decoded in 4:2:0 mode over twice as many, each row taking the place of the two it was coded from.
+//Working from the bottom up leaves every row in place until it has been copied.
+static void VMX_ExpandChromaRows(BYTE* data, int stride, int rows)
+{
+	for (int r = rows - 1; r >= 0; r--)
+	{
+		BYTE* src = data + (r * stride);
+		memcpy(src + ((r + 1) * stride), src, stride);
+		if (r) memcpy(src + (r * stride), src, stride);
+	}
+}
+
+//Reduces the rows of a chroma slice in place to the half height coded in 4:2:0 mode, averaging each pair. The last row of an odd
+//number of rows has no pair, and is used on its own. Plane strides are a multiple of 8 bytes.
+static void VMX_CompactChromaRows(BYTE* data, int stride, int rows, bool depth16)
+{
+	for (int r = 0; r < (VMX_SLICE_HEIGHT >> 1); r++)
+	{
+		BYTE* dst = data + (r * stride);
+		const BYTE* a = data + (r * 2 * stride);
+		if ((r * 2) + 1 >= rows)
+		{
+			if (r) memcpy(dst, a, stride);
+			continue;
+		}
+		const BYTE* b = a + stride;
+		int x = 0;
+		for (; x + 16 <= stride; x += 16)
+		{
+			__m128i va = _mm_loadu_si128((__m128i*)(a + x));
+			__m128i vb = _mm_loadu_si128((__m128i*)(b + x));
+			_mm_storeu_si128((__m128i*)(dst + x), depth16 ? _mm_avg_epu16(va, vb) : _mm_avg_epu8(va, vb));
+		}
+		if (x < stride)
+		{
+			__m128i va = _mm_loadl_epi64((__m128i*)(a + x));
+			__m128i vb = _mm_loadl_epi64((__m128i*)(b + x));
+			_mm_storel_epi64((__m128i*)(dst + x), depth16 ? _mm_avg_epu16(va, vb) : _mm_avg_epu8(va, vb));
+		}
+	}
+}
+
+#if VMX_STATS
+static std::atomic<int> VMX_StatsThreads(0);
+static thread_local int VMX_StatsThreadIndex = -1;
+
+//Small number identifying the calling thread for VMX_GetFrameStats, the same for the life of the thread
+static inline int VMX_StatsThread()
+{
+	if (VMX_StatsThreadIndex < 0) VMX_StatsThreadIndex = VMX_StatsThreads.fetch_add(1, std::memory_order_relaxed);
+	return VMX_StatsThreadIndex;
+}
+
+static inline int64_t VMX_StatsNow()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#define VMX_STATS_START(t) int64_t t = VMX_StatsNow()
+#define VMX_STATS_STAGE(s, stage, t) { \
+	(s)->StatsEnd = VMX_StatsNow(); \
+	(s)->StatsNs[stage] += (s)->StatsEnd - (t); \
+	(s)->StatsThread[stage] = VMX_StatsThread(); \
+}
+#else
+#define VMX_STATS_START(t)
+#define VMX_STATS_STAGE(s, stage, t)
+#endif
+
+//Clears what VMX_GetFrameStats reports of the previous frame
+static void VMX_ResetStats(VMX_INSTANCE* instance, int decode)
+{
+	instance->StatsDecode = decode;
+#if VMX_STATS
+	instance->StatsStart = VMX_StatsNow();
+	for (int i = 0; i < instance->SliceCount; i++)
+	{
+		VMX_SLICE_SET* s = instance->Slices[i];
+		memset(s->StatsNs, 0, sizeof(s->StatsNs));
+		memset(s->ZeroBlocks, 0, sizeof(s->ZeroBlocks));
+		for (int k = 0; k < VMX_STAGE_COUNT; k++) s->StatsThread[k] = -1;
+		s->StatsEnd = 0;
+	}
+#endif
+}
+
+static inline int VMX_GetSliceRows(VMX_INSTANCE* instance, VMX_SLICE_SET* s)
+{
+	return instance->Format == VMX_FORMAT_INTERLACED ? s->PixelSizeInterlaced.height : s->PixelSize.height;
+}
+
 VMX_API void VMX_DecodePlanePreview(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SLICE_SET* s)
 {
 	VMX_DecodePlanePreviewInternal(instance, pPlane, s);
+	if (pPlane->SliceHeight < VMX_SLICE_HEIGHT) VMX_ExpandChromaRows(pPlane->Data + (s->Offset[pPlane->Index] >> 3), pPlane->Stride, 1);
 }
 
 VMX_API void VMX_DecodePlane(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SLICE_SET * s)
 {
+	VMX_STATS_START(start);
 	VMX_DecodePlaneInternal(instance, pPlane, s);
+	VMX_STATS_STAGE(s, VMX_STAGE_CODE, start);
+	if (pPlane->SliceHeight < VMX_SLICE_HEIGHT) VMX_ExpandChromaRows(pPlane->Data + s->Offset[pPlane->Index], pPlane->Stride, pPlane->SliceHeight);
 }
 
 VMX_API void VMX_DecodePlane16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SLICE_SET* s)
 {
+	VMX_STATS_START(start);
 	VMX_DecodePlaneInternal16(instance, pPlane, s);
+	VMX_STATS_STAGE(s, VMX_STAGE_CODE, start);
+	if (pPlane->SliceHeight < VMX_SLICE_HEIGHT) VMX_ExpandChromaRows(pPlane->Data + s->Offset16[pPlane->Index], pPlane->Stride * 2, pPlane->SliceHeight);
 }
 
 void VMX_DecodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
@@ -592,6 +1360,7 @@ void VMX_DecodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
 		int sliceStride = instance->ImageStride * VMX_SLICE_HEIGHT;
 		int sliceStrideA;
 		int sliceStrideU;
+		int sliceStrideV;
 
 		switch (instance->ImageFormat) 
 		{
@@ -674,6 +1443,38 @@ void VMX_DecodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
 					instance->ImageData + (i * sliceStride), instance->ImageStride, s->PixelSize);
 			}
 			break;
+		case VMX_IMAGE_NV12:
+			sliceStrideU = instance->ImageStrideU * (VMX_SLICE_HEIGHT >> 1);
+			for (int i = startIndex; i < (startIndex + count); i++)
+			{
+				VMX_SLICE_SET* s = instance->Slices[i];
+				VMX_DecodePlane(instance, &y, s);
+				VMX_DecodePlane(instance, &u, s);
+				VMX_DecodePlane(instance, &v, s);
+				VMX_PlanarToNV12(instance, y.Data + s->Offset[0], y.Stride,
+					u.Data + s->Offset[1], u.Stride,
+					v.Data + s->Offset[2], v.Stride,
+					instance->ImageData + (i * sliceStride), instance->ImageStride,
+					instance->ImageDataU + (i * sliceStrideU), instance->ImageStrideU, s->PixelSize);
+			}
+			break;
+		case VMX_IMAGE_YV12:
+			sliceStrideU = instance->ImageStrideU * (VMX_SLICE_HEIGHT >> 1);
+			sliceStrideV = instance->ImageStrideV * (VMX_SLICE_HEIGHT >> 1);
+			for (int i = startIndex; i < (startIndex + count); i++)
+			{
+				VMX_SLICE_SET* s = instance->Slices[i];
+				VMX_DecodePlane(instance, &y, s);
+				VMX_DecodePlane(instance, &u, s);
+				VMX_DecodePlane(instance, &v, s);
+				VMX_PlanarToI420(instance, y.Data + s->Offset[0], y.Stride,
+					u.Data + s->Offset[1], u.Stride,
+					v.Data + s->Offset[2], v.Stride,
+					instance->ImageData + (i * sliceStride), instance->ImageStride,
+					instance->ImageDataU + (i * sliceStrideU), instance->ImageStrideU,
+					instance->ImageDataV + (i * sliceStrideV), instance->ImageStrideV, s->PixelSize);
+			}
+			break;
 		case VMX_IMAGE_BGRA:
 			colorTable = YUV_RGB_709;
 			if (instance->ColorSpace == VMX_COLORSPACE_BT601) colorTable = YUV_RGB_601;
@@ -728,6 +1529,11 @@ void VMX_DecodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
 		int sourceStrideU;
 		int interlacedOffsetU;
 
+		int sliceStrideV;
+		int offsetV;
+		int sourceStrideV;
+		int interlacedOffsetV;
+
 		switch (instance->ImageFormat)
 		{
 		case VMX_IMAGE_P216:
@@ -838,6 +1644,59 @@ void VMX_DecodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
 					instance->ImageData + (i * sliceStride) + offset, sourceStride, s->PixelSizeInterlaced);
 			}
 			break;
+		case VMX_IMAGE_NV12:
+			//Each field's chroma is averaged within the field, then the fields are interleaved as for luma
+			sourceStrideU = instance->ImageStrideU << 1;
+			sliceStrideU = sourceStrideU * (VMX_SLICE_HEIGHT >> 1);
+			offsetU = 0;
+			interlacedOffsetU = -(instance->ImageStrideU * ((instance->AlignedHeight >> 1) - 1));
+			for (int i = startIndex; i < (startIndex + count); i++)
+			{
+				VMX_SLICE_SET* s = instance->Slices[i];
+				if (s->LowerField) {
+					offset = interlacedOffset;
+					offsetU = interlacedOffsetU;
+				}
+				VMX_DecodePlane(instance, &y, s);
+				VMX_DecodePlane(instance, &u, s);
+				VMX_DecodePlane(instance, &v, s);
+				VMX_PlanarToNV12(instance, y.Data + s->Offset[0], y.Stride,
+					u.Data + s->Offset[1], u.Stride,
+					v.Data + s->Offset[2], v.Stride,
+					instance->ImageData + (i * sliceStride) + offset, sourceStride,
+					instance->ImageDataU + (i * sliceStrideU) + offsetU, sourceStrideU,
+					s->PixelSizeInterlaced);
+			}
+			break;
+		case VMX_IMAGE_YV12:
+			sourceStrideU = instance->ImageStrideU << 1;
+			sliceStrideU = sourceStrideU * (VMX_SLICE_HEIGHT >> 1);
+			offsetU = 0;
+			interlacedOffsetU = -(instance->ImageStrideU * ((instance->AlignedHeight >> 1) - 1));
+			sourceStrideV = instance->ImageStrideV << 1;
+			sliceStrideV = sourceStrideV * (VMX_SLICE_HEIGHT >> 1);
+			offsetV = 0;
+			interlacedOffsetV = -(instance->ImageStrideV * ((instance->AlignedHeight >> 1) - 1));
+			for (int i = startIndex; i < (startIndex + count); i++)
+			{
+				VMX_SLICE_SET* s = instance->Slices[i];
+				if (s->LowerField) {
+					offset = interlacedOffset;
+					offsetU = interlacedOffsetU;
+					offsetV = interlacedOffsetV;
+				}
+				VMX_DecodePlane(instance, &y, s);
+				VMX_DecodePlane(instance, &u, s);
+				VMX_DecodePlane(instance, &v, s);
+				VMX_PlanarToI420(instance, y.Data + s->Offset[0], y.Stride,
+					u.Data + s->Offset[1], u.Stride,
+					v.Data + s->Offset[2], v.Stride,
+					instance->ImageData + (i * sliceStride) + offset, sourceStride,
+					instance->ImageDataU + (i * sliceStrideU) + offsetU, sourceStrideU,
+					instance->ImageDataV + (i * sliceStrideV) + offsetV, sourceStrideV,
+					s->PixelSizeInterlaced);
+			}
+			break;
 		case VMX_IMAGE_BGRA:
 			colorTable = YUV_RGB_709;
 			if (instance->ColorSpace == VMX_COLORSPACE_BT601) colorTable = YUV_RGB_601;
@@ -881,6 +1740,7 @@ void VMX_DecodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
 
 void VMX_DecodePlanesPreview(VMX_INSTANCE* instance, bool alpha)
 {
+	VMX_PreparePlanes(instance, alpha, false);
 	VMX_PLANE y = instance->Planes[0];
 	VMX_PLANE u = instance->Planes[1];
 	VMX_PLANE v = instance->Planes[2];
@@ -888,6 +1748,7 @@ void VMX_DecodePlanesPreview(VMX_INSTANCE* instance, bool alpha)
 	for (int i = 0; i < instance->SliceCount; i++)
 	{
 		VMX_SLICE_SET* s = instance->Slices[i];
+		if (s->Repeated) continue;
 		VMX_DecodePlanePreview(instance, &y, s);
 		VMX_DecodePlanePreview(instance, &u, s);
 		VMX_DecodePlanePreview(instance, &v, s);
@@ -895,28 +1756,59 @@ void VMX_DecodePlanesPreview(VMX_INSTANCE* instance, bool alpha)
 	}
 }
 
-inline void VMX_DecodePlanes(VMX_INSTANCE* instance)
+//VMX_DecodeSlices one slice at a time when timing, with whatever VMX_DecodePlane did not count as decoding counted as conversion
+static inline void VMX_DecodeSlicesTimed(VMX_INSTANCE* instance, int startIndex, int count)
+{
+#if VMX_STATS
+	for (int i = startIndex; i < (startIndex + count); i++)
+	{
+		VMX_SLICE_SET* s = instance->Slices[i];
+		int64_t start = VMX_StatsNow();
+		int64_t code = s->StatsNs[VMX_STAGE_CODE];
+		VMX_DecodeSlices(instance, i, 1);
+		s->StatsEnd = VMX_StatsNow();
+		s->StatsNs[VMX_STAGE_CONVERT] += (s->StatsEnd - start) - (s->StatsNs[VMX_STAGE_CODE] - code);
+		s->StatsThread[VMX_STAGE_CONVERT] = VMX_StatsThread();
+	}
+#else
+	VMX_DecodeSlices(instance, startIndex, count);
+#endif
+}
+
+//Repeated slices of a frame written by VMX_GetEncodedSkipSegments keep what the destination already holds
+static void VMX_DecodeSlicesTask(void* context, int start, int count)
 {
-	int numThreads = instance->Threads;
-	int totalSlices = instance->SliceCount;
-	int slicesPerThread = totalSlices / numThreads;
-	int count = slicesPerThread;
-	for (int i = 0; i < numThreads; i++)
+	VMX_INSTANCE* instance = (VMX_INSTANCE*)context;
+	int end = start + count;
+	int run = start;
+	for (int i = start; i < end; i++)
 	{
-		if (i == numThreads - 1) count = totalSlices - (i * slicesPerThread);
-		instance->Tasks->tasks[i]->Push([instance, i, slicesPerThread, count] {VMX_DecodeSlices(instance, i * slicesPerThread, count); });
+		if (!instance->Slices[i]->Repeated) continue;
+		if (run < i) VMX_DecodeSlicesTimed(instance, run, i - run);
+		run = i + 1;
 	}
-	for (int i = 0; i < numThreads; i++)
+	if (run < end) VMX_DecodeSlicesTimed(instance, run, end - run);
+}
+
+inline void VMX_DecodePlanes(VMX_INSTANCE* instance)
+{
+	VMX_ResetStats(instance, 1);
+	VMX_PreparePlanes(instance, VMX_UsesAlphaPlane(instance->ImageFormat), VMX_Is16Bit(instance->ImageFormat));
+	if (instance->DecodeAsync)
 	{
-		instance->Tasks->tasks[i]->Join();
+		//Slices run on the workers only, VMX_WaitDecoded waits for the result
+		instance->Tasks->Submit(&instance->DecodeJob, VMX_DecodeSlicesTask, instance, instance->SliceCount, instance->Threads, false, VMX_GetNodes(instance));
+		instance->DecodePending = 1;
+		return;
 	}
+	instance->Tasks->Run(VMX_DecodeSlicesTask, instance, instance->SliceCount, instance->Threads, VMX_GetNodes(instance));
 }
 
 VMX_API VMX_ERR VMX_DecodeP216(VMX_INSTANCE* instance, BYTE* dst, int stride)
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	if (stride < (instance->Planes[0].Size.width * 2)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	if (!VMX_ResetDecodeStream(instance, 1)) return VMX_ERR_INVALID_PARAMETERS;
 	instance->ImageData = dst;
 	instance->ImageStride = stride;
 	instance->ImageFormat = VMX_IMAGE_P216;
@@ -930,7 +1822,7 @@ VMX_API VMX_ERR VMX_DecodePA16(VMX_INSTANCE* instance, BYTE* dst, int stride)
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	if (stride < (instance->Planes[0].Size.width * 2)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	if (!VMX_ResetDecodeStream(instance, 1)) return VMX_ERR_INVALID_PARAMETERS;
 	instance->ImageData = dst;
 	instance->ImageStride = stride;
 	instance->ImageFormat = VMX_IMAGE_PA16;
@@ -946,7 +1838,7 @@ VMX_API VMX_ERR VMX_DecodeUYVY(VMX_INSTANCE* instance, BYTE* dst, int stride)
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	if (stride < (instance->Planes[0].Size.width * 2)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	if (!VMX_ResetDecodeStream(instance, 1)) return VMX_ERR_INVALID_PARAMETERS;
 	instance->ImageData = dst;
 	instance->ImageStride = stride;
 	instance->ImageFormat = VMX_IMAGE_UYVY;
@@ -958,7 +1850,7 @@ VMX_API VMX_ERR VMX_DecodeUYVA(VMX_INSTANCE* instance, BYTE* dst, int stride)
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	if (stride < (instance->Planes[0].Size.width * 2)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	if (!VMX_ResetDecodeStream(instance, 1)) return VMX_ERR_INVALID_PARAMETERS;
 	instance->ImageData = dst;
 	instance->ImageStride = stride;
 	instance->ImageFormat = VMX_IMAGE_UYVA;
@@ -972,7 +1864,7 @@ VMX_API VMX_ERR VMX_DecodeYUY2(VMX_INSTANCE* instance, BYTE* dst, int stride)
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	if (stride < (instance->Planes[0].Size.width * 2)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	if (!VMX_ResetDecodeStream(instance, 1)) return VMX_ERR_INVALID_PARAMETERS;
 	instance->ImageData = dst;
 	instance->ImageStride = stride;
 	instance->ImageFormat = VMX_IMAGE_YUY2;
@@ -980,12 +1872,45 @@ VMX_API VMX_ERR VMX_DecodeYUY2(VMX_INSTANCE* instance, BYTE* dst, int stride)
 	return VMX_ERR_OK;
 }
 
+VMX_API VMX_ERR VMX_DecodeNV12(VMX_INSTANCE* instance, BYTE* dstY, int strideY, BYTE* dstUV, int strideUV)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (strideY < instance->Planes[0].Size.width) return VMX_ERR_INVALID_PARAMETERS;
+	if (strideUV < instance->Planes[0].Size.width) return VMX_ERR_INVALID_PARAMETERS;
+	if (!VMX_ResetDecodeStream(instance, 1)) return VMX_ERR_INVALID_PARAMETERS;
+	instance->ImageData = dstY;
+	instance->ImageStride = strideY;
+	instance->ImageDataU = dstUV;
+	instance->ImageStrideU = strideUV;
+	instance->ImageFormat = VMX_IMAGE_NV12;
+	VMX_DecodePlanes(instance);
+	return VMX_ERR_OK;
+}
+
+VMX_API VMX_ERR VMX_DecodeI420(VMX_INSTANCE* instance, BYTE* dstY, int strideY, BYTE* dstU, int strideU, BYTE* dstV, int strideV)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (strideY < instance->Planes[0].Size.width) return VMX_ERR_INVALID_PARAMETERS;
+	if (strideU < instance->Planes[1].Size.width) return VMX_ERR_INVALID_PARAMETERS;
+	if (strideV < instance->Planes[2].Size.width) return VMX_ERR_INVALID_PARAMETERS;
+	if (!VMX_ResetDecodeStream(instance, 1)) return VMX_ERR_INVALID_PARAMETERS;
+	instance->ImageData = dstY;
+	instance->ImageStride = strideY;
+	instance->ImageDataU = dstU;
+	instance->ImageStrideU = strideU;
+	instance->ImageDataV = dstV;
+	instance->ImageStrideV = strideV;
+	instance->ImageFormat = VMX_IMAGE_YV12; //Same slice conversion, the planes are addressed separately
+	VMX_DecodePlanes(instance);
+	return VMX_ERR_OK;
+}
+
 VMX_API VMX_ERR VMX_DecodePreviewUYVY(VMX_INSTANCE* instance, BYTE* dst, int stride)
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	VMX_SIZE previewSize = instance->PreviewSize;
 	if (stride < (previewSize.width * 2)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	if (!VMX_ResetDecodeStream(instance, 0)) return VMX_ERR_INVALID_PARAMETERS;
 	VMX_DecodePlanesPreview(instance, false);
 	if (instance->Format == VMX_FORMAT_INTERLACED)
 	{
@@ -1007,7 +1932,7 @@ VMX_API VMX_ERR VMX_DecodePreviewUYVA(VMX_INSTANCE* instance, BYTE* dst, int str
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	VMX_SIZE previewSize = instance->PreviewSize;
 	if (stride < (previewSize.width * 2)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	if (!VMX_ResetDecodeStream(instance, 0)) return VMX_ERR_INVALID_PARAMETERS;
 	VMX_DecodePlanesPreview(instance, true);
 	BYTE* dstA = dst + (previewSize.height * stride);
 	if (instance->Format == VMX_FORMAT_INTERLACED)
@@ -1034,7 +1959,7 @@ VMX_API VMX_ERR VMX_DecodePreviewYUY2(VMX_INSTANCE* instance, BYTE* dst, int str
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	VMX_SIZE previewSize = instance->PreviewSize;
 	if (stride < (previewSize.width * 2)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	if (!VMX_ResetDecodeStream(instance, 0)) return VMX_ERR_INVALID_PARAMETERS;
 	VMX_DecodePlanesPreview(instance, false);
 	if (instance->Format == VMX_FORMAT_INTERLACED)
 	{
@@ -1051,91 +1976,756 @@ VMX_API VMX_ERR VMX_DecodePreviewYUY2(VMX_INSTANCE* instance, BYTE* dst, int str
 	return VMX_ERR_OK;
 }
 
-VMX_API VMX_ERR VMX_DecodePreviewBGRA(VMX_INSTANCE* instance, BYTE* dst, int stride)
-{
-	if (!instance) return VMX_ERR_INVALID_INSTANCE;
-	VMX_SIZE previewSize = instance->PreviewSize;
-	if (stride < (previewSize.width * 4)) return VMX_ERR_INVALID_PARAMETERS;
+VMX_API VMX_ERR VMX_DecodePreviewBGRA(VMX_INSTANCE* instance, BYTE* dst, int stride)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	VMX_SIZE previewSize = instance->PreviewSize;
+	if (stride < (previewSize.width * 4)) return VMX_ERR_INVALID_PARAMETERS;
+
+	const short* colorTable = YUV_RGB_709;
+	if (instance->ColorSpace == VMX_COLORSPACE_BT601) colorTable = YUV_RGB_601;
+
+	if (!VMX_ResetDecodeStream(instance, 0)) return VMX_ERR_INVALID_PARAMETERS;
+	VMX_DecodePlanesPreview(instance, true);
+
+	if (instance->Format == VMX_FORMAT_INTERLACED)
+	{
+		previewSize = instance->PreviewSizeInterlaced;
+		VMX_SIZE sz = { previewSize.width, previewSize.height >> 1 };
+		VMX_YUV4224ToBGRA(instance->Planes[0].Data, instance->Planes[0].Stride, instance->Planes[1].Data, instance->Planes[1].Stride, instance->Planes[2].Data, instance->Planes[2].Stride, instance->Planes[3].Data, instance->Planes[3].Stride, dst, stride << 1, sz, colorTable);
+		dst += stride;
+		VMX_YUV4224ToBGRA(instance->Planes[0].DataLowerPreview, instance->Planes[0].Stride, instance->Planes[1].DataLowerPreview, instance->Planes[1].Stride, instance->Planes[2].DataLowerPreview, instance->Planes[2].Stride, instance->Planes[3].DataLowerPreview, instance->Planes[3].Stride, dst, stride << 1, sz, colorTable);
+	}
+	else
+	{
+		VMX_YUV4224ToBGRA(instance->Planes[0].Data, instance->Planes[0].Stride, instance->Planes[1].Data, instance->Planes[1].Stride, instance->Planes[2].Data, instance->Planes[2].Stride, instance->Planes[3].Data, instance->Planes[3].Stride, dst, stride, previewSize, colorTable);
+	}
+	return VMX_ERR_OK;
+}
+
+VMX_API VMX_ERR VMX_DecodePreviewBGRX(VMX_INSTANCE* instance, BYTE* dst, int stride)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	VMX_SIZE previewSize = instance->PreviewSize;
+	if (stride < (previewSize.width * 4)) return VMX_ERR_INVALID_PARAMETERS;
+
+	const short* colorTable = YUV_RGB_709;
+	if (instance->ColorSpace == VMX_COLORSPACE_BT601) colorTable = YUV_RGB_601;
+
+	if (!VMX_ResetDecodeStream(instance, 0)) return VMX_ERR_INVALID_PARAMETERS;
+	VMX_DecodePlanesPreview(instance, false);
+	VMX_PreparePlanes(instance, true, false);
+	int planeLen = instance->Planes[0].Stride * previewSize.height;
+	memset(instance->Planes[3].Data, 255, planeLen);
+
+	if (instance->Format == VMX_FORMAT_INTERLACED)
+	{
+		previewSize = instance->PreviewSizeInterlaced;
+		VMX_SIZE sz = { previewSize.width, previewSize.height >> 1 };
+		VMX_YUV4224ToBGRA(instance->Planes[0].Data, instance->Planes[0].Stride, instance->Planes[1].Data, instance->Planes[1].Stride, instance->Planes[2].Data, instance->Planes[2].Stride, instance->Planes[3].Data, instance->Planes[3].Stride, dst, stride << 1, sz, colorTable);
+		dst += stride;
+		VMX_YUV4224ToBGRA(instance->Planes[0].DataLowerPreview, instance->Planes[0].Stride, instance->Planes[1].DataLowerPreview, instance->Planes[1].Stride, instance->Planes[2].DataLowerPreview, instance->Planes[2].Stride, instance->Planes[3].DataLowerPreview, instance->Planes[3].Stride, dst, stride << 1, sz, colorTable);
+	}
+	else
+	{
+		VMX_YUV4224ToBGRA(instance->Planes[0].Data, instance->Planes[0].Stride, instance->Planes[1].Data, instance->Planes[1].Stride, instance->Planes[2].Data, instance->Planes[2].Stride, instance->Planes[3].Data, instance->Planes[3].Stride, dst, stride, previewSize, colorTable);
+	}
+	return VMX_ERR_OK;
+}
+
+VMX_API VMX_ERR VMX_DecodeBGRA(VMX_INSTANCE* instance, BYTE* dst, int stride)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (stride < (instance->Planes[0].Size.width * 4)) return VMX_ERR_INVALID_PARAMETERS;
+	if (!VMX_ResetDecodeStream(instance, 1)) return VMX_ERR_INVALID_PARAMETERS;
+	instance->ImageData = dst;
+	instance->ImageStride = stride;
+	instance->ImageFormat = VMX_IMAGE_BGRA;
+	VMX_DecodePlanes(instance);	
+	return VMX_ERR_OK;
+}
+
+VMX_API VMX_ERR VMX_DecodeBGRX(VMX_INSTANCE* instance, BYTE* dst, int stride)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (stride < (instance->Planes[0].Size.width * 4)) return VMX_ERR_INVALID_PARAMETERS;
+	if (!VMX_ResetDecodeStream(instance, 1)) return VMX_ERR_INVALID_PARAMETERS;
+	instance->ImageData = dst;
+	instance->ImageStride = stride;
+	instance->ImageFormat = VMX_IMAGE_BGRX;
+	VMX_PreparePlanes(instance, true, false);
+	//Whole slices, as the last slice of each field of an interlaced frame reaches past the image height
+	int planeLen = instance->Planes[3].Stride * instance->AlignedHeight;
+	memset(instance->Planes[3].Data, 255, planeLen);
+	VMX_DecodePlanes(instance);
+	return VMX_ERR_OK;
+}
+
+//Basis of the reduced inverse DCT used by VMX_DecodeScaled: k(x,u) = C(u)/2 * cos((2x+1)u*PI/2N) for an N point output.
+//With the same scaling as the full 8x8 transform, the output is close to the average of each 8/N x 8/N group of pixels.
+static const float VMX_SCALED_IDCT4[4][4] = {
+	{ 0.35355339f, 0.46193977f, 0.35355339f, 0.19134172f },
+	{ 0.35355339f, 0.19134172f, -0.35355339f, -0.46193977f },
+	{ 0.35355339f, -0.19134172f, -0.35355339f, 0.46193977f },
+	{ 0.35355339f, -0.46193977f, 0.35355339f, -0.19134172f }
+};
+
+static inline BYTE VMX_ClampByte(int v)
+{
+	return (BYTE)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+#define VMX_DEQUANTIZE(block, matrix, i) ((short)(block[VMX_ZIGZAGINV[i]] * matrix[i]) >> 4)
+
+//4x4 output from the low 4x4 coefficients of a zigzag ordered 8x8 block
+static inline void VMX_ZIG_INVQUANTIZE_IDCT_4X4(short* src, const unsigned short* matrix, BYTE* dst, int stride, short addVal)
+{
+	__m128 rows[4];
+	for (int v = 0; v < 4; v++)
+	{
+		int i = v << 3;
+		__m128 r = _mm_mul_ps(_mm_set1_ps((float)VMX_DEQUANTIZE(src, matrix, i)), _mm_set1_ps(VMX_SCALED_IDCT4[0][0]));
+		for (int u = 1; u < 4; u++)
+		{
+			__m128 k = _mm_setr_ps(VMX_SCALED_IDCT4[0][u], VMX_SCALED_IDCT4[1][u], VMX_SCALED_IDCT4[2][u], VMX_SCALED_IDCT4[3][u]);
+			r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps((float)VMX_DEQUANTIZE(src, matrix, i + u)), k));
+		}
+		rows[v] = r;
+	}
+	__m128i add = _mm_set1_epi16(addVal);
+	for (int y = 0; y < 4; y++)
+	{
+		__m128 r = _mm_mul_ps(rows[0], _mm_set1_ps(VMX_SCALED_IDCT4[y][0]));
+		r = _mm_add_ps(r, _mm_mul_ps(rows[1], _mm_set1_ps(VMX_SCALED_IDCT4[y][1])));
+		r = _mm_add_ps(r, _mm_mul_ps(rows[2], _mm_set1_ps(VMX_SCALED_IDCT4[y][2])));
+		r = _mm_add_ps(r, _mm_mul_ps(rows[3], _mm_set1_ps(VMX_SCALED_IDCT4[y][3])));
+		__m128i p = _mm_cvtps_epi32(r);
+		p = _mm_packs_epi32(p, p);
+		p = _mm_adds_epi16(p, add);
+		p = _mm_packus_epi16(p, p);
+		*(int*)dst = _mm_cvtsi128_si32(p);
+		dst += stride;
+	}
+}
+
+//2x2 output from the low 2x2 coefficients, every basis value is 1/(2*sqrt(2)) with a sign so this is exact in integers
+static inline void VMX_ZIG_INVQUANTIZE_IDCT_2X2(short* src, const unsigned short* matrix, BYTE* dst, int stride, short addVal)
+{
+	int f00 = VMX_DEQUANTIZE(src, matrix, 0);
+	int f01 = VMX_DEQUANTIZE(src, matrix, 1);
+	int f10 = VMX_DEQUANTIZE(src, matrix, 8);
+	int f11 = VMX_DEQUANTIZE(src, matrix, 9);
+	int a = f00 + f10;
+	int b = f00 - f10;
+	int c = f01 + f11;
+	int d = f01 - f11;
+	dst[0] = VMX_ClampByte(((a + c + 4) >> 3) + addVal);
+	dst[1] = VMX_ClampByte(((a - c + 4) >> 3) + addVal);
+	dst += stride;
+	dst[0] = VMX_ClampByte(((b + d + 4) >> 3) + addVal);
+	dst[1] = VMX_ClampByte(((b - d + 4) >> 3) + addVal);
+}
+
+static inline void VMX_BROADCAST_DC_SCALED(short src, BYTE* dst, int stride, int size, short addVal)
+{
+	int dc = ((src + 4) >> 3) + addVal;
+	BYTE val = VMX_ClampByte(dc);
+	for (int y = 0; y < size; y++)
+	{
+		memset(dst, val, size);
+		dst += stride;
+	}
+}
+
+//Same bitstream walk as VMX_DecodePlaneInternal128. The AC symbols of a slice run across block boundaries with no block lengths,
+//so every symbol is still read, but only the coefficients inside the reduced transform are used.
+static void VMX_DecodePlaneScaled(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SLICE_SET* s, int scale)
+{
+	buffer_t b = 0;
+	buffer_t bc = 0;
+	buffer_t val = 0;
+
+	VMX_PLANE plane = *pPlane;
+
+	int height = plane.SliceHeight;
+	int size = 8 / scale;
+	int shift = 0;
+	if (plane.Index == 0 || plane.Index == 3)
+	{
+		shift = 128;
+	}
+	BYTE* pDst = plane.Data + (s->Offset[plane.Index] / scale);
+	int stride = plane.Stride;
+	int dcPred = 0;
+	buffer_t termsToDecode = 0;
+
+	int dcshift = instance->DCShift;
+
+	VMX_SLICE_DATA dataDC = s->DC;
+	VMX_SLICE_DATA dataAC = s->AC;
+	short* TempBlock = s->TempBlock2;
+
+	const unsigned short* matrix = instance->DecodeMatrix;
+
+	int validCount = 0;
+
+	for (int y = 0; y < height; y += 8)
+	{
+		BYTE* dst = pDst;
+		for (int x = 0; x < stride; x += 8)
+		{
+			memset(TempBlock, 0, 128);
+			validCount = 0;
+			if (termsToDecode < 64)
+			{
+				validCount = 1;
+			}
+			while (termsToDecode < 64)
+			{
+				GolombLookup l = GolombLookupLut[(dataAC.TempRead >> (dataAC.BitsLeft - 12)) & 0xFFF];
+				if (l.length)
+				{
+					dataAC.BitsLeft -= l.length;
+					TempBlock[termsToDecode] = l.value;
+					termsToDecode += l.zeros;
+				}
+				else {
+					bc = 0;
+					GETBITB(dataAC, b);
+					if (b)
+					{
+						GETBITB(dataAC, b);
+						if (b)
+						{
+							termsToDecode++;
+						}
+						else {
+							GETZEROSB(dataAC, bc);
+							bc += 2;
+							GETBITSB(dataAC, bc, val);
+							termsToDecode += val;
+							bc = 0;
+						}
+					}
+					else {
+						GETZEROSB(dataAC, bc);
+						bc += 2;
+						GETBITSB(dataAC, bc, val);
+						TempBlock[termsToDecode] = GetIntFrom2MagSign((val - 1));
+						termsToDecode++;
+					}
+				}
+
+				RELOADBITS(dataAC);
+			}
+			termsToDecode -= 64;
+
+			//Read DC
+			GETBIT(dataDC, b);
+			if (b)
+			{
+				GETBIT(dataDC, b);
+			}
+			else {
+				GETZEROS(dataDC, bc);
+				bc += 2;
+				GETBITS(dataDC, bc, val);
+				TempBlock[0] = GetIntFrom2MagSign((val - 1));
+				TempBlock[0] <<= dcshift;
+			}
+
+			TempBlock[0] += dcPred;
+			dcPred = TempBlock[0];
+
+			if (!validCount)
+			{
+				VMX_BROADCAST_DC_SCALED(TempBlock[0], dst, stride, size, shift);
+			}
+			else if (size == 4)
+			{
+				VMX_ZIG_INVQUANTIZE_IDCT_4X4(TempBlock, matrix, dst, stride, shift);
+			}
+			else {
+				VMX_ZIG_INVQUANTIZE_IDCT_2X2(TempBlock, matrix, dst, stride, shift);
+			}
+
+			dst += size;
+		}
+		pDst += size * stride;
+	}
+
+	REWINDOVERREAD(dataAC);
+
+	FLUSHREMAININGREADBITS(dataDC);
+	FLUSHREMAININGREADBITS(dataAC);
+	s->AC = dataAC;
+	s->DC = dataDC;
+}
+
+static VMX_SIZE VMX_GetScaledSize(VMX_INSTANCE* instance, int scale)
+{
+	VMX_SIZE sz = { instance->Planes[0].Size.width / scale, 0 };
+	VMX_ALIGN(sz.width, 2);
+	for (int i = 0; i < instance->SliceCount; i++)
+	{
+		VMX_SLICE_SET* s = instance->Slices[i];
+		if (instance->Format == VMX_FORMAT_INTERLACED)
+		{
+			sz.height += s->PixelSizeInterlaced.height / scale;
+		}
+		else {
+			sz.height += s->PixelSize.height / scale;
+		}
+	}
+	return sz;
+}
+
+//Each slice is decoded into the top 1/scale of its rows in the planes and converted straight away, so slices stay independent
+static void VMX_DecodeScaledSlicesTask(void* context, int start, int count)
+{
+	VMX_INSTANCE* instance = (VMX_INSTANCE*)context;
+	VMX_PLANE y = instance->Planes[0];
+	VMX_PLANE u = instance->Planes[1];
+	VMX_PLANE v = instance->Planes[2];
+	VMX_PLANE a = instance->Planes[3];
+
+	int scale = instance->DecodeScale;
+	int rows = VMX_SLICE_HEIGHT / scale;
+	int width = VMX_GetScaledSize(instance, scale).width;
+	bool alpha = instance->ImageFormat == VMX_IMAGE_UYVA || instance->ImageFormat == VMX_IMAGE_BGRA;
+	bool interlaced = instance->Format == VMX_FORMAT_INTERLACED;
+
+	const short* colorTable = YUV_RGB_709;
+	if (instance->ColorSpace == VMX_COLORSPACE_BT601) colorTable = YUV_RGB_601;
+
+	int sourceStride = interlaced ? (instance->ImageStride << 1) : instance->ImageStride;
+	int sourceStrideA = interlaced ? (instance->ImageStrideA << 1) : instance->ImageStrideA;
+	int interlacedOffset = -(instance->ImageStride * ((instance->AlignedHeight / scale) - 1));
+	int interlacedOffsetA = -(instance->ImageStrideA * ((instance->AlignedHeight / scale) - 1));
+
+	for (int i = start; i < (start + count); i++)
+	{
+		VMX_SLICE_SET* s = instance->Slices[i];
+		if (s->Repeated) continue;
+		VMX_DecodePlaneScaled(instance, &y, s, scale);
+		VMX_DecodePlaneScaled(instance, &u, s, scale);
+		VMX_DecodePlaneScaled(instance, &v, s, scale);
+		if (alpha) VMX_DecodePlaneScaled(instance, &a, s, scale);
+		if (instance->Chroma420)
+		{
+			VMX_ExpandChromaRows(u.Data + (s->Offset[1] / scale), u.Stride, u.SliceHeight / scale);
+			VMX_ExpandChromaRows(v.Data + (s->Offset[2] / scale), v.Stride, v.SliceHeight / scale);
+		}
+
+		VMX_SIZE sz = { width, (interlaced ? s->PixelSizeInterlaced.height : s->PixelSize.height) / scale };
+		BYTE* dst = instance->ImageData + (i * rows * sourceStride);
+		BYTE* dstA = instance->ImageDataA + (i * rows * sourceStrideA);
+		if (interlaced && s->LowerField)
+		{
+			dst += interlacedOffset;
+			dstA += interlacedOffsetA;
+		}
+		BYTE* srcY = y.Data + (s->Offset[0] / scale);
+		BYTE* srcU = u.Data + (s->Offset[1] / scale);
+		BYTE* srcV = v.Data + (s->Offset[2] / scale);
+		BYTE* srcA = a.Data + (s->Offset[3] / scale);
+
+		switch (instance->ImageFormat)
+		{
+		case VMX_IMAGE_UYVY:
+			VMX_PlanarToUYVY(srcY, y.Stride, srcU, u.Stride, srcV, v.Stride, dst, sourceStride, sz);
+			break;
+		case VMX_IMAGE_UYVA:
+			VMX_PlanarToUYVY(srcY, y.Stride, srcU, u.Stride, srcV, v.Stride, dst, sourceStride, sz);
+			VMX_PlanarToA(srcA, a.Stride, dstA, sourceStrideA, sz);
+			break;
+		case VMX_IMAGE_YUY2:
+			VMX_PlanarToYUY2(srcY, y.Stride, srcU, u.Stride, srcV, v.Stride, dst, sourceStride, sz);
+			break;
+		case VMX_IMAGE_BGRA:
+		case VMX_IMAGE_BGRX:
+			VMX_YUV4224ToBGRA(srcY, y.Stride, srcU, u.Stride, srcV, v.Stride, srcA, a.Stride, dst, sourceStride, sz, colorTable);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+VMX_API VMX_ERR VMX_DecodeScaled(VMX_INSTANCE* instance, int scale, VMX_IMAGE_FORMAT format, BYTE* dst, int stride)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (scale != 2 && scale != 4) return VMX_ERR_INVALID_PARAMETERS;
+	VMX_SIZE sz = VMX_GetScaledSize(instance, scale);
+	int bytesPerPixel;
+	switch (format)
+	{
+	case VMX_IMAGE_UYVY:
+	case VMX_IMAGE_UYVA:
+	case VMX_IMAGE_YUY2:
+		bytesPerPixel = 2;
+		break;
+	case VMX_IMAGE_BGRA:
+	case VMX_IMAGE_BGRX:
+		bytesPerPixel = 4;
+		break;
+	default:
+		return VMX_ERR_INVALID_PARAMETERS;
+	}
+	if (stride < (sz.width * bytesPerPixel)) return VMX_ERR_INVALID_PARAMETERS;
+	if (!VMX_ResetDecodeStream(instance, 1)) return VMX_ERR_INVALID_PARAMETERS;
+	instance->ImageData = dst;
+	instance->ImageStride = stride;
+	instance->ImageFormat = format;
+	instance->ImageDataA = dst + (stride * sz.height);
+	instance->ImageStrideA = stride >> 1;
+	instance->DecodeScale = scale;
+	VMX_PreparePlanes(instance, VMX_UsesAlphaPlane(format), false);
+	if (format == VMX_IMAGE_BGRX)
+	{
+		int planeLen = instance->Planes[3].Stride * (instance->AlignedHeight / scale);
+		memset(instance->Planes[3].Data, 255, planeLen);
+	}
+	instance->Tasks->Run(VMX_DecodeScaledSlicesTask, instance, instance->SliceCount, instance->Threads, VMX_GetNodes(instance));
+	return VMX_ERR_OK;
+}
+
+//Same bitstream walk as VMX_DecodePlaneInternal128, limited to block columns firstBlock to lastBlock of block rows firstRow to lastRow.
+//Blocks outside only advance the AC position without storing coefficients. The planes of a slice follow each other in its streams,
+//so only the last plane decoded (stop set) can leave the walk after the last block needed.
+static void VMX_DecodePlaneRegion(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SLICE_SET* s, int firstBlock, int lastBlock, int firstRow, int lastRow, bool stop)
+{
+	buffer_t b = 0;
+	buffer_t bc = 0;
+	buffer_t val = 0;
+
+	VMX_PLANE plane = *pPlane;
+
+	int shift = 0;
+	if (plane.Index == 0 || plane.Index == 3)
+	{
+		shift = 128;
+	}
+	BYTE* pDst = plane.Data + s->Offset[plane.Index];
+	int stride = plane.Stride;
+	int blocks = stride >> 3;
+	int rows = stop ? lastRow + 1 : (plane.SliceHeight >> 3);
+	int dcPred = 0;
+	buffer_t termsToDecode = 0;
+
+	int dcshift = instance->DCShift;
+
+	VMX_SLICE_DATA dataDC = s->DC;
+	VMX_SLICE_DATA dataAC = s->AC;
+	short* TempBlock = s->TempBlock2;
+
+	const unsigned short* matrix = instance->DecodeMatrix;
+
+	int validCount = 0;
+
+	for (int row = 0; row < rows; row++)
+	{
+		for (int x = 0; x < blocks; x++)
+		{
+			bool visible = row >= firstRow && row <= lastRow && x >= firstBlock && x <= lastBlock;
+			validCount = 0;
+			if (termsToDecode < 64)
+			{
+				validCount = 1;
+			}
+			if (visible)
+			{
+				memset(TempBlock, 0, 128);
+				while (termsToDecode < 64)
+				{
+					GolombLookup l = GolombLookupLut[(dataAC.TempRead >> (dataAC.BitsLeft - 12)) & 0xFFF];
+					if (l.length)
+					{
+						dataAC.BitsLeft -= l.length;
+						TempBlock[termsToDecode] = l.value;
+						termsToDecode += l.zeros;
+					}
+					else {
+						bc = 0;
+						GETBITB(dataAC, b);
+						if (b)
+						{
+							GETBITB(dataAC, b);
+							if (b)
+							{
+								termsToDecode++;
+							}
+							else {
+								GETZEROSB(dataAC, bc);
+								bc += 2;
+								GETBITSB(dataAC, bc, val);
+								termsToDecode += val;
+								bc = 0;
+							}
+						}
+						else {
+							GETZEROSB(dataAC, bc);
+							bc += 2;
+							GETBITSB(dataAC, bc, val);
+							TempBlock[termsToDecode] = GetIntFrom2MagSign((val - 1));
+							termsToDecode++;
+						}
+					}
+
+					RELOADBITS(dataAC);
+				}
+			}
+			else {
+				while (termsToDecode < 64)
+				{
+					GolombLookup l = GolombLookupLut[(dataAC.TempRead >> (dataAC.BitsLeft - 12)) & 0xFFF];
+					if (l.length)
+					{
+						dataAC.BitsLeft -= l.length;
+						termsToDecode += l.zeros;
+					}
+					else {
+						bc = 0;
+						GETBITB(dataAC, b);
+						if (b)
+						{
+							GETBITB(dataAC, b);
+							if (b)
+							{
+								termsToDecode++;
+							}
+							else {
+								GETZEROSB(dataAC, bc);
+								bc += 2;
+								GETBITSB(dataAC, bc, val);
+								termsToDecode += val;
+								bc = 0;
+							}
+						}
+						else {
+							GETZEROSB(dataAC, bc);
+							bc += 2;
+							GETBITSB(dataAC, bc, val);
+							termsToDecode++;
+						}
+					}
+
+					RELOADBITS(dataAC);
+				}
+			}
+			termsToDecode -= 64;
+
+			//Read DC, needed for the prediction of the blocks that follow even when this one is not visible
+			short dc = 0;
+			GETBIT(dataDC, b);
+			if (b)
+			{
+				GETBIT(dataDC, b);
+			}
+			else {
+				GETZEROS(dataDC, bc);
+				bc += 2;
+				GETBITS(dataDC, bc, val);
+				dc = GetIntFrom2MagSign((val - 1));
+				dc <<= dcshift;
+			}
+			dc += dcPred;
+			dcPred = dc;
 
-	const short* colorTable = YUV_RGB_709;
-	if (instance->ColorSpace == VMX_COLORSPACE_BT601) colorTable = YUV_RGB_601;
+			if (!visible) continue;
+			TempBlock[0] = dc;
+			BYTE* dst = pDst + (row * 8 * stride) + (x * 8);
+			if (validCount)
+			{
+				VMX_ZIG_INVQUANTIZE_IDCT_8X8_128(TempBlock, matrix, dst, stride, shift);
+			}
+			else {
+				VMX_BROADCAST_DC_8X8_128(TempBlock[0], dst, stride, shift);
+			}
+			if (stop && row == lastRow && x == lastBlock) break;
+		}
+	}
 
-	VMX_ResetStream(instance);
-	VMX_DecodePlanesPreview(instance, true);
+	REWINDOVERREAD(dataAC);
+
+	FLUSHREMAININGREADBITS(dataDC);
+	FLUSHREMAININGREADBITS(dataAC);
+	s->AC = dataAC;
+	s->DC = dataDC;
+}
 
+//First frame row of a slice, with rows of interlaced slices step 2 apart. Matches the destination offsets of VMX_DecodeSlices.
+static inline int VMX_GetSliceFirstRow(VMX_INSTANCE* instance, VMX_SLICE_SET* s, int i)
+{
 	if (instance->Format == VMX_FORMAT_INTERLACED)
 	{
-		previewSize = instance->PreviewSizeInterlaced;
-		VMX_SIZE sz = { previewSize.width, previewSize.height >> 1 };
-		VMX_YUV4224ToBGRA(instance->Planes[0].Data, instance->Planes[0].Stride, instance->Planes[1].Data, instance->Planes[1].Stride, instance->Planes[2].Data, instance->Planes[2].Stride, instance->Planes[3].Data, instance->Planes[3].Stride, dst, stride << 1, sz, colorTable);
-		dst += stride;
-		VMX_YUV4224ToBGRA(instance->Planes[0].DataLowerPreview, instance->Planes[0].Stride, instance->Planes[1].DataLowerPreview, instance->Planes[1].Stride, instance->Planes[2].DataLowerPreview, instance->Planes[2].Stride, instance->Planes[3].DataLowerPreview, instance->Planes[3].Stride, dst, stride << 1, sz, colorTable);
-	}
-	else
-	{
-		VMX_YUV4224ToBGRA(instance->Planes[0].Data, instance->Planes[0].Stride, instance->Planes[1].Data, instance->Planes[1].Stride, instance->Planes[2].Data, instance->Planes[2].Stride, instance->Planes[3].Data, instance->Planes[3].Stride, dst, stride, previewSize, colorTable);
+		int row = i * VMX_SLICE_HEIGHT * 2;
+		if (s->LowerField) row -= instance->AlignedHeight - 1;
+		return row;
 	}
-	return VMX_ERR_OK;
+	return i * VMX_SLICE_HEIGHT;
 }
 
-VMX_API VMX_ERR VMX_DecodePreviewBGRX(VMX_INSTANCE* instance, BYTE* dst, int stride)
+static void VMX_DecodeRegionSlicesTask(void* context, int start, int count)
 {
-	if (!instance) return VMX_ERR_INVALID_INSTANCE;
-	VMX_SIZE previewSize = instance->PreviewSize;
-	if (stride < (previewSize.width * 4)) return VMX_ERR_INVALID_PARAMETERS;
+	VMX_INSTANCE* instance = (VMX_INSTANCE*)context;
+	VMX_PLANE y = instance->Planes[0];
+	VMX_PLANE u = instance->Planes[1];
+	VMX_PLANE v = instance->Planes[2];
+	VMX_PLANE a = instance->Planes[3];
+
+	VMX_RECT rect = instance->DecodeRegion;
+	bool alpha = instance->ImageFormat == VMX_IMAGE_UYVA || instance->ImageFormat == VMX_IMAGE_BGRA;
+	bool interlaced = instance->Format == VMX_FORMAT_INTERLACED;
+	int step = interlaced ? 2 : 1;
 
 	const short* colorTable = YUV_RGB_709;
 	if (instance->ColorSpace == VMX_COLORSPACE_BT601) colorTable = YUV_RGB_601;
 
-	VMX_ResetStream(instance);
-	VMX_DecodePlanesPreview(instance, false);
-	int planeLen = instance->Planes[0].Stride * previewSize.height;
-	memset(instance->Planes[3].Data, 255, planeLen);
+	//Block columns covering the rectangle in the full width and half width planes
+	int firstBlock = rect.x >> 3;
+	int lastBlock = (rect.x + rect.width - 1) >> 3;
+	int firstBlockUV = (rect.x >> 1) >> 3;
+	int lastBlockUV = (((rect.x + rect.width) >> 1) - 1) >> 3;
 
-	if (instance->Format == VMX_FORMAT_INTERLACED)
-	{
-		previewSize = instance->PreviewSizeInterlaced;
-		VMX_SIZE sz = { previewSize.width, previewSize.height >> 1 };
-		VMX_YUV4224ToBGRA(instance->Planes[0].Data, instance->Planes[0].Stride, instance->Planes[1].Data, instance->Planes[1].Stride, instance->Planes[2].Data, instance->Planes[2].Stride, instance->Planes[3].Data, instance->Planes[3].Stride, dst, stride << 1, sz, colorTable);
-		dst += stride;
-		VMX_YUV4224ToBGRA(instance->Planes[0].DataLowerPreview, instance->Planes[0].Stride, instance->Planes[1].DataLowerPreview, instance->Planes[1].Stride, instance->Planes[2].DataLowerPreview, instance->Planes[2].Stride, instance->Planes[3].DataLowerPreview, instance->Planes[3].Stride, dst, stride << 1, sz, colorTable);
-	}
-	else
+	for (int n = start; n < (start + count); n++)
 	{
-		VMX_YUV4224ToBGRA(instance->Planes[0].Data, instance->Planes[0].Stride, instance->Planes[1].Data, instance->Planes[1].Stride, instance->Planes[2].Data, instance->Planes[2].Stride, instance->Planes[3].Data, instance->Planes[3].Stride, dst, stride, previewSize, colorTable);
+		int i = n < instance->RegionCount[0] ? instance->RegionFirst[0] + n : instance->RegionFirst[1] + n - instance->RegionCount[0];
+		VMX_SLICE_SET* s = instance->Slices[i];
+		if (s->Repeated) continue;
+		int rows = interlaced ? s->PixelSizeInterlaced.height : s->PixelSize.height;
+		int sliceRow = VMX_GetSliceFirstRow(instance, s, i);
+
+		//Rows of this slice inside the rectangle
+		int first = rect.y - sliceRow;
+		first = first > 0 ? (first + step - 1) / step : 0;
+		int last = (rect.y + rect.height - sliceRow + step - 1) / step;
+		if (last > rows) last = rows;
+		if (first >= last) continue;
+
+		int firstRow = first >> 3;
+		int lastRow = (last - 1) >> 3;
+		//A single row of 4:2:0 chroma blocks covers the whole slice
+		int firstRowUV = instance->Chroma420 ? 0 : firstRow;
+		int lastRowUV = instance->Chroma420 ? 0 : lastRow;
+		VMX_DecodePlaneRegion(instance, &y, s, firstBlock, lastBlock, firstRow, lastRow, false);
+		VMX_DecodePlaneRegion(instance, &u, s, firstBlockUV, lastBlockUV, firstRowUV, lastRowUV, false);
+		VMX_DecodePlaneRegion(instance, &v, s, firstBlockUV, lastBlockUV, firstRowUV, lastRowUV, !alpha);
+		if (alpha) VMX_DecodePlaneRegion(instance, &a, s, firstBlock, lastBlock, firstRow, lastRow, true);
+		if (instance->Chroma420)
+		{
+			VMX_ExpandChromaRows(u.Data + s->Offset[1], u.Stride, u.SliceHeight);
+			VMX_ExpandChromaRows(v.Data + s->Offset[2], v.Stride, v.SliceHeight);
+		}
+
+		VMX_SIZE sz = { rect.width, last - first };
+		int stride = instance->ImageStride * step;
+		int strideA = instance->ImageStrideA * step;
+		int dstRow = sliceRow + (first * step) - rect.y;
+		BYTE* dst = instance->ImageData + (dstRow * instance->ImageStride);
+		BYTE* dstA = instance->ImageDataA + (dstRow * instance->ImageStrideA);
+		BYTE* srcY = y.Data + s->Offset[0] + (first * y.Stride) + rect.x;
+		BYTE* srcU = u.Data + s->Offset[1] + (first * u.Stride) + (rect.x >> 1);
+		BYTE* srcV = v.Data + s->Offset[2] + (first * v.Stride) + (rect.x >> 1);
+		BYTE* srcA = a.Data + s->Offset[3] + (first * a.Stride) + rect.x;
+
+		switch (instance->ImageFormat)
+		{
+		case VMX_IMAGE_UYVY:
+			VMX_PlanarToUYVY(srcY, y.Stride, srcU, u.Stride, srcV, v.Stride, dst, stride, sz);
+			break;
+		case VMX_IMAGE_UYVA:
+			VMX_PlanarToUYVY(srcY, y.Stride, srcU, u.Stride, srcV, v.Stride, dst, stride, sz);
+			VMX_PlanarToA(srcA, a.Stride, dstA, strideA, sz);
+			break;
+		case VMX_IMAGE_YUY2:
+			VMX_PlanarToYUY2(srcY, y.Stride, srcU, u.Stride, srcV, v.Stride, dst, stride, sz);
+			break;
+		case VMX_IMAGE_BGRX:
+			for (int r = 0; r < sz.height; r++) memset(srcA + (r * a.Stride), 255, sz.width);
+			VMX_YUV4224ToBGRA(srcY, y.Stride, srcU, u.Stride, srcV, v.Stride, srcA, a.Stride, dst, stride, sz, colorTable);
+			break;
+		case VMX_IMAGE_BGRA:
+			VMX_YUV4224ToBGRA(srcY, y.Stride, srcU, u.Stride, srcV, v.Stride, srcA, a.Stride, dst, stride, sz, colorTable);
+			break;
+		default:
+			break;
+		}
 	}
-	return VMX_ERR_OK;
 }
 
-VMX_API VMX_ERR VMX_DecodeBGRA(VMX_INSTANCE* instance, BYTE* dst, int stride)
+VMX_API VMX_ERR VMX_DecodeRegion(VMX_INSTANCE* instance, VMX_RECT rect, VMX_IMAGE_FORMAT format, BYTE* dst, int stride)
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
-	if (stride < (instance->Planes[0].Size.width * 4)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	VMX_SIZE frame = instance->Planes[0].Size;
+	if (rect.x < 0 || rect.y < 0 || rect.width <= 0 || rect.height <= 0) return VMX_ERR_INVALID_PARAMETERS;
+	if ((rect.x | rect.width) & 1) return VMX_ERR_INVALID_PARAMETERS;
+	if (rect.x + rect.width > frame.width || rect.y + rect.height > frame.height) return VMX_ERR_INVALID_PARAMETERS;
+	int bytesPerPixel;
+	switch (format)
+	{
+	case VMX_IMAGE_UYVY:
+	case VMX_IMAGE_UYVA:
+	case VMX_IMAGE_YUY2:
+		bytesPerPixel = 2;
+		break;
+	case VMX_IMAGE_BGRA:
+	case VMX_IMAGE_BGRX:
+		bytesPerPixel = 4;
+		break;
+	default:
+		return VMX_ERR_INVALID_PARAMETERS;
+	}
+	if (stride < (rect.width * bytesPerPixel)) return VMX_ERR_INVALID_PARAMETERS;
+	if (!VMX_ResetDecodeStream(instance, 1)) return VMX_ERR_INVALID_PARAMETERS;
 	instance->ImageData = dst;
 	instance->ImageStride = stride;
-	instance->ImageFormat = VMX_IMAGE_BGRA;
-	VMX_DecodePlanes(instance);	
-	return VMX_ERR_OK;
-}
+	instance->ImageFormat = format;
+	instance->ImageDataA = dst + (stride * rect.height);
+	instance->ImageStrideA = stride >> 1;
+	instance->DecodeRegion = rect;
+	VMX_PreparePlanes(instance, VMX_UsesAlphaPlane(format), false);
 
-VMX_API VMX_ERR VMX_DecodeBGRX(VMX_INSTANCE* instance, BYTE* dst, int stride)
-{
-	if (!instance) return VMX_ERR_INVALID_INSTANCE;
-	if (stride < (instance->Planes[0].Size.width * 4)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
-	instance->ImageData = dst;
-	instance->ImageStride = stride;
-	instance->ImageFormat = VMX_IMAGE_BGRX;
-	int planeLen = instance->Planes[0].Stride * instance->Planes[0].Size.height;
-	memset(instance->Planes[3].Data, 255, planeLen);
-	VMX_DecodePlanes(instance);
+	//Slices overlapping the rectangle, in one run per field
+	instance->RegionCount[0] = 0;
+	instance->RegionCount[1] = 0;
+	for (int i = 0; i < instance->SliceCount; i++)
+	{
+		VMX_SLICE_SET* s = instance->Slices[i];
+		int step = 1;
+		int rows = s->PixelSize.height;
+		if (instance->Format == VMX_FORMAT_INTERLACED)
+		{
+			step = 2;
+			rows = s->PixelSizeInterlaced.height;
+		}
+		int sliceRow = VMX_GetSliceFirstRow(instance, s, i);
+		if (sliceRow + ((rows - 1) * step) < rect.y || sliceRow >= rect.y + rect.height) continue;
+		int field = instance->Format == VMX_FORMAT_INTERLACED && s->LowerField;
+		if (!instance->RegionCount[field]) instance->RegionFirst[field] = i;
+		instance->RegionCount[field]++;
+	}
+	instance->Tasks->Run(VMX_DecodeRegionSlicesTask, instance, instance->RegionCount[0] + instance->RegionCount[1], instance->Threads);
 	return VMX_ERR_OK;
 }
 
 void VMX_AdjustBitrate(VMX_INSTANCE* instance, int prevFrameLength)
 {
 	if (!prevFrameLength) return;
+	if (instance->RateBufferSize) VMX_UpdateRateBuffer(instance, prevFrameLength);
+
+	if (instance->RateControl == VMX_RATE_CONTROL_PREDICTIVE)
+	{
+		//Quality for the next frame is picked when it is encoded, so only calibrate the estimate against what this frame produced
+		int acBytes = 0;
+		for (int i = 0; i < instance->SliceCount; i++)
+		{
+			acBytes += (int)(instance->Slices[i]->AC.StreamPos - instance->Slices[i]->AC.Stream) + 4;
+		}
+		instance->RateDCBytes = prevFrameLength - acBytes;
+		if (instance->RateEstimate > 0) instance->RateBytesPerBit = acBytes / instance->RateEstimate;
+		return;
+	}
 
 	int targetMin = instance->TargetBytesPerFrameMin;
 	int targetMax = instance->TargetBytesPerFrameMax;
@@ -1161,6 +2751,7 @@ void VMX_AdjustBitrate(VMX_INSTANCE* instance, int prevFrameLength)
 }
 VMX_API int VMX_GetEncodedPreviewLength(VMX_INSTANCE* instance)
 {
+	VMX_WaitEncoded(instance);
 	int len = 0;
 	if (instance->DCShift > 0)
 	{
@@ -1199,48 +2790,187 @@ VMX_API void VMX_SetThreads(VMX_INSTANCE* instance, int numThreads)
 {
 	if (!instance) return;
 	if (numThreads > 0) {
+		VMX_WaitEncoded(instance);
 		if (numThreads != instance->Threads) {
-			DestroyTasks(instance->Tasks);
 			instance->Threads = numThreads;
-			instance->Tasks = CreateTasks(numThreads);
+			if (!instance->SharedTasks) {
+				DestroyTasks(instance->Tasks);
+				instance->Tasks = CreateTasks(numThreads, VMX_GetNodes(instance) > 1);
+			}
 		}
 	}
 }
-VMX_API int VMX_SaveTo(VMX_INSTANCE* instance, BYTE* dst, int maxLen)
+
+static std::mutex VMX_DefaultPoolMutex;
+static VMX_POOL* VMX_DefaultPool = NULL;
+
+VMX_POOL* VMX_AcquireDefaultPool()
 {
-	if (!instance) return VMX_ERR_INVALID_INSTANCE;
-	if (!dst) return VMX_ERR_INVALID_PARAMETERS;
-	if (!maxLen) return VMX_ERR_INVALID_PARAMETERS;
+	std::lock_guard<std::mutex> lock(VMX_DefaultPoolMutex);
+	if (VMX_DefaultPool) VMX_DefaultPool->references++;
+	return VMX_DefaultPool;
+}
 
-	BYTE* b = dst;
-	BYTE* maxB = dst + maxLen;
+VMX_API VMX_POOL* VMX_CreatePool(int numThreads)
+{
+	if (numThreads <= 0) numThreads = (int)std::thread::hardware_concurrency();
+	if (numThreads <= 0) numThreads = 1;
+	VMX_POOL* pool = new VMX_POOL();
+	pool->Initialize(numThreads);
+	return pool;
+}
+
+VMX_API void VMX_DestroyPool(VMX_POOL* pool)
+{
+	DestroyTasks(pool);
+}
+
+VMX_API void VMX_SetDefaultPool(VMX_POOL* pool)
+{
+	std::lock_guard<std::mutex> lock(VMX_DefaultPoolMutex);
+	if (pool) pool->references++;
+	DestroyTasks(VMX_DefaultPool);
+	VMX_DefaultPool = pool;
+}
 
+VMX_API void VMX_SetPool(VMX_INSTANCE* instance, VMX_POOL* pool)
+{
+	if (!instance) return;
+	if (pool == instance->Tasks) return;
+	VMX_WaitEncoded(instance);
+	VMX_WaitDecoded(instance);
+	if (pool) pool->references++;
+	DestroyTasks(instance->Tasks);
+	instance->Tasks = pool;
+	instance->SharedTasks = pool ? 1 : 0;
+	if (!pool) instance->Tasks = CreateTasks(instance->Threads, VMX_GetNodes(instance) > 1);
+}
+//Writes the frame header that precedes the slice streams, returns its length (3 or 5 bytes)
+static inline int VMX_WriteFrameHeader(VMX_INSTANCE* instance, BYTE* b)
+{
 	int dcshift = instance->DCShift;
 	int slicecount = instance->SliceCount;
 	int qual = instance->Quality;
 	VMX_FORMAT fmt = instance->Format;
 
-	CHECKBUFF_SAVE(5);
-
-	if (dcshift > 0)
+	if (dcshift > 0 || instance->Chroma420)
 	{
 		b[0] = VMX_CODEC_FORMAT_EXTENDED;
-		b[1] = dcshift;
+		b[1] = dcshift | (instance->Chroma420 ? VMX_CHROMA_420 : 0);
 
 		b[2] = VMX_CODEC_FORMAT_PROGRESSIVE;
 		if (fmt == VMX_FORMAT_INTERLACED) b[2] = VMX_CODEC_FORMAT_INTERLACED;
 		b[3] = qual;
 		b[4] = slicecount;
-		b += 5;
+		return 5;
 	}
-	else {
-		b[0] = VMX_CODEC_FORMAT_PROGRESSIVE;
-		if (fmt == VMX_FORMAT_INTERLACED) b[0] = VMX_CODEC_FORMAT_INTERLACED;
-		b[1] = qual;
-		b[2] = slicecount;
-		b += 3;
+	b[0] = VMX_CODEC_FORMAT_PROGRESSIVE;
+	if (fmt == VMX_FORMAT_INTERLACED) b[0] = VMX_CODEC_FORMAT_INTERLACED;
+	b[1] = qual;
+	b[2] = slicecount;
+	return 3;
+}
+
+//Chunk header: VMX_CODEC_FORMAT_CHUNK, the frame header, then the first slice and the slice count of the chunk as 16bit values
+static inline int VMX_WriteChunkHeader(VMX_INSTANCE* instance, BYTE* b, int first, int count)
+{
+	b[0] = VMX_CODEC_FORMAT_CHUNK;
+	int len = 1 + VMX_WriteFrameHeader(instance, b + 1);
+	*(uint16_t*)(b + len) = (uint16_t)first;
+	*(uint16_t*)(b + len + 2) = (uint16_t)count;
+	return len + 4;
+}
+
+//Describes chunk c in place as its header followed by the DC and then the AC streams of its slices, each preceded by its length.
+//Adds the chunk length to length and returns the number of segments.
+static int VMX_GetChunkSegments(VMX_INSTANCE* instance, int c, VMX_SEGMENT* segments, int* length)
+{
+	int first = c * instance->ChunkSlices;
+	int count = instance->SliceCount - first;
+	if (count > instance->ChunkSlices) count = instance->ChunkSlices;
+
+	VMX_SEGMENT* seg = segments;
+	BYTE* header = instance->ChunkHeaders + (c * VMX_CHUNK_HEADER_SIZE);
+	seg->Data = header;
+	seg->Length = VMX_WriteChunkHeader(instance, header, first, count);
+	*length += seg->Length;
+	seg++;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (int i = first; i < first + count; i++)
+		{
+			VMX_SLICE_DATA* d = pass ? &instance->Slices[i]->AC : &instance->Slices[i]->DC;
+			int len = (int)(d->StreamPos - d->Stream);
+			*(uint32_t*)(d->Stream - 4) = len;
+			seg->Data = d->Stream - 4;
+			seg->Length = len + 4;
+			*length += seg->Length;
+			seg++;
+		}
 	}
+	return (int)(seg - segments);
+}
+
+VMX_API void VMX_SetChunkedOutput(VMX_INSTANCE* instance, int slicesPerChunk, VMX_CHUNK_CALLBACK callback, void* context)
+{
+	if (!instance) return;
+	VMX_WaitEncoded(instance);
+	delete[] instance->ChunkPending;
+	delete[] instance->ChunkSegments;
+	delete[] instance->ChunkHeaders;
+	instance->ChunkPending = NULL;
+	instance->ChunkSegments = NULL;
+	instance->ChunkHeaders = NULL;
+	instance->ChunkSlices = 0;
+	instance->ChunkCount = 0;
+	instance->ChunkCallback = NULL;
+	instance->ChunkContext = NULL;
+	instance->ChunkBytes = 0;
+	if (slicesPerChunk <= 0) return;
+
+	if (slicesPerChunk > instance->SliceCount) slicesPerChunk = instance->SliceCount;
+	instance->ChunkSlices = slicesPerChunk;
+	instance->ChunkCount = (instance->SliceCount + slicesPerChunk - 1) / slicesPerChunk;
+	instance->ChunkCallback = callback;
+	instance->ChunkContext = context;
+	instance->ChunkPending = new std::atomic<int>[instance->ChunkCount];
+	instance->ChunkSegments = new VMX_SEGMENT[1 + (slicesPerChunk * 2)];
+	instance->ChunkHeaders = new BYTE[instance->ChunkCount * VMX_CHUNK_HEADER_SIZE];
+}
+
+VMX_API int VMX_SaveTo(VMX_INSTANCE* instance, BYTE* dst, int maxLen)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (!dst) return VMX_ERR_INVALID_PARAMETERS;
+	if (!maxLen) return VMX_ERR_INVALID_PARAMETERS;
+	VMX_WaitEncoded(instance);
+
+	BYTE* b = dst;
+	BYTE* maxB = dst + maxLen;
+
+	int slicecount = instance->SliceCount;
+
 	int len = 0;
+	if (instance->ChunkSlices)
+	{
+		for (int c = 0; c < instance->ChunkCount; c++)
+		{
+			int count = VMX_GetChunkSegments(instance, c, instance->ChunkSegments, &len);
+			for (int i = 0; i < count; i++)
+			{
+				CHECKBUFF_SAVE(instance->ChunkSegments[i].Length);
+				memcpy(b, instance->ChunkSegments[i].Data, instance->ChunkSegments[i].Length);
+				b += instance->ChunkSegments[i].Length;
+			}
+		}
+		len = (int)(b - dst);
+		if (!instance->ChunkCallback) VMX_AdjustBitrate(instance, len);
+		return len;
+	}
+
+	CHECKBUFF_SAVE(5);
+
+	b += VMX_WriteFrameHeader(instance, b);
 	for (int i = 0; i < slicecount; i++)
 	{
 		VMX_SLICE_DATA d = instance->Slices[i]->DC;
@@ -1261,27 +2991,310 @@ VMX_API int VMX_SaveTo(VMX_INSTANCE* instance, BYTE* dst, int maxLen)
 		memcpy(b, d.Stream, len);
 		b += len;
 	}
-	len = b - dst;
-	VMX_AdjustBitrate(instance, len);
-	return len;
+	len = b - dst;
+	VMX_AdjustBitrate(instance, len);
+	return len;
+}
+
+//Describes the frame in place as the whole frame header followed by all DC streams, then all AC streams, each preceded by its length,
+//the same order as VMX_SaveTo. The length is written into the headroom reserved in front of the stream so prefix and data form a single segment.
+//Chunks describe their slices the same way, so both can be handed out for one frame. Returns the total length.
+static int VMX_GetFrameSegments(VMX_INSTANCE* instance, VMX_SEGMENT* segments)
+{
+	VMX_SEGMENT* seg = segments;
+	seg->Data = instance->EncodedHeader[instance->StreamSet];
+	seg->Length = VMX_WriteFrameHeader(instance, instance->EncodedHeader[instance->StreamSet]);
+	int total = seg->Length;
+	seg++;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (int i = 0; i < instance->SliceCount; i++)
+		{
+			VMX_SLICE_DATA* d = pass ? &instance->Slices[i]->AC : &instance->Slices[i]->DC;
+			int len = (int)(d->StreamPos - d->Stream);
+			*(uint32_t*)(d->Stream - 4) = len;
+			seg->Data = d->Stream - 4;
+			seg->Length = len + 4;
+			total += seg->Length;
+			seg++;
+		}
+	}
+	return total;
+}
+
+VMX_API int VMX_GetEncodedSegmentCount(VMX_INSTANCE* instance)
+{
+	if (!instance) return 0;
+	if (instance->ChunkSlices) return instance->ChunkCount + (instance->SliceCount * 2);
+	return 1 + (instance->SliceCount * 2);
+}
+
+VMX_API int VMX_GetEncodedSegments(VMX_INSTANCE* instance, VMX_SEGMENT* segments, int maxSegments)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (!segments) return VMX_ERR_INVALID_PARAMETERS;
+	VMX_WaitEncoded(instance);
+	if (!instance->Slices[0]->DC.Buffer || instance->Slices[0]->DC.Stream != instance->Slices[0]->DC.Buffer) return 0; //Nothing encoded yet, or a frame loaded in place
+
+	if (maxSegments < VMX_GetEncodedSegmentCount(instance)) return 0;
+
+	if (instance->ChunkSlices)
+	{
+		int total = 0;
+		VMX_SEGMENT* chunk = segments;
+		for (int c = 0; c < instance->ChunkCount; c++)
+		{
+			chunk += VMX_GetChunkSegments(instance, c, chunk, &total);
+		}
+		if (!instance->ChunkCallback) VMX_AdjustBitrate(instance, total);
+		return total;
+	}
+
+	int total = VMX_GetFrameSegments(instance, segments);
+	VMX_AdjustBitrate(instance, total);
+	return total;
+}
+
+VMX_API int VMX_GetEncodedFrameSegments(VMX_INSTANCE* instance, VMX_SEGMENT* segments, int maxSegments)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (!segments) return VMX_ERR_INVALID_PARAMETERS;
+	VMX_WaitEncoded(instance);
+	if (!instance->Slices[0]->DC.Buffer || instance->Slices[0]->DC.Stream != instance->Slices[0]->DC.Buffer) return 0; //Nothing encoded yet, or a frame loaded in place
+	if (maxSegments < 1 + (instance->SliceCount * 2)) return 0;
+	return VMX_GetFrameSegments(instance, segments);
+}
+
+VMX_API int VMX_GetRepeatedSliceCount(VMX_INSTANCE* instance)
+{
+	if (!instance) return 0;
+	VMX_WaitEncoded(instance);
+	int count = 0;
+	for (int i = 0; i < instance->SliceCount; i++) count += instance->Slices[i]->Repeated;
+	return count;
+}
+
+VMX_API int VMX_GetEncodedSkipSegments(VMX_INSTANCE* instance, VMX_SEGMENT* segments, int maxSegments)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (!segments) return VMX_ERR_INVALID_PARAMETERS;
+	VMX_WaitEncoded(instance);
+	if (!instance->Slices[0]->DC.Buffer || instance->Slices[0]->DC.Stream != instance->Slices[0]->DC.Buffer) return 0; //Nothing encoded yet, or a frame loaded in place
+	if (instance->ChunkSlices) return 0;
+
+	int slicecount = instance->SliceCount;
+	if (maxSegments < VMX_GetEncodedSegmentCount(instance)) return 0;
+
+	//Rate control may have changed the quality since the frame was encoded, so start from the header saved by VMX_EncodePlanes
+	BYTE* frameHeader = instance->EncodedHeader[instance->StreamSet];
+	BYTE* header = instance->EncodedSkipHeader[instance->StreamSet];
+	if (frameHeader[0] == VMX_CODEC_FORMAT_EXTENDED)
+	{
+		memcpy(header, frameHeader, 5);
+	}
+	else {
+		//Only the extended header has room for the flag. The short header is its last three bytes.
+		header[0] = VMX_CODEC_FORMAT_EXTENDED;
+		header[1] = 0;
+		memcpy(header + 2, frameHeader, 3);
+	}
+	header[1] |= VMX_SKIP_SLICES;
+	int bitmapLen = (slicecount + 7) >> 3;
+	memset(header + 5, 0, bitmapLen);
+	for (int i = 0; i < slicecount; i++)
+	{
+		if (instance->Slices[i]->Repeated) header[5 + (i >> 3)] |= (BYTE)(1 << (i & 7));
+	}
+
+	VMX_SEGMENT* seg = segments;
+	seg->Data = header;
+	seg->Length = 5 + bitmapLen;
+	int total = seg->Length;
+	seg++;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (int i = 0; i < slicecount; i++)
+		{
+			if (instance->Slices[i]->Repeated) continue;
+			VMX_SLICE_DATA* d = pass ? &instance->Slices[i]->AC : &instance->Slices[i]->DC;
+			int len = (int)(d->StreamPos - d->Stream);
+			*(uint32_t*)(d->Stream - 4) = len;
+			seg->Data = d->Stream - 4;
+			seg->Length = len + 4;
+			total += seg->Length;
+			seg++;
+		}
+	}
+	return total;
+}
+
+//Upper bound of the Exp-Golomb bits needed for the 63 AC coefficients of one 8x8 block quantized with matrix.
+//
+//The FDCT output is 16x the orthonormal DCT, so by Parseval the AC energy of a block of 8bit samples is at most
+//256 * 64 * 127.5^2 < 2^28, and no single coefficient exceeds the 16bit range. Maximising the code length of all 63
+//coefficients under that energy budget is bounded by its Lagrangian dual, which holds for any lambda >= 0, so the
+//smallest value over a sweep of lambdas is still a strict upper bound, yet far tighter than 23 bits per coefficient.
+static int VMX_MaxBlockACBits(const unsigned short* matrix)
+{
+	const double energy = 268435456.0;
+	double best = 63.0 * 23.0;
+	for (int l = 0; l < 400; l++)
+	{
+		double lambda = pow(10.0, -12.0 + (l * 0.03));
+		double bound = lambda * energy;
+		for (int k = 1; k < 64; k++)
+		{
+			double step = matrix[k];
+			int qmax = (int)(32767 / step) + 1;
+			double m = 2; //A zero coefficient costs at most 2 bits of a zero run
+			for (int q = 1; q <= qmax; q <<= 1)
+			{
+				//Code length only grows at powers of two, so these are the only candidates worth testing
+				int bits = 1;
+				for (int n = (q * 2) + 1; n > 1; n >>= 1) bits += 2;
+				double e = step * (q - 0.5);
+				double v = bits - (lambda * e * e);
+				if (v > m) m = v;
+			}
+			bound += m;
+		}
+		if (bound < best) best = bound;
+	}
+	return (int)ceil(best);
+}
+
+//VMX_MaxBlockACBits of each preset, worked out the first time it is asked for since the sweep is too slow to repeat every frame
+static std::atomic<int> VMX_MaxBlockACBitsCache[VMX_QUALITY_COUNT];
+
+static int VMX_GetMaxBlockACBits(int index)
+{
+	int bits = VMX_MaxBlockACBitsCache[index].load(std::memory_order_relaxed);
+	if (!bits)
+	{
+		bits = VMX_MaxBlockACBits(VMX_QUALITY_PRESETS.Decode[index]);
+		VMX_MaxBlockACBitsCache[index].store(bits, std::memory_order_relaxed);
+	}
+	return bits;
+}
+
+//Bytes the DC or AC stream of one slice can reach at the current quality, plus room for the length and flush words.
+//The bound assumes 8bit samples, so 16bit frames keep the full size streams. alpha adds the blocks of the alpha plane.
+static int VMX_GetLeanStreamLength(VMX_INSTANCE* instance, int ac, bool bits16, bool alpha)
+{
+	if (bits16)
+	{
+		return ac ? instance->Slices[0]->AC.MaxStreamLength : instance->Slices[0]->DC.MaxStreamLength;
+	}
+	int index = (int)((instance->DecodeMatrix - VMX_QUALITY_PRESETS.Decode[0]) / 64);
+	int64_t blocks = (instance->Planes[0].Stride + instance->Planes[1].Stride + instance->Planes[2].Stride) >> 2;
+	if (alpha) blocks += instance->Planes[3].Stride >> 2;
+	int64_t bits = ac ? VMX_GetMaxBlockACBits(index) : 23;
+	return (int)(((blocks * bits) + 7) >> 3) + VMX_STREAM_SLACK;
+}
+
+VMX_API void VMX_SetChroma420(VMX_INSTANCE* instance, int enable)
+{
+	VMX_WaitEncoded(instance);
+	VMX_ConfigureChroma(instance, enable ? 1 : 0);
+}
+
+VMX_API int VMX_GetChroma420(VMX_INSTANCE* instance)
+{
+	return instance->Chroma420;
+}
+
+VMX_API int VMX_GetMaxEncodedLength(VMX_INSTANCE* instance, int alpha)
+{
+	if (!instance) return 0;
+
+	//Rate control may raise quality up to VMX_MAXQ before the next frame, so size for the finest matrix reachable
+	int index = 0;
+	int q = instance->Quality > VMX_MAXQ ? instance->Quality : VMX_MAXQ;
+	for (int i = 0; i < VMX_QUALITY_COUNT; i++)
+	{
+		if (VMX_QUALITY[i] >= (100 - q)) {
+			index = i;
+			break;
+		}
+	}
+	int64_t acBits = VMX_GetMaxBlockACBits(index);
+	int64_t dcBits = 23; //DC differences are bounded by the GolombLengthLut range
+
+	int64_t blocksPerSlice = (instance->Planes[0].Stride + instance->Planes[1].Stride + instance->Planes[2].Stride) >> 2;
+	if (alpha) blocksPerSlice += instance->Planes[3].Stride >> 2;
+
+	//Each stream has a 4 byte length and at most 8 bytes of partially filled flush words
+	int64_t perSlice = 4 + ((blocksPerSlice * dcBits + 7) >> 3) + 8 + 4 + ((blocksPerSlice * acBits + 7) >> 3) + 8;
+	int64_t len = 5 + (perSlice * instance->SliceCount) + ((int64_t)instance->ChunkCount * VMX_CHUNK_HEADER_SIZE);
+	if (len > 0x7FFFFFFF) return 0x7FFFFFFF;
+	return (int)len;
 }
 
 inline void VMX_EncodePlane(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SLICE_SET* s)
 {
-	VMX_EncodePlaneInternal(instance, pPlane, s);
+	if (pPlane->SliceHeight < VMX_SLICE_HEIGHT) VMX_CompactChromaRows(pPlane->Data + s->Offset[pPlane->Index], pPlane->Stride, VMX_GetSliceRows(instance, s), false);
+	VMX_STATS_START(start);
+	VMX_EncodePlaneInternal(instance, pPlane, s, NULL);
+	VMX_STATS_STAGE(s, VMX_STAGE_CODE, start);
+}
+
+//The fused path reads whole 8x8 blocks (16 pixels wide in 4:2:2 chroma) from the source, so it is only used for full
+//slices of frames whose width needs no padding. Everything else goes through the *ToPlanar staging buffers.
+inline bool VMX_CanIngest(VMX_INSTANCE* instance, VMX_SLICE_SET* s)
+{
+	return ((instance->Planes[0].Size.width & 15) == 0) && (s->PixelSize.height == VMX_SLICE_HEIGHT);
+}
+
+//Encode the first planeCount planes of a slice straight from the source image described by ingest.
+inline void VMX_EncodeSliceIngest(VMX_INSTANCE* instance, VMX_SLICE_SET* s, const VMX_INGEST* ingest, int planeCount)
+{
+	VMX_STATS_START(start);
+	for (int p = 0; p < planeCount; p++)
+	{
+		VMX_EncodePlaneInternal(instance, &instance->Planes[p], s, ingest);
+	}
+	VMX_STATS_STAGE(s, VMX_STAGE_CODE, start);
 }
 
 inline void VMX_EncodePlane16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SLICE_SET* s)
 {
+	if (pPlane->SliceHeight < VMX_SLICE_HEIGHT) VMX_CompactChromaRows(pPlane->Data + s->Offset16[pPlane->Index], pPlane->Stride * 2, VMX_GetSliceRows(instance, s), true);
+	VMX_STATS_START(start);
 	VMX_EncodePlaneInternal16(instance, pPlane, s);
+	VMX_STATS_STAGE(s, VMX_STAGE_CODE, start);
 }
 
-void VMX_EncodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
+//Points the copies of the planes at a tile, so that the usual Offset of slice s lands on the start of the tile.
+//Rows past the end of a partial slice are reset to the fill value, as the slice before may have left its own there.
+static void VMX_BindTile(VMX_INSTANCE* instance, VMX_SLICE_SET* s, BYTE* tile, VMX_PLANE** planes)
+{
+	int shift = instance->TileShift;
+	int rows = instance->Format == VMX_FORMAT_INTERLACED ? s->PixelSizeInterlaced.height : s->PixelSize.height;
+	for (int p = 0; p < VMX_MAX_PLANES; p++)
+	{
+		VMX_PLANE* plane = planes[p];
+		int stride = plane->Stride << shift;
+		if (rows < VMX_SLICE_HEIGHT) memset(tile + (stride * rows), VMX_PLANE_FILL[p], stride * (VMX_SLICE_HEIGHT - rows));
+		plane->Data = tile - (shift ? s->Offset16[p] : s->Offset[p]);
+		tile += VMX_GetTilePlaneLength(instance, p, shift);
+	}
+}
+
+static void VMX_EncodeSlicesInternal(VMX_INSTANCE* instance, int startIndex, int count, BYTE* tile)
 {
 	VMX_PLANE y = instance->Planes[0];
 	VMX_PLANE u = instance->Planes[1];
 	VMX_PLANE v = instance->Planes[2];
 	VMX_PLANE a = instance->Planes[3];
+	if (tile)
+	{
+		VMX_PLANE* planes[VMX_MAX_PLANES] = { &y, &u, &v, &a };
+		VMX_BindTile(instance, instance->Slices[startIndex], tile, planes);
+	}
+
+	//Destinations of the first and second chroma samples of semi-planar sources
+	VMX_PLANE* pu = &u;
+	VMX_PLANE* pv = &v;
 
 	const ShortRGB* colorTable;
 
@@ -1308,6 +3321,21 @@ void VMX_EncodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
 				VMX_EncodePlane16(instance, &v, s);
 			}
 			break;
+		case VMX_IMAGE_P010:
+			sliceStrideU = (instance->ImageStrideU * VMX_SLICE_HEIGHT) >> 1;
+			for (int i = startIndex; i < (startIndex + count); i++)
+			{
+				VMX_SLICE_SET* s = instance->Slices[i];
+				VMX_P010ToPlanar(instance->ImageData + (i * sliceStride), instance->ImageStride,
+					instance->ImageDataU + (i * sliceStrideU), instance->ImageStrideU,
+					y.Data + s->Offset16[0], y.Stride * 2,
+					u.Data + s->Offset16[1], u.Stride * 2,
+					v.Data + s->Offset16[2], v.Stride * 2, s->PixelSize);
+				VMX_EncodePlane16(instance, &y, s);
+				VMX_EncodePlane16(instance, &u, s);
+				VMX_EncodePlane16(instance, &v, s);
+			}
+			break;
 		case VMX_IMAGE_PA16:
 			sliceStrideU = (instance->ImageStrideU * VMX_SLICE_HEIGHT);
 			sliceStrideA = instance->ImageStrideA * VMX_SLICE_HEIGHT;
@@ -1331,6 +3359,12 @@ void VMX_EncodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
 			for (int i = startIndex; i < (startIndex + count); i++)
 			{
 				VMX_SLICE_SET* s = instance->Slices[i];
+				if (VMX_CanIngest(instance, s))
+				{
+					VMX_INGEST ingest = { instance->ImageFormat, instance->ImageData + (i * sliceStride), instance->ImageStride, NULL, 0, NULL, instance->Chroma420 };
+					VMX_EncodeSliceIngest(instance, s, &ingest, 3);
+					continue;
+				}
 				VMX_UYVYToPlanar(instance->ImageData + (i * sliceStride), instance->ImageStride,
 					y.Data + s->Offset[0], y.Stride,
 					u.Data + s->Offset[1], u.Stride,
@@ -1361,6 +3395,12 @@ void VMX_EncodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
 			for (int i = startIndex; i < (startIndex + count); i++)
 			{
 				VMX_SLICE_SET* s = instance->Slices[i];
+				if (VMX_CanIngest(instance, s))
+				{
+					VMX_INGEST ingest = { instance->ImageFormat, instance->ImageData + (i * sliceStride), instance->ImageStride, NULL, 0, NULL, instance->Chroma420 };
+					VMX_EncodeSliceIngest(instance, s, &ingest, 3);
+					continue;
+				}
 				VMX_YUY2ToPlanar(instance->ImageData + (i * sliceStride), instance->ImageStride,
 					y.Data + s->Offset[0], y.Stride,
 					u.Data + s->Offset[1], u.Stride,
@@ -1371,15 +3411,25 @@ void VMX_EncodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
 			}
 			break;
 		case VMX_IMAGE_NV12:
+		case VMX_IMAGE_NV21:
 			sliceStrideU = (instance->ImageStrideU * VMX_SLICE_HEIGHT) >> 1;
+			//NV21 is NV12 with the chroma order reversed, so deinterleave straight into swapped planes
+			if (instance->ImageFormat == VMX_IMAGE_NV21) { pu = &v; pv = &u; }
 			for (int i = startIndex; i < (startIndex + count); i++)
 			{
 				VMX_SLICE_SET* s = instance->Slices[i];
+				if (VMX_CanIngest(instance, s))
+				{
+					VMX_INGEST ingest = { instance->ImageFormat, instance->ImageData + (i * sliceStride), instance->ImageStride,
+						instance->ImageDataU + (i * sliceStrideU), instance->ImageStrideU, NULL, instance->Chroma420 };
+					VMX_EncodeSliceIngest(instance, s, &ingest, 3);
+					continue;
+				}
 				VMX_NV12ToPlanar(instance->ImageData + (i * sliceStride), instance->ImageStride,
 					instance->ImageDataU + (i * sliceStrideU), instance->ImageStrideU,
 					y.Data + s->Offset[0], y.Stride,
-					u.Data + s->Offset[1], u.Stride,
-					v.Data + s->Offset[2], v.Stride, s->PixelSize);
+					pu->Data + s->Offset[pu->Index], pu->Stride,
+					pv->Data + s->Offset[pv->Index], pv->Stride, s->PixelSize);
 				VMX_EncodePlane(instance, &y, s);
 				VMX_EncodePlane(instance, &u, s);
 				VMX_EncodePlane(instance, &v, s);
@@ -1417,6 +3467,12 @@ void VMX_EncodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
 			for (int i = startIndex; i < (startIndex + count); i++)
 			{
 				VMX_SLICE_SET* s = instance->Slices[i];
+				if (VMX_CanIngest(instance, s))
+				{
+					VMX_INGEST ingest = { instance->ImageFormat, instance->ImageData + (i * sliceStride), instance->ImageStride, NULL, 0, colorTable, instance->Chroma420 };
+					VMX_EncodeSliceIngest(instance, s, &ingest, 4);
+					continue;
+				}
 				VMX_BGRAToYUV4224(instance->ImageData + (i * sliceStride), instance->ImageStride,
 					y.Data + s->Offset[0], y.Stride,
 					u.Data + s->Offset[1], u.Stride,
@@ -1435,6 +3491,12 @@ void VMX_EncodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
 			for (int i = startIndex; i < (startIndex + count); i++)
 			{
 				VMX_SLICE_SET* s = instance->Slices[i];
+				if (VMX_CanIngest(instance, s))
+				{
+					VMX_INGEST ingest = { instance->ImageFormat, instance->ImageData + (i * sliceStride), instance->ImageStride, NULL, 0, colorTable, instance->Chroma420 };
+					VMX_EncodeSliceIngest(instance, s, &ingest, 3);
+					continue;
+				}
 				VMX_BGRAToYUV4224(instance->ImageData + (i * sliceStride), instance->ImageStride,
 					y.Data + s->Offset[0], y.Stride,
 					u.Data + s->Offset[1], u.Stride,
@@ -1492,6 +3554,25 @@ void VMX_EncodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
 				VMX_EncodePlane16(instance, &v, s);
 			}
 			break;
+		case VMX_IMAGE_P010:
+			sourceStrideU = instance->ImageStrideU << 1;
+			sliceStrideU = (instance->ImageStrideU * VMX_SLICE_HEIGHT);
+			offsetU = 0;
+			interlacedOffsetU = -(instance->ImageStrideU * ((instance->AlignedHeight >> 1) - 1));
+			for (int i = startIndex; i < (startIndex + count); i++)
+			{
+				VMX_SLICE_SET* s = instance->Slices[i];
+				if (s->LowerField) { offset = interlacedOffset; offsetU = interlacedOffsetU; }
+				VMX_P010ToPlanar(instance->ImageData + (i * sliceStride) + offset, sourceStride,
+					instance->ImageDataU + (i * sliceStrideU) + offsetU, sourceStrideU,
+					y.Data + s->Offset16[0], y.Stride * 2,
+					u.Data + s->Offset16[1], u.Stride * 2,
+					v.Data + s->Offset16[2], v.Stride * 2, s->PixelSizeInterlaced);
+				VMX_EncodePlane16(instance, &y, s);
+				VMX_EncodePlane16(instance, &u, s);
+				VMX_EncodePlane16(instance, &v, s);
+			}
+			break;
 		case VMX_IMAGE_PA16:
 			sourceStrideU = instance->ImageStrideU << 1;
 			sliceStrideU = (sourceStrideU * VMX_SLICE_HEIGHT);
@@ -1573,6 +3654,8 @@ void VMX_EncodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
 			}
 			break;
 		case VMX_IMAGE_NV12:
+		case VMX_IMAGE_NV21:
+			if (instance->ImageFormat == VMX_IMAGE_NV21) { pu = &v; pv = &u; }
 			sourceStrideU = instance->ImageStrideU << 1;
 			sliceStrideU = (instance->ImageStrideU * VMX_SLICE_HEIGHT);
 			offsetU = 0;
@@ -1584,8 +3667,8 @@ void VMX_EncodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
 				VMX_NV12ToPlanar(instance->ImageData + (i * sliceStride) + offset, sourceStride,
 					instance->ImageDataU + (i * sliceStrideU) + offsetU, sourceStrideU,
 					y.Data + s->Offset[0], y.Stride,
-					u.Data + s->Offset[1], u.Stride,
-					v.Data + s->Offset[2], v.Stride, s->PixelSizeInterlaced);
+					pu->Data + s->Offset[pu->Index], pu->Stride,
+					pv->Data + s->Offset[pv->Index], pv->Stride, s->PixelSizeInterlaced);
 				VMX_EncodePlane(instance, &y, s);
 				VMX_EncodePlane(instance, &u, s);
 				VMX_EncodePlane(instance, &v, s);
@@ -1635,53 +3718,716 @@ void VMX_EncodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
 				VMX_EncodePlane(instance, &v, s);
 				VMX_EncodePlane(instance, &a, s);
 			}
-			break;
-		case VMX_IMAGE_BGRX:
-			colorTable = RGB_YUV_709;
-			if (instance->ColorSpace == VMX_COLORSPACE_BT601) colorTable = RGB_YUV_601;
-			for (int i = startIndex; i < (startIndex + count); i++)
+			break;
+		case VMX_IMAGE_BGRX:
+			colorTable = RGB_YUV_709;
+			if (instance->ColorSpace == VMX_COLORSPACE_BT601) colorTable = RGB_YUV_601;
+			for (int i = startIndex; i < (startIndex + count); i++)
+			{
+				VMX_SLICE_SET* s = instance->Slices[i];
+				if (s->LowerField) offset = interlacedOffset;
+				VMX_BGRAToYUV4224(instance->ImageData + (i * sliceStride) + offset, sourceStride,
+					y.Data + s->Offset[0], y.Stride,
+					u.Data + s->Offset[1], u.Stride,
+					v.Data + s->Offset[2], v.Stride,
+					a.Data + s->Offset[3], a.Stride,
+					s->PixelSizeInterlaced, colorTable);
+				VMX_EncodePlane(instance, &y, s);
+				VMX_EncodePlane(instance, &u, s);
+				VMX_EncodePlane(instance, &v, s);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+}
+
+//VMX_EncodeSlicesInternal one slice at a time when timing, with whatever VMX_EncodePlane did not count as coding counted as conversion
+static inline void VMX_EncodeSlicesTimed(VMX_INSTANCE* instance, int startIndex, int count, BYTE* tile)
+{
+#if VMX_STATS
+	for (int i = startIndex; i < (startIndex + count); i++)
+	{
+		VMX_SLICE_SET* s = instance->Slices[i];
+		int64_t start = VMX_StatsNow();
+		int64_t code = s->StatsNs[VMX_STAGE_CODE];
+		VMX_EncodeSlicesInternal(instance, i, 1, tile);
+		s->StatsEnd = VMX_StatsNow();
+		s->StatsNs[VMX_STAGE_CONVERT] += (s->StatsEnd - start) - (s->StatsNs[VMX_STAGE_CODE] - code);
+		s->StatsThread[VMX_STAGE_CONVERT] = VMX_StatsThread();
+	}
+#else
+	VMX_EncodeSlicesInternal(instance, startIndex, count, tile);
+#endif
+}
+
+void VMX_EncodeSlices(VMX_INSTANCE* instance, int startIndex, int count)
+{
+	if (!instance->Tiles || !VMX_UsesTiles(instance))
+	{
+		VMX_EncodeSlicesTimed(instance, startIndex, count, NULL);
+		return;
+	}
+	//At most Threads tasks run at once, so one of the tiles is always about to come free
+	int t = 0;
+	for (;;)
+	{
+		int expected = 0;
+		if (instance->TileBusy[t].compare_exchange_weak(expected, 1, std::memory_order_acquire)) break;
+		if (++t == instance->TileCount)
+		{
+			t = 0;
+			THREAD_TASKS_PAUSE();
+		}
+	}
+	BYTE* tile = instance->Tiles + ((size_t)t * instance->TileLength);
+	for (int i = startIndex; i < (startIndex + count); i++) VMX_EncodeSlicesTimed(instance, i, 1, tile);
+	instance->TileBusy[t].store(0, std::memory_order_release);
+}
+
+//Rows of the source image that VMX_EncodeSlices reads for one slice of one plane
+struct VMX_SLICE_SOURCE
+{
+	const BYTE* Data;
+	int Stride;
+	int Width; //Bytes per row
+	int Rows;
+};
+
+//data and stride describe a whole plane of the source, rowShift is 1 for planes of half the image height
+static inline void VMX_AddSliceSource(VMX_INSTANCE* instance, int i, const BYTE* data, int stride, int width, int rowShift, VMX_SLICE_SOURCE* sources, int* count)
+{
+	VMX_SLICE_SET* s = instance->Slices[i];
+	VMX_SLICE_SOURCE* src = &sources[(*count)++];
+	src->Width = width;
+	if (instance->Format == VMX_FORMAT_PROGRESSIVE)
+	{
+		src->Data = data + (((size_t)i * stride * VMX_SLICE_HEIGHT) >> rowShift);
+		src->Stride = stride;
+		src->Rows = s->PixelSize.height >> rowShift;
+	}
+	else {
+		src->Data = data + (((size_t)i * (stride << 1) * VMX_SLICE_HEIGHT) >> rowShift);
+		if (s->LowerField) src->Data -= (size_t)stride * ((instance->AlignedHeight >> rowShift) - 1);
+		src->Stride = stride << 1;
+		src->Rows = s->PixelSizeInterlaced.height >> rowShift;
+	}
+}
+
+//Mirrors the per format source addressing of VMX_EncodeSlices. Returns the number of sources.
+static int VMX_GetSliceSources(VMX_INSTANCE* instance, int i, VMX_SLICE_SOURCE* sources)
+{
+	int count = 0;
+	int width = instance->Planes[0].Size.width;
+	switch (instance->ImageFormat)
+	{
+	case VMX_IMAGE_P216:
+		VMX_AddSliceSource(instance, i, instance->ImageData, instance->ImageStride, width * 2, 0, sources, &count);
+		VMX_AddSliceSource(instance, i, instance->ImageDataU, instance->ImageStrideU, width * 2, 0, sources, &count);
+		break;
+	case VMX_IMAGE_P010:
+		VMX_AddSliceSource(instance, i, instance->ImageData, instance->ImageStride, width * 2, 0, sources, &count);
+		VMX_AddSliceSource(instance, i, instance->ImageDataU, instance->ImageStrideU, width * 2, 1, sources, &count);
+		break;
+	case VMX_IMAGE_PA16:
+		VMX_AddSliceSource(instance, i, instance->ImageData, instance->ImageStride, width * 2, 0, sources, &count);
+		VMX_AddSliceSource(instance, i, instance->ImageDataU, instance->ImageStrideU, width * 2, 0, sources, &count);
+		VMX_AddSliceSource(instance, i, instance->ImageDataA, instance->ImageStrideA, width * 2, 0, sources, &count);
+		break;
+	case VMX_IMAGE_UYVY:
+	case VMX_IMAGE_YUY2:
+		VMX_AddSliceSource(instance, i, instance->ImageData, instance->ImageStride, width * 2, 0, sources, &count);
+		break;
+	case VMX_IMAGE_UYVA:
+		VMX_AddSliceSource(instance, i, instance->ImageData, instance->ImageStride, width * 2, 0, sources, &count);
+		VMX_AddSliceSource(instance, i, instance->ImageDataA, instance->ImageStrideA, width, 0, sources, &count);
+		break;
+	case VMX_IMAGE_NV12:
+	case VMX_IMAGE_NV21:
+		VMX_AddSliceSource(instance, i, instance->ImageData, instance->ImageStride, width, 0, sources, &count);
+		VMX_AddSliceSource(instance, i, instance->ImageDataU, instance->ImageStrideU, width, 1, sources, &count);
+		break;
+	case VMX_IMAGE_YV12:
+		VMX_AddSliceSource(instance, i, instance->ImageData, instance->ImageStride, width, 0, sources, &count);
+		VMX_AddSliceSource(instance, i, instance->ImageDataU, instance->ImageStrideU, width >> 1, 1, sources, &count);
+		VMX_AddSliceSource(instance, i, instance->ImageDataV, instance->ImageStrideV, width >> 1, 1, sources, &count);
+		break;
+	case VMX_IMAGE_YUVPLANAR422:
+		//The caller fills the planes directly, so the whole padded slice of each plane is encoded
+		for (int p = 0; p < 3; p++)
+		{
+			VMX_SLICE_SOURCE* src = &sources[count++];
+			src->Data = instance->Planes[p].Data + instance->Slices[i]->Offset[p];
+			src->Stride = instance->Planes[p].Stride;
+			src->Width = instance->Planes[p].Stride;
+			src->Rows = VMX_SLICE_HEIGHT;
+		}
+		break;
+	case VMX_IMAGE_BGRA:
+	case VMX_IMAGE_BGRX:
+		VMX_AddSliceSource(instance, i, instance->ImageData, instance->ImageStride, width * 4, 0, sources, &count);
+		break;
+	default:
+		break;
+	}
+	return count;
+}
+
+static const uint64_t VMX_HASH_KEY[4] = { 0xBE4BA423396CFEB8ULL, 0x1CAD21F72C81017CULL, 0xDB979083E96DD4DEULL, 0x1F67B3B7A4A44072ULL };
+static const uint64_t VMX_HASH_STEP = 0x9E3779B97F4A7C15ULL;
+
+//XXH3 style accumulate of 16 bytes: the key depends on the position in the row, so moving data around changes the sum
+static inline __m128i VMX_HashAccumulate(__m128i acc, __m128i data, __m128i key)
+{
+	__m128i k = _mm_xor_si128(data, key);
+	acc = _mm_add_epi64(acc, _mm_mul_epu32(k, _mm_shuffle_epi32(k, _MM_SHUFFLE(2, 3, 0, 1))));
+	return _mm_add_epi64(acc, _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+//Mixes the accumulator after every row, so the order of rows matters too
+static inline __m128i VMX_HashScramble(__m128i acc, __m128i key)
+{
+	const __m128i prime = _mm_set1_epi32((int)0x9E3779B1);
+	acc = _mm_xor_si128(acc, _mm_srli_epi64(acc, 47));
+	acc = _mm_xor_si128(acc, key);
+	__m128i lo = _mm_mul_epu32(acc, prime);
+	__m128i hi = _mm_mul_epu32(_mm_srli_epi64(acc, 32), prime);
+	return _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+}
+
+static inline uint64_t VMX_HashAvalanche(uint64_t h)
+{
+	h ^= h >> 37;
+	h *= 0x165667919E3779F9ULL;
+	return h ^ (h >> 32);
+}
+
+static void VMX_HashSlice(VMX_INSTANCE* instance, int i, uint64_t* hash)
+{
+	VMX_SLICE_SOURCE sources[VMX_MAX_PLANES];
+	int count = VMX_GetSliceSources(instance, i, sources);
+	const __m128i key0 = _mm_set_epi64x((long long)VMX_HASH_KEY[1], (long long)VMX_HASH_KEY[0]);
+	const __m128i key1 = _mm_set_epi64x((long long)VMX_HASH_KEY[3], (long long)VMX_HASH_KEY[2]);
+	const __m128i step = _mm_set1_epi64x((long long)VMX_HASH_STEP);
+	__m128i acc0 = key1;
+	__m128i acc1 = key0;
+	for (int p = 0; p < count; p++)
+	{
+		const BYTE* row = sources[p].Data;
+		int width = sources[p].Width;
+		for (int y = 0; y < sources[p].Rows; y++)
+		{
+			__m128i k0 = key0;
+			__m128i k1 = key1;
+			int x = 0;
+			for (; x + 32 <= width; x += 32)
+			{
+				acc0 = VMX_HashAccumulate(acc0, _mm_loadu_si128((const __m128i*)(row + x)), k0);
+				acc1 = VMX_HashAccumulate(acc1, _mm_loadu_si128((const __m128i*)(row + x + 16)), k1);
+				k0 = _mm_add_epi64(k0, step);
+				k1 = _mm_add_epi64(k1, step);
+			}
+			if (x < width)
+			{
+				VMX_ALIGNAS(16) BYTE tail[32] = { 0 };
+				memcpy(tail, row + x, width - x);
+				acc0 = VMX_HashAccumulate(acc0, _mm_load_si128((const __m128i*)tail), k0);
+				acc1 = VMX_HashAccumulate(acc1, _mm_load_si128((const __m128i*)(tail + 16)), k1);
+			}
+			acc0 = VMX_HashScramble(acc0, key1);
+			acc1 = VMX_HashScramble(acc1, key0);
+			row += sources[p].Stride;
+		}
+	}
+	VMX_ALIGNAS(16) uint64_t a[4];
+	_mm_store_si128((__m128i*)a, acc0);
+	_mm_store_si128((__m128i*)(a + 2), acc1);
+	hash[0] = VMX_HashAvalanche(a[0] + a[3]);
+	hash[1] = VMX_HashAvalanche(a[1] + a[2]);
+}
+
+//Everything besides the source that the encoded streams of a slice depend on
+static int VMX_GetSliceCacheKey(VMX_INSTANCE* instance)
+{
+	return instance->Quality | (instance->DCShift << 8) | (instance->avx2 << 10) | (instance->Format << 11) | (instance->ImageFormat << 12) | (instance->Chroma420 << 24);
+}
+
+VMX_API void VMX_SetSliceCache(VMX_INSTANCE* instance, int enable)
+{
+	if (!instance) return;
+	VMX_WaitEncoded(instance);
+	instance->SliceCache = enable ? 1 : 0;
+	instance->SliceCacheKey = -1;
+}
+
+VMX_API void VMX_SetLeanMemory(VMX_INSTANCE* instance, int enable)
+{
+	if (!instance) return;
+	VMX_WaitEncoded(instance);
+	VMX_WaitDecoded(instance);
+	enable = enable ? 1 : 0;
+	if (instance->LeanMemory == enable) return;
+	instance->LeanMemory = enable;
+	//Buffers of the other mode are dropped, the ones this mode needs come back on the next frame
+	VMX_FreeStreams(instance);
+	VMX_FreePlanes(instance);
+	if (enable) return;
+	VMX_FreeTiles(instance);
+	VMX_PreparePlanes(instance, true, true);
+}
+
+//Copies the state of slices [start, start + count) onto the node coding them
+static void VMX_PlaceSlicesTask(void* context, int start, int count)
+{
+	VMX_INSTANCE* instance = (VMX_INSTANCE*)context;
+	for (int i = start; i < (start + count); i++)
+	{
+		VMX_SLICE_SET* s = new VMX_SLICE_SET(*instance->Slices[i]);
+		delete instance->Slices[i];
+		instance->Slices[i] = s;
+	}
+}
+
+VMX_API VMX_ERR VMX_SetMemoryPolicy(VMX_INSTANCE* instance, int policy)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (policy & ~(VMX_MEMORY_POLICY_NUMA | VMX_MEMORY_POLICY_HUGEPAGES | VMX_MEMORY_POLICY_HUGEPAGES_EXPLICIT)) return VMX_ERR_INVALID_PARAMETERS;
+	VMX_WaitEncoded(instance);
+	VMX_WaitDecoded(instance);
+	if (instance->MemoryPolicy == policy) return VMX_ERR_OK;
+	instance->MemoryPolicy = policy;
+	if (!instance->SharedTasks)
+	{
+		DestroyTasks(instance->Tasks);
+		instance->Tasks = CreateTasks(instance->Threads, VMX_GetNodes(instance) > 1);
+	}
+	//Everything is allocated again under the new policy. Streams come back on the next frame, planes right away unless the instance is lean.
+	VMX_FreeStreams(instance);
+	int nodes = VMX_GetNodes(instance);
+	if (nodes > 1) instance->Tasks->Run(VMX_PlaceSlicesTask, instance, instance->SliceCount, instance->Threads, nodes);
+	VMX_FreePlanes(instance);
+	if (!instance->LeanMemory) VMX_PreparePlanes(instance, true, true);
+	return VMX_ERR_OK;
+}
+
+#if VMX_STATS
+//Entry of stats->Threads for the thread numbered by VMX_StatsThread, added on first use
+static int VMX_GetThreadStats(VMX_FRAME_STATS* stats, int* threads, int thread)
+{
+	if (thread < 0) return -1;
+	for (int t = 0; t < stats->ThreadCount; t++)
+	{
+		if (threads[t] == thread) return t;
+	}
+	if (stats->ThreadCount == VMX_STATS_MAX_THREADS) return -1;
+	threads[stats->ThreadCount] = thread;
+	return stats->ThreadCount++;
+}
+#endif
+
+VMX_API VMX_ERR VMX_GetFrameStats(VMX_INSTANCE* instance, VMX_FRAME_STATS* stats, VMX_SLICE_STATS* slices, int maxSlices)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (!stats) return VMX_ERR_INVALID_PARAMETERS;
+	VMX_WaitEncoded(instance);
+	VMX_WaitDecoded(instance);
+	memset(stats, 0, sizeof(VMX_FRAME_STATS));
+	stats->Decode = instance->StatsDecode;
+	stats->Quality = instance->Quality;
+	stats->SliceCount = instance->SliceCount;
+	stats->Timed = VMX_STATS;
+
+#if VMX_STATS
+	int threads[VMX_STATS_MAX_THREADS];
+	int64_t zeroBlocks[VMX_MAX_PLANES] = {};
+	int64_t end = instance->StatsStart;
+#endif
+	int coded = 0;
+	for (int i = 0; i < instance->SliceCount; i++)
+	{
+		VMX_SLICE_SET* s = instance->Slices[i];
+		VMX_SLICE_STATS slice = {};
+		if (instance->StatsDecode)
+		{
+			slice.DCBytes = s->DC.StreamLength;
+			slice.ACBytes = s->AC.StreamLength;
+		}
+		else {
+			slice.DCBytes = (int)(s->DC.StreamPos - s->DC.Stream);
+			slice.ACBytes = (int)(s->AC.StreamPos - s->AC.Stream);
+		}
+		slice.Repeated = s->Repeated;
+		slice.Thread = -1;
+		stats->Bytes += slice.DCBytes + slice.ACBytes;
+		if (!s->Repeated) coded++;
+#if VMX_STATS
+		for (int k = 0; k < VMX_STAGE_COUNT; k++)
+		{
+			slice.StageNs[k] = s->StatsNs[k];
+			stats->StageNs[k] += s->StatsNs[k];
+			int t = VMX_GetThreadStats(stats, threads, s->StatsThread[k]);
+			if (t >= 0) stats->Threads[t].StageNs[k] += s->StatsNs[k];
+		}
+		slice.Thread = VMX_GetThreadStats(stats, threads, s->StatsThread[VMX_STAGE_CODE]);
+		if (slice.Thread >= 0) stats->Threads[slice.Thread].Slices++;
+		if (s->StatsEnd > end) end = s->StatsEnd;
+		for (int p = 0; p < VMX_MAX_PLANES; p++) zeroBlocks[p] += s->ZeroBlocks[p];
+#endif
+		if (slices && i < maxSlices) slices[i] = slice;
+	}
+#if VMX_STATS
+	stats->FrameNs = end - instance->StatsStart;
+	if (!instance->StatsDecode)
+	{
+		int planes = VMX_UsesAlphaPlane(instance->ImageFormat) ? 4 : 3;
+		for (int p = 0; p < planes; p++)
+		{
+			//Every slice codes whole 8 row blocks across the padded stride, as the encode kernels do
+			int64_t blocks = (int64_t)(instance->Planes[p].Stride >> 3) * (instance->Planes[p].SliceHeight >> 3) * coded;
+			if (blocks) stats->ZeroBlocks[p] = (float)((double)zeroBlocks[p] / (double)blocks);
+		}
+	}
+#endif
+	return VMX_ERR_OK;
+}
+
+VMX_API VMX_ERR VMX_GetMemoryUsage(VMX_INSTANCE* instance, VMX_MEMORY_USAGE* usage)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (!usage) return VMX_ERR_INVALID_PARAMETERS;
+	usage->Planes = 0;
+	for (int p = 0; p < VMX_MAX_PLANES; p++) usage->Planes += instance->PlaneLength[p];
+	usage->Tiles = (int64_t)instance->TileLength * instance->TileCount;
+	usage->Streams = 0;
+	for (int i = 0; i < instance->SliceCount; i++)
+	{
+		for (int k = 0; k < VMX_STREAM_SETS; k++)
+		{
+			int dc = instance->Slices[i]->DC.BufferLength[k];
+			int ac = instance->Slices[i]->AC.BufferLength[k];
+			if (dc) usage->Streams += dc + VMX_STREAM_HEADROOM;
+			if (ac) usage->Streams += ac + VMX_STREAM_HEADROOM;
+		}
+	}
+	usage->Other = sizeof(VMX_INSTANCE) + ((int64_t)instance->SliceCount * sizeof(VMX_SLICE_SET));
+	usage->Total = usage->Planes + usage->Tiles + usage->Streams + usage->Other;
+	return VMX_ERR_OK;
+}
+
+//Puts the cached streams of slice i into the current stream set
+static inline void VMX_ReuseSlice(VMX_INSTANCE* instance, VMX_SLICE_SET* s)
+{
+	if (s->CacheSet != instance->StreamSet)
+	{
+		memcpy(s->DC.Stream, s->DC.Buffers[s->CacheSet], s->CacheLength[0]);
+		memcpy(s->AC.Stream, s->AC.Buffers[s->CacheSet], s->CacheLength[1]);
+		s->CacheSet = instance->StreamSet;
+	}
+	s->DC.StreamPos = s->DC.Stream + s->CacheLength[0];
+	s->AC.StreamPos = s->AC.Stream + s->CacheLength[1];
+}
+
+//VMX_EncodeSlices for the slices whose fingerprint changed, in runs so each conversion still covers as many slices as possible
+static void VMX_EncodeSlicesCached(VMX_INSTANCE* instance, int startIndex, int count)
+{
+	int end = startIndex + count;
+	int run = startIndex;
+	for (int i = startIndex; i < end; i++)
+	{
+		VMX_SLICE_SET* s = instance->Slices[i];
+		uint64_t hash[2];
+		VMX_STATS_START(start);
+		VMX_HashSlice(instance, i, hash);
+		VMX_STATS_STAGE(s, VMX_STAGE_HASH, start);
+		if (s->CacheSet >= 0 && s->CacheHash[0] == hash[0] && s->CacheHash[1] == hash[1])
+		{
+			if (run < i) VMX_EncodeSlices(instance, run, i - run);
+			run = i + 1;
+			VMX_ReuseSlice(instance, s);
+			s->Repeated = 1;
+			continue;
+		}
+		s->Repeated = 0;
+		s->CacheHash[0] = hash[0];
+		s->CacheHash[1] = hash[1];
+	}
+	if (run < end) VMX_EncodeSlices(instance, run, end - run);
+	for (int i = startIndex; i < end; i++)
+	{
+		VMX_SLICE_SET* s = instance->Slices[i];
+		s->CacheLength[0] = (int)(s->DC.StreamPos - s->DC.Stream);
+		s->CacheLength[1] = (int)(s->AC.StreamPos - s->AC.Stream);
+		s->CacheSet = instance->StreamSet;
+	}
+}
+
+//Drops every cached slice when the settings changed since the frame they were encoded in
+static void VMX_PrepareSliceCache(VMX_INSTANCE* instance)
+{
+	int key = (instance->Planes[0].Size.width & 15) ? -1 : VMX_GetSliceCacheKey(instance);
+	if (key != instance->SliceCacheKey)
+	{
+		for (int i = 0; i < instance->SliceCount; i++) instance->Slices[i]->CacheSet = -1;
+	}
+	instance->SliceCacheKey = key;
+}
+
+static inline void VMX_EncodeSliceRange(VMX_INSTANCE* instance, int start, int count)
+{
+	if (instance->SliceCacheKey >= 0)
+	{
+		VMX_EncodeSlicesCached(instance, start, count);
+		return;
+	}
+	for (int i = start; i < (start + count); i++) instance->Slices[i]->Repeated = 0;
+	VMX_EncodeSlices(instance, start, count);
+}
+
+static void VMX_EncodeSlicesTask(void* context, int start, int count)
+{
+	VMX_EncodeSliceRange((VMX_INSTANCE*)context, start, count);
+}
+
+//Hands every chunk that has finished encoding to ChunkCallback, in order. Every thread that completes a chunk calls this after
+//marking it, so whichever gets the mutex last sees all of them.
+static void VMX_EmitChunks(VMX_INSTANCE* instance)
+{
+	std::lock_guard<std::mutex> lock(instance->ChunkMutex);
+	while (instance->ChunkNext < instance->ChunkCount && instance->ChunkPending[instance->ChunkNext].load(std::memory_order_acquire) == 0)
+	{
+		int c = instance->ChunkNext++;
+		int length = 0;
+		int count = VMX_GetChunkSegments(instance, c, instance->ChunkSegments, &length);
+		instance->ChunkBytes += length;
+		instance->ChunkCallback(instance->ChunkContext, instance->ChunkSegments, count, length, instance->ChunkNext == instance->ChunkCount);
+	}
+}
+
+static void VMX_EncodeChunksTask(void* context, int start, int count)
+{
+	VMX_INSTANCE* instance = (VMX_INSTANCE*)context;
+	VMX_EncodeSliceRange(instance, start, count);
+	bool complete = false;
+	for (int i = start; i < (start + count); i++)
+	{
+		if (instance->ChunkPending[i / instance->ChunkSlices].fetch_sub(1, std::memory_order_acq_rel) == 1) complete = true;
+	}
+	if (complete) VMX_EmitChunks(instance);
+}
+
+//Luma of the 8x8 block at x of the first 8 rows of a slice, either in place or gathered into block. Returns the stride of the block.
+static int VMX_SampleLuma(VMX_INSTANCE* instance, const BYTE* row, int stride, int x, BYTE* block, const BYTE** out)
+{
+	switch (instance->ImageFormat)
+	{
+	case VMX_IMAGE_NV12:
+	case VMX_IMAGE_NV21:
+	case VMX_IMAGE_YV12:
+	case VMX_IMAGE_YUVPLANAR422:
+		*out = row + x;
+		return stride;
+	case VMX_IMAGE_BGRA:
+	case VMX_IMAGE_BGRX:
+		for (int y = 0; y < 8; y++)
+		{
+			const BYTE* p = row + (y * stride) + (x * 4);
+			for (int i = 0; i < 8; i++, p += 4)
+			{
+				block[(y * 8) + i] = (BYTE)(((p[0] * 25) + (p[1] * 129) + (p[2] * 66) + 128) >> 8);
+			}
+		}
+		break;
+	default:
+		{
+			//UYVY/UYVA luma is the second byte of each pair, YUY2 the first, and P216/PA16/P010 use the upper byte of each 16bit sample
+			int first = instance->ImageFormat == VMX_IMAGE_YUY2 ? 0 : 1;
+			for (int y = 0; y < 8; y++)
 			{
-				VMX_SLICE_SET* s = instance->Slices[i];
-				if (s->LowerField) offset = interlacedOffset;
-				VMX_BGRAToYUV4224(instance->ImageData + (i * sliceStride) + offset, sourceStride,
-					y.Data + s->Offset[0], y.Stride,
-					u.Data + s->Offset[1], u.Stride,
-					v.Data + s->Offset[2], v.Stride,
-					a.Data + s->Offset[3], a.Stride,
-					s->PixelSizeInterlaced, colorTable);
-				VMX_EncodePlane(instance, &y, s);
-				VMX_EncodePlane(instance, &u, s);
-				VMX_EncodePlane(instance, &v, s);
+				const BYTE* p = row + (y * stride) + (x * 2) + first;
+				for (int i = 0; i < 8; i++)
+				{
+					block[(y * 8) + i] = p[i * 2];
+				}
 			}
-			break;
-		default:
-			break;
 		}
+		break;
+	}
+	*out = block;
+	return 8;
+}
+
+//Transforms every fourth luma block of the first 8 rows of each slice with the finest quantizer, then counts for each coefficient
+//how many of the quality presets leave it nonzero. Together with its bit length this is enough to estimate the AC cost of the slice at any quality.
+static void VMX_AnalyzeSlices(VMX_INSTANCE* instance, int startIndex, int count)
+{
+	//Presets round to nearest, so a coefficient of x at the finest preset survives preset i while 2x >= VMX_QUALITY[i]
+	BYTE nonzero[128];
+	int preset = 0;
+	for (int t = 0; t < 128; t++)
+	{
+		while (preset < VMX_QUALITY_COUNT && VMX_QUALITY[preset] <= t) preset++;
+		nonzero[t] = (BYTE)preset;
+	}
+
+	VMX_ALIGNAS(16) BYTE block[64];
+	VMX_ALIGNAS(16) short coeffs[64];
+	for (int i = startIndex; i < (startIndex + count); i++)
+	{
+		VMX_SLICE_SET* s = instance->Slices[i];
+		VMX_STATS_START(start);
+		memset(s->RateCount, 0, sizeof(s->RateCount));
+		memset(s->RateBits, 0, sizeof(s->RateBits));
+		if (s->PixelSize.height < 8) continue;
+
+		const BYTE* row;
+		int stride;
+		if (instance->ImageFormat == VMX_IMAGE_YUVPLANAR422)
+		{
+			row = instance->Planes[0].Data + s->Offset[0];
+			stride = instance->Planes[0].Stride;
+		}
+		else {
+			row = instance->ImageData + (i * instance->ImageStride * VMX_SLICE_HEIGHT);
+			stride = instance->ImageStride;
+		}
+		//Stagger the sampled columns from slice to slice so a regular pattern cannot line up with them
+		for (int x = (i & 3) * 8; x + 8 <= s->PixelSize.width; x += 32)
+		{
+			const BYTE* src;
+			int srcStride = VMX_SampleLuma(instance, row, stride, x, block, &src);
+			__m128i* c = (__m128i*)coeffs;
+			VMX_FDCT_8X8_QUANT_ZIG_128(src, srcStride, VMX_QUALITY_PRESETS.Encode[0], -128, &c[0], &c[1], &c[2], &c[3], &c[4], &c[5], &c[6], &c[7]);
+			for (int k = 1; k < 64; k++)
+			{
+				int v = coeffs[k];
+				if (v == 0) continue;
+				if (v < 0) v = -v;
+				int b = nonzero[v < 64 ? v * 2 : 127];
+				s->RateCount[b]++;
+				s->RateBits[b] += flss((unsigned short)v);
+			}
+		}
+		VMX_STATS_STAGE(s, VMX_STAGE_ANALYZE, start);
+	}
+}
+
+static void VMX_AnalyzeSlicesTask(void* context, int start, int count)
+{
+	VMX_AnalyzeSlices((VMX_INSTANCE*)context, start, count);
+}
+
+//Predictive rate control: pick the quality for this frame from the sampled coefficients before any of it is encoded.
+static void VMX_PredictQuality(VMX_INSTANCE* instance)
+{
+	int targetMin = instance->TargetBytesPerFrameMin;
+	int targetMax = instance->TargetBytesPerFrameMax;
+	if (!targetMin || !targetMax) return;
+
+	instance->Tasks->Run(VMX_AnalyzeSlicesTask, instance, instance->SliceCount, instance->Threads, VMX_GetNodes(instance));
+
+	double counts[VMX_QUALITY_COUNT + 1] = { 0 };
+	double bits[VMX_QUALITY_COUNT + 1] = { 0 };
+	for (int i = 0; i < instance->SliceCount; i++)
+	{
+		for (int b = 0; b <= VMX_QUALITY_COUNT; b++)
+		{
+			counts[b] += instance->Slices[i]->RateCount[b];
+			bits[b] += instance->Slices[i]->RateBits[b];
+		}
+	}
+
+	//Exp-Golomb spends about 3 + 2 * log2(q) bits on a nonzero coefficient q, and zero runs roughly scale with the nonzero count.
+	//Coefficients in bucket b are nonzero at every preset below b, so accumulate from the coarsest preset down.
+	float estimate[VMX_QUALITY_COUNT];
+	double nz = 0;
+	double nzBits = 0;
+	for (int i = VMX_QUALITY_COUNT - 1; i >= 0; i--)
+	{
+		nz += counts[i + 1];
+		nzBits += bits[i + 1];
+		double e = (2.0 * nz) + (2.0 * nzBits) - (2.0 * nz * log2((double)VMX_QUALITY[i]));
+		estimate[i] = (float)(e > nz ? e : nz);
+	}
+
+	//Presets reachable with VMX_SetQuality run from first (finest) to last (coarsest)
+	int first = -1;
+	int last = -1;
+	int current = -1;
+	for (int i = 0; i < VMX_QUALITY_COUNT; i++)
+	{
+		int q = 100 - VMX_QUALITY[i];
+		if (first < 0 && q <= VMX_MAXQ) first = i;
+		if (q >= instance->MinQuality) last = i;
+		if (current < 0 && q <= instance->Quality) current = i;
+	}
+	if (last < first) last = first;
+
+	float bytesPerBit = instance->RateBytesPerBit;
+	if (bytesPerBit <= 0)
+	{
+		//Nothing measured yet: the sample covers 1 in 8 luma blocks, and chroma adds about half as much again, or a quarter in 4:2:0
+		bytesPerBit = (8.0f * (instance->Chroma420 ? 1.25f : 1.5f)) / 8.0f;
 	}
 
+	float predicted = instance->RateDCBytes + (bytesPerBit * estimate[current]);
+	int choice = current;
+	if (predicted < targetMin || predicted > targetMax || current < first || current > last)
+	{
+		//Aim for the middle of the window so the estimate has room either side, and settle on the coarsest preset if even that is too big
+		float target = (targetMin + targetMax) * 0.5f;
+		choice = last;
+		for (int i = first; i <= last; i++)
+		{
+			if (instance->RateDCBytes + (bytesPerBit * estimate[i]) <= target)
+			{
+				choice = i;
+				break;
+			}
+		}
+	}
+	VMX_SetQuality(instance, 100 - VMX_QUALITY[choice]);
+	instance->RateEstimate = estimate[choice];
 }
+
 inline void VMX_EncodePlanes(VMX_INSTANCE* instance)
 {
-	int numThreads = instance->Threads;
-	int totalSlices = instance->SliceCount;
-	int slicesPerThread = totalSlices / numThreads;
-	int count = slicesPerThread;
-	for (int i = 0; i < numThreads; i++)
+	VMX_ResetStats(instance, 0);
+	if (instance->RateControl == VMX_RATE_CONTROL_PREDICTIVE) VMX_PredictQuality(instance);
+	if (instance->SliceCache) VMX_PrepareSliceCache(instance);
+	if (instance->LeanMemory) VMX_GrowStreams(instance);
+	if (VMX_UsesTiles(instance)) VMX_PrepareTiles(instance);
+	VMX_WriteFrameHeader(instance, instance->EncodedHeader[instance->StreamSet]);
+	ThreadTaskFunc task = VMX_EncodeSlicesTask;
+	if (instance->ChunkCallback)
 	{
-		if (i == numThreads - 1) count = totalSlices - (i * slicesPerThread);
-		instance->Tasks->tasks[i]->Push([instance, i, slicesPerThread, count] { VMX_EncodeSlices(instance, i * slicesPerThread, count); });
+		//Slices are handed out in order, so chunks complete roughly front to back
+		for (int c = 0; c < instance->ChunkCount; c++)
+		{
+			int count = instance->SliceCount - (c * instance->ChunkSlices);
+			if (count > instance->ChunkSlices) count = instance->ChunkSlices;
+			instance->ChunkPending[c].store(count, std::memory_order_relaxed);
+		}
+		instance->ChunkNext = 0;
+		instance->ChunkBytes = 0;
+		task = VMX_EncodeChunksTask;
 	}
-	for (int i = 0; i < numThreads; i++)
+	if (instance->EncodeAsync)
 	{
-		instance->Tasks->tasks[i]->Join();
+		//Slices run on the workers only, VMX_WaitEncoded picks up the result
+		instance->Tasks->Submit(&instance->EncodeJob, task, instance, instance->SliceCount, instance->Threads, false, VMX_GetNodes(instance));
+		instance->EncodePending = 1;
+		return;
 	}
+	instance->Tasks->Run(task, instance, instance->SliceCount, instance->Threads, VMX_GetNodes(instance));
 }
 
 VMX_API VMX_ERR VMX_EncodeP216(VMX_INSTANCE* instance, BYTE* src, int stride, int interlaced)
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	if (stride < (instance->Planes[0].Size.width * 2)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	VMX_ResetEncodeStream(instance);
 	instance->ImageData = src;
 	instance->ImageStride = stride;
 	instance->ImageDataU = src + (stride * instance->Planes[0].Size.height);
@@ -1695,7 +4441,7 @@ VMX_API VMX_ERR VMX_EncodePA16(VMX_INSTANCE* instance, BYTE* src, int stride, in
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	if (stride < (instance->Planes[0].Size.width * 2)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	VMX_ResetEncodeStream(instance);
 	instance->ImageData = src;
 	instance->ImageStride = stride;
 	instance->ImageDataU = src + (stride * instance->Planes[0].Size.height);
@@ -1712,7 +4458,7 @@ VMX_API VMX_ERR VMX_EncodeUYVY(VMX_INSTANCE* instance, BYTE* src, int stride, in
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	if (stride < (instance->Planes[0].Size.width * 2)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	VMX_ResetEncodeStream(instance);
 	instance->ImageData = src;
 	instance->ImageStride = stride;
 	instance->ImageFormat = VMX_IMAGE_UYVY;
@@ -1724,7 +4470,7 @@ VMX_API VMX_ERR VMX_EncodeUYVA(VMX_INSTANCE* instance, BYTE* src, int stride, in
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	if (stride < (instance->Planes[0].Size.width * 2)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	VMX_ResetEncodeStream(instance);
 	instance->ImageData = src;
 	instance->ImageStride = stride;
 	instance->ImageFormat = VMX_IMAGE_UYVA;
@@ -1739,7 +4485,7 @@ VMX_API VMX_ERR VMX_EncodeYUY2(VMX_INSTANCE* instance, BYTE* src, int stride, in
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	if (stride < (instance->Planes[0].Size.width * 2)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	VMX_ResetEncodeStream(instance);
 	instance->ImageData = src;
 	instance->ImageStride = stride;
 	instance->ImageFormat = VMX_IMAGE_YUY2;
@@ -1752,7 +4498,7 @@ VMX_API VMX_ERR VMX_EncodeNV12(VMX_INSTANCE* instance, BYTE* srcY, int srcStride
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	if (srcStrideY < (instance->Planes[0].Size.width)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	VMX_ResetEncodeStream(instance);
 	instance->ImageData = srcY;
 	instance->ImageStride = srcStrideY;
 	instance->ImageDataU = srcUV;
@@ -1763,11 +4509,27 @@ VMX_API VMX_ERR VMX_EncodeNV12(VMX_INSTANCE* instance, BYTE* srcY, int srcStride
 	return VMX_ERR_OK;
 }
 
+VMX_API VMX_ERR VMX_EncodeP010(VMX_INSTANCE* instance, BYTE* srcY, int srcStrideY, BYTE* srcUV, int srcStrideUV, int interlaced)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (srcStrideY < (instance->Planes[0].Size.width * 2)) return VMX_ERR_INVALID_PARAMETERS;
+	if (srcStrideUV < (instance->Planes[0].Size.width * 2)) return VMX_ERR_INVALID_PARAMETERS;
+	VMX_ResetEncodeStream(instance);
+	instance->ImageData = srcY;
+	instance->ImageStride = srcStrideY;
+	instance->ImageDataU = srcUV;
+	instance->ImageStrideU = srcStrideUV;
+	instance->ImageFormat = VMX_IMAGE_P010;
+	VMX_ConfigureInterlaced(instance, interlaced);
+	VMX_EncodePlanes(instance);
+	return VMX_ERR_OK;
+}
+
 VMX_API VMX_ERR VMX_EncodeYV12(VMX_INSTANCE* instance, BYTE* srcY, int srcStrideY, BYTE* srcU, int srcStrideU, BYTE* srcV, int srcStrideV, int interlaced)
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	if (srcStrideY < (instance->Planes[0].Size.width)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	VMX_ResetEncodeStream(instance);
 	instance->ImageData = srcY;
 	instance->ImageStride = srcStrideY;
 	instance->ImageDataU = srcU;
@@ -1780,12 +4542,38 @@ VMX_API VMX_ERR VMX_EncodeYV12(VMX_INSTANCE* instance, BYTE* srcY, int srcStride
 	return VMX_ERR_OK;
 }
 
+VMX_API VMX_ERR VMX_EncodeYUV420(VMX_INSTANCE* instance, BYTE* srcY, int srcStrideY, BYTE* srcU, int srcStrideU, BYTE* srcV, int srcStrideV, int pixelStrideUV, int interlaced)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (pixelStrideUV == 1)
+	{
+		return VMX_EncodeYV12(instance, srcY, srcStrideY, srcU, srcStrideU, srcV, srcStrideV, interlaced);
+	}
+	if (pixelStrideUV != 2 || srcStrideU != srcStrideV) return VMX_ERR_INVALID_PARAMETERS;
+	if (srcV == srcU + 1)
+	{
+		return VMX_EncodeNV12(instance, srcY, srcStrideY, srcU, srcStrideU, interlaced);
+	}
+	if (srcU != srcV + 1) return VMX_ERR_INVALID_PARAMETERS;
+	if (srcStrideY < (instance->Planes[0].Size.width)) return VMX_ERR_INVALID_PARAMETERS;
+	VMX_ResetEncodeStream(instance);
+	instance->ImageData = srcY;
+	instance->ImageStride = srcStrideY;
+	instance->ImageDataU = srcV;
+	instance->ImageStrideU = srcStrideV;
+	instance->ImageFormat = VMX_IMAGE_NV21;
+	VMX_ConfigureInterlaced(instance, interlaced);
+	VMX_EncodePlanes(instance);
+	return VMX_ERR_OK;
+}
+
 VMX_API VMX_ERR VMX_EncodePlanar(VMX_INSTANCE* instance, int interlaced)
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
-	VMX_ResetStream(instance);
+	VMX_ResetEncodeStream(instance);
 	VMX_ConfigureInterlaced(instance, interlaced);
 	instance->ImageFormat = VMX_IMAGE_YUVPLANAR422;
+	if (instance->LeanMemory) VMX_PreparePlanes(instance, false, false);
 	VMX_EncodePlanes(instance);
 	return VMX_ERR_OK;
 }
@@ -1794,7 +4582,7 @@ VMX_API VMX_ERR VMX_EncodeBGRA(VMX_INSTANCE* instance, BYTE* src, int stride, in
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	if (stride < (instance->Planes[0].Size.width * 4)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	VMX_ResetEncodeStream(instance);
 	VMX_ConfigureInterlaced(instance, interlaced);
 	instance->ImageFormat = VMX_IMAGE_BGRA;
 	instance->ImageData = src;
@@ -1807,7 +4595,7 @@ VMX_API VMX_ERR VMX_EncodeBGRX(VMX_INSTANCE* instance, BYTE* src, int stride, in
 {
 	if (!instance) return VMX_ERR_INVALID_INSTANCE;
 	if (stride < (instance->Planes[0].Size.width * 4)) return VMX_ERR_INVALID_PARAMETERS;
-	VMX_ResetStream(instance);
+	VMX_ResetEncodeStream(instance);
 	VMX_ConfigureInterlaced(instance, interlaced);
 	instance->ImageFormat = VMX_IMAGE_BGRX;
 	instance->ImageData = src;
@@ -1816,11 +4604,528 @@ VMX_API VMX_ERR VMX_EncodeBGRX(VMX_INSTANCE* instance, BYTE* src, int stride, in
 	return VMX_ERR_OK;
 }
 
+VMX_API VMX_ERR VMX_EncodeAsync(VMX_INSTANCE* instance, VMX_IMAGE_FORMAT format, BYTE* src, int stride, BYTE* srcU, int strideU, BYTE* srcV, int strideV, int interlaced)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	VMX_WaitEncoded(instance);
+	instance->StreamSets = VMX_STREAM_SETS;
+	instance->EncodeAsync = 1;
+	VMX_ERR err;
+	switch (format)
+	{
+	case VMX_IMAGE_UYVY: err = VMX_EncodeUYVY(instance, src, stride, interlaced); break;
+	case VMX_IMAGE_UYVA: err = VMX_EncodeUYVA(instance, src, stride, interlaced); break;
+	case VMX_IMAGE_YUY2: err = VMX_EncodeYUY2(instance, src, stride, interlaced); break;
+	case VMX_IMAGE_NV12: err = VMX_EncodeNV12(instance, src, stride, srcU, strideU, interlaced); break;
+	case VMX_IMAGE_NV21: err = VMX_EncodeYUV420(instance, src, stride, srcU + 1, strideU, srcU, strideU, 2, interlaced); break;
+	case VMX_IMAGE_YV12: err = VMX_EncodeYV12(instance, src, stride, srcU, strideU, srcV, strideV, interlaced); break;
+	case VMX_IMAGE_BGRA: err = VMX_EncodeBGRA(instance, src, stride, interlaced); break;
+	case VMX_IMAGE_BGRX: err = VMX_EncodeBGRX(instance, src, stride, interlaced); break;
+	case VMX_IMAGE_P216: err = VMX_EncodeP216(instance, src, stride, interlaced); break;
+	case VMX_IMAGE_PA16: err = VMX_EncodePA16(instance, src, stride, interlaced); break;
+	case VMX_IMAGE_P010: err = VMX_EncodeP010(instance, src, stride, srcU, strideU, interlaced); break;
+	default: err = VMX_ERR_INVALID_PARAMETERS; break;
+	}
+	instance->EncodeAsync = 0;
+	return err;
+}
+
+VMX_API VMX_ERR VMX_WaitEncoded(VMX_INSTANCE* instance)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (instance->EncodePending)
+	{
+		//The caller has nothing else to do until the frame is done, so it codes slices alongside the workers
+		instance->Tasks->Join(&instance->EncodeJob);
+		instance->Tasks->Finish(&instance->EncodeJob, false);
+		instance->EncodePending = 0;
+	}
+	return VMX_ERR_OK;
+}
+
+VMX_API VMX_ERR VMX_DecodeAsync(VMX_INSTANCE* instance, VMX_IMAGE_FORMAT format, BYTE* dst, int stride, BYTE* dstU, int strideU, BYTE* dstV, int strideV)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	VMX_WaitDecoded(instance);
+	instance->DecodeAsync = 1;
+	VMX_ERR err;
+	switch (format)
+	{
+	case VMX_IMAGE_UYVY: err = VMX_DecodeUYVY(instance, dst, stride); break;
+	case VMX_IMAGE_UYVA: err = VMX_DecodeUYVA(instance, dst, stride); break;
+	case VMX_IMAGE_YUY2: err = VMX_DecodeYUY2(instance, dst, stride); break;
+	case VMX_IMAGE_NV12: err = VMX_DecodeNV12(instance, dst, stride, dstU, strideU); break;
+	case VMX_IMAGE_YV12: err = VMX_DecodeI420(instance, dst, stride, dstU, strideU, dstV, strideV); break;
+	case VMX_IMAGE_BGRA: err = VMX_DecodeBGRA(instance, dst, stride); break;
+	case VMX_IMAGE_BGRX: err = VMX_DecodeBGRX(instance, dst, stride); break;
+	case VMX_IMAGE_P216: err = VMX_DecodeP216(instance, dst, stride); break;
+	case VMX_IMAGE_PA16: err = VMX_DecodePA16(instance, dst, stride); break;
+	default: err = VMX_ERR_INVALID_PARAMETERS; break;
+	}
+	instance->DecodeAsync = 0;
+	return err;
+}
+
+VMX_API VMX_ERR VMX_WaitDecoded(VMX_INSTANCE* instance)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (instance->DecodePending)
+	{
+		instance->Tasks->Finish(&instance->DecodeJob, false);
+		instance->DecodePending = 0;
+	}
+	return VMX_ERR_OK;
+}
+
+VMX_API VMX_PIPELINE* VMX_CreatePipeline(VMX_SIZE dimensions, VMX_PROFILE profile, VMX_COLORSPACE colorSpace, int depth, VMX_POOL* pool)
+{
+	if (depth < 1) return NULL;
+	VMX_PIPELINE* pipeline = new VMX_PIPELINE;
+	pipeline->Depth = depth;
+	pipeline->Head = 0;
+	pipeline->Count = 0;
+	pipeline->Instances = new VMX_INSTANCE*[depth]();
+	pipeline->UserData = new void*[depth]();
+	if (pool)
+	{
+		pool->references++;
+		pipeline->Pool = pool;
+	}
+	else {
+		pipeline->Pool = VMX_CreatePool(0);
+	}
+	for (int i = 0; i < depth; i++)
+	{
+		pipeline->Instances[i] = VMX_CreateDecoder(dimensions, colorSpace, pipeline->Pool);
+		if (!pipeline->Instances[i])
+		{
+			VMX_DestroyPipeline(pipeline);
+			return NULL;
+		}
+		//Each frame keeps to the threads of the profile, so the frames in flight share the pool between them
+		int threads = VMX_SetProfileInternal(pipeline->Instances[i], profile == VMX_PROFILE_DEFAULT ? VMX_PROFILE_HQ : profile, dimensions.height);
+		if (threads) pipeline->Instances[i]->Threads = threads;
+	}
+	return pipeline;
+}
+
+VMX_API void VMX_DestroyPipeline(VMX_PIPELINE* pipeline)
+{
+	if (!pipeline) return;
+	for (int i = 0; i < pipeline->Depth; i++)
+	{
+		VMX_Destroy(pipeline->Instances[i]);
+	}
+	DestroyTasks(pipeline->Pool);
+	delete[] pipeline->Instances;
+	delete[] pipeline->UserData;
+	delete pipeline;
+}
+
+VMX_API VMX_ERR VMX_SubmitPipelineFrame(VMX_PIPELINE* pipeline, BYTE* data, int dataLen, VMX_IMAGE_FORMAT format, BYTE* dst, int stride, BYTE* dstU, int strideU, BYTE* dstV, int strideV, void* userData)
+{
+	if (!pipeline) return VMX_ERR_INVALID_INSTANCE;
+	if (pipeline->Count == pipeline->Depth) return VMX_ERR_BUSY;
+	int i = (pipeline->Head + pipeline->Count) % pipeline->Depth;
+	VMX_INSTANCE* instance = pipeline->Instances[i];
+	VMX_ERR err = VMX_LoadFrom(instance, data, dataLen);
+	if (err != VMX_ERR_OK) return err;
+	err = VMX_DecodeAsync(instance, format, dst, stride, dstU, strideU, dstV, strideV);
+	if (err != VMX_ERR_OK) return err;
+	pipeline->UserData[i] = userData;
+	pipeline->Count++;
+	return VMX_ERR_OK;
+}
+
+VMX_API int VMX_GetPipelineFrame(VMX_PIPELINE* pipeline, int wait, void** userData)
+{
+	if (!pipeline || !pipeline->Count) return 0;
+	VMX_INSTANCE* instance = pipeline->Instances[pipeline->Head];
+	if (!wait && instance->DecodePending && !instance->Tasks->IsComplete(&instance->DecodeJob)) return 0;
+	VMX_WaitDecoded(instance);
+	if (userData) *userData = pipeline->UserData[pipeline->Head];
+	pipeline->Head = (pipeline->Head + 1) % pipeline->Depth;
+	pipeline->Count--;
+	return 1;
+}
+
 VMX_API float VMX_CalculatePSNR(BYTE* p1, BYTE* p2, int stride, int bytesPerPixel, VMX_SIZE sz)
 {
 	return VMX_CalculatePSNR_128(p1, p2, stride, bytesPerPixel, sz);
 }
 
+//One plane of the two images measured by a pass of VMX_CalculateQuality
+struct VMX_QUALITY_PLANE
+{
+	const BYTE* Data[2]; //Reference and image
+	int Stride[2];
+	int Step; //Bytes between the samples of a row, 1 for planar data
+	VMX_SIZE Size;
+	int BandHeight; //Rows of the plane in each band, half of VMX_QUALITY_BAND for the chroma of 4:2:0 images
+	BYTE* Reduced[2]; //Receives the next scale for MS-SSIM, NULL when it is not needed
+	int ReducedStride;
+};
+
+//Sums of one band of rows, kept per band so that they add up in the same order whatever thread measured them
+struct VMX_QUALITY_RESULT
+{
+	int64_t SSE;
+	int64_t Samples;
+	int64_t Windows;
+	double SSIM;
+	double CS; //Contrast and structure terms of SSIM only, for the scales of MS-SSIM
+};
+
+struct VMX_QUALITY_PASS
+{
+	VMX_INSTANCE* Instance;
+	VMX_QUALITY_PLANE Planes[3];
+	int Bands; //Bands measured, each covering the same rows of all three planes so that a packed image is read once
+	int Sampling;
+	int PSNR;
+	int SSIM;
+	int RowLength; //Bytes per scratch row, enough for the widest plane
+	VMX_QUALITY_RESULT* Results; //3 per band
+};
+
+//Row y of one image in a plane, gathered into dst unless the samples are already contiguous
+static inline const BYTE* VMX_QualityRow(const VMX_QUALITY_PLANE* plane, int image, int y, BYTE* dst)
+{
+	const BYTE* src = plane->Data[image] + ((size_t)y * plane->Stride[image]);
+	if (plane->Step == 1) return src;
+	VMX_QualityGather_128(src, plane->Step, plane->Size.width, dst);
+	return dst;
+}
+
+//Block sums of rows by * 4 to by * 4 + 3 of both images
+static inline void VMX_QualityBlockRow(VMX_INSTANCE* instance, const VMX_QUALITY_PLANE* plane, int by, BYTE* scratch, int rowLength, int* sums)
+{
+	const BYTE* a[4];
+	const BYTE* b[4];
+	for (int r = 0; r < 4; r++)
+	{
+		a[r] = VMX_QualityRow(plane, 0, (by << 2) + r, scratch + (r * rowLength));
+		b[r] = VMX_QualityRow(plane, 1, (by << 2) + r, scratch + ((r + 4) * rowLength));
+	}
+	VMX_QualityBlocks(instance, a, b, plane->Size.width >> 2, sums);
+}
+
+static void VMX_QualityBand(VMX_QUALITY_PASS* pass, int item, int p, BYTE* scratch, int* sums)
+{
+	const VMX_QUALITY_PLANE* plane = &pass->Planes[p];
+	VMX_QUALITY_RESULT* result = &pass->Results[(item * 3) + p];
+	int rowLength = pass->RowLength;
+	int width = plane->Size.width;
+	int y0 = item * pass->Sampling * plane->BandHeight;
+	int y1 = y0 + plane->BandHeight;
+	if (y1 > plane->Size.height) y1 = plane->Size.height;
+	if (y0 > y1) y0 = y1;
+
+	result->SSE = 0;
+	result->Samples = 0;
+	result->Windows = 0;
+	result->SSIM = 0;
+	result->CS = 0;
+
+	if (pass->PSNR || plane->Reduced[0])
+	{
+		for (int y = y0; y < y1; y += 2)
+		{
+			int pair = (y + 1) < y1 ? 2 : 1;
+			const BYTE* a[2];
+			const BYTE* b[2];
+			for (int r = 0; r < pair; r++)
+			{
+				a[r] = VMX_QualityRow(plane, 0, y + r, scratch + (r * rowLength));
+				b[r] = VMX_QualityRow(plane, 1, y + r, scratch + ((r + 2) * rowLength));
+				if (pass->PSNR) result->SSE += VMX_QualitySSE(pass->Instance, a[r], b[r], width);
+			}
+			if (plane->Reduced[0] && pair == 2)
+			{
+				int ry = y >> 1;
+				VMX_QualityDownsample_128(a[0], a[1], width >> 1, plane->Reduced[0] + ((size_t)ry * plane->ReducedStride));
+				VMX_QualityDownsample_128(b[0], b[1], width >> 1, plane->Reduced[1] + ((size_t)ry * plane->ReducedStride));
+			}
+		}
+		result->Samples = (int64_t)(y1 - y0) * width;
+	}
+
+	//8x8 windows at a step of 4, each made of 2x2 blocks. The windows starting in this band reach 4 rows into the next.
+	int blocksX = width >> 2;
+	int blocksY = plane->Size.height >> 2;
+	int byEnd = y1 >> 2;
+	if (byEnd > blocksY - 1) byEnd = blocksY - 1;
+	int by = y0 >> 2;
+	if (!pass->SSIM || blocksX < 2 || by >= byEnd) return;
+
+	const double c1 = (0.01 * 255) * (0.01 * 255) * 4096;
+	const double c2 = (0.03 * 255) * (0.03 * 255) * 4096;
+	int* prev = sums;
+	int* cur = sums + (blocksX << 2);
+	VMX_QualityBlockRow(pass->Instance, plane, by, scratch, rowLength, prev);
+	double ssim = 0;
+	double cs = 0;
+	for (; by < byEnd; by++)
+	{
+		VMX_QualityBlockRow(pass->Instance, plane, by + 1, scratch, rowLength, cur);
+		for (int bx = 0; bx < blocksX - 1; bx++)
+		{
+			const int* t0 = prev + (bx << 2);
+			const int* t1 = cur + (bx << 2);
+			int64_t s1 = t0[0] + t0[4] + t1[0] + t1[4];
+			int64_t s2 = t0[1] + t0[5] + t1[1] + t1[5];
+			int64_t ss = t0[2] + t0[6] + t1[2] + t1[6];
+			int64_t s12 = t0[3] + t0[7] + t1[3] + t1[7];
+			//Means and variances scaled by the 64 samples squared
+			int64_t vars = (ss << 6) - (s1 * s1) - (s2 * s2);
+			int64_t covar = (s12 << 6) - (s1 * s2);
+			double l = ((double)(2 * s1 * s2) + c1) / ((double)((s1 * s1) + (s2 * s2)) + c1);
+			double c = ((double)(2 * covar) + c2) / ((double)vars + c2);
+			ssim += l * c;
+			cs += c;
+		}
+		int* t = prev;
+		prev = cur;
+		cur = t;
+	}
+	result->SSIM = ssim;
+	result->CS = cs;
+	result->Windows = (int64_t)(byEnd - (y0 >> 2)) * (blocksX - 1);
+}
+
+static void VMX_QualityTask(void* context, int start, int count)
+{
+	VMX_QUALITY_PASS* pass = (VMX_QUALITY_PASS*)context;
+	int sumsLength = (pass->RowLength >> 2) * 8 * sizeof(int);
+	BYTE* scratch = (BYTE*)_mm_malloc(((size_t)pass->RowLength * 8) + sumsLength, VMX_ALIGNMENT);
+	if (!scratch) return;
+	int* sums = (int*)(scratch + ((size_t)pass->RowLength * 8));
+	for (int i = start; i < (start + count); i++)
+	{
+		for (int p = 0; p < 3; p++) VMX_QualityBand(pass, i, p, scratch, sums);
+	}
+	_mm_free(scratch);
+}
+
+static void VMX_RunQualityPass(VMX_QUALITY_PASS* pass)
+{
+	int width = 0;
+	pass->Bands = 0;
+	for (int p = 0; p < 3; p++)
+	{
+		VMX_QUALITY_PLANE* plane = &pass->Planes[p];
+		int bands = (plane->Size.height + plane->BandHeight - 1) / plane->BandHeight;
+		bands = (bands + pass->Sampling - 1) / pass->Sampling;
+		if (bands > pass->Bands) pass->Bands = bands;
+		if (plane->Size.width > width) width = plane->Size.width;
+	}
+	pass->RowLength = (width + VMX_ALIGNMENT + 15) & ~15;
+	pass->Instance->Tasks->Run(VMX_QualityTask, pass, pass->Bands, pass->Instance->Threads);
+}
+
+//Totals of plane p from the last pass
+static VMX_QUALITY_RESULT VMX_SumQualityPass(const VMX_QUALITY_PASS* pass, int p)
+{
+	VMX_QUALITY_RESULT sum = {};
+	for (int i = 0; i < pass->Bands; i++)
+	{
+		const VMX_QUALITY_RESULT* r = &pass->Results[(i * 3) + p];
+		sum.SSE += r->SSE;
+		sum.Samples += r->Samples;
+		sum.Windows += r->Windows;
+		sum.SSIM += r->SSIM;
+		sum.CS += r->CS;
+	}
+	return sum;
+}
+
+static float VMX_QualityPSNR(int64_t sse, int64_t samples)
+{
+	if (!samples || !sse) return 100.0f;
+	double result = 10.0 * log10((255.0 * 255.0) * (double)samples / (double)sse);
+	return result > 100.0 ? 100.0f : (float)result;
+}
+
+VMX_API VMX_ERR VMX_CalculateQuality(VMX_INSTANCE* instance, VMX_IMAGE_FORMAT format, const VMX_IMAGE* reference, const VMX_IMAGE* image, int flags, int sampling, VMX_METRICS* metrics)
+{
+	if (!instance) return VMX_ERR_INVALID_INSTANCE;
+	if (!reference || !image || !metrics || sampling < 1) return VMX_ERR_INVALID_PARAMETERS;
+	memset(metrics, 0, sizeof(VMX_METRICS));
+
+	VMX_SIZE sz = instance->Planes[0].Size;
+	VMX_SIZE szUV = { sz.width >> 1, sz.height };
+	VMX_QUALITY_PASS pass = {};
+	pass.Instance = instance;
+	const VMX_IMAGE* images[2] = { reference, image };
+	for (int i = 0; i < 2; i++)
+	{
+		const VMX_IMAGE* img = images[i];
+		if (!img->Data || img->Stride <= 0) return VMX_ERR_INVALID_PARAMETERS;
+		VMX_QUALITY_PLANE* planes = pass.Planes;
+		switch (format)
+		{
+		case VMX_IMAGE_UYVY:
+		case VMX_IMAGE_YUY2:
+		{
+			int y = format == VMX_IMAGE_UYVY ? 1 : 0;
+			int u = format == VMX_IMAGE_UYVY ? 0 : 1;
+			planes[0].Data[i] = img->Data + y;
+			planes[1].Data[i] = img->Data + u;
+			planes[2].Data[i] = img->Data + u + 2;
+			for (int p = 0; p < 3; p++) planes[p].Stride[i] = img->Stride;
+			planes[0].Step = 2;
+			planes[1].Step = 4;
+			planes[2].Step = 4;
+			break;
+		}
+		case VMX_IMAGE_NV12:
+		case VMX_IMAGE_NV21:
+		{
+			if (!img->DataU || img->StrideU <= 0) return VMX_ERR_INVALID_PARAMETERS;
+			int u = format == VMX_IMAGE_NV12 ? 0 : 1;
+			planes[0].Data[i] = img->Data;
+			planes[1].Data[i] = img->DataU + u;
+			planes[2].Data[i] = img->DataU + (1 - u);
+			planes[0].Stride[i] = img->Stride;
+			planes[1].Stride[i] = img->StrideU;
+			planes[2].Stride[i] = img->StrideU;
+			planes[0].Step = 1;
+			planes[1].Step = 2;
+			planes[2].Step = 2;
+			szUV.height = sz.height >> 1;
+			break;
+		}
+		case VMX_IMAGE_YV12:
+		case VMX_IMAGE_YUVPLANAR422:
+			if (!img->DataU || !img->DataV || img->StrideU <= 0 || img->StrideV <= 0) return VMX_ERR_INVALID_PARAMETERS;
+			planes[0].Data[i] = img->Data;
+			planes[1].Data[i] = img->DataU;
+			planes[2].Data[i] = img->DataV;
+			planes[0].Stride[i] = img->Stride;
+			planes[1].Stride[i] = img->StrideU;
+			planes[2].Stride[i] = img->StrideV;
+			for (int p = 0; p < 3; p++) planes[p].Step = 1;
+			if (format == VMX_IMAGE_YV12) szUV.height = sz.height >> 1;
+			break;
+		default:
+			return VMX_ERR_INVALID_PARAMETERS;
+		}
+	}
+	pass.Planes[0].Size = sz;
+	pass.Planes[1].Size = szUV;
+	pass.Planes[2].Size = szUV;
+	pass.Planes[0].BandHeight = VMX_QUALITY_BAND;
+	pass.Planes[1].BandHeight = szUV.height < sz.height ? VMX_QUALITY_BAND >> 1 : VMX_QUALITY_BAND;
+	pass.Planes[2].BandHeight = pass.Planes[1].BandHeight;
+
+	//MS-SSIM reduces each plane 4 times, the smallest scale still needing room for a few windows
+	const int scales = 5;
+	const double weights[scales] = { 0.0448, 0.2856, 0.3001, 0.2363, 0.1333 };
+	int msssim = (flags & VMX_METRICS_MSSSIM) && sampling == 1;
+	int msValid[3] = {};
+	BYTE* reduced = NULL;
+	size_t reducedOffset[scales][3] = {};
+	int reducedStride[scales][3] = {};
+	if (msssim)
+	{
+		size_t length = 0;
+		for (int s = 1; s < scales; s++)
+		{
+			for (int p = 0; p < 3; p++)
+			{
+				VMX_SIZE rs = { pass.Planes[p].Size.width >> s, pass.Planes[p].Size.height >> s };
+				reducedStride[s][p] = (rs.width + 15) & ~15;
+				reducedOffset[s][p] = length;
+				length += (size_t)reducedStride[s][p] * rs.height * 2;
+			}
+		}
+		for (int p = 0; p < 3; p++) msValid[p] = (pass.Planes[p].Size.width >> (scales - 1)) >= 8 && (pass.Planes[p].Size.height >> (scales - 1)) >= 8;
+		reduced = (BYTE*)_mm_malloc(length, VMX_ALIGNMENT);
+		if (!reduced) return VMX_ERR_UNKNOWN;
+	}
+	pass.Results = (VMX_QUALITY_RESULT*)malloc(sizeof(VMX_QUALITY_RESULT) * (((sz.height + VMX_QUALITY_BAND - 1) / VMX_QUALITY_BAND) * 3));
+	if (!pass.Results)
+	{
+		if (reduced) _mm_free(reduced);
+		return VMX_ERR_UNKNOWN;
+	}
+
+	double cs[scales][3] = {};
+	double windows0[3] = {};
+	for (int s = 0; s < scales; s++)
+	{
+		if (s > 0)
+		{
+			if (!msssim) break;
+			for (int p = 0; p < 3; p++)
+			{
+				VMX_QUALITY_PLANE* plane = &pass.Planes[p];
+				plane->Step = 1;
+				plane->Size.width >>= 1;
+				plane->Size.height >>= 1;
+				for (int i = 0; i < 2; i++)
+				{
+					plane->Data[i] = plane->Reduced[i];
+					plane->Stride[i] = plane->ReducedStride;
+				}
+				if (!msValid[p]) plane->Size.height = 0;
+			}
+		}
+		for (int p = 0; p < 3; p++)
+		{
+			VMX_QUALITY_PLANE* plane = &pass.Planes[p];
+			int reduce = msValid[p] && (s + 1) < scales;
+			for (int i = 0; i < 2; i++)
+			{
+				plane->Reduced[i] = reduce ? reduced + reducedOffset[s + 1][p] + ((size_t)i * reducedStride[s + 1][p] * (plane->Size.height >> 1)) : NULL;
+			}
+			plane->ReducedStride = reduce ? reducedStride[s + 1][p] : 0;
+		}
+		pass.Sampling = s ? 1 : sampling;
+		pass.PSNR = s ? 0 : (flags & VMX_METRICS_PSNR);
+		pass.SSIM = s ? 1 : (flags & (VMX_METRICS_SSIM | VMX_METRICS_MSSSIM));
+		VMX_RunQualityPass(&pass);
+
+		VMX_QUALITY_RESULT all = {};
+		for (int p = 0; p < 3; p++)
+		{
+			VMX_QUALITY_RESULT r = VMX_SumQualityPass(&pass, p);
+			double windows = r.Windows ? (double)r.Windows : 1.0;
+			cs[s][p] = ((s + 1) < scales ? r.CS : r.SSIM) / windows;
+			if (s > 0) continue;
+			windows0[p] = (double)r.Windows;
+			if (flags & VMX_METRICS_PSNR) metrics->PSNR[p] = VMX_QualityPSNR(r.SSE, r.Samples);
+			if (flags & VMX_METRICS_SSIM) metrics->SSIM[p] = (float)(r.SSIM / windows);
+			all.SSE += r.SSE;
+			all.Samples += r.Samples;
+			all.Windows += r.Windows;
+			all.SSIM += r.SSIM;
+		}
+		if (s > 0) continue;
+		if (flags & VMX_METRICS_PSNR) metrics->PSNRAll = VMX_QualityPSNR(all.SSE, all.Samples);
+		if (flags & VMX_METRICS_SSIM) metrics->SSIMAll = all.Windows ? (float)(all.SSIM / (double)all.Windows) : 0.0f;
+	}
+
+	if (msssim)
+	{
+		double all = 0;
+		double windows = 0;
+		for (int p = 0; p < 3; p++)
+		{
+			if (!msValid[p]) continue;
+			double result = 1.0;
+			for (int s = 0; s < scales; s++) result *= pow(cs[s][p] > 0.0 ? cs[s][p] : 0.0, weights[s]);
+			metrics->MSSSIM[p] = (float)result;
+			all += result * windows0[p];
+			windows += windows0[p];
+		}
+		if (windows > 0) metrics->MSSSIMAll = (float)(all / windows);
+	}
+	free(pass.Results);
+	if (reduced) _mm_free(reduced);
+	return VMX_ERR_OK;
+}
+
 VMX_API int VMX_Test(VMX_INSTANCE* instance, short * src, short * dst)
 {
 	return 0;
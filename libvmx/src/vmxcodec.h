@@ -29,8 +29,10 @@
 #include "thread_tasks.h"
 #ifdef _MSC_VER
 #define VMX_API __declspec(dllexport)
+#define VMX_ALIGNAS(n) __declspec(align(n))
 #else
 #define VMX_API extern "C" __attribute__((visibility("default")))
+#define VMX_ALIGNAS(n) __attribute__((aligned(n)))
 #endif
 #if defined(_M_ARM64) | defined(__arm64) | defined(__aarch64__)
 #define ARM64
@@ -39,10 +41,19 @@
 #define X64
 #define AVX2 //Include AVX2 in all Intel builds as these functions will be dynamically called only if instruction set available.
 #endif
+#ifndef VMX_STATS
+#define VMX_STATS 1 //Define as 0 to build without the timings and block counts behind VMX_GetFrameStats
+#endif
 
 const int VMX_SLICE_HEIGHT = 16;
 const int VMX_QUALITY_COUNT = 25;
 const int VMX_MAX_PLANES = 4;
+const int VMX_LOAD_PADDING = 64; //Readable bytes required after the frame passed to VMX_LoadFromInPlace
+const int VMX_STREAM_SETS = 2; //Rotating sets of slice streams used by VMX_EncodeAsync
+const int VMX_CHUNK_HEADER_SIZE = 10; //Longest chunk header: format, 5 byte frame header, first slice and slice count
+const int VMX_SKIP_SLICES = 0x80; //Set in the DC shift byte of an extended frame header when a bitmap of repeated slices follows it
+const int VMX_CHROMA_420 = 0x40; //Set in the DC shift byte of an extended frame header when the chroma planes are coded at half height
+const int VMX_SKIP_HEADER_SIZE = 5 + ((270 + 7) >> 3); //Extended frame header and the bitmap for the largest slice count (8K)
 
 typedef unsigned long long buffer_t;
 typedef unsigned char       BYTE;
@@ -52,6 +63,100 @@ typedef struct {
 	int height;
 } VMX_SIZE;
 
+typedef struct {
+	int x;
+	int y;
+	int width;
+	int height;
+} VMX_RECT;
+
+typedef struct VMX_SEGMENT {
+	const BYTE* Data;
+	int Length;
+} VMX_SEGMENT;
+
+typedef ThreadTasks VMX_POOL;
+
+//Bytes held by an instance, see VMX_GetMemoryUsage
+typedef struct {
+	int64_t Planes; //Frame sized planes
+	int64_t Tiles; //Slice sized staging planes of a lean instance, or of frames whose plane rows are not whole vectors
+	int64_t Streams; //DC and AC stream buffers of every slice and stream set
+	int64_t Other; //The instance and its slice state
+	int64_t Total;
+} VMX_MEMORY_USAGE;
+
+//Where an instance places its buffers, see VMX_SetMemoryPolicy. Flags can be combined.
+typedef enum {
+	VMX_MEMORY_POLICY_DEFAULT = 0,
+	VMX_MEMORY_POLICY_NUMA = 1, //Slices and their rows of each plane first touched on the NUMA node of the threads that code them
+	VMX_MEMORY_POLICY_HUGEPAGES = 2, //Planes backed by transparent huge pages
+	VMX_MEMORY_POLICY_HUGEPAGES_EXPLICIT = 4 //Planes backed by huge pages reserved with vm.nr_hugepages, transparent ones when none are free
+} VMX_MEMORY_POLICY;
+
+//An image in memory, with the planes of its format as described for VMX_EncodeAsync. Unused planes can be left NULL.
+typedef struct {
+	BYTE* Data;
+	int Stride;
+	BYTE* DataU;
+	int StrideU;
+	BYTE* DataV;
+	int StrideV;
+} VMX_IMAGE;
+
+//Quality of an image against its reference for each of Y, U and V and over all three, see VMX_CalculateQuality
+typedef struct {
+	float PSNR[3]; //dB with a peak of 255, 100 when the plane is identical
+	float SSIM[3]; //Mean SSIM of 8x8 windows at a step of 4 pixels, 1 when identical
+	float MSSSIM[3]; //Multi-scale SSIM over 5 scales, 0 when not requested or the plane is too small
+	float PSNRAll;
+	float SSIMAll;
+	float MSSSIMAll;
+} VMX_METRICS;
+
+//Stages of a frame timed by VMX_GetFrameStats
+typedef enum {
+	VMX_STAGE_ANALYZE, //Sampling of the source by VMX_RATE_CONTROL_PREDICTIVE before any slice is coded
+	VMX_STAGE_HASH, //Fingerprinting the source for VMX_SetSliceCache
+	VMX_STAGE_CONVERT, //Source image into planes when encoding, planes into the destination when decoding
+	VMX_STAGE_CODE, //DCT, quantisation and entropy coding, which run together block by block. The fused ingest path also reads the source here
+	VMX_STAGE_COUNT
+} VMX_STAGE;
+
+const int VMX_STATS_MAX_THREADS = 64;
+
+//One slice of the last frame, see VMX_GetFrameStats
+typedef struct {
+	int DCBytes;
+	int ACBytes;
+	int Repeated; //Reused from the previous frame by VMX_SetSliceCache
+	int Thread; //Entry of VMX_FRAME_STATS.Threads that coded the slice, -1 when not timed
+	int64_t StageNs[VMX_STAGE_COUNT];
+} VMX_SLICE_STATS;
+
+//Work of one thread on the last frame
+typedef struct {
+	int Slices; //Slices coded
+	int64_t StageNs[VMX_STAGE_COUNT];
+} VMX_THREAD_STATS;
+
+//What the encoder or decoder did with the last frame, see VMX_GetFrameStats
+typedef struct {
+	int Decode; //1 when the last frame was decoded, 0 when it was encoded
+	int Quality;
+	int Bytes; //DC and AC bytes of every slice, without the frame header and length prefixes
+	int SliceCount;
+	float ZeroBlocks[VMX_MAX_PLANES]; //Share of the 8x8 blocks of each plane left with no AC coefficient, encode only
+	int Timed; //1 when the library was built with VMX_STATS, otherwise everything below and ZeroBlocks are 0
+	int64_t FrameNs; //From the start of the encode or decode call until the last slice finished
+	int64_t StageNs[VMX_STAGE_COUNT]; //Summed over every thread
+	int ThreadCount;
+	VMX_THREAD_STATS Threads[VMX_STATS_MAX_THREADS];
+} VMX_FRAME_STATS;
+
+//Receives one chunk of a frame encoded with VMX_SetChunkedOutput. The segments are only valid until the callback returns.
+typedef void (*VMX_CHUNK_CALLBACK)(void* context, const VMX_SEGMENT* segments, int segmentCount, int length, int last);
+
 typedef enum {
 	VMX_FORMAT_PROGRESSIVE,
 	VMX_FORMAT_INTERLACED
@@ -64,7 +169,8 @@ typedef enum {
 	VMX_ERR_INVALID_SLICE_COUNT,
 	VMX_ERR_BUFFER_OVERFLOW,
 	VMX_ERR_INVALID_INSTANCE,
-	VMX_ERR_INVALID_PARAMETERS
+	VMX_ERR_INVALID_PARAMETERS,
+	VMX_ERR_BUSY
 } VMX_ERR;
 
 typedef enum {
@@ -91,7 +197,8 @@ typedef enum {
 	VMX_CODEC_FORMAT_NONE,
 	VMX_CODEC_FORMAT_PROGRESSIVE,
 	VMX_CODEC_FORMAT_INTERLACED,
-	VMX_CODEC_FORMAT_EXTENDED
+	VMX_CODEC_FORMAT_EXTENDED,
+	VMX_CODEC_FORMAT_CHUNK //A group of slices written in low-latency mode, see VMX_SetChunkedOutput
 } VMX_CODEC_FORMAT;
 
 typedef enum {
@@ -105,11 +212,32 @@ typedef enum {
 	VMX_IMAGE_UYVA,
 	VMX_IMAGE_P216,
 	VMX_IMAGE_PA16,
+	VMX_IMAGE_NV21,
+	VMX_IMAGE_P010,
 } VMX_IMAGE_FORMAT;
 
+/**
+* Reactive adjusts quality by a few steps after each frame based on its size.
+* Predictive estimates the cost of each frame from a sample of its DCT coefficients before it is encoded and picks the quality that lands inside the target window.
+*/
+typedef enum {
+	VMX_RATE_CONTROL_REACTIVE,
+	VMX_RATE_CONTROL_PREDICTIVE
+} VMX_RATE_CONTROL;
+
+//Metrics computed by VMX_CalculateQuality, combined with |
+typedef enum {
+	VMX_METRICS_PSNR = 1,
+	VMX_METRICS_SSIM = 2,
+	VMX_METRICS_MSSSIM = 4
+} VMX_METRICS_FLAGS;
+
 struct VMX_SLICE_DATA
 {
 	unsigned char* Stream;
+	unsigned char* Buffer; //Owned stream storage of the current set, allocated on first use. Stream points into the caller's frame after VMX_LoadFromInPlace
+	unsigned char* Buffers[VMX_STREAM_SETS];
+	int BufferLength[VMX_STREAM_SETS]; //Bytes allocated for each of Buffers, MaxStreamLength unless the instance is lean
 	unsigned char* StreamPos;
 	int MaxStreamLength;
 	int StreamLength;
@@ -129,9 +257,19 @@ struct VMX_SLICE_SET
 	VMX_SIZE PixelSize; //Size in pixels of the slice, for copying from source image data. Due to alignment last slice will be only 8 pixels height for 1080 for example.
 	VMX_SIZE PixelSizeInterlaced; //Same as above but for second field alignment adjustment at the mid point.
 	int LowerField; //=1 when this is a lower field slice
-	__declspec(align(64)) short TempBlock[128];
-	__declspec(align(64)) short TempBlock2[128];
-	__declspec(align(64)) short TempBlock3[128];
+	int RateCount[VMX_QUALITY_COUNT + 1]; //Sampled AC coefficients by the number of quality presets at which they are nonzero, for predictive rate control
+	int RateBits[VMX_QUALITY_COUNT + 1]; //Sum of the bit lengths of the same coefficients
+	uint64_t CacheHash[2]; //Fingerprint of the source the cached streams were encoded from, see VMX_SetSliceCache
+	int CacheLength[2]; //DC and AC bytes of the cached streams
+	int CacheSet; //Stream set holding the cached streams, -1 when there are none
+	int Repeated; //=1 when the slice is unchanged from the previous frame, see VMX_GetEncodedSkipSegments
+	int64_t StatsNs[VMX_STAGE_COUNT]; //Time spent on the slice in the last frame, for VMX_GetFrameStats
+	int64_t StatsEnd; //When the last stage of the slice finished
+	int StatsThread[VMX_STAGE_COUNT]; //VMX_StatsThread of the thread that ran each stage, -1 when it did not run
+	int ZeroBlocks[VMX_MAX_PLANES]; //Blocks of each plane coded with no AC coefficient
+	VMX_ALIGNAS(64) short TempBlock[128];
+	VMX_ALIGNAS(64) short TempBlock2[128];
+	VMX_ALIGNAS(64) short TempBlock3[128];
 };
 
 struct VMX_PLANE
@@ -139,6 +277,7 @@ struct VMX_PLANE
 	int Index;
 	VMX_SIZE Size;
 	int Stride; //Double this when dealing with 16bit data
+	int SliceHeight; //Rows coded per slice, half of VMX_SLICE_HEIGHT for the chroma planes in 4:2:0 mode
 	BYTE* Data;
 	BYTE* DataLowerPreview;
 };
@@ -153,25 +292,40 @@ struct VMX_INSTANCE
 	int Quality;
 	int MinQuality;
 	int DCShift;
+	int Chroma420; //Set by VMX_SetChroma420 or by the header of the frame loaded
 
-	unsigned short* DecodeQualityPresets[VMX_QUALITY_COUNT];
-	unsigned short* EncodeQualityPresets[VMX_QUALITY_COUNT];
-	unsigned short* DecodeMatrix;
-	unsigned short* EncodeMatrix;
-
-	unsigned short* DecodeQualityPresets256[VMX_QUALITY_COUNT];
-	unsigned short* EncodeQualityPresets256[VMX_QUALITY_COUNT];
-	unsigned short* DecodeMatrix256;
-	unsigned short* EncodeMatrix256;
+	//Entries of the shared VMX_QUALITY_PRESETS for the current quality
+	const unsigned short* DecodeMatrix;
+	const unsigned short* EncodeMatrix;
+	const unsigned short* DecodeMatrix256;
+	const unsigned short* EncodeMatrix256;
 
 	VMX_PLANE Planes[VMX_MAX_PLANES];
+	int PlaneLength[VMX_MAX_PLANES]; //Bytes allocated for each plane, 0 until a lean instance first needs it
+	int LeanMemory; //Set by VMX_SetLeanMemory
+	size_t PlaneMapped[VMX_MAX_PLANES]; //Bytes mapped for each plane under MemoryPolicy, 0 when it came from _mm_malloc
+	int MemoryPolicy; //VMX_MEMORY_POLICY flags set by VMX_SetMemoryPolicy
+	BYTE* Tiles; //Slice sized staging planes, one per thread that can be encoding at once, see VMX_UsesTiles
+	int TileLength; //Bytes per tile
+	int TileCount;
+	int TileShift; //1 when the tiles are laid out for 16bit samples
+	std::atomic<int>* TileBusy; //Set while a thread is converting into the tile
 	int SliceCount;
 	int AlignedHeight;
 	VMX_SLICE_SET** Slices;
 	int TargetBytesPerFrameMin;
 	int TargetBytesPerFrameMax;
+	VMX_RATE_CONTROL RateControl;
+	float RateBytesPerBit; //Encoded AC bytes per estimated bit of the sampled blocks, measured on the last frame
+	int RateDCBytes; //DC bytes of the last frame
+	float RateEstimate; //Estimated bits of the sampled blocks at the quality chosen for the current frame
+	int TargetMbps; //Bitrate of the profile from VMX_BITRATE_TABLE
+	int RateBufferSize; //Size in bytes of the leaky bucket set by VMX_SetRateControl, 0 when not in use
+	int RateBufferLevel; //Bytes in the bucket after the last frame
+	int RateBytesPerFrame; //Bytes drained from the bucket each frame
 	int Threads;
 	ThreadTasks * Tasks;
+	int SharedTasks; //Tasks is a VMX_POOL shared with other instances rather than private threads
 	VMX_SIZE PreviewSize;
 	VMX_SIZE PreviewSizeInterlaced;
 
@@ -188,6 +342,50 @@ struct VMX_INSTANCE
 	int ImageStrideA;
 
 	VMX_IMAGE_FORMAT ImageFormat;
+	int DecodeScale; //Set by VMX_DecodeScaled for the slice tasks
+	VMX_RECT DecodeRegion; //Set by VMX_DecodeRegion for the slice tasks
+	int RegionFirst[2]; //First slice overlapping DecodeRegion in each field, only the first is used for progressive frames
+	int RegionCount[2];
+
+	BYTE EncodedHeader[VMX_STREAM_SETS][8]; //Frame header returned by VMX_GetEncodedSegments, one per stream set
+	BYTE EncodedSkipHeader[VMX_STREAM_SETS][VMX_SKIP_HEADER_SIZE]; //Same for VMX_GetEncodedSkipSegments
+
+	int StreamSet; //Stream set the last frame was encoded into
+	int StreamSets; //1 until VMX_EncodeAsync is used
+	int EncodeAsync; //Set while an encode function is called from VMX_EncodeAsync
+	int EncodePending; //EncodeJob is running on the pool
+	ThreadTaskJob EncodeJob;
+	int DecodeAsync; //Set while a decode function is called from VMX_DecodeAsync
+	int DecodePending; //DecodeJob is running on the pool
+	ThreadTaskJob DecodeJob;
+
+	int ChunkSlices; //Slices per chunk set by VMX_SetChunkedOutput, 0 when whole frames are written
+	int ChunkCount;
+	VMX_CHUNK_CALLBACK ChunkCallback;
+	void* ChunkContext;
+	std::atomic<int>* ChunkPending; //Slices of each chunk still being encoded
+	int ChunkNext; //Next chunk to hand to ChunkCallback, protected by ChunkMutex
+	int ChunkBytes; //Bytes handed to ChunkCallback so far this frame
+	std::mutex ChunkMutex;
+	VMX_SEGMENT* ChunkSegments; //Segments of the chunk being written
+	BYTE* ChunkHeaders; //VMX_CHUNK_HEADER_SIZE bytes per chunk
+
+	int SliceCache; //Set by VMX_SetSliceCache
+	int SliceCacheKey; //Encoding settings the cached streams were produced with, -1 to discard them
+
+	int64_t StatsStart; //When the last frame was started, for VMX_GetFrameStats
+	int StatsDecode; //The last frame timed was decoded rather than encoded
+};
+
+//Frames decoding at once on their own instances, returned in the order they were submitted
+struct VMX_PIPELINE
+{
+	VMX_INSTANCE** Instances; //One per frame in flight, all on Pool
+	void** UserData;
+	int Depth;
+	int Head; //Instance holding the oldest frame in flight
+	int Count; //Frames in flight
+	VMX_POOL* Pool;
 };
 
 const int VMX_DECODE_MATRIX_COUNT = 64;
@@ -204,10 +402,37 @@ const int VMX_ENCODE_MATRIX_COUNT = 192;
 VMX_API VMX_INSTANCE* VMX_Create(VMX_SIZE dimensions, VMX_PROFILE profile, VMX_COLORSPACE colorSpace);
 
 /**
-* Destroy and free up memory of instance created with VMX_Create
+* Create an instance for decoding only, for receivers that open many streams and bring decoders up on demand.
+* 
+* Quantisation tables are shared, no worker threads are started and nothing frame sized is allocated up front: planes come
+* on the first decode that needs them as with VMX_SetLeanMemory, and stream buffers only with VMX_LoadFrom, so a decoder fed by
+* VMX_LoadFromInPlace into UYVY holds little more than the planes. Destroy with VMX_Destroy.
+* 
+* @param[in] dimensions The pixel size of the image, as for VMX_Create
+* @param[in] colorSpace Specify the color space to use when converting between YUV and RGB. Default is BT709.
+* @param[in] pool The pool created using VMX_CreatePool to decode on, using all of its threads. NULL uses the default pool
+* set by VMX_SetDefaultPool, or else decodes on the calling thread alone.
+*/
+VMX_API VMX_INSTANCE* VMX_CreateDecoder(VMX_SIZE dimensions, VMX_COLORSPACE colorSpace, VMX_POOL* pool);
+
+/**
+* Destroy and free up memory of instance created with VMX_Create or VMX_CreateDecoder
 */
 VMX_API void VMX_Destroy(VMX_INSTANCE* instance);
 
+/**
+* Switch the instance to another profile from the next frame, keeping its buffers, threads and slice cache.
+* 
+* MinQuality, the DC precision and the bitrate targets are set as VMX_Create would for the profile, with the targets at 60fps,
+* so call VMX_SetRateControl again afterwards when it is in use. The thread count chosen at creation is left as it is.
+* Waits for a frame started with VMX_EncodeAsync to finish first.
+* 
+* @param[in] instance The instance created using VMX_Create
+* @param[in] profile The profile to use, VMX_PROFILE_DEFAULT selecting VMX_PROFILE_HQ as in VMX_Create
+* @return VMX_ERR_INVALID_PARAMETERS if the profile has no bitrate for this frame size, in which case nothing changes
+*/
+VMX_API VMX_ERR VMX_SetProfile(VMX_INSTANCE* instance, VMX_PROFILE profile);
+
 /**
 * Set the quality to use for the next frame.
 * 
@@ -251,6 +476,32 @@ VMX_API void VMX_GetEncodingParameters(VMX_INSTANCE* instance, int* frameMin, in
 */
 VMX_API void VMX_SetEncodingParameters(VMX_INSTANCE* instance, int frameMin, int frameMax, int minQuality, int dcShift);
 
+/**
+* Target a bitrate at the actual frame rate of the source using a leaky bucket across frames.
+* 
+* VMX_Create derives frameMin/frameMax from the profile bitrate at 60fps. This replaces them with the bitrate spread over fpsN/fpsD,
+* and after each frame re-centres them on whatever keeps the bucket half full, so a run of large frames is paid back by the following ones
+* and no frame is targeted above the space left in the bucket. VMX_SetEncodingParameters turns the bucket off again.
+* 
+* @param[in] instance The instance created using VMX_Create
+* @param[in] targetMbps Average bitrate in Mbps, or 0 for the bitrate of the profile
+* @param[in] fpsN Frame rate numerator, e.g. 30000
+* @param[in] fpsD Frame rate denominator, e.g. 1001
+* @param[in] bufferMs Bucket size in milliseconds at the target bitrate, or 0 to only scale frameMin/frameMax to the frame rate
+*/
+VMX_API void VMX_SetRateControl(VMX_INSTANCE* instance, int targetMbps, int fpsN, int fpsD, int bufferMs);
+
+/**
+* Select how quality is chosen to meet the frameMin/frameMax targets. The default is VMX_RATE_CONTROL_REACTIVE.
+* 
+* In predictive mode a sample of each frame is transformed before encoding and the quality is picked from its coefficient statistics,
+* so a scene cut is absorbed by the frame it happens in rather than over the following frames. This overrides VMX_SetQuality.
+* 
+* @param[in] instance The instance created using VMX_Create
+* @param[in] mode The rate control mode to use from the next frame
+*/
+VMX_API void VMX_SetRateControlMode(VMX_INSTANCE* instance, VMX_RATE_CONTROL mode);
+
 /**
 * Decode frame into BGRA buffer. BGRA is the same as ARGB32 and A8R8G8B8 on Windows
 * 
@@ -324,6 +575,34 @@ VMX_API VMX_ERR VMX_DecodeUYVA(VMX_INSTANCE* instance, BYTE* dst, int stride);
 */
 VMX_API VMX_ERR VMX_DecodeYUY2(VMX_INSTANCE* instance, BYTE* dst, int stride);
 
+/**
+* Decode frame into a 4:2:0 NV12 buffer, a Y plane followed by a plane of interleaved U and V at half the height.
+* 
+* Chroma is the average of each pair of rows. Interlaced frames average rows within each field.
+* 
+* @param[in] instance The instance created using VMX_Create
+* @param[in] dstY The destination Y plane
+* @param[in] strideY The stride of the Y plane in bytes
+* @param[in] dstUV The destination UV plane, (height + 1) / 2 rows
+* @param[in] strideUV The stride of the UV plane in bytes
+*/
+VMX_API VMX_ERR VMX_DecodeNV12(VMX_INSTANCE* instance, BYTE* dstY, int strideY, BYTE* dstUV, int strideUV);
+
+/**
+* Same as VMX_DecodeNV12 except for separate U and V planes of half the width (I420, yuv420p in FFmpeg).
+* 
+* Pass the planes in the opposite order for YV12.
+* 
+* @param[in] instance The instance created using VMX_Create
+* @param[in] dstY The destination Y plane
+* @param[in] strideY The stride of the Y plane in bytes
+* @param[in] dstU The destination U plane
+* @param[in] strideU The stride of the U plane in bytes
+* @param[in] dstV The destination V plane
+* @param[in] strideV The stride of the V plane in bytes
+*/
+VMX_API VMX_ERR VMX_DecodeI420(VMX_INSTANCE* instance, BYTE* dstY, int strideY, BYTE* dstU, int strideU, BYTE* dstV, int strideV);
+
 /**
 * Decodes a special 1/8th preview of the compressed image
 * 
@@ -371,6 +650,39 @@ VMX_API VMX_ERR VMX_DecodePreviewUYVA(VMX_INSTANCE* instance, BYTE* dst, int str
 */
 VMX_API VMX_ERR VMX_DecodePreviewYUY2(VMX_INSTANCE* instance, BYTE* dst, int stride);
 
+/**
+* Decodes the frame at 1/2 or 1/4 of its size, for thumbnails and multiviewer tiles.
+* 
+* Each 8x8 block is reconstructed from its low frequency coefficients with a 4x4 or 2x2 inverse transform rather than decoded in full and scaled down.
+* 
+* The size is the width divided by scale rounded up to be divisible by 2, and the height divided by scale.
+* 
+* Example 1920x1080 becomes 960x540 at scale 2 and 480x270 at scale 4.
+* 
+* @param[in] instance The instance created using VMX_Create
+* @param[in] scale 2 or 4
+* @param[in] format One of VMX_IMAGE_UYVY, VMX_IMAGE_UYVA, VMX_IMAGE_YUY2, VMX_IMAGE_BGRA or VMX_IMAGE_BGRX, laid out the same as the matching full size decode
+* @param[in] dst The destination buffer
+* @param[in] stride The stride in bytes of each row of pixels
+*/
+VMX_API VMX_ERR VMX_DecodeScaled(VMX_INSTANCE* instance, int scale, VMX_IMAGE_FORMAT format, BYTE* dst, int stride);
+
+/**
+* Decodes only a rectangle of the frame, for monitoring a crop of a larger source.
+* 
+* Only the slices overlapping the rectangle are decoded, and within them only the blocks it covers are transformed.
+* The rest of each slice is still read up to the last block needed, as the bitstream has no block lengths.
+* 
+* The image written to dst is rect.width x rect.height, with the top left pixel at rect.x, rect.y of the frame.
+* 
+* @param[in] instance The instance created using VMX_Create
+* @param[in] rect Area of the frame to decode. x and width must be divisible by 2 and the rectangle must lie within the frame.
+* @param[in] format One of VMX_IMAGE_UYVY, VMX_IMAGE_UYVA, VMX_IMAGE_YUY2, VMX_IMAGE_BGRA or VMX_IMAGE_BGRX, laid out the same as the matching full size decode
+* @param[in] dst The destination buffer
+* @param[in] stride The stride in bytes of each row of pixels
+*/
+VMX_API VMX_ERR VMX_DecodeRegion(VMX_INSTANCE* instance, VMX_RECT rect, VMX_IMAGE_FORMAT format, BYTE* dst, int stride);
+
 
 /**
 * Encode a BGRA image. This is the same as the ARGB32 in DirectShow or A8R8G8B8 in Direct3D
@@ -447,6 +759,25 @@ VMX_API VMX_ERR VMX_EncodeNV12(VMX_INSTANCE* instance, BYTE* srcY, int srcStride
 */
 VMX_API VMX_ERR VMX_EncodeYV12(VMX_INSTANCE* instance, BYTE* srcY, int srcStrideY, BYTE* srcU, int srcStrideU, BYTE* srcV, int srcStrideV, int interlaced);
 
+/**
+* Encode a 4:2:0 image described as three planes, such as an Android YUV_420_888 Image.
+* 
+* A chroma pixel stride of 1 is I420/YV12. A pixel stride of 2 is semi-planar: NV12 when srcV is srcU + 1, or NV21 when srcU is srcV + 1.
+* 
+* The planes are read in place, so no copy into a contiguous buffer is required.
+* 
+* @param[in] instance The instance created using VMX_Create
+* @param[in] srcY The Y plane source pixels
+* @param[in] srcStrideY The stride of the Y plane in bytes
+* @param[in] srcU The first U sample
+* @param[in] srcStrideU The stride of the U plane in bytes
+* @param[in] srcV The first V sample
+* @param[in] srcStrideV The stride of the V plane in bytes
+* @param[in] pixelStrideUV The distance in bytes between two consecutive U (or V) samples on the same row, either 1 or 2
+* @param[in] interlaced 1 if interlaced, 0 if progressive
+*/
+VMX_API VMX_ERR VMX_EncodeYUV420(VMX_INSTANCE* instance, BYTE* srcY, int srcStrideY, BYTE* srcU, int srcStrideU, BYTE* srcV, int srcStrideV, int pixelStrideUV, int interlaced);
+
 /**
 * Encode a 4:2:2 P216 image.
 * 
@@ -475,6 +806,23 @@ VMX_API VMX_ERR VMX_EncodeP216(VMX_INSTANCE* instance, BYTE* src, int stride, in
 */
 VMX_API VMX_ERR VMX_EncodePA16(VMX_INSTANCE* instance, BYTE* src, int stride, int interlaced);
 
+/**
+* Encode a 4:2:0 P010 image, as delivered by most 10bit camera and hardware decoder pipelines.
+*
+* This is a 16bit Y plane and a half height interleaved 16bit UV plane, which may be separate buffers.
+*
+* As with P216 the 10bit values are in the most significant bits of each sample, so the planes are encoded as they are
+* with each UV row covering two rows of the image. The result decodes as P216 or any other format.
+*
+* @param[in] instance The instance created using VMX_Create
+* @param[in] srcY The Y plane source pixels
+* @param[in] srcStrideY The stride of the Y plane in bytes
+* @param[in] srcUV The UV plane source pixels
+* @param[in] srcStrideUV The stride of the UV plane in bytes
+* @param[in] interlaced 1 if interlaced, 0 if progressive
+*/
+VMX_API VMX_ERR VMX_EncodeP010(VMX_INSTANCE* instance, BYTE* srcY, int srcStrideY, BYTE* srcUV, int srcStrideUV, int interlaced);
+
 
 VMX_API VMX_ERR VMX_EncodePlanar(VMX_INSTANCE* instance, int interlaced);
 
@@ -486,6 +834,19 @@ VMX_API VMX_ERR VMX_EncodePlanar(VMX_INSTANCE* instance, int interlaced);
 */
 VMX_API VMX_ERR VMX_LoadFrom(VMX_INSTANCE* instance, BYTE* data, int dataLen);
 
+/**
+* Load a compressed frame without copying it. Only the location of each slice within data is recorded, decoding reads directly from it.
+* data must remain valid and unchanged until the last VMX_Decode* call for this frame returns, and at least VMX_LOAD_PADDING readable bytes must follow dataLen,
+* as the bitstream reader fetches 64bits at a time past the end of each slice.
+* An instance used only with this function never allocates its own stream buffers.
+* Chunks written by VMX_SetChunkedOutput are accepted only when data covers every slice of the frame, otherwise VMX_ERR_INVALID_SLICE_COUNT is returned
+* and the frame must not be decoded. Load partial frames with VMX_LoadFrom instead.
+* @param[in] instance The instance created using VMX_Create
+* @param[in] data The compressed frame data
+* @param[in] dataLen The length of the compressed frame data in bytes, excluding the padding.
+*/
+VMX_API VMX_ERR VMX_LoadFromInPlace(VMX_INSTANCE* instance, BYTE* data, int dataLen);
+
 /**
 * Save a compressed frame to a buffer.
 * @param[in] instance The instance created using VMX_Create
@@ -494,6 +855,259 @@ VMX_API VMX_ERR VMX_LoadFrom(VMX_INSTANCE* instance, BYTE* data, int dataLen);
 */
 VMX_API int VMX_SaveTo(VMX_INSTANCE* instance, BYTE* dst, int maxLen);
 
+/**
+* Start encoding a frame on the instance's worker threads and return immediately. Call VMX_WaitEncoded before using the result with VMX_SaveTo or VMX_GetEncodedSegments.
+* The source image must remain valid and unchanged until then.
+* The instance rotates between VMX_STREAM_SETS sets of slice streams, so the segments of the previous frame remain valid while this one is encoded.
+* If the instance has no worker threads the frame is encoded before returning.
+* @param[in] instance The instance created using VMX_Create
+* @param[in] format The source image format, one of UYVY, UYVA, YUY2, NV12, NV21, YV12, BGRA, BGRX, P216, PA16 or P010
+* @param[in] src The source image, or Y plane for the 4:2:0 formats
+* @param[in] stride The stride in bytes of src
+* @param[in] srcU The UV plane for NV12/NV21/P010, U plane for YV12, otherwise ignored
+* @param[in] strideU The stride in bytes of srcU
+* @param[in] srcV The V plane for YV12, otherwise ignored
+* @param[in] strideV The stride in bytes of srcV
+* @param[in] interlaced 1 if the image is interlaced
+*/
+VMX_API VMX_ERR VMX_EncodeAsync(VMX_INSTANCE* instance, VMX_IMAGE_FORMAT format, BYTE* src, int stride, BYTE* srcU, int strideU, BYTE* srcV, int strideV, int interlaced);
+
+/**
+* Wait for the frame started by VMX_EncodeAsync to finish. Returns immediately if no frame is in progress.
+* The calling thread encodes any slices the workers have not started yet, so work that can overlap the encode belongs before this call.
+* @param[in] instance The instance created using VMX_Create
+*/
+VMX_API VMX_ERR VMX_WaitEncoded(VMX_INSTANCE* instance);
+
+/**
+* Start decoding the frame loaded with VMX_LoadFrom on the instance's worker threads and return immediately. Call VMX_WaitDecoded before using the image.
+* The destination must remain valid until then, as must the data passed to VMX_LoadFromInPlace.
+* If the instance has no worker threads the frame is decoded before returning.
+* @param[in] instance The instance created using VMX_Create
+* @param[in] format The destination image format, one of UYVY, UYVA, YUY2, NV12, YV12 (I420 plane order), BGRA, BGRX, P216 or PA16
+* @param[in] dst The destination image, or Y plane for the 4:2:0 formats
+* @param[in] stride The stride in bytes of dst
+* @param[in] dstU The UV plane for NV12, U plane for YV12, otherwise ignored
+* @param[in] strideU The stride in bytes of dstU
+* @param[in] dstV The V plane for YV12, otherwise ignored
+* @param[in] strideV The stride in bytes of dstV
+*/
+VMX_API VMX_ERR VMX_DecodeAsync(VMX_INSTANCE* instance, VMX_IMAGE_FORMAT format, BYTE* dst, int stride, BYTE* dstU, int strideU, BYTE* dstV, int strideV);
+
+/**
+* Wait for the frame started by VMX_DecodeAsync to finish. Returns immediately if no frame is in progress.
+* @param[in] instance The instance created using VMX_Create
+*/
+VMX_API VMX_ERR VMX_WaitDecoded(VMX_INSTANCE* instance);
+
+/**
+* Create a decoder that works on several frames at once, for streams whose slices alone cannot keep a many core machine busy (720p and below).
+* 
+* Each frame in flight is decoded on its own instance on a shared pool, and frames are returned in the order they were submitted.
+* depth trades latency for throughput: 1 decodes one frame at a time like a single instance, each extra frame in flight can hold a
+* frame back by up to one more frame time but lets another frame use cores the first leaves idle.
+* 
+* @param[in] dimensions The frame dimensions
+* @param[in] profile The profile of the stream, which sets the threads each frame uses
+* @param[in] colorSpace The color space for the RGB conversions
+* @param[in] depth The most frames in flight, 1 or more
+* @param[in] pool The pool created using VMX_CreatePool to decode on, or NULL to create one with a thread per logical processor
+*/
+VMX_API VMX_PIPELINE* VMX_CreatePipeline(VMX_SIZE dimensions, VMX_PROFILE profile, VMX_COLORSPACE colorSpace, int depth, VMX_POOL* pool);
+
+/**
+* Wait for the frames in flight and release the pipeline. Frames not yet returned by VMX_GetPipelineFrame are discarded.
+* @param[in] pipeline The pipeline created using VMX_CreatePipeline
+*/
+VMX_API void VMX_DestroyPipeline(VMX_PIPELINE* pipeline);
+
+/**
+* Copy a compressed frame into the pipeline and start decoding it. data can be reused as soon as this returns.
+* Returns VMX_ERR_BUSY without doing anything if depth frames are already in flight, call VMX_GetPipelineFrame first.
+* @param[in] pipeline The pipeline created using VMX_CreatePipeline
+* @param[in] data The compressed frame
+* @param[in] dataLen The length of data in bytes
+* @param[in] format The destination image format, as VMX_DecodeAsync
+* @param[in] dst, stride, dstU, strideU, dstV, strideV The destination image as VMX_DecodeAsync. It must not be used until this frame is returned.
+* @param[in] userData Returned with the frame by VMX_GetPipelineFrame
+*/
+VMX_API VMX_ERR VMX_SubmitPipelineFrame(VMX_PIPELINE* pipeline, BYTE* data, int dataLen, VMX_IMAGE_FORMAT format, BYTE* dst, int stride, BYTE* dstU, int strideU, BYTE* dstV, int strideV, void* userData);
+
+/**
+* Return the oldest frame in flight once it is decoded.
+* @param[in] pipeline The pipeline created using VMX_CreatePipeline
+* @param[in] wait 1 to wait for the frame to finish, 0 to return straight away if it has not
+* @param[out] userData The userData passed to VMX_SubmitPipelineFrame with this frame, can be NULL
+* @return 1 if a frame was returned, 0 if there are no frames in flight or wait is 0 and the oldest has not finished
+*/
+VMX_API int VMX_GetPipelineFrame(VMX_PIPELINE* pipeline, int wait, void** userData);
+
+/**
+* Returns the number of segments VMX_GetEncodedSegments will return for this instance.
+* @param[in] instance The instance created using VMX_Create
+*/
+VMX_API int VMX_GetEncodedSegmentCount(VMX_INSTANCE* instance);
+
+/**
+* Describe the compressed frame as a list of segments in place, without copying it.
+* The segments concatenated in order are identical to the output of VMX_SaveTo, and can be passed directly to a
+* scatter-gather send such as writev/sendmsg. They point into the instance and remain valid until the next encode starts, or once VMX_EncodeAsync has been used, until the encode after next starts.
+* Returns the total length in bytes, or 0 if maxSegments is less than VMX_GetEncodedSegmentCount.
+* @param[in] instance The instance created using VMX_Create
+* @param[out] segments Receives the header segment followed by the DC and AC stream of every slice
+* @param[in] maxSegments The number of entries available in segments
+*/
+VMX_API int VMX_GetEncodedSegments(VMX_INSTANCE* instance, VMX_SEGMENT* segments, int maxSegments);
+
+/**
+* Switch to low-latency output, where the frame is written as self-describing chunks of consecutive slices.
+* 
+* Each chunk carries the frame header, its first slice and slice count, then the DC and AC streams of those slices, so it can be passed to
+* VMX_LoadFrom on its own. VMX_SaveTo and VMX_GetEncodedSegments write every chunk of the frame back to back, which VMX_LoadFrom also accepts.
+* With a callback, chunks are handed over in order from the encoding threads as soon as all their slices are encoded, before the encode function
+* (or VMX_WaitEncoded after VMX_EncodeAsync) returns. Calls are never concurrent, and last is 1 for the final chunk of the frame.
+* Decoders that predate this mode cannot read chunked frames.
+* 
+* @param[in] instance The instance created using VMX_Create
+* @param[in] slicesPerChunk Slices of 16 lines per chunk, or 0 to go back to whole frames
+* @param[in] callback Receives each chunk as it completes, or NULL to only change the framing
+* @param[in] context Passed to callback
+*/
+VMX_API void VMX_SetChunkedOutput(VMX_INSTANCE* instance, int slicesPerChunk, VMX_CHUNK_CALLBACK callback, void* context);
+
+/**
+* Describe the compressed frame in place as one whole frame, as VMX_GetEncodedSegments does without chunked output, even when chunked output is on.
+* This lets a frame go out as chunks to decoders that read them and whole to decoders that predate VMX_SetChunkedOutput, from a single encode.
+* 
+* This does not feed rate control, so call it after the chunks of the frame were delivered, or after VMX_SaveTo or VMX_GetEncodedSegments.
+* Returns the total length in bytes, or 0 if maxSegments is less than 1 + (2 * slice count).
+* @param[in] instance The instance created using VMX_Create
+* @param[out] segments Receives the header segment followed by the DC and AC stream of every slice
+* @param[in] maxSegments The number of entries available in segments
+*/
+VMX_API int VMX_GetEncodedFrameSegments(VMX_INSTANCE* instance, VMX_SEGMENT* segments, int maxSegments);
+
+/**
+* Reuse the encoded streams of slices whose source has not changed since the previous frame.
+* 
+* Each slice of the source image is fingerprinted with a 128bit hash before it is encoded. When the fingerprint matches the previous
+* frame and the quality and other encoding settings are the same, the previous DC and AC streams are reused instead of converting and
+* encoding the slice again, so the output is identical to a full encode while static areas of the picture cost little more than the hash.
+* Only applies to images whose width is a multiple of 16; other sizes are always encoded in full.
+* 
+* @param[in] instance The instance created using VMX_Create
+* @param[in] enable 1 to turn the cache on, 0 to turn it off and discard it
+*/
+VMX_API void VMX_SetSliceCache(VMX_INSTANCE* instance, int enable);
+
+/**
+* Keep only the memory encoding actually needs, for devices where a full size instance is too large.
+* 
+* A lean instance frees the frame sized planes and allocates them again only when a decode needs them, and then without alpha
+* or 16bit storage unless the format uses it. Encoding converts each slice into a tile of one slice that stays in cache instead,
+* one per thread. DC and AC stream buffers are sized for the worst case at the quality of each frame and grow when rate control
+* raises it, rather than for the largest frame of any quality.
+* The output is identical either way. Call straight after VMX_Create, as the streams of earlier frames are discarded.
+* Not for instances fed through VMX_EncodePlanar, whose planes the caller fills before each frame.
+* 
+* @param[in] instance The instance created using VMX_Create
+* @param[in] enable 1 to make the instance lean, 0 to go back to full size buffers
+*/
+VMX_API void VMX_SetLeanMemory(VMX_INSTANCE* instance, int enable);
+
+/**
+* Report how many bytes the instance currently holds, e.g. to compare VMX_SetLeanMemory with the default.
+* @param[in] instance The instance created using VMX_Create
+* @param[out] usage Receives the breakdown
+*/
+VMX_API VMX_ERR VMX_GetMemoryUsage(VMX_INSTANCE* instance, VMX_MEMORY_USAGE* usage);
+
+/**
+* Choose where the instance places its memory, for 4K and 8K instances on servers with several sockets.
+* 
+* With VMX_MEMORY_POLICY_NUMA the slices of a frame are split into one contiguous range per NUMA node. Each slice, its DC and AC stream
+* buffers and its rows of every plane are first touched by a thread of the node its range belongs to, and threads take slices of their
+* own node before helping with the others, so conversion and coding stay on local memory unless a node falls behind.
+* Private threads are restarted bound to the nodes round robin. Workers of a shared VMX_POOL are not bound, and take slices of the node
+* they are running on at the time.
+* VMX_MEMORY_POLICY_HUGEPAGES and VMX_MEMORY_POLICY_HUGEPAGES_EXPLICIT back the frame sized planes with 2MB pages to cut TLB misses.
+* The output is identical either way. Both are Linux only, elsewhere the policy is kept but changes nothing.
+* Call straight after VMX_Create, as the buffers are allocated again and the streams of earlier frames are discarded.
+* 
+* @param[in] instance The instance created using VMX_Create
+* @param[in] policy VMX_MEMORY_POLICY flags, VMX_MEMORY_POLICY_DEFAULT for ordinary allocations
+* @return VMX_ERR_INVALID_PARAMETERS if policy holds unknown flags, in which case nothing changes
+*/
+VMX_API VMX_ERR VMX_SetMemoryPolicy(VMX_INSTANCE* instance, int policy);
+
+/**
+* Returns the number of slices of the last encoded frame that were reused unchanged from the frame before by VMX_SetSliceCache.
+* @param[in] instance The instance created using VMX_Create
+*/
+VMX_API int VMX_GetRepeatedSliceCount(VMX_INSTANCE* instance);
+
+/**
+* Report what the last frame cost: the quality used, the DC and AC bytes of each slice, how many blocks of each plane
+* were coded without any AC coefficient, and how long each stage of each slice took and on which thread.
+* 
+* Timings come from a few clock reads per slice and plane in VMX_EncodeSlices and VMX_DecodeSlices, and the block counts
+* from the encode kernels, all removed by building with VMX_STATS defined as 0. Only full frame encodes and decodes are
+* timed, not VMX_DecodeScaled, VMX_DecodeRegion or the previews. Waits for a frame started with VMX_EncodeAsync or VMX_DecodeAsync.
+* 
+* @param[in] instance The instance created using VMX_Create or VMX_CreateDecoder
+* @param[out] stats Receives the totals for the frame
+* @param[out] slices Receives one entry per slice, in slice order. Can be NULL
+* @param[in] maxSlices Entries available at slices. Slices beyond this are still counted in stats
+*/
+VMX_API VMX_ERR VMX_GetFrameStats(VMX_INSTANCE* instance, VMX_FRAME_STATS* stats, VMX_SLICE_STATS* slices, int maxSlices);
+
+/**
+* Describe the compressed frame in place like VMX_GetEncodedSegments, but with the slices that repeat the previous frame left out.
+* 
+* The frame header is always extended, with VMX_SKIP_SLICES set in its DC shift byte and followed by one bit per slice (least
+* significant bit first) that is set for repeated slices. Only the DC and AC streams of the other slices follow.
+* VMX_LoadFrom does not touch repeated slices and the Decode functions skip them, leaving whatever the destination already holds,
+* so such a frame is only valid for a decoder that decoded the previous frame into the same destination with the same function.
+* Decoders that predate this format reject it.
+* 
+* This does not feed rate control, so call it after VMX_SaveTo or VMX_GetEncodedSegments for the same frame.
+* Returns the total length in bytes, or 0 in chunked mode or if maxSegments is less than VMX_GetEncodedSegmentCount.
+* @param[in] instance The instance created using VMX_Create
+* @param[out] segments Receives the header and bitmap segment followed by the DC and AC streams of the slices that changed
+* @param[in] maxSegments The number of entries available in segments
+*/
+VMX_API int VMX_GetEncodedSkipSegments(VMX_INSTANCE* instance, VMX_SEGMENT* segments, int maxSegments);
+
+/**
+* Code the chroma planes at half height, for sources that only have 4:2:0 chroma such as NV12, YV12 and P010.
+* 
+* By default chroma is coded as 4:2:2, so a 4:2:0 source pays for every chroma row twice. In 4:2:0 mode each slice codes 8 rows
+* of U and V instead of 16, which cuts the blocks per frame by a quarter. 4:2:2 sources are averaged down in row pairs.
+* The frame header is extended with VMX_CHROMA_420 set in its DC shift byte, and decoding duplicates each chroma row again, so
+* every Decode function and output format works as before. VMX_DecodeScaled and the previews reduce the coded rows as they do
+* the rest, so their chroma has half the vertical resolution of their luma. Decoders that predate this mode misread such frames,
+* so only enable it when every receiver is known to support it.
+* 
+* Takes effect from the next frame encoded. VMX_LoadFrom sets it from each frame, so decoders never need to call this.
+* @param[in] instance The instance created using VMX_Create
+* @param[in] enable 1 for 4:2:0, 0 for 4:2:2
+*/
+VMX_API void VMX_SetChroma420(VMX_INSTANCE* instance, int enable);
+
+/**
+* Returns 1 if the instance codes chroma as 4:2:0, see VMX_SetChroma420. After VMX_LoadFrom this describes the frame loaded.
+* @param[in] instance The instance created using VMX_Create
+*/
+VMX_API int VMX_GetChroma420(VMX_INSTANCE* instance);
+
+/**
+* Returns an upper bound of the compressed frame length for this instance, valid for any image content at any quality
+* the rate control can reach. Use this to size the buffer passed to VMX_SaveTo instead of width*height*4.
+* @param[in] instance The instance created using VMX_Create
+* @param[in] alpha 1 if frames will be encoded with an alpha channel
+*/
+VMX_API int VMX_GetMaxEncodedLength(VMX_INSTANCE* instance, int alpha);
+
 /**
 * Returns the portion of the compressed frame that is needed to decode a preview. 
 */
@@ -535,6 +1149,24 @@ VMX_API int VMX_BGRXToUYVYConditional(BYTE* pSrc, BYTE* pSrcPrev, int srcStride,
 */
 VMX_API float VMX_CalculatePSNR(BYTE* p1, BYTE* p2, int stride, int bytesPerPixel, VMX_SIZE sz);
 
+/**
+* Measure the quality of an image against its reference, for each plane and over all of them, on the threads of instance.
+* 
+* PSNR and SSIM are computed together from the same pass over the rows. MS-SSIM also needs 4 reduced copies of both images and costs
+* about a third more than SSIM. Values match across the 128bit and AVX2 paths and any number of threads.
+* 
+* For monitoring a live stream, sampling measures only 1 in every sampling bands of 32 image rows, which cuts the cost by as
+* much. The same bands are measured every frame. MS-SSIM needs whole images, so it is left at 0 when sampling is above 1.
+* @param[in] instance The instance created using VMX_Create, whose dimensions both images share and whose threads do the work
+* @param[in] format VMX_IMAGE_UYVY, VMX_IMAGE_YUY2, VMX_IMAGE_NV12, VMX_IMAGE_NV21, VMX_IMAGE_YV12 or VMX_IMAGE_YUVPLANAR422
+* @param[in] reference The original image
+* @param[in] image The image to compare with it, in the same format
+* @param[in] flags VMX_METRICS_FLAGS to compute, the rest are left at 0
+* @param[in] sampling 1 to measure every row, n to measure 1 in n bands of rows
+* @param[out] metrics The results
+*/
+VMX_API VMX_ERR VMX_CalculateQuality(VMX_INSTANCE* instance, VMX_IMAGE_FORMAT format, const VMX_IMAGE* reference, const VMX_IMAGE* image, int flags, int sampling, VMX_METRICS* metrics);
+
 /**
 * Get the number of threads currently configured for encoding/decoding. These are automatically set based on the dimensions/profile.
 * @param[in] instance The instance created using VMX_Create
@@ -542,15 +1174,46 @@ VMX_API float VMX_CalculatePSNR(BYTE* p1, BYTE* p2, int stride, int bytesPerPixe
 VMX_API int VMX_GetThreads(VMX_INSTANCE* instance);
 
 /**
-* Set the number of threads for encoding/decoding.
+* Set the number of threads for encoding/decoding. With a shared pool this is the most threads the instance will use from it at once.
 * @param[in] instance The instance created using VMX_Create
 * @param[in] numThreads The number of threads to use. <= 0 is invalid and ignored.
 */
 VMX_API void VMX_SetThreads(VMX_INSTANCE* instance, int numThreads);
 
+/**
+* Create a worker pool that can be shared by any number of instances, instead of each instance starting its own threads.
+* Instances attached to a pool use at most VMX_GetThreads threads at once, including the calling thread, and are served round robin.
+* @param[in] numThreads The number of worker threads. <= 0 uses one per logical processor.
+*/
+VMX_API VMX_POOL* VMX_CreatePool(int numThreads);
+
+/**
+* Release a pool created with VMX_CreatePool. The threads stop once every instance using the pool has also been destroyed or detached.
+* @param[in] pool The pool created using VMX_CreatePool
+*/
+VMX_API void VMX_DestroyPool(VMX_POOL* pool);
+
+/**
+* Set the pool that instances created from now on will use. VMX_Create then starts no threads of its own.
+* @param[in] pool The pool created using VMX_CreatePool, or NULL to go back to private threads per instance.
+*/
+VMX_API void VMX_SetDefaultPool(VMX_POOL* pool);
+
+/**
+* Move an existing instance onto a pool, stopping its private threads.
+* Must not be called while the instance is encoding or decoding.
+* @param[in] instance The instance created using VMX_Create
+* @param[in] pool The pool created using VMX_CreatePool, or NULL to go back to private threads.
+*/
+VMX_API void VMX_SetPool(VMX_INSTANCE* instance, VMX_POOL* pool);
+
 VMX_API int VMX_Test(VMX_INSTANCE* instance, short* src, short* dst);
 //Private functions
 void VMX_ResetData(VMX_SLICE_DATA* s);
 void VMX_ResetStream(VMX_INSTANCE* instance);
+void VMX_ResetEncodeStream(VMX_INSTANCE* instance);
+void VMX_AdjustBitrate(VMX_INSTANCE* instance, int prevFrameLength);
+int VMX_ResetDecodeStream(VMX_INSTANCE* instance, int ac);
+VMX_POOL* VMX_AcquireDefaultPool();
 
 
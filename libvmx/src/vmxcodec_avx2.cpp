@@ -25,6 +25,7 @@
 #include "pch.h"
 #include "vmxcodec_x86.h"
 #include "vmxcodec_avx2.h"
+#include "vmxcodec_ingest.h"
 #include <fstream>
 
 /// X86 Compilation Notes:
@@ -53,21 +54,21 @@
 //===========================
 //IDCT Tables for 256bit SIMD
 //===========================
-__declspec(align(32)) const short one_corr_256[16] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 };
-__declspec(align(32)) const short round_inv_row_256[16] = { IRND_INV_ROW, 0, IRND_INV_ROW, 0, IRND_INV_ROW, 0, IRND_INV_ROW, 0, IRND_INV_ROW, 0, IRND_INV_ROW, 0, IRND_INV_ROW, 0, IRND_INV_ROW, 0 };
-__declspec(align(32)) const short round_inv_col_256[16] = { IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL };
-__declspec(align(32)) const short round_inv_corr_256[16] = { IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR };
+VMX_ALIGNAS(32) const short one_corr_256[16] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+VMX_ALIGNAS(32) const short round_inv_row_256[16] = { IRND_INV_ROW, 0, IRND_INV_ROW, 0, IRND_INV_ROW, 0, IRND_INV_ROW, 0, IRND_INV_ROW, 0, IRND_INV_ROW, 0, IRND_INV_ROW, 0, IRND_INV_ROW, 0 };
+VMX_ALIGNAS(32) const short round_inv_col_256[16] = { IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL };
+VMX_ALIGNAS(32) const short round_inv_corr_256[16] = { IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR };
 
-__declspec(align(32)) const short round_inv_row_256_10[16] = { IRND_INV_ROW10, 0, IRND_INV_ROW10, 0, IRND_INV_ROW10, 0, IRND_INV_ROW10, 0, IRND_INV_ROW10, 0, IRND_INV_ROW10, 0, IRND_INV_ROW10, 0, IRND_INV_ROW10, 0 };
-__declspec(align(32)) const short round_inv_col_256_10[16] = { IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10 };
-__declspec(align(32)) const short round_inv_corr_256_10[16] = { IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10 };
+VMX_ALIGNAS(32) const short round_inv_row_256_10[16] = { IRND_INV_ROW10, 0, IRND_INV_ROW10, 0, IRND_INV_ROW10, 0, IRND_INV_ROW10, 0, IRND_INV_ROW10, 0, IRND_INV_ROW10, 0, IRND_INV_ROW10, 0, IRND_INV_ROW10, 0 };
+VMX_ALIGNAS(32) const short round_inv_col_256_10[16] = { IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10 };
+VMX_ALIGNAS(32) const short round_inv_corr_256_10[16] = { IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10 };
 
-__declspec(align(32)) const short tg_1_16_256[16] = { 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036 }; // tg * (2<<16) + 0.5
-__declspec(align(32)) const short tg_2_16_256[16] = { 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146 }; // tg * (2<<16) + 0.5
-__declspec(align(32)) const short tg_3_16_256[16] = { -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746 }; // tg * (2<<16) + 0.5
-__declspec(align(32)) const short cos_4_16_256[16] = { -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195 };// cos * (2<<16) + 0.5
+VMX_ALIGNAS(32) const short tg_1_16_256[16] = { 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036 }; // tg * (2<<16) + 0.5
+VMX_ALIGNAS(32) const short tg_2_16_256[16] = { 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146 }; // tg * (2<<16) + 0.5
+VMX_ALIGNAS(32) const short tg_3_16_256[16] = { -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746 }; // tg * (2<<16) + 0.5
+VMX_ALIGNAS(32) const short cos_4_16_256[16] = { -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195 };// cos * (2<<16) + 0.5
 
-__declspec(align(32)) const short tab_i_04_256[] = {
+VMX_ALIGNAS(32) const short tab_i_04_256[] = {
 	16384, 21407, 16384, 8867,
 	16384, -8867, 16384, -21407,
 	16384, 21407, 16384, 8867,
@@ -88,7 +89,7 @@ __declspec(align(32)) const short tab_i_04_256[] = {
 	12873, 4520, -22725, -12873, 
 	4520, 19266, 19266, -22725 }; 
 
-__declspec(align(32)) const short tab_i_17_256[] = {
+VMX_ALIGNAS(32) const short tab_i_17_256[] = {
 	22725, 29692, 22725, 12299,
 	22725, -12299, 22725, -29692,
 	22725, 29692, 22725, 12299,
@@ -109,7 +110,7 @@ __declspec(align(32)) const short tab_i_17_256[] = {
 	17855, 6270, -31521, -17855,
 	6270, 26722, 26722, -31521 }; 
 
-__declspec(align(32)) const short tab_i_26_256[] = {
+VMX_ALIGNAS(32) const short tab_i_26_256[] = {
 	21407, 27969, 21407, 11585,
 	21407, -11585, 21407, -27969, 
 	21407, 27969, 21407, 11585,
@@ -130,7 +131,7 @@ __declspec(align(32)) const short tab_i_26_256[] = {
 	16819, 5906, -29692, -16819, 
 	5906, 25172, 25172, -29692 }; 
 
-__declspec(align(32)) const short tab_i_35_256[] = {
+VMX_ALIGNAS(32) const short tab_i_35_256[] = {
 	19266, 25172, 19266, 10426,
 	19266, -10426, 19266, -25172,
 	19266, 25172, 19266, 10426,
@@ -155,28 +156,28 @@ __declspec(align(32)) const short tab_i_35_256[] = {
 //FDCT Tables for 256bit SIMD
 //===========================
 
-__declspec(align(32)) const unsigned short ftab1_256[] = {
+VMX_ALIGNAS(32) const unsigned short ftab1_256[] = {
 	16384, 16384, 22725, 19266, 56669, 44129, 42811, 52663,16384, 16384, 22725, 19266, 56669, 44129, 42811, 52663,
 	16384, 16384, 12873, 4520, 21407, 8867, 19266, 61016,16384, 16384, 12873, 4520, 21407, 8867, 19266, 61016,
 	16384, 49152, 12873, 42811, 21407, 56669, 19266, 42811,16384, 49152, 12873, 42811, 21407, 56669, 19266, 42811,
 	49152, 16384, 4520, 19266, 8867, 44129, 4520, 52663,49152, 16384, 4520, 19266, 8867, 44129, 4520, 52663
 };
 
-__declspec(align(32)) const unsigned short ftab2_256[] = {
+VMX_ALIGNAS(32) const unsigned short ftab2_256[] = {
 	22725, 22725, 31521, 26722, 53237, 35844, 34015, 47681,22725, 22725, 31521, 26722, 53237, 35844, 34015, 47681,
 	22725, 22725, 17855, 6270, 29692, 12299, 26722, 59266,22725, 22725, 17855, 6270, 29692, 12299, 26722, 59266,
 	22725, 42811, 17855, 34015, 29692, 53237, 26722, 34015,22725, 42811, 17855, 34015, 29692, 53237, 26722, 34015,
 	42811, 22725, 6270, 26722, 12299, 35844, 6270, 47681,42811, 22725, 6270, 26722, 12299, 35844, 6270, 47681
 };
 
-__declspec(align(32)) const unsigned short ftab3_256[] = {
+VMX_ALIGNAS(32) const unsigned short ftab3_256[] = {
 	21407, 21407, 29692, 25172, 53951, 37567, 35844, 48717,21407, 21407, 29692, 25172, 53951, 37567, 35844, 48717,
 	21407, 21407, 16819, 5906, 27969, 11585, 25172, 59630,21407, 21407, 16819, 5906, 27969, 11585, 25172, 59630,
 	21407, 44129, 16819, 35844, 27969, 53951, 25172, 35844,21407, 44129, 16819, 35844, 27969, 53951, 25172, 35844,
 	44129, 21407, 5906, 25172, 11585, 37567, 5906, 48717,44129, 21407, 5906, 25172, 11585, 37567, 5906, 48717
 };
 
-__declspec(align(32)) const unsigned short ftab4_256[] = {
+VMX_ALIGNAS(32) const unsigned short ftab4_256[] = {
 	19266, 19266, 26722, 22654, 55110, 40364, 38814, 50399,19266, 19266, 26722, 22654, 55110, 40364, 38814, 50399,
 	19266, 19266, 15137, 5315, 25172, 10426, 22654, 60221,19266, 19266, 15137, 5315, 25172, 10426, 22654, 60221,
 	19266, 46270, 15137, 38814, 25172, 55110, 22654, 38814,19266, 46270, 15137, 38814, 25172, 55110, 22654, 38814,
@@ -194,7 +195,7 @@ inline void GetIntFrom2MagSignMinus1V_256(__m256i* input)
 	*input = _mm256_subs_epi16(a, b);
 }
 
-void VMX_ZIG_INVQUANTIZE_IDCT_8X8_256(short* srca, short* srcb, unsigned short* matrix, BYTE* dst, int stride, short addVal) {
+void VMX_ZIG_INVQUANTIZE_IDCT_8X8_256(short* srca, short* srcb, const unsigned short* matrix, BYTE* dst, int stride, short addVal) {
 
 	//load 8x8x16x2
 	__m256i a0 = _mm256_loadu2_m128i((__m128i*) & srcb[0], (__m128i*) & srca[0]);
@@ -632,7 +633,7 @@ void VMX_ZIG_INVQUANTIZE_IDCT_8X8_256(short* srca, short* srcb, unsigned short*
 }
 
 
-void VMX_ZIG_INVQUANTIZE_IDCT_8X8_256_16(short* srca, short* srcb, unsigned short* matrix, BYTE* dst, int stride, short addVal) {
+void VMX_ZIG_INVQUANTIZE_IDCT_8X8_256_16(short* srca, short* srcb, const unsigned short* matrix, BYTE* dst, int stride, short addVal) {
 
 	//load 8x8x16x2
 	__m256i a0 = _mm256_loadu2_m128i((__m128i*) & srcb[0], (__m128i*) & srca[0]);
@@ -1107,34 +1108,9 @@ void VMX_ZIG_INVQUANTIZE_IDCT_8X8_256_16(short* srca, short* srcb, unsigned shor
 }
 
 //Forward DCT8x8 + Quantize + ZigZag
-void VMX_FDCT_8X8_QUANT_ZIG_256(const BYTE* src, int stride, unsigned short* matrix, short addVal, __m256i* out0, __m256i* out1, __m256i* out2, __m256i* out3, __m256i* out4, __m256i* out5, __m256i* out6, __m256i* out7) {
-
-	// Load input
-	__m128i iin0 = _mm_loadu_si128((__m128i*) & src[0]);
-	src += stride;
-	__m128i iin1 = _mm_loadu_si128((__m128i*) & src[0]);
-	src += stride;
-	__m128i iin2 = _mm_loadu_si128((__m128i*) & src[0]);
-	src += stride;
-	__m128i iin3 = _mm_loadu_si128((__m128i*) & src[0]);
-	src += stride;
-	__m128i iin4 = _mm_loadu_si128((__m128i*) & src[0]);
-	src += stride;
-	__m128i iin5 = _mm_loadu_si128((__m128i*) & src[0]);
-	src += stride;
-	__m128i iin6 = _mm_loadu_si128((__m128i*) & src[0]);
-	src += stride;
-	__m128i iin7 = _mm_loadu_si128((__m128i*) & src[0]);
-	src += stride;
-
-	__m256i in0 = _mm256_cvtepu8_epi16(iin0);
-	__m256i in1 = _mm256_cvtepu8_epi16(iin1);
-	__m256i in2 = _mm256_cvtepu8_epi16(iin2);
-	__m256i in3 = _mm256_cvtepu8_epi16(iin3);
-	__m256i in4 = _mm256_cvtepu8_epi16(iin4);
-	__m256i in5 = _mm256_cvtepu8_epi16(iin5);
-	__m256i in6 = _mm256_cvtepu8_epi16(iin6);
-	__m256i in7 = _mm256_cvtepu8_epi16(iin7);
+//Forward DCT, quantization and zigzag of two horizontally adjacent 8x8 blocks already widened to 16bit,
+//first block in the low lane of each row register and second block in the high lane.
+static inline void VMX_FDCT_8X8_QUANT_ZIG_256_ROWS(__m256i in0, __m256i in1, __m256i in2, __m256i in3, __m256i in4, __m256i in5, __m256i in6, __m256i in7, const unsigned short* matrix, short addVal, __m256i* out0, __m256i* out1, __m256i* out2, __m256i* out3, __m256i* out4, __m256i* out5, __m256i* out6, __m256i* out7) {
 
 	__m256i vadd = _mm256_set1_epi16(addVal);
 	in0 = _mm256_adds_epi16(in0, vadd);
@@ -1656,9 +1632,41 @@ void VMX_FDCT_8X8_QUANT_ZIG_256(const BYTE* src, int stride, unsigned short* mat
 	*out7 = in7;
 }
 
+void VMX_FDCT_8X8_QUANT_ZIG_256(const BYTE* src, int stride, const unsigned short* matrix, short addVal, __m256i* out0, __m256i* out1, __m256i* out2, __m256i* out3, __m256i* out4, __m256i* out5, __m256i* out6, __m256i* out7) {
+
+	// Load input
+	__m128i iin0 = _mm_loadu_si128((__m128i*) & src[0]);
+	src += stride;
+	__m128i iin1 = _mm_loadu_si128((__m128i*) & src[0]);
+	src += stride;
+	__m128i iin2 = _mm_loadu_si128((__m128i*) & src[0]);
+	src += stride;
+	__m128i iin3 = _mm_loadu_si128((__m128i*) & src[0]);
+	src += stride;
+	__m128i iin4 = _mm_loadu_si128((__m128i*) & src[0]);
+	src += stride;
+	__m128i iin5 = _mm_loadu_si128((__m128i*) & src[0]);
+	src += stride;
+	__m128i iin6 = _mm_loadu_si128((__m128i*) & src[0]);
+	src += stride;
+	__m128i iin7 = _mm_loadu_si128((__m128i*) & src[0]);
+	src += stride;
+
+	__m256i in0 = _mm256_cvtepu8_epi16(iin0);
+	__m256i in1 = _mm256_cvtepu8_epi16(iin1);
+	__m256i in2 = _mm256_cvtepu8_epi16(iin2);
+	__m256i in3 = _mm256_cvtepu8_epi16(iin3);
+	__m256i in4 = _mm256_cvtepu8_epi16(iin4);
+	__m256i in5 = _mm256_cvtepu8_epi16(iin5);
+	__m256i in6 = _mm256_cvtepu8_epi16(iin6);
+	__m256i in7 = _mm256_cvtepu8_epi16(iin7);
+
+	VMX_FDCT_8X8_QUANT_ZIG_256_ROWS(in0, in1, in2, in3, in4, in5, in6, in7, matrix, addVal, out0, out1, out2, out3, out4, out5, out6, out7);
+}
+
 
 //Forward DCT8x8 + Quantize + ZigZag for 16bit input
-void VMX_FDCT_8X8_QUANT_ZIG_256_16(const BYTE* src, int stride, unsigned short* matrix, short addVal, __m256i* out0, __m256i* out1, __m256i* out2, __m256i* out3, __m256i* out4, __m256i* out5, __m256i* out6, __m256i* out7) {
+void VMX_FDCT_8X8_QUANT_ZIG_256_16(const BYTE* src, int stride, const unsigned short* matrix, short addVal, __m256i* out0, __m256i* out1, __m256i* out2, __m256i* out3, __m256i* out4, __m256i* out5, __m256i* out6, __m256i* out7) {
 
 	// Load input
 	__m256i in0 = _mm256_loadu_si256((__m256i*) & src[0]);
@@ -2208,17 +2216,20 @@ void VMX_FDCT_8X8_QUANT_ZIG_256_16(const BYTE* src, int stride, unsigned short*
 	*out7 = in7;
 }
 
-void VMX_EncodePlaneInternal256(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_SLICE_SET* s)
+void VMX_EncodePlaneInternal256(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_SLICE_SET* s, const VMX_INGEST* ingest)
 {
 	VMX_PLANE plane = *pPlane;
 
 	//int width = plane.Size.width;
-	int height = VMX_SLICE_HEIGHT;
+	int height = plane.SliceHeight;
 	short dcPred = 0;
 	BYTE* src = plane.Data + s->Offset[plane.Index];
 	int stride = plane.Stride;
 
 	uint32_t numZeros = 0;
+#if VMX_STATS
+	int zeroBlocks = 0;
+#endif
 	uint64_t mIndex1 = 0;
 	uint64_t mIndex2 = 0;
 	uint32_t input = 0;
@@ -2241,7 +2252,7 @@ void VMX_EncodePlaneInternal256(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_
 	int addVal = 0;
 	if (plane.Index == 0 || plane.Index == 3) addVal = -128;
 
-	unsigned short* matrix = instance->EncodeMatrix256;
+	const unsigned short* matrix = instance->EncodeMatrix256;
 
 	short* pos = TempBlock;
 	short* end;
@@ -2255,7 +2266,19 @@ void VMX_EncodePlaneInternal256(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_
 		{
 
 			__m256i a0, a1, a2, a3, a4, a5, a6, a7;
-			VMX_FDCT_8X8_QUANT_ZIG_256(src, stride, matrix, addVal, &a0, &a1, &a2, &a3, &a4, &a5, &a6, &a7);
+			if (ingest)
+			{
+				__m128i lo[8], hi[8];
+				__m256i r[8];
+				VMX_IngestBlock128(ingest, plane.Index, x, y, lo);
+				VMX_IngestBlock128(ingest, plane.Index, x + 8, y, hi);
+				for (int i = 0; i < 8; i++) r[i] = _mm256_inserti128_si256(_mm256_castsi128_si256(lo[i]), hi[i], 1);
+				VMX_FDCT_8X8_QUANT_ZIG_256_ROWS(r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7], matrix, addVal, &a0, &a1, &a2, &a3, &a4, &a5, &a6, &a7);
+			}
+			else
+			{
+				VMX_FDCT_8X8_QUANT_ZIG_256(src, stride, matrix, addVal, &a0, &a1, &a2, &a3, &a4, &a5, &a6, &a7);
+			}
 			src += 16;
 
 			__m256i b0, b2,b4, b6;
@@ -2297,6 +2320,7 @@ void VMX_EncodePlaneInternal256(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_
 			mIndex2 |= (uint64_t)(i2 >> 16) << 32;
 			mIndex2 |= (uint64_t)(i3 >> 16) << 48;
 			mIndex2 = ~mIndex2;
+			VMX_STATS_COUNT(zeroBlocks, (mIndex1 == 0) + (mIndex2 == 0));
 
 			if ((mIndex1 == 0) && (mIndex2 == 0))
 			{
@@ -2376,6 +2400,7 @@ void VMX_EncodePlaneInternal256(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_
 	EmitBits32(dataAC);
 	FlushRemainingBits(dataAC);
 	FlushRemainingBits(dataDC);
+	VMX_STATS_COUNT(s->ZeroBlocks[plane.Index], zeroBlocks);
 	s->DC = dataDC;
 	s->AC = dataAC;
 }
@@ -2386,12 +2411,15 @@ void VMX_EncodePlaneInternal256_16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VM
 	VMX_PLANE plane = *pPlane;
 
 	//int width = plane.Size.width;
-	int height = VMX_SLICE_HEIGHT;
+	int height = plane.SliceHeight;
 	short dcPred = 0;
 	BYTE* src = plane.Data + s->Offset16[plane.Index];
 	int stride = plane.Stride * 2;
 
 	uint32_t numZeros = 0;
+#if VMX_STATS
+	int zeroBlocks = 0;
+#endif
 	uint64_t mIndex1 = 0;
 	uint64_t mIndex2 = 0;
 	uint32_t input = 0;
@@ -2414,7 +2442,7 @@ void VMX_EncodePlaneInternal256_16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VM
 	int addVal = 0;
 	if (plane.Index == 0 || plane.Index == 3) addVal = -512;
 
-	unsigned short* matrix = instance->EncodeMatrix256;
+	const unsigned short* matrix = instance->EncodeMatrix256;
 
 	short* pos = TempBlock;
 	short* end;
@@ -2470,6 +2498,7 @@ void VMX_EncodePlaneInternal256_16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VM
 			mIndex2 |= (uint64_t)(i2 >> 16) << 32;
 			mIndex2 |= (uint64_t)(i3 >> 16) << 48;
 			mIndex2 = ~mIndex2;
+			VMX_STATS_COUNT(zeroBlocks, (mIndex1 == 0) + (mIndex2 == 0));
 
 			if ((mIndex1 == 0) && (mIndex2 == 0))
 			{
@@ -2549,6 +2578,7 @@ void VMX_EncodePlaneInternal256_16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VM
 	EmitBits32(dataAC);
 	FlushRemainingBits(dataAC);
 	FlushRemainingBits(dataDC);
+	VMX_STATS_COUNT(s->ZeroBlocks[plane.Index], zeroBlocks);
 	s->DC = dataDC;
 	s->AC = dataAC;
 }
@@ -2561,7 +2591,7 @@ void VMX_DecodePlaneInternal256(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_
 
 	VMX_PLANE plane = *pPlane;
 
-	int height = VMX_SLICE_HEIGHT;
+	int height = plane.SliceHeight;
 	int shift = 0;
 	if (plane.Index == 0 || plane.Index == 3)
 	{
@@ -2579,8 +2609,8 @@ void VMX_DecodePlaneInternal256(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_
 	short* TempBlockB = s->TempBlock3;
 	short* CurrentBlock = TempBlockA;
 
-	unsigned short* matrix256 = instance->DecodeMatrix256;
-	unsigned short* matrix128 = instance->DecodeMatrix;
+	const unsigned short* matrix256 = instance->DecodeMatrix256;
+	const unsigned short* matrix128 = instance->DecodeMatrix;
 	int validCount[2] = { 0,0 };
 
 	buffer_t termsToDecode = 0; //Unsigned to ensure corrupt data doesnt overflow negative
@@ -2702,7 +2732,7 @@ void VMX_DecodePlaneInternal256_16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VM
 
 	VMX_PLANE plane = *pPlane;
 
-	int height = VMX_SLICE_HEIGHT;
+	int height = plane.SliceHeight;
 	int shift = 0;
 	if (plane.Index == 0 || plane.Index == 3)
 	{
@@ -2720,8 +2750,8 @@ void VMX_DecodePlaneInternal256_16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VM
 	short* TempBlockB = s->TempBlock3;
 	short* CurrentBlock = TempBlockA;
 
-	unsigned short* matrix256 = instance->DecodeMatrix256;
-	unsigned short* matrix128 = instance->DecodeMatrix;
+	const unsigned short* matrix256 = instance->DecodeMatrix256;
+	const unsigned short* matrix128 = instance->DecodeMatrix;
 	int validCount[2] = { 0,0 };
 
 	buffer_t termsToDecode = 0; //Unsigned to ensure corrupt data doesnt overflow negative
@@ -2834,4 +2864,150 @@ void VMX_DecodePlaneInternal256_16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VM
 	s->DC = dataDC;
 }
 
+//Same as VMX_PlanarToNV12Internal128, 32 chroma samples at a time
+void VMX_PlanarToNV12Internal256(BYTE* ysrc, int ystride, BYTE* usrc, int ustride, BYTE* vsrc, int vstride, BYTE* dstY, int dstStrideY, BYTE* dstUV, int dstStrideUV, VMX_SIZE size)
+{
+	for (int y = 0; y < size.height; y++) {
+		memcpy(dstY, ysrc, size.width);
+		ysrc += ystride;
+		dstY += dstStrideY;
+	}
+
+	int height = (size.height + 1) >> 1;
+	int width = size.width >> 1;
+	for (int y = 0; y < height; y++)
+	{
+		int x = 0;
+		for (; x <= width - 32; x += 32)
+		{
+			__m256i u = _mm256_avg_epu8(_mm256_loadu_si256((__m256i*) & usrc[x]), _mm256_loadu_si256((__m256i*) & usrc[x + ustride]));
+			__m256i v = _mm256_avg_epu8(_mm256_loadu_si256((__m256i*) & vsrc[x]), _mm256_loadu_si256((__m256i*) & vsrc[x + vstride]));
+			//Unpack works within each 128bit lane, so put samples 0-7 and 16-23 in the low lane first
+			u = _mm256_permute4x64_epi64(u, 0xD8);
+			v = _mm256_permute4x64_epi64(v, 0xD8);
+			_mm256_storeu_si256((__m256i*) & dstUV[x * 2], _mm256_unpacklo_epi8(u, v));
+			_mm256_storeu_si256((__m256i*) & dstUV[(x * 2) + 32], _mm256_unpackhi_epi8(u, v));
+		}
+		for (; x < width; x++)
+		{
+			dstUV[x * 2] = (BYTE)((usrc[x] + usrc[x + ustride] + 1) >> 1);
+			dstUV[(x * 2) + 1] = (BYTE)((vsrc[x] + vsrc[x + vstride] + 1) >> 1);
+		}
+		usrc += ustride << 1;
+		vsrc += vstride << 1;
+		dstUV += dstStrideUV;
+	}
+}
+
+void VMX_PlanarToI420Internal256(BYTE* ysrc, int ystride, BYTE* usrc, int ustride, BYTE* vsrc, int vstride, BYTE* dstY, int dstStrideY, BYTE* dstU, int dstStrideU, BYTE* dstV, int dstStrideV, VMX_SIZE size)
+{
+	for (int y = 0; y < size.height; y++) {
+		memcpy(dstY, ysrc, size.width);
+		ysrc += ystride;
+		dstY += dstStrideY;
+	}
+
+	int height = (size.height + 1) >> 1;
+	int width = size.width >> 1;
+	for (int y = 0; y < height; y++)
+	{
+		int x = 0;
+		for (; x <= width - 32; x += 32)
+		{
+			__m256i u = _mm256_avg_epu8(_mm256_loadu_si256((__m256i*) & usrc[x]), _mm256_loadu_si256((__m256i*) & usrc[x + ustride]));
+			__m256i v = _mm256_avg_epu8(_mm256_loadu_si256((__m256i*) & vsrc[x]), _mm256_loadu_si256((__m256i*) & vsrc[x + vstride]));
+			_mm256_storeu_si256((__m256i*) & dstU[x], u);
+			_mm256_storeu_si256((__m256i*) & dstV[x], v);
+		}
+		for (; x < width; x++)
+		{
+			dstU[x] = (BYTE)((usrc[x] + usrc[x + ustride] + 1) >> 1);
+			dstV[x] = (BYTE)((vsrc[x] + vsrc[x + vstride] + 1) >> 1);
+		}
+		usrc += ustride << 1;
+		vsrc += vstride << 1;
+		dstU += dstStrideU;
+		dstV += dstStrideV;
+	}
+}
+
+int64_t VMX_QualitySSE_256(const BYTE* a, const BYTE* b, int width)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i acc = _mm256_setzero_si256();
+	int x = 0;
+	for (; x + 32 <= width; x += 32)
+	{
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + x));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b + x));
+		__m256i lo = _mm256_sub_epi16(_mm256_unpacklo_epi8(va, zero), _mm256_unpacklo_epi8(vb, zero));
+		__m256i hi = _mm256_sub_epi16(_mm256_unpackhi_epi8(va, zero), _mm256_unpackhi_epi8(vb, zero));
+		acc = _mm256_add_epi32(acc, _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi)));
+	}
+	__m128i sum4 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	sum4 = _mm_add_epi32(sum4, _mm_srli_si128(sum4, 8));
+	sum4 = _mm_add_epi32(sum4, _mm_srli_si128(sum4, 4));
+	int64_t sum = (unsigned int)_mm_cvtsi128_si32(sum4);
+	for (; x < width; x++)
+	{
+		int d = a[x] - b[x];
+		sum += d * d;
+	}
+	return sum;
+}
+
+//As VMX_QualityBlocks_128, 32 pixels at a time. The unpacks and hadds work within each 128bit lane,
+//so the low lane ends up with blocks 0-3 and the high lane with blocks 4-7.
+void VMX_QualityBlocks_256(const BYTE* const* a, const BYTE* const* b, int blocks, int* sums)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i ones = _mm256_set1_epi16(1);
+	int i = 0;
+	for (; i + 8 <= blocks; i += 8)
+	{
+		int x = i << 2;
+		__m256i s1lo = zero, s1hi = zero, s2lo = zero, s2hi = zero;
+		__m256i sslo = zero, sshi = zero, s12lo = zero, s12hi = zero;
+		for (int r = 0; r < 4; r++)
+		{
+			__m256i va = _mm256_loadu_si256((const __m256i*)(a[r] + x));
+			__m256i vb = _mm256_loadu_si256((const __m256i*)(b[r] + x));
+			__m256i alo = _mm256_unpacklo_epi8(va, zero);
+			__m256i ahi = _mm256_unpackhi_epi8(va, zero);
+			__m256i blo = _mm256_unpacklo_epi8(vb, zero);
+			__m256i bhi = _mm256_unpackhi_epi8(vb, zero);
+			s1lo = _mm256_add_epi16(s1lo, alo);
+			s1hi = _mm256_add_epi16(s1hi, ahi);
+			s2lo = _mm256_add_epi16(s2lo, blo);
+			s2hi = _mm256_add_epi16(s2hi, bhi);
+			sslo = _mm256_add_epi32(sslo, _mm256_add_epi32(_mm256_madd_epi16(alo, alo), _mm256_madd_epi16(blo, blo)));
+			sshi = _mm256_add_epi32(sshi, _mm256_add_epi32(_mm256_madd_epi16(ahi, ahi), _mm256_madd_epi16(bhi, bhi)));
+			s12lo = _mm256_add_epi32(s12lo, _mm256_madd_epi16(alo, blo));
+			s12hi = _mm256_add_epi32(s12hi, _mm256_madd_epi16(ahi, bhi));
+		}
+		__m256i s1 = _mm256_hadd_epi32(_mm256_madd_epi16(s1lo, ones), _mm256_madd_epi16(s1hi, ones));
+		__m256i s2 = _mm256_hadd_epi32(_mm256_madd_epi16(s2lo, ones), _mm256_madd_epi16(s2hi, ones));
+		__m256i ss = _mm256_hadd_epi32(sslo, sshi);
+		__m256i s12 = _mm256_hadd_epi32(s12lo, s12hi);
+
+		__m256i t0 = _mm256_unpacklo_epi32(s1, s2);
+		__m256i t1 = _mm256_unpacklo_epi32(ss, s12);
+		__m256i t2 = _mm256_unpackhi_epi32(s1, s2);
+		__m256i t3 = _mm256_unpackhi_epi32(ss, s12);
+		__m256i r0 = _mm256_unpacklo_epi64(t0, t1); //Blocks 0 and 4
+		__m256i r1 = _mm256_unpackhi_epi64(t0, t1); //Blocks 1 and 5
+		__m256i r2 = _mm256_unpacklo_epi64(t2, t3);
+		__m256i r3 = _mm256_unpackhi_epi64(t2, t3);
+		int* dst = sums + (i << 2);
+		_mm256_storeu_si256((__m256i*)dst, _mm256_permute2x128_si256(r0, r1, 0x20));
+		_mm256_storeu_si256((__m256i*)(dst + 8), _mm256_permute2x128_si256(r2, r3, 0x20));
+		_mm256_storeu_si256((__m256i*)(dst + 16), _mm256_permute2x128_si256(r0, r1, 0x31));
+		_mm256_storeu_si256((__m256i*)(dst + 24), _mm256_permute2x128_si256(r2, r3, 0x31));
+	}
+	for (; i < blocks; i++)
+	{
+		VMX_QualityBlock(a, b, i << 2, sums + (i << 2));
+	}
+}
+
 #endif
\ No newline at end of file
@@ -37,9 +37,13 @@
 #define VMX_BUFFERSWAP(t) _byteswap_uint64(t)
 #endif
 
-void VMX_EncodePlaneInternal256(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SLICE_SET* s);
+void VMX_EncodePlaneInternal256(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SLICE_SET* s, const VMX_INGEST* ingest);
 void VMX_EncodePlaneInternal256_16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SLICE_SET* s);
 void VMX_DecodePlaneInternal256(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SLICE_SET* s);
 void VMX_DecodePlaneInternal256_16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SLICE_SET* s);
+void VMX_PlanarToNV12Internal256(BYTE* ysrc, int ystride, BYTE* usrc, int ustride, BYTE* vsrc, int vstride, BYTE* dstY, int dstStrideY, BYTE* dstUV, int dstStrideUV, VMX_SIZE size);
+void VMX_PlanarToI420Internal256(BYTE* ysrc, int ystride, BYTE* usrc, int ustride, BYTE* vsrc, int vstride, BYTE* dstY, int dstStrideY, BYTE* dstU, int dstStrideU, BYTE* dstV, int dstStrideV, VMX_SIZE size);
+int64_t VMX_QualitySSE_256(const BYTE* a, const BYTE* b, int width);
+void VMX_QualityBlocks_256(const BYTE* const* a, const BYTE* const* b, int blocks, int* sums);
 
 #endif
\ No newline at end of file
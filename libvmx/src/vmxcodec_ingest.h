@@ -0,0 +1,234 @@
+/*
+* MIT License
+*
+* Copyright (c) 2025 Open Media Transport Contributors
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+*/
+#pragma once
+#include "vmxcodec_common.h"
+
+/// Block loaders for the fused ingest encode path.
+///
+/// Include after vmxcodec_x86.h or vmxcodec_arm.h so that the SSE intrinsics (or their sse2neon equivalents) are available.
+///
+/// Each loader produces the 8 rows of one 8x8 block of the requested plane, widened to 16bit, straight from the source image.
+/// The values are exactly those the matching *ToPlanar conversion would have written into VMX_PLANE data, so encoding from
+/// these rows is bit-exact with encoding from the staged planes.
+
+//Convert 8 16Bit pixels into 8 16Bit U or V values
+static inline __m128i VMX_ConvertRGBVec(__m128i r, __m128i g, __m128i b, short mulR, short mulG, short mulB, short add)
+{
+	__m128i y = _mm_mullo_epi16(r, _mm_set1_epi16(mulR));
+	__m128i tmp = _mm_mullo_epi16(g, _mm_set1_epi16(mulG));
+	y = _mm_adds_epi16(y, tmp);
+	tmp = _mm_mullo_epi16(b, _mm_set1_epi16(mulB));
+	y = _mm_adds_epi16(y, tmp);
+	y = _mm_adds_epi16(y, _mm_set1_epi16(128));
+	y = _mm_srai_epi16(y, 8);
+	y = _mm_adds_epi16(y, _mm_set1_epi16(add));
+	return y;
+}
+//Same as above, except that the G channel result can be > 32767, so we need to upscale to 32bit for all calculations
+//as there is no _mm_mullo_ for unsigned 16bit.
+static inline __m128i VMX_ConvertRGBVecU(__m128i r, __m128i g, __m128i b, short mulR, short mulG, short mulB, short add)
+{
+	__m128i y = _mm_mullo_epi16(r, _mm_set1_epi16(mulR));
+
+	//Convert G to 32bit
+	__m128i tmp = _mm_cvtepu16_epi32(g);
+	tmp = _mm_mullo_epi32(tmp, _mm_set1_epi32(mulG));
+	__m128i tmp2 = _mm_srli_si128(g, 8);
+	tmp2 = _mm_cvtepi16_epi32(tmp2);
+	tmp2 = _mm_mullo_epi32(tmp2, _mm_set1_epi32(mulG));
+	tmp = _mm_packus_epi32(tmp, tmp2);
+	y = _mm_adds_epu16(y, tmp);
+
+	tmp = _mm_mullo_epi16(b, _mm_set1_epi16(mulB));
+	y = _mm_adds_epu16(y, tmp);
+
+	y = _mm_adds_epu16(y, _mm_set1_epi16(128));
+	y = _mm_srli_epi16(y, 8);
+	y = _mm_adds_epu16(y, _mm_set1_epi16(add));
+	return y;
+}
+//Create 16BPP single channel vector from 8BPP source, I.E R0R0R0R0R0R0R0R0
+static inline __m128i VMX_CreateRGBVec(__m128i m1, __m128i m2, char pos)
+{
+	__m128i r = _mm_shuffle_epi8(m1, _mm_set_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, pos + 12, -1, pos + 8, -1, pos + 4, -1, pos));
+	__m128i tmp = _mm_shuffle_epi8(m2, _mm_set_epi8(-1, pos + 12, -1, pos + 8, -1, pos + 4, -1, pos, -1, -1, -1, -1, -1, -1, -1, -1));
+	r = _mm_or_si128(r, tmp);
+	return r;
+}
+
+static inline void VMX_IngestPackedYUV422(const VMX_INGEST* ingest, int planeIndex, int x, int y, __m128i* rows)
+{
+	const BYTE* p = ingest->Data + (y * ingest->Stride);
+	int stride = ingest->Stride;
+	int yuy2 = ingest->Format == VMX_IMAGE_YUY2;
+	if (planeIndex == 0)
+	{
+		//8 pixels = 16 bytes, Y is the odd byte of each pair for UYVY and the even byte for YUY2
+		p += x * 2;
+		__m128i mask = _mm_set1_epi16(0xFF);
+		for (int i = 0; i < 8; i++)
+		{
+			__m128i v = _mm_loadu_si128((__m128i*)p);
+			rows[i] = yuy2 ? _mm_and_si128(v, mask) : _mm_srli_epi16(v, 8);
+			p += stride;
+		}
+	}
+	else
+	{
+		//8 chroma samples = 16 pixels = 32 bytes, one U and one V in every 4 bytes
+		p += x * 4;
+		int shift = (planeIndex == 1) ? 0 : 16;
+		if (yuy2) shift += 8;
+		__m128i count = _mm_cvtsi32_si128(shift);
+		__m128i mask = _mm_set1_epi32(0xFF);
+		for (int i = 0; i < 8; i++)
+		{
+			__m128i v1 = _mm_loadu_si128((__m128i*)p);
+			__m128i v2 = _mm_loadu_si128((__m128i*)(p + 16));
+			v1 = _mm_and_si128(_mm_srl_epi32(v1, count), mask);
+			v2 = _mm_and_si128(_mm_srl_epi32(v2, count), mask);
+			rows[i] = _mm_packs_epi32(v1, v2);
+			p += stride;
+		}
+	}
+}
+
+static inline void VMX_IngestNV12(const VMX_INGEST* ingest, int planeIndex, int x, int y, __m128i* rows)
+{
+	if (planeIndex == 0)
+	{
+		const BYTE* p = ingest->Data + (y * ingest->Stride) + x;
+		for (int i = 0; i < 8; i++)
+		{
+			rows[i] = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*)p));
+			p += ingest->Stride;
+		}
+	}
+	else if (ingest->Chroma420)
+	{
+		//Chroma lines are coded as they are, y is always 0
+		const BYTE* p = ingest->DataUV + (x * 2);
+		int first = (planeIndex == 1) != (ingest->Format == VMX_IMAGE_NV21);
+		__m128i mask = _mm_set1_epi16(0xFF);
+		for (int i = 0; i < 8; i++)
+		{
+			__m128i v = _mm_loadu_si128((__m128i*)p);
+			rows[i] = first ? _mm_and_si128(v, mask) : _mm_srli_epi16(v, 8);
+			p += ingest->StrideUV;
+		}
+	}
+	else
+	{
+		//Each 4:2:0 chroma line is used for two 4:2:2 lines, as in VMX_NV12ToPlanar
+		const BYTE* p = ingest->DataUV + ((y >> 1) * ingest->StrideUV) + (x * 2);
+		int first = (planeIndex == 1) != (ingest->Format == VMX_IMAGE_NV21);
+		__m128i mask = _mm_set1_epi16(0xFF);
+		for (int i = 0; i < 8; i += 2)
+		{
+			__m128i v = _mm_loadu_si128((__m128i*)p);
+			v = first ? _mm_and_si128(v, mask) : _mm_srli_epi16(v, 8);
+			rows[i] = v;
+			rows[i + 1] = v;
+			p += ingest->StrideUV;
+		}
+	}
+}
+
+static inline void VMX_IngestBGRA(const VMX_INGEST* ingest, int planeIndex, int x, int y, __m128i* rows)
+{
+	const BYTE* p = ingest->Data + (y * ingest->Stride);
+	const ShortRGB* c = ingest->ColorTable;
+	if (planeIndex == 1 || planeIndex == 2)
+	{
+		//8 chroma samples = 16 pixels, averaged in pairs as in VMX_ConvertBGRABlock
+		ShortRGB cc = c[planeIndex];
+		p += x * 8;
+		for (int i = 0; i < 8; i++)
+		{
+			__m128i m1 = _mm_loadu_si128((__m128i*)p);
+			__m128i m2 = _mm_loadu_si128((__m128i*)(p + 16));
+			__m128i m3 = _mm_loadu_si128((__m128i*)(p + 32));
+			__m128i m4 = _mm_loadu_si128((__m128i*)(p + 48));
+			__m128i u1 = VMX_ConvertRGBVec(VMX_CreateRGBVec(m1, m2, 2), VMX_CreateRGBVec(m1, m2, 1), VMX_CreateRGBVec(m1, m2, 0), cc.R, cc.G, cc.B, 128);
+			__m128i u2 = VMX_ConvertRGBVec(VMX_CreateRGBVec(m3, m4, 2), VMX_CreateRGBVec(m3, m4, 1), VMX_CreateRGBVec(m3, m4, 0), cc.R, cc.G, cc.B, 128);
+			u1 = _mm_hadd_epi16(u1, u2);
+			u1 = _mm_srai_epi16(u1, 1);
+			rows[i] = _mm_cvtepu8_epi16(_mm_packus_epi16(u1, u1));
+			p += ingest->Stride;
+		}
+	}
+	else
+	{
+		p += x * 4;
+		for (int i = 0; i < 8; i++)
+		{
+			__m128i m1 = _mm_loadu_si128((__m128i*)p);
+			__m128i m2 = _mm_loadu_si128((__m128i*)(p + 16));
+			if (planeIndex == 0)
+			{
+				__m128i v = VMX_ConvertRGBVecU(VMX_CreateRGBVec(m1, m2, 2), VMX_CreateRGBVec(m1, m2, 1), VMX_CreateRGBVec(m1, m2, 0), c[0].R, c[0].G, c[0].B, 16);
+				rows[i] = _mm_cvtepu8_epi16(_mm_packus_epi16(v, v));
+			}
+			else
+			{
+				rows[i] = VMX_CreateRGBVec(m1, m2, 3);
+			}
+			p += ingest->Stride;
+		}
+	}
+}
+
+/// Load one 8x8 block of a plane straight from the source image.
+/// @param[in] x Horizontal position of the block in pixels of the requested plane
+/// @param[in] y Vertical position of the block within the slice (0 or 8)
+/// @param[out] rows The 8 rows of the block as 16bit values
+static inline void VMX_IngestBlock128(const VMX_INGEST* ingest, int planeIndex, int x, int y, __m128i* rows)
+{
+	if (ingest->Chroma420 && (planeIndex == 1 || planeIndex == 2) && ingest->Format != VMX_IMAGE_NV12 && ingest->Format != VMX_IMAGE_NV21)
+	{
+		//A 4:2:0 block averages the 16 rows of the slice in pairs, as VMX_EncodePlane does with the staged planes
+		VMX_INGEST source = *ingest;
+		source.Chroma420 = 0;
+		__m128i full[16];
+		VMX_IngestBlock128(&source, planeIndex, x, 0, full);
+		VMX_IngestBlock128(&source, planeIndex, x, 8, full + 8);
+		for (int i = 0; i < 8; i++) rows[i] = _mm_avg_epu16(full[i * 2], full[(i * 2) + 1]);
+		return;
+	}
+	switch (ingest->Format)
+	{
+	case VMX_IMAGE_UYVY:
+	case VMX_IMAGE_YUY2:
+		VMX_IngestPackedYUV422(ingest, planeIndex, x, y, rows);
+		break;
+	case VMX_IMAGE_NV12:
+	case VMX_IMAGE_NV21:
+		VMX_IngestNV12(ingest, planeIndex, x, y, rows);
+		break;
+	default:
+		VMX_IngestBGRA(ingest, planeIndex, x, y, rows);
+		break;
+	}
+}
@@ -24,6 +24,7 @@
 */
 #include "pch.h"
 #include "vmxcodec_x86.h"
+#include "vmxcodec_ingest.h"
 #include <iostream>
 #include <fstream>
 
@@ -48,21 +49,21 @@
 //===========================
 //IDCT Tables for 128bit SIMD
 //===========================
-__declspec(align(16)) const short one_corr_128[8] = { 1, 1, 1, 1, 1, 1, 1, 1 };
-__declspec(align(16)) const short round_inv_row_128[8] = { IRND_INV_ROW, 0, IRND_INV_ROW, 0, IRND_INV_ROW, 0, IRND_INV_ROW, 0 };
-__declspec(align(16)) const short round_inv_col_128[8] = { IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL };
-__declspec(align(16)) const short round_inv_corr_128[8] = { IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR };
+VMX_ALIGNAS(16) const short one_corr_128[8] = { 1, 1, 1, 1, 1, 1, 1, 1 };
+VMX_ALIGNAS(16) const short round_inv_row_128[8] = { IRND_INV_ROW, 0, IRND_INV_ROW, 0, IRND_INV_ROW, 0, IRND_INV_ROW, 0 };
+VMX_ALIGNAS(16) const short round_inv_col_128[8] = { IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL, IRND_INV_COL };
+VMX_ALIGNAS(16) const short round_inv_corr_128[8] = { IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR, IRND_INV_CORR };
 
-__declspec(align(16)) const short round_inv_row_128_10[8] = { IRND_INV_ROW10, 0, IRND_INV_ROW10, 0, IRND_INV_ROW10, 0, IRND_INV_ROW10, 0 };
-__declspec(align(16)) const short round_inv_col_128_10[8] = { IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10 };
-__declspec(align(16)) const short round_inv_corr_128_10[8] = { IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10 };
+VMX_ALIGNAS(16) const short round_inv_row_128_10[8] = { IRND_INV_ROW10, 0, IRND_INV_ROW10, 0, IRND_INV_ROW10, 0, IRND_INV_ROW10, 0 };
+VMX_ALIGNAS(16) const short round_inv_col_128_10[8] = { IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10, IRND_INV_COL10 };
+VMX_ALIGNAS(16) const short round_inv_corr_128_10[8] = { IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10, IRND_INV_CORR10 };
 
-__declspec(align(16)) const short tg_1_16_128[8] = { 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036 }; // tg * (2<<16) + 0.5
-__declspec(align(16)) const short tg_2_16_128[8] = { 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146 }; // tg * (2<<16) + 0.5
-__declspec(align(16)) const short tg_3_16_128[8] = { -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746 }; // tg * (2<<16) + 0.5
-__declspec(align(16)) const short cos_4_16_128[8] = { -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195 };// cos * (2<<16) + 0.5
+VMX_ALIGNAS(16) const short tg_1_16_128[8] = { 13036, 13036, 13036, 13036, 13036, 13036, 13036, 13036 }; // tg * (2<<16) + 0.5
+VMX_ALIGNAS(16) const short tg_2_16_128[8] = { 27146, 27146, 27146, 27146, 27146, 27146, 27146, 27146 }; // tg * (2<<16) + 0.5
+VMX_ALIGNAS(16) const short tg_3_16_128[8] = { -21746, -21746, -21746, -21746, -21746, -21746, -21746, -21746 }; // tg * (2<<16) + 0.5
+VMX_ALIGNAS(16) const short cos_4_16_128[8] = { -19195, -19195, -19195, -19195, -19195, -19195, -19195, -19195 };// cos * (2<<16) + 0.5
 
-__declspec(align(16)) const short tab_i_04_128[] = {
+VMX_ALIGNAS(16) const short tab_i_04_128[] = {
 	16384, 21407, 16384, 8867,
 	16384, -8867, 16384, -21407,
 	16384, 8867, -16384, -21407, 
@@ -72,7 +73,7 @@ __declspec(align(16)) const short tab_i_04_128[] = {
 	12873, 4520, -22725, -12873, 
 	4520, 19266, 19266, -22725 }; 
 
-__declspec(align(16)) const short tab_i_17_128[] = {
+VMX_ALIGNAS(16) const short tab_i_17_128[] = {
 	22725, 29692, 22725, 12299,
 	22725, -12299, 22725, -29692,
 	22725, 12299, -22725, -29692,
@@ -82,7 +83,7 @@ __declspec(align(16)) const short tab_i_17_128[] = {
 	17855, 6270, -31521, -17855,
 	6270, 26722, 26722, -31521 };
 
-__declspec(align(16)) const short tab_i_26_128[] = {
+VMX_ALIGNAS(16) const short tab_i_26_128[] = {
 	21407, 27969, 21407, 11585,
 	21407, -11585, 21407, -27969, 
 	21407, 11585, -21407, -27969, 
@@ -92,7 +93,7 @@ __declspec(align(16)) const short tab_i_26_128[] = {
 	16819, 5906, -29692, -16819, 
 	5906, 25172, 25172, -29692 }; 
 
-__declspec(align(16)) const short tab_i_35_128[] = {
+VMX_ALIGNAS(16) const short tab_i_35_128[] = {
 	19266, 25172, 19266, 10426,
 	19266, -10426, 19266, -25172, 
 	19266, 10426, -19266, -25172,
@@ -106,28 +107,28 @@ __declspec(align(16)) const short tab_i_35_128[] = {
 //FDCT Tables for 128bit SIMD
 //===========================
 
-__declspec(align(16)) const unsigned short ftab1_128[] = {
+VMX_ALIGNAS(16) const unsigned short ftab1_128[] = {
 	16384, 16384, 22725, 19266, 56669, 44129, 42811, 52663,
 	16384, 16384, 12873, 4520, 21407, 8867, 19266, 61016,
 	16384, 49152, 12873, 42811, 21407, 56669, 19266, 42811,
 	49152, 16384, 4520, 19266, 8867, 44129, 4520, 52663
 };
 
-__declspec(align(16)) const unsigned short ftab2_128[] = {
+VMX_ALIGNAS(16) const unsigned short ftab2_128[] = {
 	22725, 22725, 31521, 26722, 53237, 35844, 34015, 47681,
 	22725, 22725, 17855, 6270, 29692, 12299, 26722, 59266,
 	22725, 42811, 17855, 34015, 29692, 53237, 26722, 34015,
 	42811, 22725, 6270, 26722, 12299, 35844, 6270, 47681
 };
 
-__declspec(align(16)) const unsigned short ftab3_128[] = {
+VMX_ALIGNAS(16) const unsigned short ftab3_128[] = {
 	21407, 21407, 29692, 25172, 53951, 37567, 35844, 48717,
 	21407, 21407, 16819, 5906, 27969, 11585, 25172, 59630,
 	21407, 44129, 16819, 35844, 27969, 53951, 25172, 35844,
 	44129, 21407, 5906, 25172, 11585, 37567, 5906, 48717
 };
 
-__declspec(align(16)) const unsigned short ftab4_128[] = {
+VMX_ALIGNAS(16) const unsigned short ftab4_128[] = {
 	19266, 19266, 26722, 22654, 55110, 40364, 38814, 50399,
 	19266, 19266, 15137, 5315, 25172, 10426, 22654, 60221,
 	19266, 46270, 15137, 38814, 25172, 55110, 22654, 38814,
@@ -136,34 +137,9 @@ __declspec(align(16)) const unsigned short ftab4_128[] = {
 
 
 //Forward DCT8x8 + Quantize + ZigZag
-void VMX_FDCT_8X8_QUANT_ZIG_128(const BYTE* src, int stride, unsigned short* matrix, short addVal, __m128i* out0, __m128i* out1, __m128i* out2, __m128i* out3, __m128i* out4, __m128i* out5, __m128i* out6, __m128i* out7) {
-
-	// Load input
-	__m128i in0 = _mm_loadl_epi64((__m128i*) & src[0]);
-	src += stride;
-	__m128i in1 = _mm_loadl_epi64((__m128i*) & src[0]);
-	src += stride;
-	__m128i in2 = _mm_loadl_epi64((__m128i*) & src[0]);
-	src += stride;
-	__m128i in3 = _mm_loadl_epi64((__m128i*) & src[0]);
-	src += stride;
-	__m128i in4 = _mm_loadl_epi64((__m128i*) & src[0]);
-	src += stride;
-	__m128i in5 = _mm_loadl_epi64((__m128i*) & src[0]);
-	src += stride;
-	__m128i in6 = _mm_loadl_epi64((__m128i*) & src[0]);
-	src += stride;
-	__m128i in7 = _mm_loadl_epi64((__m128i*) & src[0]);
-	src += stride;
-
-	in0 = _mm_cvtepu8_epi16(in0);
-	in1 = _mm_cvtepu8_epi16(in1);
-	in2 = _mm_cvtepu8_epi16(in2);
-	in3 = _mm_cvtepu8_epi16(in3);
-	in4 = _mm_cvtepu8_epi16(in4);
-	in5 = _mm_cvtepu8_epi16(in5);
-	in6 = _mm_cvtepu8_epi16(in6);
-	in7 = _mm_cvtepu8_epi16(in7);
+//Forward DCT, quantization and zigzag of an 8x8 block already widened to 16bit, one row per register.
+//Shared by the plane encoder and the fused ingest path, which builds the rows directly from the source image.
+static inline void VMX_FDCT_8X8_QUANT_ZIG_128_ROWS(__m128i in0, __m128i in1, __m128i in2, __m128i in3, __m128i in4, __m128i in5, __m128i in6, __m128i in7, const unsigned short* matrix, short addVal, __m128i* out0, __m128i* out1, __m128i* out2, __m128i* out3, __m128i* out4, __m128i* out5, __m128i* out6, __m128i* out7) {
 
 	__m128i vadd = _mm_set1_epi16(addVal);
 	in0 = _mm_adds_epi16(in0, vadd);
@@ -682,9 +658,41 @@ void VMX_FDCT_8X8_QUANT_ZIG_128(const BYTE* src, int stride, unsigned short* mat
 	*out7 = in7;
 }
 
+void VMX_FDCT_8X8_QUANT_ZIG_128(const BYTE* src, int stride, const unsigned short* matrix, short addVal, __m128i* out0, __m128i* out1, __m128i* out2, __m128i* out3, __m128i* out4, __m128i* out5, __m128i* out6, __m128i* out7) {
+
+	// Load input
+	__m128i in0 = _mm_loadl_epi64((__m128i*) & src[0]);
+	src += stride;
+	__m128i in1 = _mm_loadl_epi64((__m128i*) & src[0]);
+	src += stride;
+	__m128i in2 = _mm_loadl_epi64((__m128i*) & src[0]);
+	src += stride;
+	__m128i in3 = _mm_loadl_epi64((__m128i*) & src[0]);
+	src += stride;
+	__m128i in4 = _mm_loadl_epi64((__m128i*) & src[0]);
+	src += stride;
+	__m128i in5 = _mm_loadl_epi64((__m128i*) & src[0]);
+	src += stride;
+	__m128i in6 = _mm_loadl_epi64((__m128i*) & src[0]);
+	src += stride;
+	__m128i in7 = _mm_loadl_epi64((__m128i*) & src[0]);
+	src += stride;
+
+	in0 = _mm_cvtepu8_epi16(in0);
+	in1 = _mm_cvtepu8_epi16(in1);
+	in2 = _mm_cvtepu8_epi16(in2);
+	in3 = _mm_cvtepu8_epi16(in3);
+	in4 = _mm_cvtepu8_epi16(in4);
+	in5 = _mm_cvtepu8_epi16(in5);
+	in6 = _mm_cvtepu8_epi16(in6);
+	in7 = _mm_cvtepu8_epi16(in7);
+
+	VMX_FDCT_8X8_QUANT_ZIG_128_ROWS(in0, in1, in2, in3, in4, in5, in6, in7, matrix, addVal, out0, out1, out2, out3, out4, out5, out6, out7);
+}
+
 
 //16-Bit Forward DCT8x8 + Quantize + ZigZag. Source is 16-bit unsigned values
-void VMX_FDCT_8X8_QUANT_ZIG_128_16(const BYTE* src, int stride, unsigned short* matrix, short addVal, __m128i* out0, __m128i* out1, __m128i* out2, __m128i* out3, __m128i* out4, __m128i* out5, __m128i* out6, __m128i* out7) {
+void VMX_FDCT_8X8_QUANT_ZIG_128_16(const BYTE* src, int stride, const unsigned short* matrix, short addVal, __m128i* out0, __m128i* out1, __m128i* out2, __m128i* out3, __m128i* out4, __m128i* out5, __m128i* out6, __m128i* out7) {
 
 	// Load input
 	__m128i in0 = _mm_loadu_si128((__m128i*) & src[0]);
@@ -1231,18 +1239,21 @@ void VMX_FDCT_8X8_QUANT_ZIG_128_16(const BYTE* src, int stride, unsigned short*
 	*out7 = in7;
 }
 
-void VMX_EncodePlaneInternal128(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_SLICE_SET* s)
+void VMX_EncodePlaneInternal128(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_SLICE_SET* s, const VMX_INGEST* ingest)
 {
 	VMX_PLANE plane = *pPlane;
 
 	//int width = plane.Size.width;
-	int height = VMX_SLICE_HEIGHT;
+	int height = plane.SliceHeight;
 	short dcPred = 0;
 	short dc = 0;
 	BYTE* src = plane.Data + s->Offset[plane.Index];
 	int stride = plane.Stride;
 
 	uint32_t numZeros = 0;
+#if VMX_STATS
+	int zeroBlocks = 0;
+#endif
 	uint64_t mIndex = 0;
 	uint32_t input = 0;
 	uint32_t bc = 0;
@@ -1259,7 +1270,7 @@ void VMX_EncodePlaneInternal128(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_
 	int addVal = 0;
 	if (plane.Index == 0 || plane.Index == 3) addVal = -128;
 
-	unsigned short* matrix = instance->EncodeMatrix;
+	const unsigned short* matrix = instance->EncodeMatrix;
 
 	uint64_t nz;
 	short* pos = TempBlock;
@@ -1272,7 +1283,16 @@ void VMX_EncodePlaneInternal128(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_
 		for (int x = 0; x < stride; x += 8)
 		{
 			__m128i a0, a1, a2, a3, a4, a5, a6, a7;
-			VMX_FDCT_8X8_QUANT_ZIG_128(src, stride, matrix, addVal, &a0, &a1, &a2, &a3, &a4, &a5, &a6, &a7);
+			if (ingest)
+			{
+				__m128i r[8];
+				VMX_IngestBlock128(ingest, plane.Index, x, y, r);
+				VMX_FDCT_8X8_QUANT_ZIG_128_ROWS(r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7], matrix, addVal, &a0, &a1, &a2, &a3, &a4, &a5, &a6, &a7);
+			}
+			else
+			{
+				VMX_FDCT_8X8_QUANT_ZIG_128(src, stride, matrix, addVal, &a0, &a1, &a2, &a3, &a4, &a5, &a6, &a7);
+			}
 			src += 8;
 
 			dc = _mm_extract_epi16(a0, 0);
@@ -1302,6 +1322,7 @@ void VMX_EncodePlaneInternal128(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_
 
 			if (mIndex == 0)
 			{
+				VMX_STATS_COUNT(zeroBlocks, 1);
 				numZeros += 64;
 				continue;
 			}
@@ -1371,6 +1392,7 @@ void VMX_EncodePlaneInternal128(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_
 	EmitBits32(dataAC);
 	FlushRemainingBits(dataAC);
 	FlushRemainingBits(dataDC);
+	VMX_STATS_COUNT(s->ZeroBlocks[plane.Index], zeroBlocks);
 	s->DC = dataDC;
 	s->AC = dataAC;
 }
@@ -1380,13 +1402,16 @@ void VMX_EncodePlaneInternal128_16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VM
 	VMX_PLANE plane = *pPlane;
 
 	//int width = plane.Size.width;
-	int height = VMX_SLICE_HEIGHT;
+	int height = plane.SliceHeight;
 	short dcPred = 0;
 	short dc = 0;
 	BYTE* src = plane.Data + s->Offset16[plane.Index];
 	int stride = plane.Stride * 2;
 
 	uint32_t numZeros = 0;
+#if VMX_STATS
+	int zeroBlocks = 0;
+#endif
 	uint64_t mIndex = 0;
 	uint32_t input = 0;
 	uint32_t bc = 0;
@@ -1403,7 +1428,7 @@ void VMX_EncodePlaneInternal128_16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VM
 	int addVal = 0;
 	if (plane.Index == 0 || plane.Index == 3) addVal = -512;
 
-	unsigned short* matrix = instance->EncodeMatrix;
+	const unsigned short* matrix = instance->EncodeMatrix;
 
 	uint64_t nz;
 	short* pos = TempBlock;
@@ -1446,6 +1471,7 @@ void VMX_EncodePlaneInternal128_16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VM
 
 			if (mIndex == 0)
 			{
+				VMX_STATS_COUNT(zeroBlocks, 1);
 				numZeros += 64;
 				continue;
 			}
@@ -1515,6 +1541,7 @@ void VMX_EncodePlaneInternal128_16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VM
 	EmitBits32(dataAC);
 	FlushRemainingBits(dataAC);
 	FlushRemainingBits(dataDC);
+	VMX_STATS_COUNT(s->ZeroBlocks[plane.Index], zeroBlocks);
 	s->DC = dataDC;
 	s->AC = dataAC;
 }
@@ -1527,7 +1554,7 @@ void VMX_DecodePlaneInternal128(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_
 
 	VMX_PLANE plane = *pPlane;
 
-	int height = VMX_SLICE_HEIGHT;
+	int height = plane.SliceHeight;
 	int shift = 0;
 	if (plane.Index == 0 || plane.Index == 3)
 	{
@@ -1545,7 +1572,7 @@ void VMX_DecodePlaneInternal128(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_
 	short* TempBlock = s->TempBlock;
 	short* TempBlock2 = s->TempBlock2;
 
-	unsigned short* matrix = instance->DecodeMatrix;
+	const unsigned short* matrix = instance->DecodeMatrix;
 
 	int validCount = 0;
 
@@ -1648,7 +1675,7 @@ void VMX_DecodePlaneInternal128_16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VM
 
 	VMX_PLANE plane = *pPlane;
 
-	int height = VMX_SLICE_HEIGHT;
+	int height = plane.SliceHeight;
 	int shift = 0;
 	if (plane.Index == 0 || plane.Index == 3)
 	{
@@ -1666,7 +1693,7 @@ void VMX_DecodePlaneInternal128_16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VM
 	short* TempBlock = s->TempBlock;
 	short* TempBlock2 = s->TempBlock2;
 
-	unsigned short* matrix = instance->DecodeMatrix;
+	const unsigned short* matrix = instance->DecodeMatrix;
 
 	int validCount = 0;
 
@@ -1772,7 +1799,7 @@ void VMX_DecodePlanePreviewInternal(VMX_INSTANCE* instance, VMX_PLANE * pPlane,
 
 	int stride = plane.Stride;
 	int width = plane.Stride >> 3; //We need to read the correct number of DC values per row, so we use stride here
-	int height = VMX_SLICE_HEIGHT >> 3;
+	int height = plane.SliceHeight >> 3;
 	int shift = 0;
 	if (plane.Index == 0 || plane.Index == 3)
 	{
@@ -1853,19 +1880,19 @@ void VMX_DecodePlaneInternal16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SL
 #endif
 }
 
-void VMX_EncodePlaneInternal(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SLICE_SET* s)
+void VMX_EncodePlaneInternal(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SLICE_SET* s, const VMX_INGEST* ingest)
 {
 #if defined(AVX2)
 	if (instance->avx2)
 	{
-		VMX_EncodePlaneInternal256(instance, pPlane, s);
+		VMX_EncodePlaneInternal256(instance, pPlane, s, ingest);
 	}
 	else
 	{
-		VMX_EncodePlaneInternal128(instance, pPlane, s);
+		VMX_EncodePlaneInternal128(instance, pPlane, s, ingest);
 	}
 #else
-	VMX_EncodePlaneInternal128(instance, pPlane, s);
+	VMX_EncodePlaneInternal128(instance, pPlane, s, ingest);
 #endif
 }
 
@@ -2073,6 +2100,62 @@ void VMX_P216ToPlanar(BYTE* srcY, int srcStrideY, BYTE* srcUV, int srcStrideUV,
 }
 
 
+void VMX_P010ToPlanar(BYTE* srcY, int srcStrideY, BYTE* srcUV, int srcStrideUV, BYTE* ydst, int ystride, BYTE* udst, int ustride, BYTE* vdst, int vstride, VMX_SIZE size)
+{
+	//P010 keeps its 10 bits in the upper bits of each word like P216, so the samples are copied as they are
+
+	//Y Plane
+	for (int y = 0; y < size.height; y++) {
+		memcpy(ydst, srcY, size.width * 2);
+		srcY += srcStrideY;
+		ydst += ystride;
+	}
+
+	//UV Plane, each half height row is written to both of the plane rows it covers
+	__m128i uShuffle = _mm_set_epi8(-1, -1, -1, -1, -1, -1, -1, -1, 13, 12, 9, 8, 5, 4, 1, 0);
+	__m128i vShuffle = _mm_set_epi8(-1, -1, -1, -1, -1, -1, -1, -1, 15, 14, 11, 10, 7, 6, 3, 2);
+
+	int samples = size.width >> 1;
+	for (int y = 0; y < size.height; y += 2)
+	{
+		//The last row of an odd height has no second row to fill
+		int nextU = (y + 1 < size.height) ? ustride : 0;
+		int nextV = (y + 1 < size.height) ? vstride : 0;
+		int x = 0;
+		for (; x + 8 <= samples; x += 8)
+		{
+			__m128i uv1 = _mm_loadu_si128((__m128i*) & srcUV[x * 4]); //uuvvuuvvuuvvuuvv
+			__m128i uv2 = _mm_loadu_si128((__m128i*) & srcUV[x * 4 + 16]);
+
+			__m128i u1 = _mm_shuffle_epi8(uv1, uShuffle);
+			__m128i u2 = _mm_slli_si128(_mm_shuffle_epi8(uv2, uShuffle), 8);
+
+			__m128i v1 = _mm_shuffle_epi8(uv1, vShuffle);
+			__m128i v2 = _mm_slli_si128(_mm_shuffle_epi8(uv2, vShuffle), 8);
+
+			__m128i u = _mm_or_si128(u1, u2);
+			__m128i v = _mm_or_si128(v1, v2);
+
+			_mm_storeu_si128((__m128i*) & udst[x * 2], u);
+			_mm_storeu_si128((__m128i*) & udst[x * 2 + nextU], u);
+			_mm_storeu_si128((__m128i*) & vdst[x * 2], v);
+			_mm_storeu_si128((__m128i*) & vdst[x * 2 + nextV], v);
+		}
+		for (; x < samples; x++)
+		{
+			unsigned short* uv = (unsigned short*)&srcUV[x * 4];
+			*(unsigned short*)&udst[x * 2] = uv[0];
+			*(unsigned short*)&udst[x * 2 + nextU] = uv[0];
+			*(unsigned short*)&vdst[x * 2] = uv[1];
+			*(unsigned short*)&vdst[x * 2 + nextV] = uv[1];
+		}
+		srcUV += srcStrideUV;
+		udst += ustride * 2;
+		vdst += vstride * 2;
+	}
+}
+
+
 void VMX_PlanarToA(BYTE* asrc, int astride, BYTE* dst, int dstStride, VMX_SIZE size) {
 	for (int y = 0; y < size.height; y++) {
 		memcpy(dst, asrc, size.width);
@@ -2190,10 +2273,12 @@ void VMX_NV12ToPlanar(BYTE* srcY, int srcStrideY, BYTE* srcUV, int srcStrideUV,
 		ydst += ystride;
 	}
 
+	//The interleaved UV plane has half as many rows as luma
+	VMX_SIZE uvSize = { size.width, size.height / 2 };
 	BYTE* alignedSrc;
 	int alignedStride;
-	VMX_CreateAlignedStrideBuffer(srcUV, srcStrideUV, size, &alignedSrc, &alignedStride, 16, 1);
-	VMX_CopyToAlignedStrideBuffer(alignedSrc, alignedStride, srcUV, srcStrideUV, size, 1);
+	VMX_CreateAlignedStrideBuffer(srcUV, srcStrideUV, uvSize, &alignedSrc, &alignedStride, 16, 1);
+	VMX_CopyToAlignedStrideBuffer(alignedSrc, alignedStride, srcUV, srcStrideUV, uvSize, 1);
 
 	BYTE* pU = udst;
 	BYTE* pV = vdst;
@@ -2312,6 +2397,103 @@ void VMX_PlanarToYUY2(BYTE* ysrc, int ystride, BYTE* usrc, int ustride, BYTE* vs
 	VMX_CopyFromAlignedStrideBufferAndFree(alignedDst, alignedStride, dst, dstStride, size, 2);
 }
 
+//4:2:0 output averages each pair of chroma rows. For an odd height the last pair reads one row of plane padding.
+static inline void VMX_PlanarToLuma(BYTE* ysrc, int ystride, BYTE* dstY, int dstStrideY, VMX_SIZE size)
+{
+	for (int y = 0; y < size.height; y++) {
+		memcpy(dstY, ysrc, size.width);
+		ysrc += ystride;
+		dstY += dstStrideY;
+	}
+}
+
+void VMX_PlanarToNV12Internal128(BYTE* ysrc, int ystride, BYTE* usrc, int ustride, BYTE* vsrc, int vstride, BYTE* dstY, int dstStrideY, BYTE* dstUV, int dstStrideUV, VMX_SIZE size)
+{
+	VMX_PlanarToLuma(ysrc, ystride, dstY, dstStrideY, size);
+
+	int height = (size.height + 1) >> 1;
+	int width = size.width >> 1;
+	for (int y = 0; y < height; y++)
+	{
+		int x = 0;
+		for (; x <= width - 16; x += 16)
+		{
+			__m128i u = _mm_avg_epu8(_mm_loadu_si128((__m128i*) & usrc[x]), _mm_loadu_si128((__m128i*) & usrc[x + ustride]));
+			__m128i v = _mm_avg_epu8(_mm_loadu_si128((__m128i*) & vsrc[x]), _mm_loadu_si128((__m128i*) & vsrc[x + vstride]));
+			_mm_storeu_si128((__m128i*) & dstUV[x * 2], _mm_unpacklo_epi8(u, v));
+			_mm_storeu_si128((__m128i*) & dstUV[(x * 2) + 16], _mm_unpackhi_epi8(u, v));
+		}
+		for (; x < width; x++)
+		{
+			dstUV[x * 2] = (BYTE)((usrc[x] + usrc[x + ustride] + 1) >> 1);
+			dstUV[(x * 2) + 1] = (BYTE)((vsrc[x] + vsrc[x + vstride] + 1) >> 1);
+		}
+		usrc += ustride << 1;
+		vsrc += vstride << 1;
+		dstUV += dstStrideUV;
+	}
+}
+
+void VMX_PlanarToI420Internal128(BYTE* ysrc, int ystride, BYTE* usrc, int ustride, BYTE* vsrc, int vstride, BYTE* dstY, int dstStrideY, BYTE* dstU, int dstStrideU, BYTE* dstV, int dstStrideV, VMX_SIZE size)
+{
+	VMX_PlanarToLuma(ysrc, ystride, dstY, dstStrideY, size);
+
+	int height = (size.height + 1) >> 1;
+	int width = size.width >> 1;
+	for (int y = 0; y < height; y++)
+	{
+		int x = 0;
+		for (; x <= width - 16; x += 16)
+		{
+			__m128i u = _mm_avg_epu8(_mm_loadu_si128((__m128i*) & usrc[x]), _mm_loadu_si128((__m128i*) & usrc[x + ustride]));
+			__m128i v = _mm_avg_epu8(_mm_loadu_si128((__m128i*) & vsrc[x]), _mm_loadu_si128((__m128i*) & vsrc[x + vstride]));
+			_mm_storeu_si128((__m128i*) & dstU[x], u);
+			_mm_storeu_si128((__m128i*) & dstV[x], v);
+		}
+		for (; x < width; x++)
+		{
+			dstU[x] = (BYTE)((usrc[x] + usrc[x + ustride] + 1) >> 1);
+			dstV[x] = (BYTE)((vsrc[x] + vsrc[x + vstride] + 1) >> 1);
+		}
+		usrc += ustride << 1;
+		vsrc += vstride << 1;
+		dstU += dstStrideU;
+		dstV += dstStrideV;
+	}
+}
+
+void VMX_PlanarToNV12(VMX_INSTANCE* instance, BYTE* ysrc, int ystride, BYTE* usrc, int ustride, BYTE* vsrc, int vstride, BYTE* dstY, int dstStrideY, BYTE* dstUV, int dstStrideUV, VMX_SIZE size)
+{
+#if defined(AVX2)
+	if (instance->avx2)
+	{
+		VMX_PlanarToNV12Internal256(ysrc, ystride, usrc, ustride, vsrc, vstride, dstY, dstStrideY, dstUV, dstStrideUV, size);
+	}
+	else
+	{
+		VMX_PlanarToNV12Internal128(ysrc, ystride, usrc, ustride, vsrc, vstride, dstY, dstStrideY, dstUV, dstStrideUV, size);
+	}
+#else
+	VMX_PlanarToNV12Internal128(ysrc, ystride, usrc, ustride, vsrc, vstride, dstY, dstStrideY, dstUV, dstStrideUV, size);
+#endif
+}
+
+void VMX_PlanarToI420(VMX_INSTANCE* instance, BYTE* ysrc, int ystride, BYTE* usrc, int ustride, BYTE* vsrc, int vstride, BYTE* dstY, int dstStrideY, BYTE* dstU, int dstStrideU, BYTE* dstV, int dstStrideV, VMX_SIZE size)
+{
+#if defined(AVX2)
+	if (instance->avx2)
+	{
+		VMX_PlanarToI420Internal256(ysrc, ystride, usrc, ustride, vsrc, vstride, dstY, dstStrideY, dstU, dstStrideU, dstV, dstStrideV, size);
+	}
+	else
+	{
+		VMX_PlanarToI420Internal128(ysrc, ystride, usrc, ustride, vsrc, vstride, dstY, dstStrideY, dstU, dstStrideU, dstV, dstStrideV, size);
+	}
+#else
+	VMX_PlanarToI420Internal128(ysrc, ystride, usrc, ustride, vsrc, vstride, dstY, dstStrideY, dstU, dstStrideU, dstV, dstStrideV, size);
+#endif
+}
+
 inline void GetIntFrom2MagSignMinus1V_128(__m128i* input)
 {
 	__m128i one = _mm_set1_epi16(1);
@@ -2323,7 +2505,7 @@ inline void GetIntFrom2MagSignMinus1V_128(__m128i* input)
 	*input = _mm_subs_epi16(a, b);
 }
 
-void VMX_ZIG_INVQUANTIZE_IDCT_8X8_128(short* src, unsigned short* matrix, BYTE* dst, int stride, short addVal) {
+void VMX_ZIG_INVQUANTIZE_IDCT_8X8_128(short* src, const unsigned short* matrix, BYTE* dst, int stride, short addVal) {
 
 	//load 8x8x16
 	__m128i a0 = _mm_load_si128((__m128i*) & src[0]);
@@ -2751,7 +2933,7 @@ void VMX_ZIG_INVQUANTIZE_IDCT_8X8_128(short* src, unsigned short* matrix, BYTE*
 }
 
 
-void VMX_ZIG_INVQUANTIZE_IDCT_8X8_128_16(short* src, unsigned short* matrix, BYTE* dst, int stride, short addVal) {
+void VMX_ZIG_INVQUANTIZE_IDCT_8X8_128_16(short* src, const unsigned short* matrix, BYTE* dst, int stride, short addVal) {
 
 	//load 8x8x16
 	__m128i a0 = _mm_load_si128((__m128i*) & src[0]);
@@ -3254,50 +3436,6 @@ void VMX_BROADCAST_DC_8X8_128_16(short src, BYTE* dst, int stride, short addVal)
 	dst += stride;
 }
 
-//Convert 8 16Bit pixels into 8 16Bit U or V values
-static inline __m128i VMX_ConvertRGBVec(__m128i r, __m128i g, __m128i b, short mulR, short mulG, short mulB, short add)
-{
-	__m128i y = _mm_mullo_epi16(r, _mm_set1_epi16(mulR));
-	__m128i tmp = _mm_mullo_epi16(g, _mm_set1_epi16(mulG));
-	y = _mm_adds_epi16(y, tmp);
-	tmp = _mm_mullo_epi16(b, _mm_set1_epi16(mulB));
-	y = _mm_adds_epi16(y, tmp);
-	y = _mm_adds_epi16(y, _mm_set1_epi16(128));
-	y = _mm_srai_epi16(y, 8);
-	y = _mm_adds_epi16(y, _mm_set1_epi16(add));
-	return y;
-}
-//Same as above, except that the G channel result can be > 32767, so we need to upscale to 32bit for all calculations
-//as there is no _mm_mullo_ for unsigned 16bit.
-static inline __m128i VMX_ConvertRGBVecU(__m128i r, __m128i g, __m128i b, short mulR, short mulG, short mulB, short add)
-{
-	__m128i y = _mm_mullo_epi16(r, _mm_set1_epi16(mulR));
-
-	//Convert G to 32bit
-	__m128i tmp = _mm_cvtepu16_epi32(g);
-	tmp = _mm_mullo_epi32(tmp, _mm_set1_epi32(mulG));
-	__m128i tmp2 = _mm_srli_si128(g, 8);
-	tmp2 = _mm_cvtepi16_epi32(tmp2);
-	tmp2 = _mm_mullo_epi32(tmp2, _mm_set1_epi32(mulG));
-	tmp = _mm_packus_epi32(tmp, tmp2);
-	y = _mm_adds_epu16(y, tmp);
-
-	tmp = _mm_mullo_epi16(b, _mm_set1_epi16(mulB));
-	y = _mm_adds_epu16(y, tmp);
-
-	y = _mm_adds_epu16(y, _mm_set1_epi16(128));
-	y = _mm_srli_epi16(y, 8);
-	y = _mm_adds_epu16(y, _mm_set1_epi16(add));
-	return y;
-}
-//Create 16BPP single channel vector from 8BPP source, I.E R0R0R0R0R0R0R0R0
-static inline __m128i VMX_CreateRGBVec(__m128i m1, __m128i m2, char pos)
-{
-	__m128i r = _mm_shuffle_epi8(m1, _mm_set_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, pos + 12, -1, pos + 8, -1, pos + 4, -1, pos));
-	__m128i tmp = _mm_shuffle_epi8(m2, _mm_set_epi8(-1, pos + 12, -1, pos + 8, -1, pos + 4, -1, pos, -1, -1, -1, -1, -1, -1, -1, -1));
-	r = _mm_or_si128(r, tmp);
-	return r;
-}
 //Converts a line of 16 pixels into the planar outputs in the following layout: YYYYYYYYYYYYYYYY,UUUUUUUU,VVVVVVVV,AAAAAAAAAAAAAAAA
 static inline void VMX_ConvertBGRABlock(__m128i* mInput, BYTE* pY, BYTE* pU, BYTE* pV, BYTE* pA, ShortRGB cY, ShortRGB cU, ShortRGB cV)
 {
@@ -3790,6 +3928,166 @@ float VMX_CalculatePSNR_128(BYTE* pImage1, BYTE* pImage2, int stride, int bytesP
 	return (float)result;
 }
 
+//Sum of squared differences of one row of samples, for the PSNR of VMX_CalculateQuality
+int64_t VMX_QualitySSE_128(const BYTE* a, const BYTE* b, int width)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i acc = _mm_setzero_si128();
+	int x = 0;
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i va = _mm_loadu_si128((const __m128i*)(a + x));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b + x));
+		__m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+		__m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+		acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+	}
+	acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 8));
+	acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 4));
+	int64_t sum = (unsigned int)_mm_cvtsi128_si32(acc);
+	for (; x < width; x++)
+	{
+		int d = a[x] - b[x];
+		sum += d * d;
+	}
+	return sum;
+}
+
+//Sums of each 4x4 block of rows a[0..3] and b[0..3] for SSIM, 16 pixels at a time
+void VMX_QualityBlocks_128(const BYTE* const* a, const BYTE* const* b, int blocks, int* sums)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i ones = _mm_set1_epi16(1);
+	int i = 0;
+	for (; i + 4 <= blocks; i += 4)
+	{
+		int x = i << 2;
+		__m128i s1lo = zero, s1hi = zero, s2lo = zero, s2hi = zero;
+		__m128i sslo = zero, sshi = zero, s12lo = zero, s12hi = zero;
+		for (int r = 0; r < 4; r++)
+		{
+			__m128i va = _mm_loadu_si128((const __m128i*)(a[r] + x));
+			__m128i vb = _mm_loadu_si128((const __m128i*)(b[r] + x));
+			__m128i alo = _mm_unpacklo_epi8(va, zero);
+			__m128i ahi = _mm_unpackhi_epi8(va, zero);
+			__m128i blo = _mm_unpacklo_epi8(vb, zero);
+			__m128i bhi = _mm_unpackhi_epi8(vb, zero);
+			s1lo = _mm_add_epi16(s1lo, alo);
+			s1hi = _mm_add_epi16(s1hi, ahi);
+			s2lo = _mm_add_epi16(s2lo, blo);
+			s2hi = _mm_add_epi16(s2hi, bhi);
+			sslo = _mm_add_epi32(sslo, _mm_add_epi32(_mm_madd_epi16(alo, alo), _mm_madd_epi16(blo, blo)));
+			sshi = _mm_add_epi32(sshi, _mm_add_epi32(_mm_madd_epi16(ahi, ahi), _mm_madd_epi16(bhi, bhi)));
+			s12lo = _mm_add_epi32(s12lo, _mm_madd_epi16(alo, blo));
+			s12hi = _mm_add_epi32(s12hi, _mm_madd_epi16(ahi, bhi));
+		}
+		//Pairs of columns are already summed by madd, hadd adds the pairs into blocks
+		__m128i s1 = _mm_hadd_epi32(_mm_madd_epi16(s1lo, ones), _mm_madd_epi16(s1hi, ones));
+		__m128i s2 = _mm_hadd_epi32(_mm_madd_epi16(s2lo, ones), _mm_madd_epi16(s2hi, ones));
+		__m128i ss = _mm_hadd_epi32(sslo, sshi);
+		__m128i s12 = _mm_hadd_epi32(s12lo, s12hi);
+
+		__m128i t0 = _mm_unpacklo_epi32(s1, s2);
+		__m128i t1 = _mm_unpacklo_epi32(ss, s12);
+		__m128i t2 = _mm_unpackhi_epi32(s1, s2);
+		__m128i t3 = _mm_unpackhi_epi32(ss, s12);
+		int* dst = sums + (i << 2);
+		_mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi64(t0, t1));
+		_mm_storeu_si128((__m128i*)(dst + 4), _mm_unpackhi_epi64(t0, t1));
+		_mm_storeu_si128((__m128i*)(dst + 8), _mm_unpacklo_epi64(t2, t3));
+		_mm_storeu_si128((__m128i*)(dst + 12), _mm_unpackhi_epi64(t2, t3));
+	}
+	for (; i < blocks; i++)
+	{
+		VMX_QualityBlock(a, b, i << 2, sums + (i << 2));
+	}
+}
+
+//Copy every step'th byte of src (1, 2 or 4) into dst, to measure one plane of a packed or interleaved image
+void VMX_QualityGather_128(const BYTE* src, int step, int width, BYTE* dst)
+{
+	int x = 0;
+	if (step == 2)
+	{
+		__m128i mask = _mm_set1_epi16(0x00FF);
+		for (; x + 16 < width; x += 16)
+		{
+			__m128i v0 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + (x << 1))), mask);
+			__m128i v1 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + (x << 1) + 16)), mask);
+			_mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(v0, v1));
+		}
+	}
+	else if (step == 4)
+	{
+		__m128i mask = _mm_set1_epi32(0x000000FF);
+		for (; x + 16 < width; x += 16)
+		{
+			const BYTE* s = src + (x << 2);
+			__m128i v0 = _mm_and_si128(_mm_loadu_si128((const __m128i*)s), mask);
+			__m128i v1 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(s + 16)), mask);
+			__m128i v2 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(s + 32)), mask);
+			__m128i v3 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(s + 48)), mask);
+			_mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(_mm_packus_epi32(v0, v1), _mm_packus_epi32(v2, v3)));
+		}
+	}
+	for (; x < width; x++)
+	{
+		dst[x] = src[x * step];
+	}
+}
+
+//Average each 2x2 group of rows r0 and r1 into width samples of dst, for the reduced scales of MS-SSIM
+void VMX_QualityDownsample_128(const BYTE* r0, const BYTE* r1, int width, BYTE* dst)
+{
+	__m128i ones = _mm_set1_epi8(1);
+	__m128i round = _mm_set1_epi16(2);
+	int x = 0;
+	for (; x + 16 <= width; x += 16)
+	{
+		const BYTE* p0 = r0 + (x << 1);
+		const BYTE* p1 = r1 + (x << 1);
+		__m128i lo = _mm_add_epi16(_mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)p0), ones), _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)p1), ones));
+		__m128i hi = _mm_add_epi16(_mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)(p0 + 16)), ones), _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)(p1 + 16)), ones));
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 2);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 2);
+		_mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+	}
+	for (; x < width; x++)
+	{
+		int i = x << 1;
+		dst[x] = (BYTE)((r0[i] + r0[i + 1] + r1[i] + r1[i + 1] + 2) >> 2);
+	}
+}
+
+int64_t VMX_QualitySSE(VMX_INSTANCE* instance, const BYTE* a, const BYTE* b, int width)
+{
+#if defined(AVX2)
+	if (instance->avx2)
+	{
+		return VMX_QualitySSE_256(a, b, width);
+	}
+	return VMX_QualitySSE_128(a, b, width);
+#else
+	return VMX_QualitySSE_128(a, b, width);
+#endif
+}
+
+void VMX_QualityBlocks(VMX_INSTANCE* instance, const BYTE* const* a, const BYTE* const* b, int blocks, int* sums)
+{
+#if defined(AVX2)
+	if (instance->avx2)
+	{
+		VMX_QualityBlocks_256(a, b, blocks, sums);
+	}
+	else
+	{
+		VMX_QualityBlocks_128(a, b, blocks, sums);
+	}
+#else
+	VMX_QualityBlocks_128(a, b, blocks, sums);
+#endif
+}
+
 #endif
 
 
@@ -34,6 +34,10 @@
 #if defined(__linux__) | defined(__APPLE__)
 #include <x86intrin.h>
 #define VMX_BUFFERSWAP(t) __builtin_bswap64(t)
+#if defined(__GNUC__) && !defined(__BMI__)
+//Only ever called with a non-zero mask, so bsf is an exact substitute when the TU is not built with -mbmi
+#define _tzcnt_u64(t) __builtin_ctzll(t)
+#endif
 #else
 #include <intrin.h>
 #define VMX_BUFFERSWAP(t) _byteswap_uint64(t)
@@ -41,23 +45,26 @@
 
 void VMX_BROADCAST_DC_8X8_128(short src, BYTE* dst, int stride, short addVal);
 void VMX_BROADCAST_DC_8X8_128_16(short src, BYTE* dst, int stride, short addVal);
-void VMX_ZIG_INVQUANTIZE_IDCT_8X8_128(short* src, unsigned short* matrix, BYTE* dst, int stride, short addVal);
-void VMX_ZIG_INVQUANTIZE_IDCT_8X8_128_16(short* src, unsigned short* matrix, BYTE* dst, int stride, short addVal);
-void VMX_FDCT_8X8_QUANT_ZIG_128(const BYTE* src, int stride, unsigned short* matrix, short addVal, __m128i* out0, __m128i* out1, __m128i* out2, __m128i* out3, __m128i* out4, __m128i* out5, __m128i* out6, __m128i* out7);
-void VMX_FDCT_8X8_QUANT_ZIG_128_16(const BYTE* src, int stride, unsigned short* matrix, short addVal, __m128i* out0, __m128i* out1, __m128i* out2, __m128i* out3, __m128i* out4, __m128i* out5, __m128i* out6, __m128i* out7);
+void VMX_ZIG_INVQUANTIZE_IDCT_8X8_128(short* src, const unsigned short* matrix, BYTE* dst, int stride, short addVal);
+void VMX_ZIG_INVQUANTIZE_IDCT_8X8_128_16(short* src, const unsigned short* matrix, BYTE* dst, int stride, short addVal);
+void VMX_FDCT_8X8_QUANT_ZIG_128(const BYTE* src, int stride, const unsigned short* matrix, short addVal, __m128i* out0, __m128i* out1, __m128i* out2, __m128i* out3, __m128i* out4, __m128i* out5, __m128i* out6, __m128i* out7);
+void VMX_FDCT_8X8_QUANT_ZIG_128_16(const BYTE* src, int stride, const unsigned short* matrix, short addVal, __m128i* out0, __m128i* out1, __m128i* out2, __m128i* out3, __m128i* out4, __m128i* out5, __m128i* out6, __m128i* out7);
 void VMX_PlanarToUYVY(BYTE* ysrc, int ystride, BYTE* usrc, int ustride, BYTE* vsrc, int vstride, BYTE* dst, int stride, VMX_SIZE size);
 void VMX_PlanarToP216(BYTE* ysrc, int ystride, BYTE* usrc, int ustride, BYTE* vsrc, int vstride, BYTE* dstY, int dstStrideY, BYTE* dstUV, int dstStrideUV, VMX_SIZE size);
 void VMX_UYVYToPlanar(BYTE* src, int stride, BYTE* ydst, int ystride, BYTE* udst, int ustride, BYTE* vdst, int vstride, VMX_SIZE size);
 void VMX_P216ToPlanar(BYTE* srcY, int srcStrideY, BYTE* srcUV, int srcStrideUV, BYTE* ydst, int ystride, BYTE* udst, int ustride, BYTE* vdst, int vstride, VMX_SIZE size);
+void VMX_P010ToPlanar(BYTE* srcY, int srcStrideY, BYTE* srcUV, int srcStrideUV, BYTE* ydst, int ystride, BYTE* udst, int ustride, BYTE* vdst, int vstride, VMX_SIZE size);
 void VMX_AToPlanar(BYTE* src, int srcStride, BYTE* adst, int astride, VMX_SIZE size);
 void VMX_A16ToPlanar(BYTE* src, int srcStride, BYTE* adst, int astride, VMX_SIZE size);
 void VMX_PlanarToA(BYTE* asrc, int astride, BYTE* dst, int dstStride, VMX_SIZE size);
 void VMX_PlanarToA16(BYTE* asrc, int astride, BYTE* dst, int dstStride, VMX_SIZE size);
 void VMX_PlanarToYUY2(BYTE* ysrc, int ystride, BYTE* usrc, int ustride, BYTE* vsrc, int vstride, BYTE* dst, int stride, VMX_SIZE size);
+void VMX_PlanarToNV12(VMX_INSTANCE* instance, BYTE* ysrc, int ystride, BYTE* usrc, int ustride, BYTE* vsrc, int vstride, BYTE* dstY, int dstStrideY, BYTE* dstUV, int dstStrideUV, VMX_SIZE size);
+void VMX_PlanarToI420(VMX_INSTANCE* instance, BYTE* ysrc, int ystride, BYTE* usrc, int ustride, BYTE* vsrc, int vstride, BYTE* dstY, int dstStrideY, BYTE* dstU, int dstStrideU, BYTE* dstV, int dstStrideV, VMX_SIZE size);
 void VMX_YUY2ToPlanar(BYTE* src, int stride, BYTE* ydst, int ystride, BYTE* udst, int ustride, BYTE* vdst, int vstride, VMX_SIZE size);
 void VMX_NV12ToPlanar(BYTE* srcY, int strideY, BYTE * srcUV, int strideUV, BYTE* ydst, int ystride, BYTE* udst, int ustride, BYTE* vdst, int vstride, VMX_SIZE size);
 void VMX_YV12ToPlanar(BYTE* srcY, int srcStrideY, BYTE* srcU, int srcStrideU, BYTE* srcV, int srcStrideV, BYTE* ydst, int ystride, BYTE* udst, int ustride, BYTE* vdst, int vstride, VMX_SIZE size);
-void VMX_EncodePlaneInternal(VMX_INSTANCE* instance, VMX_PLANE * pPlane, VMX_SLICE_SET* s);
+void VMX_EncodePlaneInternal(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SLICE_SET* s, const VMX_INGEST* ingest);
 void VMX_EncodePlaneInternal16(VMX_INSTANCE* instance, VMX_PLANE* pPlane, VMX_SLICE_SET* s);
 void VMX_YUV4224ToBGRA(BYTE* pSrcY, int iStrideY, BYTE* pSrcU, int iStrideU, BYTE* pSrcV, int iStrideV, BYTE* pSrcA, int iStrideA, BYTE* pDst, int dstStride, VMX_SIZE sz, const short * colorTable);
 void VMX_BGRAToYUV4224(BYTE* pSrc, int srcStride, BYTE* pDstY, int iStrideY, BYTE* pDstU, int iStrideU, BYTE* pDstV, int iStrideV, BYTE* pDstA, int iStrideA, VMX_SIZE sz, const ShortRGB * colorTables);
@@ -67,5 +74,11 @@ void VMX_DecodePlanePreviewInternal(VMX_INSTANCE* instance, VMX_PLANE* pPlane, V
 void VMX_BGRXToUYVYInternal(BYTE* pSrc, int srcStride, BYTE* pDst, int iStride, VMX_SIZE sz, const ShortRGB* colorTables);
 int VMX_BGRXToUYVYConditionalInternal(BYTE* pSrc, BYTE* pSrcPrev, int srcStride, BYTE* pDst, int iStride, VMX_SIZE sz, const ShortRGB* colorTables);
 float VMX_CalculatePSNR_128(BYTE* p1, BYTE* p2, int stride, int bytesPerPixel, VMX_SIZE sz);
+int64_t VMX_QualitySSE_128(const BYTE* a, const BYTE* b, int width);
+void VMX_QualityBlocks_128(const BYTE* const* a, const BYTE* const* b, int blocks, int* sums);
+void VMX_QualityGather_128(const BYTE* src, int step, int width, BYTE* dst);
+void VMX_QualityDownsample_128(const BYTE* r0, const BYTE* r1, int width, BYTE* dst);
+int64_t VMX_QualitySSE(VMX_INSTANCE* instance, const BYTE* a, const BYTE* b, int width);
+void VMX_QualityBlocks(VMX_INSTANCE* instance, const BYTE* const* a, const BYTE* const* b, int blocks, int* sums);
 
 #endif
\ No newline at end of file
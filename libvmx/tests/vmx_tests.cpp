@@ -0,0 +1,833 @@
+/*
+* MIT License
+*
+* Copyright (c) 2025 Open Media Transport Contributors
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in all
+* copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+*/
+
+/// vmx_tests: round trip checks of libvmx through its public API, registered with ctest one check per test.
+///
+/// Most checks compare two paths that must agree exactly: a lean instance with a full size one, a frame of skipped
+/// slices with the full frame, chunks with the whole frame, async with blocking calls, a region or a pipeline with a
+/// plain decode. The rest check what the API documents where the output is not bit exact, such as the size of a frame
+/// under rate control or a scaled decode against the average of the full one.
+///
+/// Usage: vmx_tests [name...]    Runs the named checks, or every check when none are named.
+
+#include "vmxcodec.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define TEST_CHECK(cond) \
+	if (!(cond)) \
+	{ \
+		printf("  %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		return false; \
+	}
+
+static const VMX_SIZE TEST_HD = { 1920, 1080 }; //Interlaced needs 480, 576 or 1080 lines
+static const VMX_SIZE TEST_ODD = { 1000, 576 }; //Rows end part way through the vectors of the converters
+
+static int TestAlign(int v, int a)
+{
+	return (v + a - 1) & ~(a - 1);
+}
+
+/// Image buffer with a stride of whole 64 byte vectors and room behind it, as the converters read and write past each row.
+struct TestImage
+{
+	std::vector<BYTE> Data;
+	int Stride = 0;
+	int Rows = 0;
+
+	TestImage(int rowBytes, int rows)
+	{
+		Stride = TestAlign(rowBytes, 64);
+		Rows = rows;
+		Data.assign((size_t)Stride * Rows + 4096, 0);
+	}
+	BYTE* Row(int y) { return Data.data() + ((size_t)y * Stride); }
+	bool Same(TestImage& other, int rowBytes)
+	{
+		for (int y = 0; y < Rows; y++)
+		{
+			if (memcmp(Row(y), other.Row(y), rowBytes)) return false;
+		}
+		return true;
+	}
+};
+
+/// Smooth gradients with a band of fine detail and a little noise, so every quality and block type gets exercised.
+static void TestFill(TestImage& img, int seed)
+{
+	unsigned int r = (unsigned int)seed * 2654435761u + 1;
+	for (int y = 0; y < img.Rows; y++)
+	{
+		BYTE* p = img.Row(y);
+		for (int x = 0; x < img.Stride; x++)
+		{
+			r = (r * 1664525u) + 1013904223u;
+			int v = ((x * 3) + (y * 2) + (seed * 17)) & 255;
+			if (((y + seed * 8) & 255) < 48) v ^= ((x >> 1) & 1) ? 0x60 : 0;
+			p[x] = (BYTE)(v + ((r >> 24) & 7));
+		}
+	}
+}
+
+/// Source of any encode format, every plane filled by TestFill.
+struct TestSource
+{
+	VMX_SIZE Size;
+	VMX_IMAGE_FORMAT Format;
+	TestImage Main; //Packed image, or the Y plane of the 4:2:0 formats
+	TestImage Second; //UV plane for NV12/P010, U plane for YV12
+	TestImage Third; //V plane for YV12
+
+	TestSource(VMX_SIZE size, VMX_IMAGE_FORMAT format, int seed) : Size(size), Format(format),
+		Main(size.width * TestBytesPerPixel(format), size.height * TestPlanes(format)),
+		Second(size.width, (size.height + 1) / 2), Third(size.width / 2, (size.height + 1) / 2)
+	{
+		if (format == VMX_IMAGE_P010) Second = TestImage(size.width * 2, (size.height + 1) / 2);
+		TestFill(Main, seed);
+		TestFill(Second, seed + 1);
+		TestFill(Third, seed + 2);
+	}
+
+	static int TestBytesPerPixel(VMX_IMAGE_FORMAT format)
+	{
+		switch (format)
+		{
+		case VMX_IMAGE_BGRA:
+		case VMX_IMAGE_BGRX:
+			return 4;
+		case VMX_IMAGE_NV12:
+		case VMX_IMAGE_YV12:
+			return 1;
+		default:
+			return 2;
+		}
+	}
+	//Planes stored one after another at Main: Y and UV for P216, and A as well for PA16
+	static int TestPlanes(VMX_IMAGE_FORMAT format)
+	{
+		if (format == VMX_IMAGE_P216) return 2;
+		if (format == VMX_IMAGE_PA16) return 3;
+		return 1;
+	}
+
+	VMX_ERR Encode(VMX_INSTANCE* instance, int interlaced)
+	{
+		BYTE* d = Main.Data.data();
+		switch (Format)
+		{
+		case VMX_IMAGE_UYVY: return VMX_EncodeUYVY(instance, d, Main.Stride, interlaced);
+		case VMX_IMAGE_YUY2: return VMX_EncodeYUY2(instance, d, Main.Stride, interlaced);
+		case VMX_IMAGE_BGRA: return VMX_EncodeBGRA(instance, d, Main.Stride, interlaced);
+		case VMX_IMAGE_BGRX: return VMX_EncodeBGRX(instance, d, Main.Stride, interlaced);
+		case VMX_IMAGE_NV12: return VMX_EncodeNV12(instance, d, Main.Stride, Second.Data.data(), Second.Stride, interlaced);
+		case VMX_IMAGE_YV12: return VMX_EncodeYV12(instance, d, Main.Stride, Second.Data.data(), Second.Stride, Third.Data.data(), Third.Stride, interlaced);
+		case VMX_IMAGE_P216: return VMX_EncodeP216(instance, d, Main.Stride, interlaced);
+		case VMX_IMAGE_PA16: return VMX_EncodePA16(instance, d, Main.Stride, interlaced);
+		case VMX_IMAGE_P010: return VMX_EncodeP010(instance, d, Main.Stride, Second.Data.data(), Second.Stride, interlaced);
+		default: return VMX_ERR_INVALID_PARAMETERS;
+		}
+	}
+};
+
+static const VMX_IMAGE_FORMAT TEST_FORMATS[] = {
+	VMX_IMAGE_UYVY, VMX_IMAGE_YUY2, VMX_IMAGE_BGRA, VMX_IMAGE_BGRX, VMX_IMAGE_NV12, VMX_IMAGE_YV12, VMX_IMAGE_P216, VMX_IMAGE_PA16, VMX_IMAGE_P010
+};
+
+static VMX_INSTANCE* TestCreate(VMX_SIZE sz, int threads = 0)
+{
+	VMX_INSTANCE* instance = VMX_Create(sz, VMX_PROFILE_HQ, VMX_COLORSPACE_BT709);
+	if (instance && threads) VMX_SetThreads(instance, threads);
+	return instance;
+}
+
+/// The last frame encoded, as VMX_SaveTo writes it.
+static std::vector<BYTE> TestSave(VMX_INSTANCE* instance)
+{
+	std::vector<BYTE> encoded(VMX_GetMaxEncodedLength(instance, 1));
+	int len = VMX_SaveTo(instance, encoded.data(), (int)encoded.size());
+	encoded.resize(len > 0 ? len : 0);
+	return encoded;
+}
+
+/// Segments concatenated into one frame, followed by the padding VMX_LoadFromInPlace needs.
+static std::vector<BYTE> TestJoin(const VMX_SEGMENT* segments, int count, int length)
+{
+	std::vector<BYTE> frame;
+	for (int i = 0; i < count && (int)frame.size() < length; i++) frame.insert(frame.end(), segments[i].Data, segments[i].Data + segments[i].Length);
+	frame.resize(frame.size() + VMX_LOAD_PADDING);
+	return frame;
+}
+
+/// Loads a copy of frame and decodes it to UYVY.
+static bool TestDecode(VMX_INSTANCE* instance, std::vector<BYTE>& frame, int length, TestImage& dst)
+{
+	if (VMX_LoadFrom(instance, frame.data(), length) != VMX_ERR_OK) return false;
+	return VMX_DecodeUYVY(instance, dst.Data.data(), dst.Stride) == VMX_ERR_OK;
+}
+
+static double TestPSNR(TestImage& a, TestImage& b, int rowBytes, int step, int offset)
+{
+	double sum = 0;
+	int64_t count = 0;
+	for (int y = 0; y < a.Rows; y++)
+	{
+		for (int x = offset; x < rowBytes; x += step)
+		{
+			double d = (double)a.Row(y)[x] - b.Row(y)[x];
+			sum += d * d;
+			count++;
+		}
+	}
+	if (sum == 0) return 100;
+	return 10 * log10((255.0 * 255.0) / (sum / count));
+}
+
+/// Lean instances must write the same stream as full size ones, through quality changes that grow their streams,
+/// and a decode only instance must decode it the same.
+static bool TestLean()
+{
+	for (VMX_IMAGE_FORMAT format : TEST_FORMATS)
+	{
+		for (int interlaced = 0; interlaced < 2; interlaced++)
+		{
+			TestSource src(TEST_HD, format, (int)format);
+			VMX_INSTANCE* full = TestCreate(TEST_HD);
+			VMX_INSTANCE* lean = TestCreate(TEST_HD);
+			VMX_SetLeanMemory(lean, 1);
+			const int qualities[] = { 60, 95, 80 };
+			for (int q : qualities)
+			{
+				VMX_SetQuality(full, q);
+				VMX_SetQuality(lean, q);
+				TEST_CHECK(src.Encode(full, interlaced) == VMX_ERR_OK);
+				TEST_CHECK(src.Encode(lean, interlaced) == VMX_ERR_OK);
+				std::vector<BYTE> a = TestSave(full);
+				std::vector<BYTE> b = TestSave(lean);
+				TEST_CHECK(!a.empty() && a == b);
+			}
+			VMX_MEMORY_USAGE fullUsage, leanUsage;
+			VMX_GetMemoryUsage(full, &fullUsage);
+			VMX_GetMemoryUsage(lean, &leanUsage);
+			TEST_CHECK(leanUsage.Total < fullUsage.Total);
+
+			std::vector<BYTE> frame = TestSave(full);
+			VMX_INSTANCE* decoder = VMX_CreateDecoder(TEST_HD, VMX_COLORSPACE_BT709, NULL);
+			TestImage expected(TEST_HD.width * 2, TEST_HD.height);
+			TestImage actual(TEST_HD.width * 2, TEST_HD.height);
+			TEST_CHECK(TestDecode(full, frame, (int)frame.size(), expected));
+			TEST_CHECK(TestDecode(decoder, frame, (int)frame.size(), actual));
+			TEST_CHECK(expected.Same(actual, TEST_HD.width * 2));
+			VMX_Destroy(decoder);
+			VMX_Destroy(lean);
+			VMX_Destroy(full);
+		}
+	}
+	return true;
+}
+
+/// Frames of skipped slices, decoded over the previous frame, must give the same image as the full frames.
+/// The slice cache behind them must not change the stream.
+static bool TestSkip()
+{
+	for (int interlaced = 0; interlaced < 2; interlaced++)
+	{
+		TestSource src(TEST_HD, VMX_IMAGE_UYVY, 5);
+		VMX_INSTANCE* cached = TestCreate(TEST_HD);
+		VMX_INSTANCE* plain = TestCreate(TEST_HD);
+		VMX_SetSliceCache(cached, 1);
+		VMX_INSTANCE* skipDecoder = TestCreate(TEST_HD);
+		VMX_INSTANCE* fullDecoder = TestCreate(TEST_HD);
+		TestImage skipImage(TEST_HD.width * 2, TEST_HD.height);
+		TestImage fullImage(TEST_HD.width * 2, TEST_HD.height);
+		int count = VMX_GetEncodedSegmentCount(cached);
+		std::vector<VMX_SEGMENT> segments(count);
+		for (int frame = 0; frame < 5; frame++)
+		{
+			//A band of 30 lines changes on every other frame
+			if (frame & 1)
+			{
+				for (int y = 200; y < 230; y++)
+				{
+					for (int x = 0; x < TEST_HD.width * 2; x++) src.Main.Row(y)[x] ^= 0x15;
+				}
+			}
+			VMX_SetQuality(cached, 80);
+			VMX_SetQuality(plain, 80);
+			TEST_CHECK(src.Encode(cached, interlaced) == VMX_ERR_OK);
+			TEST_CHECK(src.Encode(plain, interlaced) == VMX_ERR_OK);
+			std::vector<BYTE> full = TestSave(cached);
+			TEST_CHECK(full == TestSave(plain));
+			if (frame == 2) TEST_CHECK(VMX_GetRepeatedSliceCount(cached) == count / 2);
+			if (frame == 3) TEST_CHECK(VMX_GetRepeatedSliceCount(cached) > 0 && VMX_GetRepeatedSliceCount(cached) < count / 2);
+
+			int length = VMX_GetEncodedSkipSegments(cached, segments.data(), count);
+			TEST_CHECK(length > 0 && (frame == 0 || length < (int)full.size()));
+			std::vector<BYTE> skip = TestJoin(segments.data(), count, length);
+			TEST_CHECK(TestDecode(skipDecoder, skip, length, skipImage));
+			TEST_CHECK(TestDecode(fullDecoder, full, (int)full.size(), fullImage));
+			TEST_CHECK(skipImage.Same(fullImage, TEST_HD.width * 2));
+		}
+		VMX_Destroy(fullDecoder);
+		VMX_Destroy(skipDecoder);
+		VMX_Destroy(plain);
+		VMX_Destroy(cached);
+	}
+	return true;
+}
+
+struct TestChunks
+{
+	std::vector<std::vector<BYTE>> Chunks;
+	std::vector<BYTE> All;
+	int Lasts = 0;
+	int LastIndex = -1;
+};
+
+static void TestChunkReceived(void* context, const VMX_SEGMENT* segments, int segmentCount, int length, int last)
+{
+	TestChunks* c = (TestChunks*)context;
+	std::vector<BYTE> chunk;
+	for (int i = 0; i < segmentCount; i++) chunk.insert(chunk.end(), segments[i].Data, segments[i].Data + segments[i].Length);
+	if ((int)chunk.size() != length) chunk.clear();
+	if (last)
+	{
+		c->Lasts++;
+		c->LastIndex = (int)c->Chunks.size();
+	}
+	c->All.insert(c->All.end(), chunk.begin(), chunk.end());
+	c->Chunks.push_back(chunk);
+}
+
+/// Chunked output must carry the same slices as a whole frame, whether the chunks are loaded together, one at a time,
+/// or the frame is described whole again with VMX_GetEncodedFrameSegments.
+static bool TestChunked()
+{
+	TestSource src(TEST_HD, VMX_IMAGE_UYVY, 7);
+	VMX_INSTANCE* whole = TestCreate(TEST_HD);
+	VMX_INSTANCE* chunked = TestCreate(TEST_HD);
+	TestChunks c;
+	VMX_SetChunkedOutput(chunked, 8, TestChunkReceived, &c);
+	TEST_CHECK(src.Encode(whole, 0) == VMX_ERR_OK);
+	TEST_CHECK(src.Encode(chunked, 0) == VMX_ERR_OK);
+	int slices = VMX_GetEncodedSegmentCount(whole) / 2;
+	TEST_CHECK((int)c.Chunks.size() == (slices + 7) / 8);
+	TEST_CHECK(c.Lasts == 1 && c.LastIndex == (int)c.Chunks.size() - 1);
+	TEST_CHECK(TestSave(chunked) == c.All);
+
+	std::vector<BYTE> frame = TestSave(whole);
+	VMX_INSTANCE* decoder = TestCreate(TEST_HD);
+	TestImage expected(TEST_HD.width * 2, TEST_HD.height);
+	TestImage actual(TEST_HD.width * 2, TEST_HD.height);
+	TEST_CHECK(TestDecode(decoder, frame, (int)frame.size(), expected));
+	TEST_CHECK(TestDecode(decoder, c.All, (int)c.All.size(), actual));
+	TEST_CHECK(expected.Same(actual, TEST_HD.width * 2));
+
+	VMX_INSTANCE* piecewise = VMX_CreateDecoder(TEST_HD, VMX_COLORSPACE_BT709, NULL);
+	for (std::vector<BYTE>& chunk : c.Chunks) TEST_CHECK(VMX_LoadFrom(piecewise, chunk.data(), (int)chunk.size()) == VMX_ERR_OK);
+	memset(actual.Data.data(), 0, actual.Data.size());
+	TEST_CHECK(VMX_DecodeUYVY(piecewise, actual.Data.data(), actual.Stride) == VMX_ERR_OK);
+	TEST_CHECK(expected.Same(actual, TEST_HD.width * 2));
+
+	std::vector<VMX_SEGMENT> segments(1 + (2 * slices));
+	int length = VMX_GetEncodedFrameSegments(chunked, segments.data(), (int)segments.size());
+	TEST_CHECK(length == (int)frame.size());
+	std::vector<BYTE> rejoined = TestJoin(segments.data(), (int)segments.size(), length);
+	TEST_CHECK(memcmp(rejoined.data(), frame.data(), length) == 0);
+
+	VMX_Destroy(piecewise);
+	VMX_Destroy(decoder);
+	VMX_Destroy(chunked);
+	VMX_Destroy(whole);
+	return true;
+}
+
+/// Copies frame into its own heap block with the padding VMX_LoadFromInPlace needs, so that freeing it can be checked.
+static BYTE* TestHeapCopy(const std::vector<BYTE>& frame, int length)
+{
+	BYTE* p = (BYTE*)malloc(length + VMX_LOAD_PADDING);
+	memcpy(p, frame.data(), length);
+	memset(p + length, 0, VMX_LOAD_PADDING);
+	return p;
+}
+
+/// Frames loaded in place, whole or as chunks, must decode the same as copies, and nothing may refer to them once
+/// they are freed and the next frame is loaded. Partial chunks cannot be loaded in place.
+static bool TestInPlace()
+{
+	TestSource first(TEST_HD, VMX_IMAGE_UYVY, 11);
+	TestSource second(TEST_HD, VMX_IMAGE_UYVY, 12);
+	VMX_INSTANCE* encoder = TestCreate(TEST_HD);
+	TestChunks c;
+	VMX_SetChunkedOutput(encoder, 8, TestChunkReceived, &c);
+	TEST_CHECK(first.Encode(encoder, 0) == VMX_ERR_OK);
+	std::vector<BYTE> chunked = c.All;
+	std::vector<BYTE> firstChunk = c.Chunks[0];
+	VMX_SetChunkedOutput(encoder, 0, NULL, NULL);
+	TEST_CHECK(second.Encode(encoder, 0) == VMX_ERR_OK);
+	std::vector<BYTE> whole = TestSave(encoder);
+
+	VMX_INSTANCE* reference = TestCreate(TEST_HD);
+	TestImage expectedFirst(TEST_HD.width * 2, TEST_HD.height);
+	TestImage expectedSecond(TEST_HD.width * 2, TEST_HD.height);
+	TEST_CHECK(TestDecode(reference, chunked, (int)chunked.size(), expectedFirst));
+	TEST_CHECK(TestDecode(reference, whole, (int)whole.size(), expectedSecond));
+
+	VMX_INSTANCE* decoder = VMX_CreateDecoder(TEST_HD, VMX_COLORSPACE_BT709, NULL);
+	TestImage actual(TEST_HD.width * 2, TEST_HD.height);
+	BYTE* data = TestHeapCopy(chunked, (int)chunked.size());
+	TEST_CHECK(VMX_LoadFromInPlace(decoder, data, (int)chunked.size()) == VMX_ERR_OK);
+	TEST_CHECK(VMX_DecodeUYVY(decoder, actual.Data.data(), actual.Stride) == VMX_ERR_OK);
+	free(data);
+	TEST_CHECK(actual.Same(expectedFirst, TEST_HD.width * 2));
+
+	data = TestHeapCopy(firstChunk, (int)firstChunk.size());
+	TEST_CHECK(VMX_LoadFromInPlace(decoder, data, (int)firstChunk.size()) == VMX_ERR_INVALID_SLICE_COUNT);
+	free(data);
+
+	data = TestHeapCopy(whole, (int)whole.size());
+	TEST_CHECK(VMX_LoadFromInPlace(decoder, data, (int)whole.size()) == VMX_ERR_OK);
+	TEST_CHECK(VMX_DecodeUYVY(decoder, actual.Data.data(), actual.Stride) == VMX_ERR_OK);
+	free(data);
+	TEST_CHECK(actual.Same(expectedSecond, TEST_HD.width * 2));
+
+	//Copying loads after in place ones must not write through pointers into the freed frames
+	TEST_CHECK(TestDecode(decoder, chunked, (int)chunked.size(), actual));
+	TEST_CHECK(actual.Same(expectedFirst, TEST_HD.width * 2));
+
+	VMX_Destroy(decoder);
+	VMX_Destroy(reference);
+	VMX_Destroy(encoder);
+	return true;
+}
+
+/// 4:2:0 chroma must survive the header, code fewer bytes than 4:2:2 and keep the luma as it was.
+static bool TestChroma420()
+{
+	for (int interlaced = 0; interlaced < 2; interlaced++)
+	{
+		TestSource src(TEST_HD, VMX_IMAGE_NV12, 13);
+		VMX_INSTANCE* c422 = TestCreate(TEST_HD);
+		VMX_INSTANCE* c420 = TestCreate(TEST_HD, 1);
+		VMX_INSTANCE* threaded = TestCreate(TEST_HD, 4);
+		VMX_SetChroma420(c420, 1);
+		VMX_SetChroma420(threaded, 1);
+		TEST_CHECK(VMX_GetChroma420(c420) == 1);
+		TEST_CHECK(src.Encode(c422, interlaced) == VMX_ERR_OK);
+		TEST_CHECK(src.Encode(c420, interlaced) == VMX_ERR_OK);
+		TEST_CHECK(src.Encode(threaded, interlaced) == VMX_ERR_OK);
+		std::vector<BYTE> a = TestSave(c422);
+		std::vector<BYTE> b = TestSave(c420);
+		TEST_CHECK(b.size() < a.size());
+		TEST_CHECK(b == TestSave(threaded));
+
+		VMX_INSTANCE* decoder = TestCreate(TEST_HD);
+		TestImage y(TEST_HD.width, TEST_HD.height);
+		TestImage uv(TEST_HD.width, (TEST_HD.height + 1) / 2);
+		TEST_CHECK(VMX_LoadFrom(decoder, b.data(), (int)b.size()) == VMX_ERR_OK);
+		TEST_CHECK(VMX_GetChroma420(decoder) == 1);
+		TEST_CHECK(VMX_DecodeNV12(decoder, y.Data.data(), y.Stride, uv.Data.data(), uv.Stride) == VMX_ERR_OK);
+		TEST_CHECK(TestPSNR(y, src.Main, TEST_HD.width, 1, 0) > 28);
+		TEST_CHECK(TestPSNR(uv, src.Second, TEST_HD.width, 1, 0) > 28);
+		TEST_CHECK(VMX_LoadFrom(decoder, a.data(), (int)a.size()) == VMX_ERR_OK);
+		TEST_CHECK(VMX_GetChroma420(decoder) == 0);
+		VMX_Destroy(decoder);
+		VMX_Destroy(threaded);
+		VMX_Destroy(c420);
+		VMX_Destroy(c422);
+	}
+	return true;
+}
+
+/// A region must be exactly the same pixels as the full decode, in every format and wherever it lies.
+static bool TestRegion()
+{
+	const VMX_IMAGE_FORMAT formats[] = { VMX_IMAGE_UYVY, VMX_IMAGE_YUY2, VMX_IMAGE_BGRA, VMX_IMAGE_BGRX };
+	const VMX_RECT rects[] = { { 0, 0, 64, 16 }, { 64, 37, 256, 100 }, { 1002, 517, 918, 563 }, { 0, 0, 1920, 1080 } };
+	for (int interlaced = 0; interlaced < 2; interlaced++)
+	{
+		TestSource src(TEST_HD, VMX_IMAGE_UYVY, 17);
+		VMX_INSTANCE* instance = TestCreate(TEST_HD);
+		TEST_CHECK(src.Encode(instance, interlaced) == VMX_ERR_OK);
+		std::vector<BYTE> frame = TestSave(instance);
+		TEST_CHECK(VMX_LoadFrom(instance, frame.data(), (int)frame.size()) == VMX_ERR_OK);
+		for (VMX_IMAGE_FORMAT format : formats)
+		{
+			int bytesPerPixel = (format == VMX_IMAGE_BGRA || format == VMX_IMAGE_BGRX) ? 4 : 2;
+			TestImage full(TEST_HD.width * bytesPerPixel, TEST_HD.height);
+			switch (format)
+			{
+			case VMX_IMAGE_UYVY: TEST_CHECK(VMX_DecodeUYVY(instance, full.Data.data(), full.Stride) == VMX_ERR_OK); break;
+			case VMX_IMAGE_YUY2: TEST_CHECK(VMX_DecodeYUY2(instance, full.Data.data(), full.Stride) == VMX_ERR_OK); break;
+			case VMX_IMAGE_BGRA: TEST_CHECK(VMX_DecodeBGRA(instance, full.Data.data(), full.Stride) == VMX_ERR_OK); break;
+			default: TEST_CHECK(VMX_DecodeBGRX(instance, full.Data.data(), full.Stride) == VMX_ERR_OK); break;
+			}
+			for (const VMX_RECT& r : rects)
+			{
+				TestImage region(r.width * bytesPerPixel, r.height);
+				TEST_CHECK(VMX_DecodeRegion(instance, r, format, region.Data.data(), region.Stride) == VMX_ERR_OK);
+				for (int y = 0; y < r.height; y++)
+				{
+					TEST_CHECK(memcmp(region.Row(y), full.Row(r.y + y) + (r.x * bytesPerPixel), r.width * bytesPerPixel) == 0);
+				}
+			}
+		}
+		VMX_RECT outside = { 1900, 0, 64, 16 };
+		TestImage region(outside.width * 2, outside.height);
+		TEST_CHECK(VMX_DecodeRegion(instance, outside, VMX_IMAGE_UYVY, region.Data.data(), region.Stride) == VMX_ERR_INVALID_PARAMETERS);
+		VMX_Destroy(instance);
+	}
+	return true;
+}
+
+/// A scaled decode must be close to the average of each group of pixels of the full decode.
+static bool TestScaled()
+{
+	TestSource src(TEST_HD, VMX_IMAGE_UYVY, 19);
+	VMX_INSTANCE* instance = TestCreate(TEST_HD);
+	TEST_CHECK(src.Encode(instance, 0) == VMX_ERR_OK);
+	std::vector<BYTE> frame = TestSave(instance);
+	TestImage full(TEST_HD.width * 2, TEST_HD.height);
+	TEST_CHECK(TestDecode(instance, frame, (int)frame.size(), full));
+	for (int scale = 2; scale <= 4; scale += 2)
+	{
+		VMX_SIZE sz = { TestAlign(TEST_HD.width / scale, 2), TEST_HD.height / scale };
+		TestImage scaled(sz.width * 2, sz.height);
+		TEST_CHECK(VMX_DecodeScaled(instance, scale, VMX_IMAGE_UYVY, scaled.Data.data(), scaled.Stride) == VMX_ERR_OK);
+		TestImage average(sz.width * 2, sz.height);
+		for (int y = 0; y < sz.height; y++)
+		{
+			for (int x = 0; x < sz.width; x++)
+			{
+				int sum = 0;
+				for (int j = 0; j < scale; j++)
+				{
+					for (int i = 0; i < scale; i++) sum += full.Row((y * scale) + j)[(((x * scale) + i) * 2) + 1];
+				}
+				average.Row(y)[(x * 2) + 1] = (BYTE)((sum + ((scale * scale) / 2)) / (scale * scale));
+			}
+		}
+		TEST_CHECK(TestPSNR(scaled, average, sz.width * 2, 2, 1) > 30);
+	}
+	TestImage bad(TEST_HD.width * 2, TEST_HD.height);
+	TEST_CHECK(VMX_DecodeScaled(instance, 3, VMX_IMAGE_UYVY, bad.Data.data(), bad.Stride) == VMX_ERR_INVALID_PARAMETERS);
+	VMX_Destroy(instance);
+	return true;
+}
+
+/// NV12 and I420 decodes must carry the luma of the UYVY decode unchanged, and chroma averaged over each pair of rows.
+static bool TestDecode420()
+{
+	for (int interlaced = 0; interlaced < 2; interlaced++)
+	{
+		VMX_SIZE sizes[] = { TEST_HD, TEST_ODD };
+		for (VMX_SIZE sz : sizes)
+		{
+			TestSource src(sz, VMX_IMAGE_UYVY, 23);
+			VMX_INSTANCE* instance = TestCreate(sz);
+			TEST_CHECK(src.Encode(instance, interlaced) == VMX_ERR_OK);
+			std::vector<BYTE> frame = TestSave(instance);
+			TestImage uyvy(sz.width * 2, sz.height);
+			TEST_CHECK(TestDecode(instance, frame, (int)frame.size(), uyvy));
+			int chromaRows = (sz.height + 1) / 2;
+			TestImage y(sz.width, sz.height);
+			TestImage uv(sz.width, chromaRows);
+			TestImage y2(sz.width, sz.height);
+			TestImage u(sz.width / 2, chromaRows);
+			TestImage v(sz.width / 2, chromaRows);
+			TEST_CHECK(VMX_DecodeNV12(instance, y.Data.data(), y.Stride, uv.Data.data(), uv.Stride) == VMX_ERR_OK);
+			TEST_CHECK(VMX_DecodeI420(instance, y2.Data.data(), y2.Stride, u.Data.data(), u.Stride, v.Data.data(), v.Stride) == VMX_ERR_OK);
+			TEST_CHECK(y.Same(y2, sz.width));
+			int worst = 0;
+			for (int row = 0; row < sz.height; row++)
+			{
+				for (int x = 0; x < sz.width; x++) TEST_CHECK(y.Row(row)[x] == uyvy.Row(row)[(x * 2) + 1]);
+			}
+			for (int row = 0; row < chromaRows; row++)
+			{
+				//Row pairs are taken within each field of an interlaced frame
+				int top = interlaced ? (((row >> 1) << 2) + (row & 1)) : (row * 2);
+				int bottom = interlaced ? top + 2 : top + 1;
+				if (bottom >= sz.height) bottom = top;
+				for (int x = 0; x < sz.width / 2; x++)
+				{
+					TEST_CHECK(uv.Row(row)[x * 2] == u.Row(row)[x] && uv.Row(row)[(x * 2) + 1] == v.Row(row)[x]);
+					int cu = (uyvy.Row(top)[x * 4] + uyvy.Row(bottom)[x * 4] + 1) >> 1;
+					int cv = (uyvy.Row(top)[(x * 4) + 2] + uyvy.Row(bottom)[(x * 4) + 2] + 1) >> 1;
+					worst = std::max(worst, std::max(abs(cu - u.Row(row)[x]), abs(cv - v.Row(row)[x])));
+				}
+			}
+			TEST_CHECK(worst <= 1);
+			VMX_Destroy(instance);
+		}
+	}
+	return true;
+}
+
+/// A pipeline must return every frame in the order submitted, decoded exactly as a single instance decodes it.
+static bool TestPipeline()
+{
+	const int frames = 8;
+	VMX_SIZE sz = { 1280, 720 };
+	VMX_INSTANCE* encoder = TestCreate(sz);
+	std::vector<std::vector<BYTE>> encoded;
+	std::vector<TestImage> expected;
+	VMX_INSTANCE* decoder = TestCreate(sz);
+	for (int i = 0; i < frames; i++)
+	{
+		TestSource src(sz, VMX_IMAGE_UYVY, 29 + i);
+		TEST_CHECK(src.Encode(encoder, 0) == VMX_ERR_OK);
+		encoded.push_back(TestSave(encoder));
+		expected.emplace_back(sz.width * 2, sz.height);
+		TEST_CHECK(TestDecode(decoder, encoded.back(), (int)encoded.back().size(), expected.back()));
+	}
+	for (int depth = 1; depth <= 4; depth += 3)
+	{
+		VMX_POOL* pool = VMX_CreatePool(4);
+		VMX_PIPELINE* pipeline = VMX_CreatePipeline(sz, VMX_PROFILE_HQ, VMX_COLORSPACE_BT709, depth, pool);
+		TEST_CHECK(pipeline);
+		std::vector<TestImage> images(frames, TestImage(sz.width * 2, sz.height));
+		int submitted = 0;
+		int returned = 0;
+		while (returned < frames)
+		{
+			if (submitted < frames)
+			{
+				VMX_ERR err = VMX_SubmitPipelineFrame(pipeline, encoded[submitted].data(), (int)encoded[submitted].size(), VMX_IMAGE_UYVY,
+					images[submitted].Data.data(), images[submitted].Stride, NULL, 0, NULL, 0, (void*)(intptr_t)submitted);
+				if (err == VMX_ERR_OK)
+				{
+					submitted++;
+					continue;
+				}
+				TEST_CHECK(err == VMX_ERR_BUSY);
+			}
+			void* userData = NULL;
+			TEST_CHECK(VMX_GetPipelineFrame(pipeline, 1, &userData) == 1);
+			TEST_CHECK((intptr_t)userData == returned);
+			TEST_CHECK(images[returned].Same(expected[returned], sz.width * 2));
+			returned++;
+		}
+		TEST_CHECK(VMX_GetPipelineFrame(pipeline, 1, NULL) == 0);
+		VMX_DestroyPipeline(pipeline);
+		VMX_DestroyPool(pool);
+	}
+	VMX_Destroy(decoder);
+	VMX_Destroy(encoder);
+	return true;
+}
+
+/// Async encodes and decodes must match the blocking calls on any number of threads, and the segments of a frame
+/// must stay valid while the next one is encoded.
+static bool TestAsync()
+{
+	const int frames = 4;
+	VMX_SIZE sz = TEST_ODD;
+	std::vector<TestSource> sources;
+	for (int i = 0; i < frames; i++) sources.emplace_back(sz, VMX_IMAGE_UYVY, 31 + i);
+	VMX_INSTANCE* blocking = TestCreate(sz, 1);
+	std::vector<std::vector<BYTE>> expected;
+	for (TestSource& src : sources)
+	{
+		TEST_CHECK(src.Encode(blocking, 0) == VMX_ERR_OK);
+		expected.push_back(TestSave(blocking));
+	}
+	for (int threads = 1; threads <= 4; threads += 3)
+	{
+		VMX_INSTANCE* async = TestCreate(sz, threads);
+		int count = VMX_GetEncodedSegmentCount(async);
+		std::vector<VMX_SEGMENT> previous(count);
+		int previousLength = 0;
+		for (int i = 0; i < frames; i++)
+		{
+			TestSource& src = sources[i];
+			TEST_CHECK(VMX_EncodeAsync(async, VMX_IMAGE_UYVY, src.Main.Data.data(), src.Main.Stride, NULL, 0, NULL, 0, 0) == VMX_ERR_OK);
+			if (i > 0)
+			{
+				std::vector<BYTE> frame = TestJoin(previous.data(), count, previousLength);
+				TEST_CHECK(memcmp(frame.data(), expected[i - 1].data(), previousLength) == 0);
+			}
+			TEST_CHECK(VMX_WaitEncoded(async) == VMX_ERR_OK);
+			previousLength = VMX_GetEncodedSegments(async, previous.data(), count);
+			TEST_CHECK(previousLength == (int)expected[i].size());
+		}
+
+		TestImage a(sz.width * 2, sz.height);
+		TestImage b(sz.width * 2, sz.height);
+		TEST_CHECK(TestDecode(blocking, expected[0], (int)expected[0].size(), a));
+		TEST_CHECK(VMX_LoadFrom(async, expected[0].data(), (int)expected[0].size()) == VMX_ERR_OK);
+		TEST_CHECK(VMX_DecodeAsync(async, VMX_IMAGE_UYVY, b.Data.data(), b.Stride, NULL, 0, NULL, 0) == VMX_ERR_OK);
+		TEST_CHECK(VMX_WaitDecoded(async) == VMX_ERR_OK);
+		TEST_CHECK(a.Same(b, sz.width * 2));
+		VMX_Destroy(async);
+	}
+	VMX_Destroy(blocking);
+	return true;
+}
+
+/// Rate control must bring frames of a detailed source down to the target, and predictive mode must do it on the
+/// first frame after a cut rather than over the following ones.
+static bool TestRateControl()
+{
+	TestSource calm(TEST_HD, VMX_IMAGE_UYVY, 37);
+	TestSource busy(TEST_HD, VMX_IMAGE_UYVY, 38);
+	unsigned int r = 7;
+	for (BYTE& b : busy.Main.Data)
+	{
+		r = (r * 1664525u) + 1013904223u;
+		b = (BYTE)(b + ((r >> 24) & 31));
+	}
+	int cutLength[2] = { 0, 0 };
+	for (int mode = 0; mode < 2; mode++)
+	{
+		VMX_INSTANCE* instance = TestCreate(TEST_HD);
+		VMX_SetRateControl(instance, 0, 30000, 1001, 250);
+		VMX_SetRateControlMode(instance, mode ? VMX_RATE_CONTROL_PREDICTIVE : VMX_RATE_CONTROL_REACTIVE);
+		int frameMin, frameMax, minQuality, dcShift;
+		VMX_GetEncodingParameters(instance, &frameMin, &frameMax, &minQuality, &dcShift);
+		TEST_CHECK(frameMin > 0 && frameMax >= frameMin);
+		for (int frame = 0; frame < 40; frame++)
+		{
+			//Calm and busy scenes of 10 frames each, cutting to the busy one at frames 10 and 30
+			TestSource& src = (frame / 10) & 1 ? busy : calm;
+			TEST_CHECK(src.Encode(instance, 0) == VMX_ERR_OK);
+			int length = (int)TestSave(instance).size();
+			if (frame == 10) cutLength[mode] = length;
+			if (&src == &busy && frame % 10 == 9) TEST_CHECK(length <= frameMax);
+		}
+		VMX_Destroy(instance);
+	}
+	TEST_CHECK(cutLength[1] < cutLength[0]);
+	return true;
+}
+
+/// Frame stats must add up to what was coded, for encodes and for decodes.
+static bool TestStats()
+{
+	TestSource src(TEST_HD, VMX_IMAGE_UYVY, 41);
+	VMX_INSTANCE* instance = TestCreate(TEST_HD, 2);
+	VMX_SetQuality(instance, 90);
+	TEST_CHECK(src.Encode(instance, 0) == VMX_ERR_OK);
+	std::vector<BYTE> frame = TestSave(instance);
+	int slices = VMX_GetEncodedSegmentCount(instance) / 2;
+	std::vector<VMX_SLICE_STATS> sliceStats(slices);
+	VMX_FRAME_STATS stats;
+	TEST_CHECK(VMX_GetFrameStats(instance, &stats, sliceStats.data(), slices) == VMX_ERR_OK);
+	TEST_CHECK(stats.Decode == 0 && stats.SliceCount == slices && stats.Quality == VMX_GetQuality(instance));
+	int bytes = 0;
+	for (VMX_SLICE_STATS& s : sliceStats) bytes += s.DCBytes + s.ACBytes;
+	TEST_CHECK(bytes == stats.Bytes && bytes > 0 && bytes < (int)frame.size());
+	if (stats.Timed)
+	{
+		TEST_CHECK(stats.FrameNs > 0 && stats.ThreadCount >= 1);
+		int coded = 0;
+		for (int t = 0; t < stats.ThreadCount; t++) coded += stats.Threads[t].Slices;
+		TEST_CHECK(coded == slices);
+		TEST_CHECK(stats.ZeroBlocks[0] >= 0 && stats.ZeroBlocks[0] <= 1);
+	}
+
+	VMX_INSTANCE* decoder = VMX_CreateDecoder(TEST_HD, VMX_COLORSPACE_BT709, NULL);
+	TestImage image(TEST_HD.width * 2, TEST_HD.height);
+	TEST_CHECK(TestDecode(decoder, frame, (int)frame.size(), image));
+	TEST_CHECK(VMX_GetFrameStats(decoder, &stats, NULL, 0) == VMX_ERR_OK);
+	TEST_CHECK(stats.Decode == 1 && stats.SliceCount == slices && stats.Bytes == bytes);
+	VMX_Destroy(decoder);
+	VMX_Destroy(instance);
+	return true;
+}
+
+/// Memory policies must only move buffers, never change the stream, and unknown flags must be refused.
+static bool TestMemoryPolicy()
+{
+	TestSource src(TEST_ODD, VMX_IMAGE_BGRA, 43);
+	VMX_INSTANCE* plain = TestCreate(TEST_ODD);
+	TEST_CHECK(src.Encode(plain, 0) == VMX_ERR_OK);
+	std::vector<BYTE> expected = TestSave(plain);
+	const int policies[] = { VMX_MEMORY_POLICY_NUMA, VMX_MEMORY_POLICY_HUGEPAGES, VMX_MEMORY_POLICY_NUMA | VMX_MEMORY_POLICY_HUGEPAGES_EXPLICIT };
+	for (int policy : policies)
+	{
+		for (int lean = 0; lean < 2; lean++)
+		{
+			VMX_INSTANCE* instance = TestCreate(TEST_ODD);
+			VMX_SetLeanMemory(instance, lean);
+			TEST_CHECK(VMX_SetMemoryPolicy(instance, policy) == VMX_ERR_OK);
+			TEST_CHECK(src.Encode(instance, 0) == VMX_ERR_OK);
+			TEST_CHECK(TestSave(instance) == expected);
+			VMX_Destroy(instance);
+		}
+	}
+	TEST_CHECK(VMX_SetMemoryPolicy(plain, 64) == VMX_ERR_INVALID_PARAMETERS);
+	VMX_Destroy(plain);
+	return true;
+}
+
+struct TestCase
+{
+	const char* Name;
+	bool (*Run)();
+};
+
+static const TestCase TEST_CASES[] = {
+	{ "lean", TestLean },
+	{ "skip", TestSkip },
+	{ "chunked", TestChunked },
+	{ "inplace", TestInPlace },
+	{ "chroma420", TestChroma420 },
+	{ "region", TestRegion },
+	{ "scaled", TestScaled },
+	{ "decode420", TestDecode420 },
+	{ "pipeline", TestPipeline },
+	{ "async", TestAsync },
+	{ "ratecontrol", TestRateControl },
+	{ "stats", TestStats },
+	{ "memorypolicy", TestMemoryPolicy },
+};
+
+int main(int argc, char** argv)
+{
+	int failed = 0;
+	int run = 0;
+	for (const TestCase& t : TEST_CASES)
+	{
+		bool selected = argc < 2;
+		for (int i = 1; i < argc; i++) selected |= (std::string(argv[i]) == t.Name);
+		if (!selected) continue;
+		run++;
+		bool ok = t.Run();
+		printf("%-13s %s\n", t.Name, ok ? "PASS" : "FAIL");
+		if (!ok) failed++;
+	}
+	if (!run)
+	{
+		printf("No test matches the names given\n");
+		return 1;
+	}
+	return failed ? 1 : 0;
+}